@@ -0,0 +1,373 @@
+#include "CpuRenderer.h"
+#include "cpu/accel_cache.h"
+#include "cpu/benchmark.h"
+#include "cpu/depth_complexity.h"
+#include "cpu/lights.h"
+
+using namespace std;
+using namespace optix;
+
+float3 CpuRenderer::m_exception_color			= make_float3(0.0f, 0.0f, 0.0f);
+float3 CpuRenderer::m_background_color			= make_float3(0.0f, 0.0f, 0.0f);
+
+// pixels per side of the scheduling and accumulation tiles
+static const unsigned int TILE_SIZE				= 16;
+
+string CpuRenderer::SpatialDataStructures[]		= { "Trbvh", "Sbvh", "MedianBvh", "Lbvh", "BvhCompact", "Bvh", "TriangleKdTree", "KdTree", "NoAccel" };
+
+void CpuRenderer::initScene(InitialCameraData&	camera_data)
+{
+	initContext();
+	initRayPrograms();
+	initLighting();
+	initGeometry();
+	initCamera(camera_data);
+	finalize();
+}
+
+void CpuRenderer::initContext()
+{
+	// Setup output buffer
+	m_context.output_buffer.resize(m_width, m_height);
+	m_context.ray_count_buffer.resize(m_width, m_height);
+	m_context.variance_buffer.resize(m_width, m_height);
+	m_context.accumulation_buffer.resize(m_width, m_height, TILE_SIZE);
+	m_context.scene_epsilon = 1.e-3f;
+	m_context.max_depth		= m_bounces;	// Max Bounces
+
+	m_context.pt.radiance_ray_type	= 0;
+	m_context.pt.shadow_ray_type	= 1;
+
+	m_context.pt.frame_number		= 1;
+	m_context.pt.sqrt_num_samples	= m_sqrt_num_samples;
+	m_context.pt.rr_begin_depth		= m_rr_begin_depth;
+	m_context.pt.adaptive_threshold	= m_adaptive_threshold;
+	m_context.pt.adaptive_min_frames = m_adaptive_min_frames;
+
+	// the camera rays of the AA pattern are traced in packets, of 2 pixels with AVX2
+	// and 2x2 pixels with AVX-512; other sample counts and the scalar level trace them one by one
+	m_context.packet_size = 0;
+#if defined (AA)
+	const cpu::SimdLevel simd_level = cpu::getSimdLevel();
+	if (m_sqrt_num_samples * m_sqrt_num_samples == NUM_SAMPLES && simd_level != cpu::SIMD_SCALAR)
+		m_context.packet_size = (simd_level == cpu::SIMD_AVX512) ? 16 : 8;
+#endif
+}
+
+void CpuRenderer::initRayPrograms()
+{
+	// Miss and exception programs
+	m_context.color.background	= m_background_color;
+	m_context.color.exception	= m_exception_color;
+}
+
+void CpuRenderer::initCamera(InitialCameraData&	camera_data)
+{
+	// Set up camera
+	float max_dim  = m_model_aabb.maxExtent();
+	float3 eye	   = m_model_aabb.center();
+	eye.z         += 2.0f * max_dim;
+
+	float3 lookat  = m_model_aabb.center();
+
+	// Sponza
+	if (m_model_name == "sponza.obj")
+	{
+		eye = make_float3(-1.0f, 1.5f, 4.0f);
+		lookat = make_float3(-0.835098f, 1.771803f, 3.051880f);
+	}
+	else if (m_model_name == "ruins.obj")
+	{
+		eye = make_float3(-12.709822f, 2.071503f, 4.993989f);
+		lookat = make_float3(-11.770233f, 2.006715f, 4.657871f);
+	}
+
+	camera_data = InitialCameraData(eye,                             // eye
+									lookat,							 // lookat
+									make_float3( 0.0f, 1.0f, 0.0f ), // up
+									m_fov );                         // vfov
+
+	// The values do not matter, they will be overwritten in trace.
+	m_context.camera.eye = m_context.camera.U = m_context.camera.V = m_context.camera.W = make_float3(0.0f, 0.0f, 0.0f);
+}
+
+void CpuRenderer::initLighting()
+{
+	m_ambient_light_color = make_float3(0.0f, 0.0f, 0.0f);
+
+	BasicLight lights[] =
+	{
+		//Sponza
+		{
+			make_float4(5.0f, 40.0f, 0.0f, 1.0f),
+			make_float3(0.0f, 20.0f, 0.0f), 50.0f,
+			make_float3(0.79f, 0.879f, 1.0f), 5000.0f,
+			m_shadows_enabled ? 1 : 0
+		}
+	};
+
+	if (m_scene_file.empty())
+		m_context.lights.assign(lights, lights + sizeof(lights) / sizeof(BasicLight));
+	else
+		cpu::loadSceneLights(m_scene_file, m_shadows_enabled, m_context.lights);
+	cpu::buildLightAliasTable(m_context.lights, m_context.light_alias_table);
+	m_context.ambient_light_color = m_ambient_light_color;
+}
+
+void CpuRenderer::initGeometry()
+{
+	m_geometry_group = cpu::createAccel(getSpatialDataStructure(m_sds_builder), getSpatialDataStructure(m_sds_traverser));
+	{
+		initModel();
+	}
+	m_context.mesh			= &m_model_geometry;
+	m_context.top_object	= m_geometry_group.get();
+	m_context.top_shadower	= m_geometry_group.get();
+}
+
+void CpuRenderer::initModel()
+{
+	string m_model_path = "/data/" + m_model_name;
+	cpu::loadOBJ(m_model_path, m_model_geometry);
+	m_model_aabb = m_model_geometry.sceneBBox();
+}
+
+void CpuRenderer::finalize()
+{
+	// the SIMD level is part of the key, since it selects the leaf cost and layout of the BVH
+	const string cache_key = getSpatialDataStructure(m_sds_builder) + "." + getSpatialDataStructure(m_sds_traverser) + "." +
+		cpu::getSimdLevelName(cpu::getSimdLevel());
+
+	double start, end_AS_build;
+	bool loaded;
+	start = cpu::currentTime();
+	const string model_path = "/data/" + m_model_name;
+	cpu::AccelCache cache(m_accel_cache ? (m_accel_cache_directory.empty() ? cpu::getDirectoryName(model_path) : m_accel_cache_directory) : string(),
+		model_path, cache_key);
+	{
+		loaded = cache.load(*m_geometry_group, m_model_geometry);
+		if (!loaded)
+			m_geometry_group->build(m_model_geometry);
+	}
+	end_AS_build = cpu::currentTime();
+	cout << "Acceleration           : " << getSpatialDataStructure(m_sds_builder) << " / " << getSpatialDataStructure(m_sds_traverser) << "\n";
+	cout << (loaded ? "Time to AS load        : " : "Time to AS build       : ") << end_AS_build - start << " s.\n";
+	if (cache.enabled())
+	{
+		cout << "AS cache               : ";
+		if (loaded)
+			cout << "loaded";
+		else
+			cout << (cache.save(*m_geometry_group) ? "saved" : "not saved");
+		cout << " " << cache.getFilename() << "\n";
+	}
+	cout << "AS memory              : " << m_geometry_group->memoryUsage() / (1024.0 * 1024.0) << " MB\n";
+	cout << "Triangles              : " << m_model_geometry.size() << "\n";
+	cout << "Threads                : " << m_thread_pool.size() << "\n";
+	cout << "SIMD                   : " << cpu::getSimdLevelName(cpu::getSimdLevel());
+	if (m_context.packet_size > 0 && !m_ray_sort)
+		cout << ", " << m_context.packet_size << "-ray camera packets";
+	cout << "\n";
+	cout << "Path tracing           : " << (m_ray_sort ? "wavefront, sorted rays" : "tiles") << ", " << m_bounces << " bounces\n";
+	cout << "Russian roulette       : from bounce " << m_rr_begin_depth << " of " << m_bounces << "\n";
+	cout << "Adaptive sampling      : ";
+	if (m_adaptive_threshold > 0.0f)
+		cout << "rel. MSE " << m_adaptive_threshold << ", from frame " << m_adaptive_min_frames << "\n";
+	else
+		cout << "off\n";
+}
+
+void CpuRenderer::trace(const RayGenCameraData&	camera_data)
+{
+	//Set Camera View
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	if (m_camera_changed)
+	{
+		m_camera_changed = false;
+		m_frame = 1;
+		m_context.accumulation_buffer.reset();
+	}
+	m_context.pt.frame_number = m_frame++;
+
+	cpu::TileBuffer& tiles = m_context.accumulation_buffer;
+	if (m_ray_sort)
+	{
+		for (unsigned int i = 0; i < tiles.size(); ++i)
+			tiles[i].frames++;
+		m_wavefront.trace(m_context, m_thread_pool, m_model_aabb);
+		return;
+	}
+
+	// Morton-ordered tiles on the work-stealing scheduler: each thread starts on a compact
+	// part of the image and expensive tiles are rebalanced by stealing. The tiles are a
+	// multiple of the packet blocks.
+	uint2 block = make_uint2(1u, 1u);
+#if defined (AA)
+	if (m_context.packet_size > 0)
+		block = cpu::packet_block_size(m_context);
+#endif
+	m_thread_pool.runStealing(tiles.size(), [&](unsigned int index, unsigned int)
+	{
+		cpu::Tile& tile = tiles[index];
+		tile.frames++;
+		for (unsigned int y = tile.origin.y; y < tile.origin.y + tile.size.y; y += block.y)
+			for (unsigned int x = tile.origin.x; x < tile.origin.x + tile.size.x; x += block.x)
+			{
+#if defined (AA)
+				if (m_context.packet_size > 0)
+				{
+					cpu::pinhole_camera_packet(m_context, make_uint2(x, y));
+					continue;
+				}
+#endif
+				cpu::pinhole_camera(m_context, make_uint2(x, y));
+			}
+	});
+}
+
+unsigned long long CpuRenderer::getRayCount() const
+{
+	unsigned long long num_rays = 0;
+	const vector<unsigned int>& ray_counts = m_context.ray_count_buffer.data;
+	for (size_t i = 0; i < ray_counts.size(); ++i)
+		num_rays += ray_counts[i];
+	return num_rays;
+}
+
+unsigned long long CpuRenderer::getSampleCount() const
+{
+	unsigned long long num_pixels = 0;
+	const vector<unsigned int>& ray_counts = m_context.ray_count_buffer.data;
+	for (size_t i = 0; i < ray_counts.size(); ++i)
+		num_pixels += (ray_counts[i] > 0) ? 1 : 0;
+	return num_pixels * m_sqrt_num_samples * m_sqrt_num_samples;
+}
+
+bool CpuRenderer::setSpatialDataStructure(const string& builder, const string& traverser)
+{
+	bool found_builder = false, found_traverser = false;
+	for (int i = SDS_TRBVH; i <= SDS_NO_ACCEL; ++i)
+	{
+		if (SpatialDataStructures[i] == builder)
+		{
+			m_sds_builder = static_cast<SpatialDataStructureType>(i);
+			found_builder = true;
+		}
+		if (SpatialDataStructures[i] == traverser)
+		{
+			m_sds_traverser = static_cast<SpatialDataStructureType>(i);
+			found_traverser = true;
+		}
+	}
+	return found_builder && found_traverser;
+}
+
+void CpuRenderer::benchmark(const RayGenCameraData&	camera_data)
+{
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	cpu::benchmarkAccels(m_context, m_thread_pool);
+}
+
+void CpuRenderer::benchmarkABuffers(const RayGenCameraData&	camera_data, const cpu::ABufferSettings& settings)
+{
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	cpu::benchmarkABuffers(m_context, settings, m_thread_pool);
+}
+
+void CpuRenderer::benchmarkDepthBounds(const RayGenCameraData&	camera_data, const cpu::MMRTSettings& settings)
+{
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	cpu::benchmarkDepthBounds(m_context, settings, m_thread_pool);
+}
+
+void CpuRenderer::measureDepthComplexity(const RayGenCameraData&	camera_data, const string& json_file, double percentile, cpu::ABufferSettings& settings)
+{
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	const cpu::RasterCamera camera = { m_context.camera.eye, m_context.camera.U, m_context.camera.V, m_context.camera.W, m_context.scene_epsilon };
+	cpu::Rasterizer rasterizer;
+	rasterizer.setup(*m_context.mesh, camera, m_width, m_height, m_thread_pool);
+
+	cpu::DepthComplexityStats depth_complexity;
+	cpu::measureDepthComplexity(rasterizer, settings.buckets, settings.bucket_distribution, m_thread_pool, depth_complexity);
+	if (!json_file.empty())
+		cpu::writeDepthComplexityJson(json_file, depth_complexity, settings);
+
+	const unsigned long long covered_pixels = depth_complexity.getCoveredPixels();
+	cout << "Depth complexity       : " << (covered_pixels ? static_cast<double>(depth_complexity.fragments) / covered_pixels : 0.0) << " mean, "
+		 << cpu::getPercentile(depth_complexity.histogram, 99.0) << " at the 99th percentile, " << depth_complexity.getMaxCount() << " max, "
+		 << depth_complexity.fragments << " fragments\n";
+	if (percentile > 0.0)
+	{
+		cpu::sizeABuffer(depth_complexity, percentile, settings);
+		cout << "A-buffer sized at " << percentile << "%  : max layers " << settings.max_layers << ", buckets " << settings.buckets
+			 << ", preallocated fragments " << settings.prealloc_fragments << "\n";
+	}
+}
+
+void CpuRenderer::renderMMRT(const RayGenCameraData&	camera_data, const cpu::MMRTSettings& settings, bool path_tracing)
+{
+	m_context.camera.eye	= camera_data.eye;
+	m_context.camera.U		= camera_data.U;
+	m_context.camera.V		= camera_data.V;
+	m_context.camera.W		= camera_data.W;
+
+	const cpu::RasterCamera camera = { m_context.camera.eye, m_context.camera.U, m_context.camera.V, m_context.camera.W, settings.near_plane };
+	cpu::MMRTTracer tracer(settings);
+	double start = cpu::currentTime();
+	tracer.build(*m_context.mesh, camera, m_width, m_height, length(m_model_aabb.extent()), m_thread_pool);
+	const double build_time = cpu::currentTime() - start;
+
+	cpu::MMRTStatistics statistics;
+	start = cpu::currentTime();
+	if (path_tracing)
+	{
+		if (m_context.lights.empty())
+			throw runtime_error("MMRT_PT needs a light");
+		tracer.renderPT(cpu::makeMMRTLight(m_context.lights[0]), m_shadows_enabled ? m_context.top_shadower : 0, m_context.scene_epsilon,
+			m_thread_pool, m_context.output_buffer, statistics);
+	}
+	else
+		tracer.renderAO(m_thread_pool, m_context.output_buffer, statistics);
+	const double render_time = cpu::currentTime() - start;
+
+	cout << "MMRT views             : " << tracer.getViewCount() << ", " << tracer.memoryUsage() / (1024.0 * 1024.0) << " MB, built in " << build_time * 1000.0 << " ms\n";
+	cout << "MMRT " << (path_tracing ? "PT" : "AO") << " frames         : " << settings.frames << " in " << render_time * 1000.0 << " ms, "
+		 << statistics.rays / max(render_time, 1.e-9) / 1.e6 << " Mrays/s\n";
+	cout << "MMRT rays              : " << statistics.rays << ", " << (statistics.rays ? 100.0 * statistics.hits / statistics.rays : 0.0) << " % hit, "
+		 << (statistics.rays ? static_cast<double>(statistics.faces) / statistics.rays : 0.0) << " faces, "
+		 << (statistics.rays ? static_cast<double>(statistics.searches) / statistics.rays : 0.0) << " searches and "
+		 << (statistics.rays ? static_cast<double>(statistics.fragments) / statistics.rays : 0.0) << " fragments per ray\n";
+	cout << "MMRT buckets           : " << settings.abuffer.buckets << " " << cpu::getBucketDistributionName(settings.abuffer.bucket_distribution) << ", "
+		 << (statistics.buckets ? static_cast<double>(statistics.fragments) / statistics.buckets : 0.0) << " fragments per bucket walked\n";
+	if (tracer.getViewCount() > 1)
+	{
+		static const char* const face_names[cpu::MMRT_MAX_FACES] = { "primary", "front", "back", "left", "right", "bottom", "top" };
+		cout << "MMRT faces             : " << (settings.schedule_faces ? "scheduled" : "in order") << ", "
+			 << (statistics.rays ? static_cast<double>(statistics.frustum_tests) / statistics.rays : 0.0) << " frustum tests per ray, "
+			 << (statistics.rays ? 100.0 * statistics.skipped / statistics.rays : 0.0) << " % of the rays ended at skipped faces\n";
+		cout << "MMRT face entries      :";
+		for (unsigned int face = 0; face < tracer.getViewCount(); ++face)
+			cout << (face ? ", " : " ") << face_names[face] << " " << (statistics.rays ? 100.0 * statistics.entries[face] / statistics.rays : 0.0) << " %";
+		cout << "\n";
+	}
+}
@@ -0,0 +1,172 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// CPU backend of OptixRenderer for machines without an NVIDIA GPU.
+// It exposes the same initScene/trace/getOutputBuffer interface as SampleScene, but does
+// not derive from it, since SampleScene creates an OptiX context on construction.
+// The ray programs of cuda/ are ported to cpu/ and launched on a thread pool.
+
+#pragma once
+
+#include <SampleScene.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "commonStructs.h"
+#include "cpu/abuffer.h"
+#include "cpu/accel.h"
+#include "cpu/context.h"
+#include "cpu/mmrt.h"
+#include "cpu/simd.h"
+#include "cpu/thread_pool.h"
+#include "cpu/triangle_mesh.h"
+#include "cpu/wavefront.h"
+
+using namespace std;
+using namespace optix;
+
+class CpuRenderer
+{
+public:
+
+	// Same values and names as OptixRenderer::SpatialDataStructureType
+	enum SpatialDataStructureType
+	{
+		SDS_TRBVH = 0,
+		SDS_SBVH,
+		SDS_MBVH,
+		SDS_LBVH,
+		SDS_CBVH,
+		SDS_BVH,
+		SDS_TKDT,
+		SDS_KDT,
+		SDS_NO_ACCEL
+	};
+
+	static const string getSpatialDataStructure(SpatialDataStructureType value)
+	{
+		return SpatialDataStructures[value];
+	}
+
+	CpuRenderer(const unsigned int w, const unsigned int h, const unsigned int num_threads = 0) :
+		m_shadows_enabled(true),
+		m_sds_builder(SDS_TRBVH),
+		m_sds_traverser(SDS_BVH),
+		m_sqrt_num_samples(1),
+		m_fov(40.0f),
+		m_bounces(2),
+		m_rr_begin_depth(3u),
+		m_adaptive_threshold(0.0f),
+		m_adaptive_min_frames(32u),
+		m_frame(0u),
+		m_width(w),
+		m_height(h),
+		m_camera_changed(true),
+		m_ray_sort(false),
+		m_model_name("sponza.obj"),
+		m_accel_cache(true),
+		m_thread_pool(num_threads) {}
+
+	// Same as SampleScene
+	void	initScene(InitialCameraData&	camera_data);
+	void	trace(const RayGenCameraData&	camera_data);
+	const cpu::Buffer&	getOutputBuffer(void) const { return m_context.output_buffer; }
+
+	void	signalCameraChanged(void) { m_camera_changed = true; }
+	// Samples per pixel and frame are sqrt_num_samples^2; call before initScene
+	void	setSqrtNumSamples(unsigned int sqrt_num_samples) { m_sqrt_num_samples = sqrt_num_samples; }
+	unsigned int getSqrtNumSamples(void) const { return m_sqrt_num_samples; }
+	// Maximum path depth; call before initScene
+	void	setBounces(int bounces) { m_bounces = bounces; }
+	// Same as OptixRenderer
+	void	setRussianRouletteDepth(unsigned int rr_begin_depth) { m_rr_begin_depth = rr_begin_depth; }
+	void	setAdaptiveSampling(float threshold, unsigned int min_frames) { m_adaptive_threshold = threshold; m_adaptive_min_frames = max(min_frames, 2u); }
+	// Rays traced by the last trace() call
+	unsigned long long getRayCount(void) const;
+	// Camera samples traced by the last trace() call; pixels skipped by adaptive sampling trace none
+	unsigned long long getSampleCount(void) const;
+
+	// Selects the acceleration structure by OptiX builder/traverser name; call before initScene.
+	// Returns false for unknown names.
+	bool	setSpatialDataStructure(const string& builder, const string& traverser);
+
+	// Takes the lights from the <light> nodes of a demo .scene file instead of the built-in
+	// Sponza light; call before initScene
+	void	setSceneFile(const string& scene_file) { m_scene_file = scene_file; }
+
+	// Acceleration structure cache (cpu::AccelCache), on by default, in directory or, if it
+	// is empty, in the directory of the model. Call before initScene.
+	void	setAccelCache(bool enable, const string& directory) { m_accel_cache = enable; m_accel_cache_directory = directory; }
+
+	// Traces the frames bounce by bounce over the whole image (cpu::Wavefront) and sorts the
+	// rays of each bounce by direction and origin before tracing them, instead of following
+	// each path to its end tile by tile
+	void	setRaySorting(bool ray_sort) { m_ray_sort = ray_sort; }
+
+	// Runs cpu::benchmarkAccels on the loaded scene, from the given view
+	void	benchmark(const RayGenCameraData&	camera_data);
+	// Runs cpu::benchmarkABuffers on the loaded scene, from the given view
+	void	benchmarkABuffers(const RayGenCameraData&	camera_data, const cpu::ABufferSettings& settings);
+	// Measures the depth complexity of the loaded scene from the given view, writes it to
+	// json_file unless empty, and with a percentile above 0, sizes settings with
+	// cpu::sizeABuffer for it
+	void	measureDepthComplexity(const RayGenCameraData&	camera_data, const string& json_file, double percentile, cpu::ABufferSettings& settings);
+	// Renders the loaded scene from the given view with the CPU reference of the MMRT_AO
+	// (path_tracing false) or MMRT_PT pass into the output buffer, instead of tracing the BVH
+	void	renderMMRT(const RayGenCameraData&	camera_data, const cpu::MMRTSettings& settings, bool path_tracing);
+	// Runs cpu::benchmarkDepthBounds on the loaded scene, from the given view
+	void	benchmarkDepthBounds(const RayGenCameraData&	camera_data, const cpu::MMRTSettings& settings);
+
+	unsigned int getNumThreads(void) const { return m_thread_pool.size(); }
+
+private:
+
+	bool			m_shadows_enabled;
+
+	SpatialDataStructureType	m_sds_builder, m_sds_traverser;
+
+	unsigned int	m_sqrt_num_samples;
+
+	float			m_fov;
+
+	float3			m_ambient_light_color;
+
+	int				m_bounces;
+	unsigned int	m_rr_begin_depth;
+
+	float			m_adaptive_threshold;
+	unsigned int	m_adaptive_min_frames;
+
+	unsigned int	m_frame;
+	unsigned int	m_width;
+	unsigned int	m_height;
+	bool			m_camera_changed;
+	bool			m_ray_sort;
+
+	string			m_model_name;
+	string			m_scene_file;
+	bool			m_accel_cache;
+	string			m_accel_cache_directory;
+	Aabb			m_model_aabb;
+
+	cpu::TriangleMesh		m_model_geometry;
+	unique_ptr<cpu::Accel>	m_geometry_group;
+	cpu::Context			m_context;
+	cpu::ThreadPool			m_thread_pool;
+	cpu::Wavefront			m_wavefront;
+
+	static float3	m_exception_color;
+	static float3	m_background_color;
+
+	static string	SpatialDataStructures[];
+
+	void initContext(void);
+	void initRayPrograms(void);
+	void initCamera(InitialCameraData& camera_data);
+	void initLighting(void);
+	void initGeometry(void);
+	void initModel(void);
+	void finalize(void);
+};
@@ -1,4 +1,10 @@
 #include "OptixRenderer.h"
+#include "CpuRenderer.h"
+#include "cpu/accel_cache.h"
+#include "cpu/image.h"
+#include "cpu/lights.h"
+
+#include <fstream>
 
 using namespace std;
 using namespace optix;
@@ -31,6 +37,10 @@ void OptixRenderer::initContext()
 
 	// Setup output buffer
 	m_context["output_buffer"]->set(createOutputBuffer(RT_FORMAT_FLOAT4, m_width, m_height));
+	m_ray_count_buffer = m_context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_UNSIGNED_INT, m_width, m_height);
+	m_context["ray_count_buffer"]->set(m_ray_count_buffer);
+	m_variance_buffer = m_context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4, m_width, m_height);
+	m_context["variance_buffer"]->set(m_variance_buffer);
 	m_context["scene_epsilon"]->setFloat(1.e-3f);
 	m_context["max_depth"]->setInt(m_bounces);	// Max Bounces
 
@@ -39,6 +49,9 @@ void OptixRenderer::initContext()
 
 	m_context["pt::frame_number"]->setUint(1);
 	m_context["pt::sqrt_num_samples"]->setUint(m_sqrt_num_samples);
+	m_context["pt::rr_begin_depth"]->setUint(m_rr_begin_depth);
+	m_context["pt::adaptive_threshold"]->setFloat(m_adaptive_threshold);
+	m_context["pt::adaptive_min_frames"]->setUint(m_adaptive_min_frames);
 }
 
 void OptixRenderer::initRayPrograms()
@@ -123,14 +136,35 @@ void OptixRenderer::initLighting()
 		//}
 	};
 
+	vector<BasicLight> scene_lights(lights, lights + sizeof(lights) / sizeof(BasicLight));
+	if (!m_scene_file.empty())
+		cpu::loadSceneLights(m_scene_file, m_shadows_enabled, scene_lights);
+
 	m_light_buffer = m_context->createBuffer(RT_BUFFER_INPUT);
 	m_light_buffer->setFormat(RT_FORMAT_USER);
 	m_light_buffer->setElementSize(sizeof(BasicLight));
-	m_light_buffer->setSize(sizeof(lights) / sizeof(BasicLight));
-	memcpy(m_light_buffer->map(), lights, sizeof(lights));
-	m_light_buffer->unmap();
+	m_light_buffer->setSize(scene_lights.size());
+	if (!scene_lights.empty())
+	{
+		memcpy(m_light_buffer->map(), &scene_lights[0], scene_lights.size() * sizeof(BasicLight));
+		m_light_buffer->unmap();
+	}
+
+	// path_tracingShade samples a single light per hit point from this table
+	vector<LightAlias> alias_table;
+	cpu::buildLightAliasTable(scene_lights, alias_table);
+	m_light_alias_buffer = m_context->createBuffer(RT_BUFFER_INPUT);
+	m_light_alias_buffer->setFormat(RT_FORMAT_USER);
+	m_light_alias_buffer->setElementSize(sizeof(LightAlias));
+	m_light_alias_buffer->setSize(alias_table.size());
+	if (!alias_table.empty())
+	{
+		memcpy(m_light_alias_buffer->map(), &alias_table[0], alias_table.size() * sizeof(LightAlias));
+		m_light_alias_buffer->unmap();
+	}
 
 	m_context["lights"]->set(m_light_buffer);
+	m_context["light_alias_table"]->set(m_light_alias_buffer);
 	m_context["ambient_light_color"]->setFloat(m_ambient_light_color);
 	m_context["importance_cutoff"]->setFloat(0.01f);
 }
@@ -166,6 +200,16 @@ void OptixRenderer::finalize()
 	// Prepare to run
 	m_context->validate();
 
+	// a cached structure is handed to OptiX before the first launch, which then skips the build
+	Acceleration acceleration = m_geometry_group->getAcceleration();
+	const string model_path = "/data/" + m_model_name;
+	cpu::AccelCache cache(m_accel_cache ? (m_accel_cache_directory.empty() ? cpu::getDirectoryName(model_path) : m_accel_cache_directory) : string(),
+		model_path, "optix." + getSpatialDataStructure(m_sds_builder) + "." + getSpatialDataStructure(m_sds_traverser));
+	size_t cache_offset, cache_size;
+	shared_ptr<const cpu::MappedFile> cached_data = cache.open(cache_offset, cache_size);
+	if (cached_data)
+		acceleration->setData(cached_data->data() + cache_offset, cache_size);
+
 	double start, end_compile, end_AS_build;
 	sutilCurrentTime(&start);
 	{
@@ -178,6 +222,27 @@ void OptixRenderer::finalize()
 	sutilCurrentTime(&end_AS_build);
 	cout << "Time to AS CACHING     : " << end_AS_build - end_compile << " s.\n";
 	cout << "Time to compile kernel : " << end_compile - start << " s.\n";
+
+	if (cache.enabled())
+	{
+		cout << "AS cache               : ";
+		if (cached_data)
+			cout << "loaded";
+		else
+		{
+			vector<char> data(acceleration->getDataSize());
+			if (!data.empty())
+				acceleration->getData(&data[0]);
+			cout << (!data.empty() && cache.write([&data](ostream& out) { out.write(&data[0], data.size()); return !out.fail(); }) ? "saved" : "not saved");
+		}
+		cout << " " << cache.getFilename() << "\n";
+	}
+	cout << "Russian roulette       : from bounce " << m_rr_begin_depth << " of " << m_bounces << "\n";
+	cout << "Adaptive sampling      : ";
+	if (m_adaptive_threshold > 0.0f)
+		cout << "rel. MSE " << m_adaptive_threshold << ", from frame " << m_adaptive_min_frames << "\n";
+	else
+		cout << "off\n";
 }
 
 void OptixRenderer::trace   (const RayGenCameraData&	camera_data )
@@ -199,6 +264,57 @@ void OptixRenderer::trace   (const RayGenCameraData&	camera_data )
 		static_cast<unsigned int>(m_height));
 }
 
+void OptixRenderer::doResize(unsigned int width, unsigned int height)
+{
+	m_ray_count_buffer->setSize(width, height);
+	m_variance_buffer->setSize(width, height);
+}
+
+unsigned long long OptixRenderer::getRayCount()
+{
+	RTsize width, height;
+	m_ray_count_buffer->getSize(width, height);
+
+	unsigned long long num_rays = 0;
+	const unsigned int* ray_counts = static_cast<const unsigned int*>(m_ray_count_buffer->map());
+	for (RTsize i = 0; i < width * height; ++i)
+		num_rays += ray_counts[i];
+	m_ray_count_buffer->unmap();
+	return num_rays;
+}
+
+unsigned long long OptixRenderer::getSampleCount()
+{
+	RTsize width, height;
+	m_ray_count_buffer->getSize(width, height);
+
+	unsigned long long num_pixels = 0;
+	const unsigned int* ray_counts = static_cast<const unsigned int*>(m_ray_count_buffer->map());
+	for (RTsize i = 0; i < width * height; ++i)
+		num_pixels += (ray_counts[i] > 0) ? 1 : 0;
+	m_ray_count_buffer->unmap();
+	return num_pixels * m_sqrt_num_samples * m_sqrt_num_samples;
+}
+
+bool OptixRenderer::setSpatialDataStructure(const string& builder, const string& traverser)
+{
+	bool found_builder = false, found_traverser = false;
+	for (int i = SDS_TRBVH; i <= SDS_NO_ACCEL; ++i)
+	{
+		if (SpatialDataStructures[i] == builder)
+		{
+			m_sds_builder = static_cast<SpatialDataStructureType>(i);
+			found_builder = true;
+		}
+		if (SpatialDataStructures[i] == traverser)
+		{
+			m_sds_traverser = static_cast<SpatialDataStructureType>(i);
+			found_traverser = true;
+		}
+	}
+	return found_builder && found_traverser;
+}
+
 void	printUsageAndExit( const string& argv0, bool doExit = true )
 {
   cerr
@@ -207,17 +323,230 @@ void	printUsageAndExit( const string& argv0, bool doExit = true )
     << "  -h  | --help                               Print this usage message\n"
     << "  -t  | --texture-path <path>                Specify path to texture directory\n"
     << "        --dim=<width>x<height>               Set image dimensions\n"
+    << "        --frames <n>                         Render n frames without a window (default: 1)\n"
+    << "        --spp <s>                            Samples per pixel and frame, a square number (default: 1)\n"
+    << "        --bounces <n>                        Maximum path depth (default: 2)\n"
+    << "        --rr-depth <n>                       Bounce from which Russian roulette ends paths (default: 3)\n"
+    << "        --adaptive <e>                       Stop tracing pixels whose estimated relative MSE is at most e (default: 0, off)\n"
+    << "        --adaptive-min-frames <n>            Frames traced before a pixel may stop (default: 32)\n"
+    << "        --out <file.pfm>                     Image written after a run without a window (default: output.pfm)\n"
+    << "        --csv <file.csv>                     Per-frame trace time, rays/s and samples/s (default: <out>.csv)\n"
+    << "        --reference <file.pfm>               Also log the relative MSE of every frame against a reference image\n"
+    << "        --target-rel-mse <e>                 Stop once the relative MSE against the reference is at most e\n"
+    << "        --cpu                                Render with the CPU backend, without a window\n"
+    << "        --ray-sort                           Trace the CPU backend paths bounce by bounce, sorting the rays by direction and origin\n"
+    << "        --threads <n>                        Number of CPU backend threads (default: all cores)\n"
+    << "        --builder <name>                     Acceleration builder: Trbvh, Sbvh, MedianBvh, Lbvh, BvhCompact,\n"
+    << "                                             Bvh, TriangleKdTree, KdTree or NoAccel (default: Trbvh)\n"
+    << "        --traverser <name>                   Acceleration traverser: Bvh, BvhCompact, KdTree or NoAccel (default: Bvh)\n"
+    << "        --scene <file.scene>                 Load the lights of a demo scene file (default: a single Sponza spotlight)\n"
+    << "        --accel-cache <dir>                  Directory of the acceleration structure cache (default: the model directory)\n"
+    << "        --no-accel-cache                     Always build the acceleration structure\n"
+    << "        --simd <level>                       CPU backend instruction set: scalar, avx2 or avx512 (default: the best available)\n"
+    << "        --cpu-benchmark                      Report build time, memory and rays/s of every CPU acceleration structure\n"
+    << "        --abuffer-benchmark                  Report construction and resolve time and memory of every A-buffer variant on the CPU\n"
+    << "        --abuffer-telemetry <file.json>      Write the per-pixel and per-bucket depth complexity of the view on the CPU\n"
+    << "        --auto-size-abuffer <p>              Set max layers, buckets and preallocated fragments so that p % of the\n"
+    << "                                             pixels of the view fit, before --abuffer-benchmark\n"
+    << "        --buckets <n>                        Depth buckets per pixel of the A-buffer _BUN variants (default: 4)\n"
+    << "        --bucket-distribution <name>         Depth ranges of the buckets: uniform, log or equalized, from a histogram\n"
+    << "                                             of the fragments of every pixel (default: uniform)\n"
+    << "        --max-layers <n>                     Fragments sorted per pixel, or per bucket, by the A-buffer resolve (default: 50)\n"
+    << "        --insert-vs-shell <n>                Largest fragment count the A-buffer resolve sorts by insertion (default: 16)\n"
+    << "        --prealloc-fragments <n>             Fixed node count of the linked-list A-buffer variants, dropping the\n"
+    << "                                             fragments past it (default: counted per scene)\n"
+    << "        --sb-atomic-prefix-sum               Assign the S-buffer pixel ranges with atomics on shared counters, as the GLSL version\n"
+    << "        --no-sort-networks                   Sort the A-buffer fragments as the GLSL resolve, without the SIMD sorting networks\n"
+    << "        --radix-resolve                      Resolve the S-buffer by one radix sort of all fragments instead of per pixel\n"
+    << "        --sb-counters <n>                    S-buffer counters of the tiled and morton layouts (default: 32)\n"
+    << "        --sb-counter-layout <name>           Screen tiles of the S-buffer counters: glsl, tiled or morton (default: morton)\n"
+    << "        --sb-unpadded-counters               Pack the S-buffer counters together instead of one per cache line\n"
+    << "        --kbuffer-size <k>                   Fragments kept per pixel, the closest ones, by the AB_KB variants (default: 8)\n"
+    << "        --mmrt <ao|pt>                       Render the MMRT_AO or MMRT_PT pass on the CPU through the multiview A-buffers\n"
+    << "                                             instead of the BVH, for --frames progressive frames and --bounces bounces\n"
+    << "        --mmrt-views <single|cubemap>        Views of the MMRT tracing: the camera alone or with a cubemap (default: cubemap)\n"
+    << "        --mmrt-face-resolution <n>           Width and height of the MMRT cube faces (default: the image height)\n"
+    << "        --mmrt-thickness <t>                 Thickness of the MMRT fragments behind their depth (default: 0.1)\n"
+    << "        --mmrt-ray-distance <d>              Length of the MMRT_AO rays, 0 for unlimited (default: 1)\n"
+    << "        --mmrt-spp <n>                       MMRT_AO rays per pixel and frame (default: 1)\n"
+    << "        --mmrt-linked-lists                  Trace the MMRT buckets through their linked lists, as the shaders,\n"
+    << "                                             instead of compacting them into contiguous spans\n"
+    << "        --mmrt-fixed-face-order              Test the MMRT cube faces a ray may continue in one by one, instead of\n"
+    << "                                             picking them from the edge it left through and its direction\n"
+    << "        --mmrt-skip-faces <f>                Skip the MMRT cube faces entered by less than fraction f of the rays\n"
+    << "                                             of the frame before (default: 0, none)\n"
+    << "        --depth-bounds-benchmark             Report the full and incremental build time of the MMRT depth-bounds pyramids on the CPU\n"
     << endl;
   GLUTDisplay::printUsage();
 
   if ( doExit ) exit(1);
 }
 
+// Same camera setup as GLUTDisplay, for runs without a window
+RayGenCameraData	makeRayGenCameraData( const InitialCameraData& camera_data, unsigned int width, unsigned int height )
+{
+	PinholeCamera camera( camera_data.eye, camera_data.lookat, camera_data.up, -1.0f, camera_data.vfov, PinholeCamera::KeepVertical );
+	camera.setAspectRatio( static_cast<float>(width) / static_cast<float>(height) );
+
+	RayGenCameraData ray_gen_data;
+	camera.getEyeUVW( ray_gen_data.eye, ray_gen_data.U, ray_gen_data.V, ray_gen_data.W );
+	return ray_gen_data;
+}
+
+// Settings of runs without a window
+struct HeadlessOptions
+{
+	unsigned int	frames;
+	string			output_file;
+	string			csv_file;
+	string			reference_file;		// image to report the relative MSE against, if any
+	double			target_rel_mse;		// stops once the relative MSE is reached, if positive
+};
+
+bool	saveOutputBuffer ( OptixRenderer& scene, const string& filename )
+{
+	Buffer buffer = scene.getOutputBuffer();
+	RTsize width, height;
+	buffer->getSize( width, height );
+
+	bool saved = cpu::savePFM( filename, static_cast<const float4*>( buffer->map() ), static_cast<unsigned int>(width), static_cast<unsigned int>(height) );
+	buffer->unmap();
+	return saved;
+}
+
+bool	saveOutputBuffer ( CpuRenderer& scene, const string& filename )
+{
+	const cpu::Buffer& buffer = scene.getOutputBuffer();
+	return cpu::savePFM( filename, &buffer.data[0], buffer.width, buffer.height );
+}
+
+double	outputRelativeMSE ( OptixRenderer& scene, const vector<float4>& reference )
+{
+	Buffer buffer = scene.getOutputBuffer();
+	double rel_mse = cpu::relativeMSE( static_cast<const float4*>( buffer->map() ), &reference[0], reference.size() );
+	buffer->unmap();
+	return rel_mse;
+}
+
+double	outputRelativeMSE ( CpuRenderer& scene, const vector<float4>& reference )
+{
+	return cpu::relativeMSE( &scene.getOutputBuffer().data[0], &reference[0], reference.size() );
+}
+
+// Accumulates frames progressively through trace(), logs the trace time, rays/s and
+// samples/s of every frame to a CSV file and saves the final image. With a reference
+// image, the relative MSE of every frame is logged too, and the run stops once it
+// reaches the target.
+template<class Scene>
+int		runHeadless		 ( Scene& scene, unsigned int width, unsigned int height, const HeadlessOptions& options )
+{
+	vector<float4> reference;
+	if ( !options.reference_file.empty() )
+	{
+		unsigned int reference_width, reference_height;
+		if ( !cpu::loadPFM( options.reference_file, reference, reference_width, reference_height ) || reference_width != width || reference_height != height )
+		{
+			cerr << "Could not read a " << width << "x" << height << " reference image from '" << options.reference_file << "'" << endl;
+			return 1;
+		}
+	}
+
+	InitialCameraData camera_data;
+	scene.initScene( camera_data );
+	RayGenCameraData ray_gen_data = makeRayGenCameraData( camera_data, width, height );
+
+	ofstream csv( options.csv_file.c_str() );
+	if ( !csv )
+	{
+		cerr << "Could not write '" << options.csv_file << "'" << endl;
+		return 1;
+	}
+	csv << "frame,trace_time_s,rays,rays_per_s,samples_per_s" << ( reference.empty() ? "" : ",rel_mse" ) << "\n";
+
+	double total_time = 0.0, total_rays = 0.0, total_samples = 0.0, rel_mse = 0.0;
+	unsigned int frame = 0;
+	bool target_reached = false;
+	while ( frame < options.frames && !target_reached )
+	{
+		++frame;
+		double start, end;
+		sutilCurrentTime( &start );
+		{
+			scene.trace( ray_gen_data );
+		}
+		sutilCurrentTime( &end );
+
+		const double			 trace_time  = end - start;
+		const unsigned long long num_rays	 = scene.getRayCount();
+		const unsigned long long num_samples = scene.getSampleCount();
+		csv << frame << "," << trace_time << "," << num_rays << "," << num_rays / trace_time << "," << num_samples / trace_time;
+		if ( !reference.empty() )
+		{
+			rel_mse = outputRelativeMSE( scene, reference );
+			target_reached = options.target_rel_mse > 0.0 && rel_mse <= options.target_rel_mse;
+			csv << "," << rel_mse;
+		}
+		csv << "\n";
+
+		total_time	  += trace_time;
+		total_rays	  += static_cast<double>( num_rays );
+		total_samples += static_cast<double>( num_samples );
+	}
+
+	cout << "Frames                 : " << frame << " x " << scene.getSqrtNumSamples() * scene.getSqrtNumSamples() << " spp\n";
+	cout << "Time to trace          : " << total_time << " s.\n";
+	cout << "Rays/s                 : " << total_rays / total_time << "\n";
+	cout << "Samples/s              : " << total_samples / total_time << "\n";
+	if ( !reference.empty() )
+	{
+		cout << "Rel. MSE               : " << rel_mse << "\n";
+		if ( options.target_rel_mse > 0.0 )
+			cout << "Time to target MSE     : " << ( target_reached ? "" : "not reached, " ) << total_time << " s.\n";
+	}
+
+	if ( !saveOutputBuffer( scene, options.output_file ) )
+	{
+		cerr << "Could not write '" << options.output_file << "'" << endl;
+		return 1;
+	}
+	return 0;
+}
+
 int		main			 ( int argc, char** argv )
 {
-	GLUTDisplay::init( argc, argv );
+	// GLUT needs a display, which GPU-less render nodes and cron jobs do not have
+	bool			headless = false;
+	for ( int i = 1; i < argc; ++i )
+	{
+		string arg( argv[i] );
+		if ( arg == "--cpu" || arg == "--cpu-benchmark" || arg == "--abuffer-benchmark" || arg == "--frames" ||
+			 arg == "--abuffer-telemetry" || arg == "--auto-size-abuffer" || arg == "--mmrt" ||
+			 arg == "--depth-bounds-benchmark" )	headless = true;
+	}
+	if ( !headless )
+		GLUTDisplay::init( argc, argv );
 		
 	unsigned int	width  = 1024u, height = 768u;
+	unsigned int	num_threads = 0u;
+	unsigned int	sqrt_num_samples = 1u;
+	int				bounces = 2;
+	unsigned int	rr_begin_depth = 3u, adaptive_min_frames = 32u;
+	float			adaptive_threshold = 0.0f;
+	bool			use_cpu = false, benchmark_accels = false, benchmark_abuffers = false, benchmark_depth_bounds = false, ray_sort = false;
+	cpu::ABufferSettings	abuffer_settings;
+	string			abuffer_telemetry_file;
+	double			abuffer_size_percentile = 0.0;
+	cpu::MMRTSettings	mmrt_settings;
+	string			mmrt_application;
+	string			builder = "Trbvh", traverser = "Bvh";
+	string			scene_file;
+	bool			accel_cache = true;
+	string			accel_cache_directory;
+
+	HeadlessOptions	headless_options;
+	headless_options.frames		 = 1u;
+	headless_options.output_file = "output.pfm";
+	headless_options.target_rel_mse = 0.0;
 	
 	string		texture_path;
 	for ( int i = 1; i < argc; ++i )
@@ -238,21 +567,337 @@ int		main			 ( int argc, char** argv )
 			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
 			texture_path = argv[++i];
 		}
+		else if (arg == "--cpu")
+			use_cpu = true;
+		else if (arg == "--cpu-benchmark")
+			use_cpu = benchmark_accels = true;
+		else if (arg == "--abuffer-benchmark")
+			use_cpu = benchmark_abuffers = true;
+		else if (arg == "--depth-bounds-benchmark")
+			use_cpu = benchmark_depth_bounds = true;
+		else if (arg == "--abuffer-telemetry")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_telemetry_file = argv[++i];
+			use_cpu = true;
+		}
+		else if (arg == "--auto-size-abuffer")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_size_percentile = atof(argv[++i]);
+			if ( abuffer_size_percentile <= 0.0 || abuffer_size_percentile > 100.0 )	printUsageAndExit( argv[0] );
+			use_cpu = true;
+		}
+		else if (arg == "--buckets")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.buckets = atoi(argv[++i]);
+			if ( abuffer_settings.buckets == 0 )				printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--bucket-distribution")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			if ( !cpu::parseBucketDistribution( argv[++i], abuffer_settings.bucket_distribution ) )
+			{
+				cerr << "Unknown bucket distribution: '" << argv[i] << "'" << endl;
+																printUsageAndExit( argv[0] );
+			}
+		}
+		else if (arg == "--max-layers")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.max_layers = atoi(argv[++i]);
+			if ( abuffer_settings.max_layers == 0 )				printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--insert-vs-shell")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.insert_vs_shell = atoi(argv[++i]);
+		}
+		else if (arg == "--prealloc-fragments")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.prealloc_fragments = atoi(argv[++i]);
+			if ( abuffer_settings.prealloc_fragments == 0 )		printUsageAndExit( argv[0] );
+			abuffer_settings.exact_allocation = false;
+		}
+		else if (arg == "--sb-atomic-prefix-sum")
+			abuffer_settings.scan_prefix_sum = false;
+		else if (arg == "--no-sort-networks")
+			abuffer_settings.sort_networks = false;
+		else if (arg == "--radix-resolve")
+			abuffer_settings.radix_resolve = true;
+		else if (arg == "--sb-counters")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.sb_counters = atoi(argv[++i]);
+			if ( abuffer_settings.sb_counters == 0 )			printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--sb-counter-layout")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			if ( !cpu::parseCounterLayout( argv[++i], abuffer_settings.sb_counter_layout ) )
+			{
+				cerr << "Unknown S-buffer counter layout: '" << argv[i] << "'" << endl;
+																printUsageAndExit( argv[0] );
+			}
+		}
+		else if (arg == "--sb-unpadded-counters")
+			abuffer_settings.sb_pad_counters = false;
+		else if (arg == "--kbuffer-size")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			abuffer_settings.kbuffer_size = atoi(argv[++i]);
+			if ( abuffer_settings.kbuffer_size == 0 )			printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--mmrt")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_application = argv[++i];
+			if ( mmrt_application != "ao" && mmrt_application != "pt" )	printUsageAndExit( argv[0] );
+			use_cpu = true;
+		}
+		else if (arg == "--mmrt-views")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			string views = argv[++i];
+			if ( views == "single" )							mmrt_settings.faces = 1u;
+			else if ( views == "cubemap" )						mmrt_settings.faces = cpu::MMRT_MAX_FACES;
+			else												printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--mmrt-face-resolution")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_settings.face_resolution = atoi(argv[++i]);
+		}
+		else if (arg == "--mmrt-thickness")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_settings.thickness = static_cast<float>( atof(argv[++i]) );
+		}
+		else if (arg == "--mmrt-ray-distance")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_settings.ray_distance = static_cast<float>( atof(argv[++i]) );
+		}
+		else if (arg == "--mmrt-spp")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_settings.samples_per_pixel = atoi(argv[++i]);
+			if ( mmrt_settings.samples_per_pixel == 0 )		printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--mmrt-linked-lists")
+			mmrt_settings.compact_buckets = false;
+		else if (arg == "--mmrt-fixed-face-order")
+			mmrt_settings.schedule_faces = false;
+		else if (arg == "--mmrt-skip-faces")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			mmrt_settings.skip_faces = static_cast<float>( atof(argv[++i]) );
+		}
+		else if (arg == "--ray-sort")
+			ray_sort = true;
+		else if (arg == "--builder")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			builder = argv[++i];
+		}
+		else if (arg == "--traverser")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			traverser = argv[++i];
+		}
+		else if (arg == "--scene")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			scene_file = argv[++i];
+		}
+		else if (arg == "--accel-cache")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			accel_cache_directory = argv[++i];
+		}
+		else if (arg == "--no-accel-cache")
+			accel_cache = false;
+		else if (arg == "--simd")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			cpu::SimdLevel level;
+			if ( !cpu::parseSimdLevel( argv[++i], level ) )
+			{
+				cerr << "Unknown SIMD level: '" << argv[i] << "'" << endl;
+																printUsageAndExit( argv[0] );
+			}
+			if ( cpu::setSimdLevel( level ) != level )
+				cerr << "SIMD level '" << argv[i] << "' is not supported, using '" << cpu::getSimdLevelName( cpu::getSimdLevel() ) << "'" << endl;
+		}
+		else if (arg == "--threads")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			num_threads = atoi(argv[++i]);
+		}
+		else if (arg == "--frames")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			headless_options.frames = atoi(argv[++i]);
+			if ( headless_options.frames == 0 )					printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--spp")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			// the AA pattern stratifies the pixel in sqrt(S) x sqrt(S) cells
+			unsigned int spp = atoi(argv[++i]);
+			sqrt_num_samples = static_cast<unsigned int>( sqrtf( static_cast<float>(spp) ) + 0.5f );
+			if ( spp == 0 || sqrt_num_samples * sqrt_num_samples != spp )
+			{
+				cerr << "Samples per pixel must be a square number: '" << argv[i] << "'" << endl;
+																printUsageAndExit( argv[0] );
+			}
+		}
+		else if (arg == "--bounces")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			bounces = atoi(argv[++i]);
+			if ( bounces <= 0 )									printUsageAndExit( argv[0] );
+		}
+		else if (arg == "--rr-depth")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			rr_begin_depth = atoi(argv[++i]);
+		}
+		else if (arg == "--adaptive")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			adaptive_threshold = static_cast<float>( atof(argv[++i]) );
+		}
+		else if (arg == "--adaptive-min-frames")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			adaptive_min_frames = atoi(argv[++i]);
+		}
+		else if (arg == "--reference")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			headless_options.reference_file = argv[++i];
+		}
+		else if (arg == "--target-rel-mse")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			headless_options.target_rel_mse = atof(argv[++i]);
+		}
+		else if (arg == "--out")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			headless_options.output_file = argv[++i];
+		}
+		else if (arg == "--csv")
+		{
+			if ( i == argc-1 ) 									printUsageAndExit( argv[0] );
+			headless_options.csv_file = argv[++i];
+		}
 		else
 		{
 			cerr << "Unknown option: '" << arg << "'\n";	printUsageAndExit( argv[0] );
 		}
 	}
 
+	if ( headless_options.csv_file.empty() )
+		headless_options.csv_file = headless_options.output_file.substr( 0, headless_options.output_file.find_last_of( '.' ) ) + ".csv";
+
+	if (use_cpu)
+	{
+		try
+		{
+			CpuRenderer scene(width, height, num_threads);
+			scene.setSqrtNumSamples(sqrt_num_samples);
+			scene.setBounces(bounces);
+			scene.setRussianRouletteDepth(rr_begin_depth);
+			scene.setAdaptiveSampling(adaptive_threshold, adaptive_min_frames);
+			scene.setRaySorting(ray_sort);
+			scene.setSceneFile(scene_file);
+			scene.setAccelCache(accel_cache, accel_cache_directory);
+			if (!scene.setSpatialDataStructure(builder, traverser))
+			{
+				cerr << "Unknown acceleration builder/traverser: '" << builder << "'/'" << traverser << "'" << endl;
+				return 1;
+			}
+
+			if (benchmark_accels)
+			{
+				InitialCameraData camera_data;
+				scene.initScene(camera_data);
+				scene.benchmark(makeRayGenCameraData(camera_data, width, height));
+				return 0;
+			}
+			if (benchmark_abuffers || !abuffer_telemetry_file.empty() || abuffer_size_percentile > 0.0)
+			{
+				InitialCameraData camera_data;
+				scene.initScene(camera_data);
+				if (!abuffer_telemetry_file.empty() || abuffer_size_percentile > 0.0)
+					scene.measureDepthComplexity(makeRayGenCameraData(camera_data, width, height), abuffer_telemetry_file, abuffer_size_percentile, abuffer_settings);
+				if (benchmark_abuffers)
+					scene.benchmarkABuffers(makeRayGenCameraData(camera_data, width, height), abuffer_settings);
+				return 0;
+			}
+			if (benchmark_depth_bounds)
+			{
+				InitialCameraData camera_data;
+				scene.initScene(camera_data);
+				mmrt_settings.abuffer = abuffer_settings;
+				scene.benchmarkDepthBounds(makeRayGenCameraData(camera_data, width, height), mmrt_settings);
+				return 0;
+			}
+			if (!mmrt_application.empty())
+			{
+				InitialCameraData camera_data;
+				scene.initScene(camera_data);
+				mmrt_settings.abuffer = abuffer_settings;
+				mmrt_settings.frames  = headless_options.frames;
+				mmrt_settings.bounces = bounces;
+				scene.renderMMRT(makeRayGenCameraData(camera_data, width, height), mmrt_settings, mmrt_application == "pt");
+				if ( !saveOutputBuffer( scene, headless_options.output_file ) )
+				{
+					cerr << "Could not write '" << headless_options.output_file << "'" << endl;
+					return 1;
+				}
+				return 0;
+			}
+			return runHeadless(scene, width, height, headless_options);
+		}
+		catch( std::exception& e )
+		{
+			sutilReportError( e.what() );
+			return 1;
+		}
+	}
+
 	if (texture_path.empty())
 		texture_path = string(sutilSamplesDir()) + "/tutorial/data";
 
-	if(!GLUTDisplay::isBenchmark())
+	if(!headless && !GLUTDisplay::isBenchmark())
 		printUsageAndExit( argv[0], false );
 	
 	try
 	{
 		OptixRenderer scene(texture_path, width, height);
+		scene.setSqrtNumSamples(sqrt_num_samples);
+		scene.setBounces(bounces);
+		scene.setRussianRouletteDepth(rr_begin_depth);
+		scene.setAdaptiveSampling(adaptive_threshold, adaptive_min_frames);
+		scene.setSceneFile(scene_file);
+		scene.setAccelCache(accel_cache, accel_cache_directory);
+		if (!scene.setSpatialDataStructure(builder, traverser))
+		{
+			cerr << "Unknown acceleration builder/traverser: '" << builder << "'/'" << traverser << "'" << endl;
+			printUsageAndExit( argv[0] );
+		}
+
+		if (headless)
+		{
+			// no GL context to share the output buffer with
+			scene.setUseVBOBuffer(false);
+			return runHeadless(scene, width, height, headless_options);
+		}
 
 		GLUTDisplay::setUseSRGB(true);
 		GLUTDisplay::run("Tutorial", &scene);
@@ -264,4 +909,4 @@ int		main			 ( int argc, char** argv )
 	}
 	
 	return 0;
-}
\ No newline at end of file
+}
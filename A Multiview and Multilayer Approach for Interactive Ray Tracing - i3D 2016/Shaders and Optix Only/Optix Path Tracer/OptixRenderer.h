@@ -31,6 +31,7 @@
 
 #include <optixu/optixpp_namespace.h>
 #include <optixu/optixu_math_namespace.h>
+#include <algorithm>
 #include <iostream>
 #include <GLUTDisplay.h>
 #include <ImageLoader.h>
@@ -48,27 +49,27 @@ class OptixRenderer : public SampleScene
 {
 public:
 
-	static enum ShadingModel
+	enum ShadingModel
 	{
 		SM_NORMAL = 0,
 		SM_LAMBERTIAN,
 		SM_PHONG_DIRECT
 	};
-	static enum ShadowingModel
+	enum ShadowingModel
 	{
 		SM_SIMPLE = 0,
 		SM_TRANSPARENT
 	};
-	static enum CameraType
+	enum CameraType
 	{
 		CT_PINHOLE = 0,
 		CT_ORTHO
 	};
-	static enum SamplingStrategy
+	enum SamplingStrategy
 	{
 		SS_BSDF = 0,
 	};
-	static enum SpatialDataStructureType
+	enum SpatialDataStructureType
 	{
 		SDS_TRBVH = 0,
 		SDS_SBVH,
@@ -106,25 +107,58 @@ public:
 		m_shadows_enabled(true),
 		m_sds_builder(SDS_TRBVH),
 		m_sds_traverser(SDS_BVH),
-		m_width(720),
-		m_height(480),
+		m_width(w),
+		m_height(h),
 		m_fov(40.0f),
 		m_gamma(2.2f),
 		m_frame(0u),
-		m_rr_begin_depth(0u),
+		m_rr_begin_depth(3u),
+		m_adaptive_threshold(0.0f),
+		m_adaptive_min_frames(32u),
 		m_sqrt_num_samples(1), 
 		m_sampling_strategy(SS_BSDF),
 		m_bounces(2),
 		m_model_name("sponza.obj"),
+		m_accel_cache(true),
 		m_texture_path(tex_path){}
 
 	// From SampleScene
 	void	initScene(InitialCameraData&	camera_data);
 	void	trace(const RayGenCameraData&	camera_data);
 	Buffer  getOutputBuffer(void) { return m_context["output_buffer"]->getBuffer(); }
+	void	doResize(unsigned int width, unsigned int height);
+
+	// Samples per pixel and frame are sqrt_num_samples^2; call before initScene
+	void	setSqrtNumSamples(unsigned int sqrt_num_samples) { m_sqrt_num_samples = sqrt_num_samples; }
+	unsigned int getSqrtNumSamples(void) const { return m_sqrt_num_samples; }
+	// Maximum path depth; call before initScene
+	void	setBounces(int bounces) { m_bounces = bounces; }
+	// Bounce from which Russian roulette ends paths with the probability of their throughput;
+	// call before initScene
+	void	setRussianRouletteDepth(unsigned int rr_begin_depth) { m_rr_begin_depth = rr_begin_depth; }
+	// Stops tracing a pixel once the relative MSE of its mean, estimated from the luminance
+	// variance of its frames, is below threshold, and not before min_frames (at least 2).
+	// A threshold of 0 traces every pixel in every frame. Call before initScene.
+	void	setAdaptiveSampling(float threshold, unsigned int min_frames) { m_adaptive_threshold = threshold; m_adaptive_min_frames = max(min_frames, 2u); }
+	// Rays traced by the last launch
+	unsigned long long getRayCount(void);
+	// Camera samples traced by the last launch; pixels skipped by adaptive sampling trace none
+	unsigned long long getSampleCount(void);
 
 	string	texpath(const string& base) { return m_texture_path + "/" + base; }
 
+	// Selects the acceleration structure by builder/traverser name; call before initScene.
+	// Returns false for unknown names.
+	bool	setSpatialDataStructure(const string& builder, const string& traverser);
+
+	// Takes the lights from the <light> nodes of a demo .scene file instead of the built-in
+	// Sponza light; call before initScene
+	void	setSceneFile(const string& scene_file) { m_scene_file = scene_file; }
+
+	// Acceleration structure cache (cpu::AccelCache), on by default, in directory or, if it
+	// is empty, in the directory of the model. Call before initScene.
+	void	setAccelCache(bool enable, const string& directory) { m_accel_cache = enable; m_accel_cache_directory = directory; }
+
 private:
 	
 	bool			m_envmap_enabled;
@@ -141,12 +175,19 @@ private:
 	float3			m_ambient_light_color;
 
 	int				m_bounces;
+	unsigned int	m_rr_begin_depth;
+
+	float			m_adaptive_threshold;
+	unsigned int	m_adaptive_min_frames;
 
 	unsigned int	m_frame;
 	unsigned int	m_width;
 	unsigned int	m_height;
 
 	string			m_model_name;
+	string			m_scene_file;
+	bool			m_accel_cache;
+	string			m_accel_cache_directory;
 	string			m_texture_path;
 	Aabb			m_model_aabb;
 
@@ -157,6 +198,9 @@ private:
 	Program			m_model_closest_hit_program;
 
 	Buffer			m_light_buffer;
+	Buffer			m_light_alias_buffer;
+	Buffer			m_ray_count_buffer;
+	Buffer			m_variance_buffer;
 
 	CameraType		m_camera_type;
 	ShadingModel	m_shading_model;
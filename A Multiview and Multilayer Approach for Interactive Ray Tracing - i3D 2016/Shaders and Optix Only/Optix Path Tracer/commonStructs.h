@@ -47,3 +47,12 @@ struct BasicLight
   int    casts_shadow;  
 };
 
+// Alias table entry for sampling lights in proportion to their power (Vose's method):
+// slot i picks light i with the given probability and light alias otherwise, pdf is the
+// probability of picking light i
+struct LightAlias
+{
+  float        probability;
+  unsigned int alias;
+  float        pdf;
+};
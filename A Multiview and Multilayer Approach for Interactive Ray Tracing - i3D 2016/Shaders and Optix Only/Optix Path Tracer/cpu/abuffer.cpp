@@ -0,0 +1,1260 @@
+#include "abuffer.h"
+#include "fragment_sort.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// pixels per tile of SBuffer::scanPixelRanges
+	static const unsigned int	SCAN_TILE_SIZE = 4096;
+
+	// s-buffer.h, for resolution 1024 x 768
+	static const int	COUNTERS	= 32;
+	static const int	COUNTERS_X	= 256;
+	static const int	COUNTERS_Y	= 192;
+	static const int	COUNTERS_W	= 4;
+
+	// bytes between padded S-buffer counters
+	static const unsigned int	CACHE_LINE_SIZE = 64;
+
+	static inline unsigned int packUnorm(float value, float scale)
+	{
+		return static_cast<unsigned int>(fminf(fmaxf(value, 0.0f), 1.0f) * scale + 0.5f);
+	}
+
+	static inline unsigned int packUnorm4x8(const float4& v)
+	{
+		return packUnorm(v.x, 255.0f) | (packUnorm(v.y, 255.0f) << 8) | (packUnorm(v.z, 255.0f) << 16) | (packUnorm(v.w, 255.0f) << 24);
+	}
+
+	static inline unsigned int packUnorm2x16(const float2& v)
+	{
+		return packUnorm(v.x, 65535.0f) | (packUnorm(v.y, 65535.0f) << 16);
+	}
+
+	static inline float unpackUnorm(unsigned int bits, float scale)
+	{
+		return static_cast<float>(bits) / scale;
+	}
+
+	static inline float signNotZero(float value)
+	{
+		return (value >= 0.0f) ? 1.0f : -1.0f;
+	}
+
+	// [AtomicImage]
+
+	void AtomicImage::resize(unsigned int width, unsigned int height, unsigned int layers)
+	{
+		if (width == m_width && height == m_height && layers == m_layers)
+			return;
+		m_width	 = width;
+		m_height = height;
+		m_layers = layers;
+		m_texels.reset(new atomic<unsigned int>[static_cast<size_t>(width) * height * layers]);
+	}
+
+	void AtomicImage::clear(unsigned int value, ThreadPool& thread_pool)
+	{
+		for (unsigned int layer = 0; layer < m_layers; ++layer)
+			clearLayer(layer, value, thread_pool);
+	}
+
+	void AtomicImage::clearLayer(unsigned int layer, unsigned int value, ThreadPool& thread_pool)
+	{
+		thread_pool.run(m_height, [&](unsigned int y, unsigned int)
+		{
+			atomic<unsigned int>* texels = &(*this)(0, y, layer);
+			for (unsigned int x = 0; x < m_width; ++x)
+				texels[x].store(value, memory_order_relaxed);
+		});
+	}
+
+	unsigned int AtomicImage::atomicMin(unsigned int x, unsigned int y, unsigned int layer, unsigned int value)
+	{
+		atomic<unsigned int>& texel = (*this)(x, y, layer);
+		unsigned int previous = texel.load(memory_order_relaxed);
+		while (value < previous && !texel.compare_exchange_weak(previous, value, memory_order_relaxed)) {}
+		return previous;
+	}
+
+	unsigned int AtomicImage::atomicMax(unsigned int x, unsigned int y, unsigned int layer, unsigned int value)
+	{
+		atomic<unsigned int>& texel = (*this)(x, y, layer);
+		unsigned int previous = texel.load(memory_order_relaxed);
+		while (value > previous && !texel.compare_exchange_weak(previous, value, memory_order_relaxed)) {}
+		return previous;
+	}
+
+	// [DepthBuckets]
+
+	void DepthBuckets::equalize(const Rasterizer& rasterizer, const AtomicImage& depth_bounds, ThreadPool& thread_pool)
+	{
+		// a single bucket has no boundaries
+		if (m_distribution != BUCKETS_EQUALIZED || m_buckets == 1)
+			return;
+
+		const unsigned int width  = depth_bounds.width();
+		const unsigned int height = depth_bounds.height();
+		const unsigned int bins	  = m_buckets * HISTOGRAM_BINS;
+		m_histogram.resize(width, height, (bins + 1) / 2);
+		m_histogram.clear(0u, thread_pool);
+		m_bounds.resize(static_cast<size_t>(width) * height * (m_buckets - 1));
+
+		// [BucketHistogram], 16-bit counters that a pixel would need 65536 fragments in one
+		// bin to overflow
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int)
+		{
+			const float depth_near = uintBitsToFloat(depth_bounds(x, y, 0).load(memory_order_relaxed));
+			const float depth_far  = uintBitsToFloat(depth_bounds(x, y, 1).load(memory_order_relaxed));
+			const float normalized_depth = fminf(fmaxf((-pecsZ - depth_near) / (depth_far - depth_near), 0.0f), 1.0f);
+			const unsigned int bin = min(static_cast<unsigned int>(floorf(static_cast<float>(bins) * normalized_depth)), bins - 1);
+			m_histogram(x, y, bin / 2).fetch_add(1u << (16 * (bin & 1u)), memory_order_relaxed);
+		});
+
+		// the boundaries at every multiple of a bucket's share of the cumulative count
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			vector<unsigned int> counts(bins);
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				float* bounds = &m_bounds[(static_cast<size_t>(y) * width + x) * (m_buckets - 1)];
+				const unsigned int near_bits = depth_bounds(x, y, 0).load(memory_order_relaxed);
+				if (near_bits == 0xFFFFFFFFu)
+				{
+					fill(bounds, bounds + m_buckets - 1, FLT_MAX);
+					continue;
+				}
+				const float depth_near = uintBitsToFloat(near_bits);
+				const float bin_length = (uintBitsToFloat(depth_bounds(x, y, 1).load(memory_order_relaxed)) - depth_near) / static_cast<float>(bins);
+
+				unsigned int total = 0;
+				for (unsigned int bin = 0; bin < bins; ++bin)
+				{
+					counts[bin] = (m_histogram(x, y, bin / 2).load(memory_order_relaxed) >> (16 * (bin & 1u))) & 0xFFFFu;
+					total += counts[bin];
+				}
+
+				// the front fragment stays in bucket 0, where Ambient_Occlusion and Path_Tracing read
+				// it as with the other distributions, and so do all of a single-depth pixel
+				const float above_near = nextafterf(depth_near, FLT_MAX);
+				unsigned int bin = 0, cumulative = 0;
+				for (unsigned int b = 1; b < m_buckets; ++b)
+				{
+					const float share = static_cast<float>(total) * static_cast<float>(b) / static_cast<float>(m_buckets);
+					while (bin + 1 < bins && static_cast<float>(cumulative + counts[bin]) < share)
+						cumulative += counts[bin++];
+					const float fraction = counts[bin] ? fminf(fmaxf((share - static_cast<float>(cumulative)) / static_cast<float>(counts[bin]), 0.0f), 1.0f) : 0.0f;
+					bounds[b - 1] = fmaxf(depth_near + (static_cast<float>(bin) + fraction) * bin_length, above_near);
+				}
+			}
+		});
+	}
+
+	unsigned int DepthBuckets::getBucket(const AtomicImage& depth_bounds, unsigned int x, unsigned int y, float Z) const
+	{
+		// a single bucket has no boundaries, equalized or not
+		if (m_buckets == 1)
+			return 0;
+		if (m_distribution == BUCKETS_EQUALIZED)
+		{
+			// the buckets whose lower boundary Z has reached
+			const float* bounds = &m_bounds[(static_cast<size_t>(y) * depth_bounds.width() + x) * (m_buckets - 1)];
+			return static_cast<unsigned int>(upper_bound(bounds, bounds + m_buckets - 1, Z) - bounds);
+		}
+		const float depth_near = uintBitsToFloat(depth_bounds(x, y, 0).load(memory_order_relaxed));
+		const float depth_far  = uintBitsToFloat(depth_bounds(x, y, 1).load(memory_order_relaxed));
+		// fmaxf maps the NaN of a single-depth pixel to 0, as clamp does on the GPU
+		const float normalized_depth = (m_distribution == BUCKETS_LOGARITHMIC) ?
+			fminf(fmaxf(logf(Z / depth_near) / logf(depth_far / depth_near), 0.0f), 1.0f) :
+			fminf(fmaxf((Z - depth_near) / (depth_far - depth_near), 0.0f), 1.0f);
+		return min(static_cast<unsigned int>(floorf(static_cast<float>(m_buckets) * normalized_depth)), m_buckets - 1);
+	}
+
+	// [LinkedListABuffer]
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	LinkedListABuffer<DOUBLE, LAYOUT>::LinkedListABuffer(const ABufferSettings& settings, bool bucketed) :
+		m_settings(settings),
+		m_bucketed(bucketed),
+		m_buckets(bucketed ? max(settings.buckets, 1u) : 1u),
+		m_depth_buckets(settings.bucket_distribution, m_buckets),
+		m_next_address(0)
+	{
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	unsigned int LinkedListABuffer<DOUBLE, LAYOUT>::getBucket(unsigned int x, unsigned int y, float Z) const
+	{
+		return m_bucketed ? m_depth_buckets.getBucket(m_depth_bounds, x, y, Z) : 0;
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	void LinkedListABuffer<DOUBLE, LAYOUT>::resizeNodes(unsigned int num_nodes)
+	{
+		m_nodes.resize(num_nodes);
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	void LinkedListABuffer<DOUBLE, LAYOUT>::peel(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, ThreadPool& thread_pool)
+	{
+		m_head.clear(0u, thread_pool);
+		m_next_address = 0;
+		const unsigned int num_nodes = m_nodes.size();
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int prim)
+		{
+			const unsigned int index = m_next_address.fetch_add(1u, memory_order_relaxed) + 1u;
+			if (index >= num_nodes)
+				return;
+
+			const unsigned int bucket = getBucket(x, y, -pecsZ);
+			m_nodes.setDepth(index, pecsZ);
+			m_nodes.setNext(index, m_head(x, y, bucket).exchange(index, memory_order_relaxed));
+			m_nodes.setData(index, attributes[prim]);
+		});
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	void LinkedListABuffer<DOUBLE, LAYOUT>::build(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, ThreadPool& thread_pool)
+	{
+		const unsigned int width  = rasterizer.width();
+		const unsigned int height = rasterizer.height();
+
+		m_head.resize(width, height, m_buckets);
+		if (DOUBLE)
+			m_tail.resize(width, height, m_buckets);
+
+		// without exact allocation, the buffers are allocated once, as the GL buffer objects
+		if (!m_settings.exact_allocation && m_nodes.size() != max(m_settings.prealloc_fragments, 1u))
+			resizeNodes(max(m_settings.prealloc_fragments, 1u));
+
+		// [DepthBoundsCompute], which also counts the fragments
+		atomic<unsigned int> total_counter(0u);
+		bool counted = false;
+		if (m_bucketed)
+		{
+			m_depth_bounds.resize(width, height, 2);
+			m_depth_bounds.clearLayer(0, 0xFFFFFFFFu, thread_pool);
+			m_depth_bounds.clearLayer(1, 0u, thread_pool);
+			rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int)
+			{
+				const unsigned int Z = floatBitsToUint(-pecsZ);
+				total_counter.fetch_add(1u, memory_order_relaxed);
+				m_depth_bounds.atomicMin(x, y, 0, Z);
+				m_depth_bounds.atomicMax(x, y, 1, Z);
+			});
+			counted = true;
+		}
+		else if (m_settings.exact_allocation && m_nodes.size() <= 1)
+		{
+			// [Accumulate], once: later builds start from the current pool
+			rasterizer.rasterize(thread_pool, [&](unsigned int, unsigned int, float, unsigned int)
+			{
+				total_counter.fetch_add(1u, memory_order_relaxed);
+			});
+			counted = true;
+		}
+		if (m_settings.exact_allocation && counted && total_counter.load() + 1u > m_nodes.size())
+			resizeNodes(total_counter.load() + 1u);
+
+		if (m_bucketed)
+			m_depth_buckets.equalize(rasterizer, m_depth_bounds, thread_pool);
+
+		// [Peel], again into a pool of the size it asked for when it ran out of nodes
+		peel(rasterizer, attributes, thread_pool);
+		unsigned long long allocated = m_next_address.load();
+		if (m_settings.exact_allocation && allocated + 1u > m_nodes.size())
+		{
+			m_overflow_count++;
+			resizeNodes(static_cast<unsigned int>(allocated) + 1u);
+			peel(rasterizer, attributes, thread_pool);
+			allocated = m_next_address.load();
+		}
+		// the pool follows the scene down as well, with some slack against reallocating
+		// on every build
+		if (m_settings.exact_allocation && 2u * (allocated + 1u) < m_nodes.size())
+			resizeNodes(static_cast<unsigned int>(allocated) + 1u);
+
+		m_fragment_count = min(allocated, static_cast<unsigned long long>(m_nodes.size() - 1));
+		m_dropped_count	 = allocated - m_fragment_count;
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	void LinkedListABuffer<DOUBLE, LAYOUT>::resolve(ThreadPool& thread_pool)
+	{
+		const unsigned int width	  = m_head.width();
+		const unsigned int max_layers = max(m_settings.max_layers, 1u);
+		thread_pool.run(m_head.height(), [&](unsigned int y, unsigned int)
+		{
+			vector<unsigned int> fragments_id(max_layers);
+			vector<float>		 fragments_depth(max_layers);
+			for (unsigned int x = 0; x < width; ++x)
+				for (unsigned int b = 0; b < m_buckets; ++b)
+				{
+					unsigned int index = m_head(x, y, b).load(memory_order_relaxed);
+					if (index == 0u)
+						continue;
+
+					// 1. LOAD
+					unsigned int counter = 0;
+					while (index != 0u && counter < max_layers)
+					{
+						fragments_id[counter]	 = index;
+						fragments_depth[counter] = m_nodes.getDepth(index);
+						index = m_nodes.getNext(index);
+						counter++;
+					}
+
+					// 2. SORT
+					sortFragments(&fragments_id[0], &fragments_depth[0], static_cast<int>(counter), static_cast<int>(m_settings.insert_vs_shell), m_settings.sort_networks);
+
+					// 3. HEAD TAILS
+					m_head(x, y, b).store(fragments_id[0], memory_order_relaxed);
+					if (DOUBLE)
+						m_tail(x, y, b).store(fragments_id[counter - 1], memory_order_relaxed);
+
+					// 4. NEXT
+					for (unsigned int i = 0; i + 1 < counter; i++)
+						m_nodes.setNext(fragments_id[i], fragments_id[i + 1]);
+					m_nodes.setNext(fragments_id[counter - 1], 0u);
+
+					// 5. PREV
+					if (DOUBLE)
+					{
+						for (unsigned int i = counter - 1; i > 0; i--)
+							m_nodes.setPrev(fragments_id[i], fragments_id[i - 1]);
+						m_nodes.setPrev(fragments_id[0], 0u);
+					}
+				}
+		});
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	unsigned int LinkedListABuffer<DOUBLE, LAYOUT>::getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const
+	{
+		unsigned int count = 0;
+		for (unsigned int b = 0; b < m_buckets; ++b)
+			for (unsigned int index = m_head(x, y, b).load(memory_order_relaxed); index != 0u && count < max_depths; index = m_nodes.getNext(index))
+				depths[count++] = m_nodes.getDepth(index);
+		return count;
+	}
+
+	// The buckets span the depths of the segment, front to back, as in ray_hit_a_buffer_search
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	bool LinkedListABuffer<DOUBLE, LAYOUT>::traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const
+	{
+		unsigned int b0 = 0, b1 = m_buckets - 1;
+		if (m_bucketed)
+		{
+			const float depth_near = uintBitsToFloat(m_depth_bounds(x, y, 0).load(memory_order_relaxed));
+			const float depth_far  = uintBitsToFloat(m_depth_bounds(x, y, 1).load(memory_order_relaxed));
+			if (minZ >= -depth_near || maxZ < -depth_far)
+				return false;
+			b0 = getBucket(x, y, -maxZ);
+			b1 = getBucket(x, y, -minZ);
+		}
+
+		for (unsigned int b = b0; b <= b1; ++b)
+			for (unsigned int index = m_head(x, y, b).load(memory_order_relaxed); index != 0u; index = m_nodes.getNext(index))
+			{
+				const float node_depth = m_nodes.getDepth(index);
+				if (node_depth <= minZ)
+					return false;
+				if (node_depth <= maxZ)
+				{
+					depth = node_depth;
+					data  = m_nodes.getData(index);
+					return true;
+				}
+			}
+		return false;
+	}
+
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	size_t LinkedListABuffer<DOUBLE, LAYOUT>::memoryUsage(void) const
+	{
+		return m_head.memoryUsage() + m_tail.memoryUsage() + m_depth_bounds.memoryUsage() + m_depth_buckets.memoryUsage() +
+			sizeof(m_next_address) + m_nodes.memoryUsage();
+	}
+
+	template class LinkedListABuffer<false, FL_AOS>;
+	template class LinkedListABuffer<false, FL_DECOUPLED>;
+	template class LinkedListABuffer<false, FL_SOA>;
+	template class LinkedListABuffer<false, FL_AOSOA8>;
+	template class LinkedListABuffer<true, FL_AOS>;
+	template class LinkedListABuffer<true, FL_DECOUPLED>;
+	template class LinkedListABuffer<true, FL_SOA>;
+	template class LinkedListABuffer<true, FL_AOSOA8>;
+
+	// [SBuffer]
+
+	static inline unsigned int expandBits2D(unsigned int v)
+	{
+		v &= 0x0000FFFFu;
+		v = (v | (v << 8)) & 0x00FF00FFu;
+		v = (v | (v << 4)) & 0x0F0F0F0Fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+	const char* getBucketDistributionName(BucketDistribution distribution)
+	{
+		switch (distribution)
+		{
+		case BUCKETS_UNIFORM:		return "uniform";
+		case BUCKETS_LOGARITHMIC:	return "log";
+		case BUCKETS_EQUALIZED:		return "equalized";
+		}
+		return "unknown";
+	}
+
+	bool parseBucketDistribution(const string& name, BucketDistribution& distribution)
+	{
+		for (int d = BUCKETS_UNIFORM; d <= BUCKETS_EQUALIZED; ++d)
+			if (name == getBucketDistributionName(static_cast<BucketDistribution>(d)))
+			{
+				distribution = static_cast<BucketDistribution>(d);
+				return true;
+			}
+		return false;
+	}
+
+	const char* getCounterLayoutName(SBufferCounterLayout layout)
+	{
+		switch (layout)
+		{
+		case SB_COUNTERS_GLSL:		return "glsl";
+		case SB_COUNTERS_TILED:		return "tiled";
+		case SB_COUNTERS_MORTON:	return "morton";
+		}
+		return "unknown";
+	}
+
+	bool parseCounterLayout(const string& name, SBufferCounterLayout& layout)
+	{
+		for (int l = SB_COUNTERS_GLSL; l <= SB_COUNTERS_MORTON; ++l)
+			if (name == getCounterLayoutName(static_cast<SBufferCounterLayout>(l)))
+			{
+				layout = static_cast<SBufferCounterLayout>(l);
+				return true;
+			}
+		return false;
+	}
+
+	// The tiled layouts split the viewport into the grid of sb_counters tiles, among those
+	// with a whole number of rows and columns, whose tiles are closest to square
+	template<FragmentLayout LAYOUT>
+	void SBuffer<LAYOUT>::layoutCounters(unsigned int width, unsigned int height)
+	{
+		unsigned int tiles_x, tiles_y, tile_width, tile_height;
+		if (m_settings.sb_counter_layout == SB_COUNTERS_GLSL)
+		{
+			tile_width	= COUNTERS_X;
+			tile_height = COUNTERS_Y;
+			tiles_x		= (width + tile_width - 1) / tile_width;
+			tiles_y		= (height + tile_height - 1) / tile_height;
+		}
+		else
+		{
+			const unsigned int counters = max(m_settings.sb_counters, 1u);
+			float best_aspect = FLT_MAX;
+			tiles_x = 1;
+			for (unsigned int columns = 1; columns <= counters; ++columns)
+			{
+				if (counters % columns != 0)
+					continue;
+				const float aspect = fabsf(logf((static_cast<float>(width) / columns) / (static_cast<float>(height) / (counters / columns))));
+				if (aspect < best_aspect)
+				{
+					best_aspect = aspect;
+					tiles_x		= columns;
+				}
+			}
+			tiles_y		= counters / tiles_x;
+			tile_width	= (width + tiles_x - 1) / tiles_x;
+			tile_height = (height + tiles_y - 1) / tiles_y;
+		}
+
+		m_tile_columns.resize(width);
+		for (unsigned int x = 0; x < width; ++x)
+			m_tile_columns[x] = min(x / tile_width, tiles_x - 1);
+		m_tile_rows.resize(height);
+		for (unsigned int y = 0; y < height; ++y)
+			m_tile_rows[y] = min(y / tile_height, tiles_y - 1) * tiles_x;
+
+		m_tile_counters.resize(tiles_x * tiles_y);
+		for (unsigned int ty = 0; ty < tiles_y; ++ty)
+			for (unsigned int tx = 0; tx < tiles_x; ++tx)
+				// New Hash Function from [VPF15]
+				m_tile_counters[ty * tiles_x + tx] = (m_settings.sb_counter_layout == SB_COUNTERS_GLSL) ? tx * COUNTERS_W + ty : ty * tiles_x + tx;
+		if (m_settings.sb_counter_layout == SB_COUNTERS_MORTON)
+		{
+			// number the tiles by their rank along the curve, as the grid need not be square
+			vector<pair<unsigned int, unsigned int> > codes(m_tile_counters.size());
+			for (unsigned int t = 0; t < codes.size(); ++t)
+				codes[t] = make_pair(expandBits2D(t % tiles_x) | (expandBits2D(t / tiles_x) << 1), t);
+			sort(codes.begin(), codes.end());
+			for (unsigned int rank = 0; rank < codes.size(); ++rank)
+				m_tile_counters[codes[rank].second] = rank;
+		}
+
+		// viewports above 1024 x 768 extend the tiles of the GLSL layout past COUNTERS
+		m_counters = (m_settings.sb_counter_layout == SB_COUNTERS_GLSL) ?
+			max(static_cast<unsigned int>(COUNTERS), *max_element(m_tile_counters.begin(), m_tile_counters.end()) + 1u) : tiles_x * tiles_y;
+		m_counter_stride = m_settings.sb_pad_counters ? CACHE_LINE_SIZE / sizeof(atomic<unsigned int>) : 1u;
+		m_head_s.reset(new atomic<unsigned int>[m_counters * m_counter_stride]);
+		m_counter_offsets.resize(m_counters);
+	}
+
+	template<FragmentLayout LAYOUT>
+	unsigned int SBuffer<LAYOUT>::getPixelBase(unsigned int x, unsigned int y) const
+	{
+		// the peel pass leaves the head at the end of the pixel's range
+		const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+		const unsigned int address = m_head(x, y).load(memory_order_relaxed) - counter;
+		return m_counter_offsets[hashFunction(x, y)] + address;
+	}
+
+	// Three passes over tiles of consecutive pixels in row-major order: the fragment counts
+	// of each tile are reduced, the tile sums are scanned, and each tile is scanned again
+	// from its offset, writing the start of every pixel's range to its head
+	template<FragmentLayout LAYOUT>
+	void SBuffer<LAYOUT>::scanPixelRanges(ThreadPool& thread_pool)
+	{
+		const unsigned int num_pixels = m_counter.width() * m_counter.height();
+		const unsigned int num_tiles  = (num_pixels + SCAN_TILE_SIZE - 1) / SCAN_TILE_SIZE;
+		const atomic<unsigned int>* counts = &m_counter(0, 0);
+		atomic<unsigned int>*		heads  = &m_head(0, 0);
+
+		m_tile_sums.resize(num_tiles);
+		thread_pool.run(num_tiles, [&](unsigned int tile, unsigned int)
+		{
+			const unsigned int end = min(num_pixels, (tile + 1) * SCAN_TILE_SIZE);
+			unsigned int sum = 0u;
+			for (unsigned int i = tile * SCAN_TILE_SIZE; i < end; ++i)
+				sum += counts[i].load(memory_order_relaxed);
+			m_tile_sums[tile] = sum;
+		});
+
+		unsigned int offset = 0u;
+		for (unsigned int tile = 0; tile < num_tiles; ++tile)
+		{
+			const unsigned int sum = m_tile_sums[tile];
+			m_tile_sums[tile] = offset;
+			offset += sum;
+		}
+
+		thread_pool.run(num_tiles, [&](unsigned int tile, unsigned int)
+		{
+			const unsigned int end = min(num_pixels, (tile + 1) * SCAN_TILE_SIZE);
+			unsigned int address = m_tile_sums[tile];
+			for (unsigned int i = tile * SCAN_TILE_SIZE; i < end; ++i)
+			{
+				heads[i].store(address, memory_order_relaxed);
+				address += counts[i].load(memory_order_relaxed);
+			}
+		});
+	}
+
+	template<FragmentLayout LAYOUT>
+	void SBuffer<LAYOUT>::build(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, ThreadPool& thread_pool)
+	{
+		const unsigned int width  = rasterizer.width();
+		const unsigned int height = rasterizer.height();
+
+		if (m_tile_columns.size() != width || m_tile_rows.size() != height)
+			layoutCounters(width, height);
+		for (unsigned int id = 0; id < m_counters; ++id)
+			m_head_s[id * m_counter_stride].store(0u, memory_order_relaxed);
+
+		m_counter.resize(width, height, 1);
+		m_counter.clear(0u, thread_pool);
+		m_head.resize(width, height, 1);
+		m_head.clear(0u, thread_pool);
+
+		// [Accumulate]
+		atomic<unsigned int> total_counter(0u);
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float, unsigned int)
+		{
+			total_counter.fetch_add(1u, memory_order_relaxed);
+			m_counter(x, y).fetch_add(1u, memory_order_relaxed);
+		});
+
+		const double prefix_sum_start = currentTime();
+		if (m_settings.scan_prefix_sum)
+			scanPixelRanges(thread_pool);
+		else
+		{
+			// [PrefixSum] each pixel reserves its range within its counter
+			thread_pool.run(height, [&](unsigned int y, unsigned int)
+			{
+				for (unsigned int x = 0; x < width; ++x)
+				{
+					const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+					if (counter == 0u)
+						continue;
+					const unsigned int address = m_head_s[hashFunction(x, y) * m_counter_stride].fetch_add(counter, memory_order_relaxed);
+					m_head(x, y).store(address, memory_order_relaxed);
+				}
+			});
+		}
+
+		// [ComputeMap] exclusive prefix sum of the counters, all 0 after a scan
+		unsigned int sum = 0u;
+		for (unsigned int id = 0; id < m_counters; ++id)
+		{
+			m_counter_offsets[id] = sum;
+			sum += m_head_s[id * m_counter_stride].load(memory_order_relaxed);
+		}
+		m_prefix_sum_time = currentTime() - prefix_sum_start;
+
+		// the node buffer only grows, as a GL buffer reallocated on demand
+		const unsigned int total = total_counter.load();
+		if (m_nodes.size() < total)
+			m_nodes.resize(total);
+
+		// [Peel]
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int prim)
+		{
+			const unsigned int page_id = m_head(x, y).fetch_add(1u, memory_order_relaxed);
+			const unsigned int index   = m_counter_offsets[hashFunction(x, y)] + page_id;
+
+			m_nodes.setDepth(index, pecsZ);
+			m_nodes.setIndex(index, index);
+			m_nodes.setData(index, attributes[prim]);
+		});
+
+		m_fragment_count = total;
+		m_dropped_count	 = 0;
+	}
+
+	template<FragmentLayout LAYOUT>
+	void SBuffer<LAYOUT>::resolveRadix(ThreadPool& thread_pool)
+	{
+		const unsigned int width  = m_head.width();
+		const unsigned int height = m_head.height();
+		m_radix_sort.reset(static_cast<unsigned int>(m_fragment_count), width * height);
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+				const unsigned int base	   = (counter != 0u) ? getPixelBase(x, y) : 0u;
+				for (unsigned int page_id = base; page_id < base + counter; ++page_id)
+					m_radix_sort.setFragment(page_id, y * width + x, m_nodes.getDepth(page_id));
+			}
+		});
+		m_radix_sort.sort(thread_pool);
+
+		// the front-most fragment goes to the last address of the range, as in resolve
+		const unsigned int* order = m_radix_sort.getOrder();
+		m_resolved_nodes.resize(m_nodes.size());
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+				if (counter == 0u)
+					continue;
+				const unsigned int init_page_id = getPixelBase(x, y) + counter - 1u;
+				const unsigned int span_start	= m_radix_sort.getSpanStart(y * width + x);
+				for (unsigned int i = 0; i < counter; i++)
+				{
+					// the decoupled IDs move, pointing to their attributes, as in resolve
+					const unsigned int page_id = init_page_id - i, fragment = order[span_start + i];
+					if (Storage::INDEXED)
+					{
+						m_resolved_nodes.setDepth(page_id, m_nodes.getDepth(fragment));
+						m_resolved_nodes.setIndex(page_id, m_nodes.getIndex(fragment));
+						m_resolved_nodes.setData(page_id, m_nodes.getData(page_id));
+					}
+					else
+						m_resolved_nodes.copy(page_id, m_nodes, fragment);
+				}
+			}
+		});
+		m_nodes.swap(m_resolved_nodes);
+	}
+
+	template<FragmentLayout LAYOUT>
+	void SBuffer<LAYOUT>::resolve(ThreadPool& thread_pool)
+	{
+		if (m_settings.radix_resolve)
+		{
+			resolveRadix(thread_pool);
+			return;
+		}
+
+		const unsigned int width	  = m_head.width();
+		const unsigned int max_layers = max(m_settings.max_layers, 1u);
+		thread_pool.run(m_head.height(), [&](unsigned int y, unsigned int)
+		{
+			vector<unsigned int> fragments_id(max_layers);
+			vector<float>		 fragments_depth(max_layers);
+			vector<NodeTypeData> fragments(Storage::INDEXED ? 0 : max_layers);
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				// fragments past max_layers are left unsorted at the start of the range
+				const unsigned int counter = min(m_counter(x, y).load(memory_order_relaxed), max_layers);
+				if (counter == 0u)
+					continue;
+
+				// 1. LOAD, from the last address of the pixel backwards
+				const unsigned int init_page_id = getPixelBase(x, y) + m_counter(x, y).load(memory_order_relaxed) - 1u;
+				unsigned int page_id = init_page_id;
+				for (unsigned int i = 0; i < counter; i++, page_id--)
+				{
+					fragments_id[i]	   = page_id;
+					fragments_depth[i] = m_nodes.getDepth(page_id);
+				}
+
+				// 2. SORT
+				sortFragments(&fragments_id[0], &fragments_depth[0], static_cast<int>(counter), static_cast<int>(m_settings.insert_vs_shell), m_settings.sort_networks);
+
+				// 3. DATA POINTERS: the decoupled IDs point to the attributes, which stay in
+				// place, while whole nodes are moved otherwise
+				page_id = init_page_id;
+				if (Storage::INDEXED)
+				{
+					for (unsigned int i = 0; i < counter; i++, page_id--)
+					{
+						m_nodes.setIndex(page_id, fragments_id[i]);
+						m_nodes.setDepth(page_id, fragments_depth[i]);
+					}
+				}
+				else
+				{
+					for (unsigned int i = 0; i < counter; i++)
+						fragments[i] = m_nodes.getData(fragments_id[i]);
+					for (unsigned int i = 0; i < counter; i++, page_id--)
+					{
+						m_nodes.setDepth(page_id, fragments_depth[i]);
+						m_nodes.setData(page_id, fragments[i]);
+					}
+				}
+			}
+		});
+	}
+
+	template<FragmentLayout LAYOUT>
+	unsigned int SBuffer<LAYOUT>::getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const
+	{
+		const unsigned int counter = min(m_counter(x, y).load(memory_order_relaxed), max_depths);
+		if (counter == 0u)
+			return 0;
+		unsigned int page_id = getPixelBase(x, y) + m_counter(x, y).load(memory_order_relaxed) - 1u;
+		for (unsigned int i = 0; i < counter; i++, page_id--)
+			depths[i] = m_nodes.getDepth(page_id);
+		return counter;
+	}
+
+	// From the front-most fragment at the end of the range, through the sorted ones
+	template<FragmentLayout LAYOUT>
+	bool SBuffer<LAYOUT>::traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const
+	{
+		const unsigned int counter = min(m_counter(x, y).load(memory_order_relaxed), max(m_settings.max_layers, 1u));
+		if (counter == 0u)
+			return false;
+		unsigned int page_id = getPixelBase(x, y) + m_counter(x, y).load(memory_order_relaxed) - 1u;
+		for (unsigned int i = 0; i < counter; i++, page_id--)
+		{
+			const float node_depth = m_nodes.getDepth(page_id);
+			if (node_depth <= minZ)
+				return false;
+			if (node_depth <= maxZ)
+			{
+				depth = node_depth;
+				data  = m_nodes.getData(m_nodes.getIndex(page_id));
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<FragmentLayout LAYOUT>
+	size_t SBuffer<LAYOUT>::memoryUsage(void) const
+	{
+		return m_counter.memoryUsage() + m_head.memoryUsage() + (m_counter_stride + 1) * m_counters * sizeof(unsigned int) +
+			   (m_tile_columns.size() + m_tile_rows.size() + m_tile_counters.size()) * sizeof(unsigned int) +
+			   m_nodes.memoryUsage() + m_radix_sort.memoryUsage() + m_resolved_nodes.memoryUsage();
+	}
+
+	template class SBuffer<FL_AOS>;
+	template class SBuffer<FL_DECOUPLED>;
+	template class SBuffer<FL_SOA>;
+	template class SBuffer<FL_AOSOA8>;
+
+	// [KBuffer]
+
+	template<FragmentLayout LAYOUT>
+	void KBuffer<LAYOUT>::build(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, ThreadPool& thread_pool)
+	{
+		const unsigned int width  = rasterizer.width();
+		const unsigned int height = rasterizer.height();
+
+		m_counter.resize(width, height, 1);
+		m_counter.clear(0u, thread_pool);
+		m_semaphore.resize(width, height, 1);
+		m_semaphore.clear(0u, thread_pool);
+
+		// the fixed budget of k nodes per pixel
+		const size_t num_nodes = static_cast<size_t>(width) * height * m_k;
+		if (m_nodes.size() != num_nodes)
+			m_nodes.resize(num_nodes);
+
+		// [Peel]
+		atomic<unsigned long long> total_counter(0u), dropped_counter(0u);
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int prim)
+		{
+			total_counter.fetch_add(1u, memory_order_relaxed);
+			const unsigned int base = getPixelBase(x, y);
+
+			// critical section of the pixel, as the spin-lock k+-buffer
+			atomic<unsigned int>& semaphore = m_semaphore(x, y);
+			while (semaphore.exchange(1u, memory_order_acquire) != 0u)
+				;
+
+			const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+			unsigned int index = base + counter;
+			if (counter < m_k)
+				m_counter(x, y).store(counter + 1u, memory_order_relaxed);
+			else
+			{
+				// max-array: the farthest fragment, of the lowest pecsZ, is replaced
+				index = base;
+				for (unsigned int i = base + 1u; i < base + m_k; ++i)
+					if (m_nodes.getDepth(i) < m_nodes.getDepth(index))
+						index = i;
+				dropped_counter.fetch_add(1u, memory_order_relaxed);
+				if (pecsZ <= m_nodes.getDepth(index))
+					index = ~0u;
+			}
+
+			if (index != ~0u)
+			{
+				m_nodes.setDepth(index, pecsZ);
+				m_nodes.setIndex(index, index);
+				m_nodes.setData(index, attributes[prim]);
+			}
+			semaphore.store(0u, memory_order_release);
+		});
+
+		m_dropped_count	 = dropped_counter.load();
+		m_fragment_count = total_counter.load() - m_dropped_count;
+	}
+
+	template<FragmentLayout LAYOUT>
+	void KBuffer<LAYOUT>::resolve(ThreadPool& thread_pool)
+	{
+		const unsigned int width = m_counter.width();
+		thread_pool.run(m_counter.height(), [&](unsigned int y, unsigned int)
+		{
+			vector<unsigned int> fragments_id(m_k);
+			vector<float>		 fragments_depth(m_k);
+			vector<NodeTypeData> fragments(m_k);
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+				if (counter == 0u)
+					continue;
+
+				// 1. LOAD
+				const unsigned int base = getPixelBase(x, y);
+				for (unsigned int i = 0; i < counter; i++)
+				{
+					fragments_id[i]	   = base + i;
+					fragments_depth[i] = m_nodes.getDepth(base + i);
+				}
+
+				// 2. SORT
+				sortFragments(&fragments_id[0], &fragments_depth[0], static_cast<int>(counter), static_cast<int>(m_settings.insert_vs_shell), m_settings.sort_networks);
+
+				// 3. STORE front to back from the first slot; the decoupled IDs point to the
+				// attributes, which stay in place
+				if (Storage::INDEXED)
+				{
+					for (unsigned int i = 0; i < counter; i++)
+						fragments_id[i] = m_nodes.getIndex(fragments_id[i]);
+					for (unsigned int i = 0; i < counter; i++)
+					{
+						m_nodes.setDepth(base + i, fragments_depth[i]);
+						m_nodes.setIndex(base + i, fragments_id[i]);
+					}
+				}
+				else
+				{
+					for (unsigned int i = 0; i < counter; i++)
+						fragments[i] = m_nodes.getData(fragments_id[i]);
+					for (unsigned int i = 0; i < counter; i++)
+					{
+						m_nodes.setDepth(base + i, fragments_depth[i]);
+						m_nodes.setData(base + i, fragments[i]);
+					}
+				}
+			}
+		});
+	}
+
+	template<FragmentLayout LAYOUT>
+	unsigned int KBuffer<LAYOUT>::getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const
+	{
+		const unsigned int counter = min(m_counter(x, y).load(memory_order_relaxed), max_depths);
+		const unsigned int base	   = getPixelBase(x, y);
+		for (unsigned int i = 0; i < counter; i++)
+			depths[i] = m_nodes.getDepth(base + i);
+		return counter;
+	}
+
+	template<FragmentLayout LAYOUT>
+	bool KBuffer<LAYOUT>::traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const
+	{
+		const unsigned int counter = m_counter(x, y).load(memory_order_relaxed);
+		const unsigned int base	   = getPixelBase(x, y);
+		for (unsigned int i = 0; i < counter; i++)
+		{
+			const float node_depth = m_nodes.getDepth(base + i);
+			if (node_depth <= minZ)
+				return false;
+			if (node_depth <= maxZ)
+			{
+				depth = node_depth;
+				data  = m_nodes.getData(m_nodes.getIndex(base + i));
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<FragmentLayout LAYOUT>
+	size_t KBuffer<LAYOUT>::memoryUsage(void) const
+	{
+		return m_counter.memoryUsage() + m_semaphore.memoryUsage() + m_nodes.memoryUsage();
+	}
+
+	template class KBuffer<FL_AOS>;
+	template class KBuffer<FL_DECOUPLED>;
+	template class KBuffer<FL_SOA>;
+	template class KBuffer<FL_AOSOA8>;
+
+	// [PackedABuffer]
+
+	unsigned int PackedABuffer::encodeNormal(unsigned int spheremap)
+	{
+		const float3 n = decodeSpheremapNormal(spheremap);
+		const float	 l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		float2 oct = make_float2(n.x / l1, n.y / l1);
+		if (n.z < 0.0f)
+			oct = make_float2((1.0f - fabsf(oct.y)) * signNotZero(oct.x), (1.0f - fabsf(oct.x)) * signNotZero(oct.y));
+		return packUnorm(oct.x * 0.5f + 0.5f, 255.0f) | (packUnorm(oct.y * 0.5f + 0.5f, 255.0f) << 8);
+	}
+
+	float3 PackedABuffer::decodeNormal(unsigned int octahedral)
+	{
+		const float2 oct = make_float2(unpackUnorm(octahedral & 0xFFu, 255.0f) * 2.0f - 1.0f, unpackUnorm((octahedral >> 8) & 0xFFu, 255.0f) * 2.0f - 1.0f);
+		float3 n = make_float3(oct.x, oct.y, 1.0f - fabsf(oct.x) - fabsf(oct.y));
+		const float t = fmaxf(-n.z, 0.0f);
+		n.x += (n.x >= 0.0f) ? -t : t;
+		n.y += (n.y >= 0.0f) ? -t : t;
+		return normalize(n);
+	}
+
+	void PackedABuffer::build(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, ThreadPool& thread_pool)
+	{
+		const unsigned int width   = rasterizer.width();
+		const unsigned int height  = rasterizer.height();
+		const unsigned int tiles_x = (width + PACKED_TILE_SIZE - 1) / PACKED_TILE_SIZE;
+		const unsigned int tiles_y = (height + PACKED_TILE_SIZE - 1) / PACKED_TILE_SIZE;
+
+		m_head.resize(width, height, 1);
+		m_head.clear(0u, thread_pool);
+		if (m_num_tiles != tiles_x * tiles_y)
+		{
+			m_num_tiles = tiles_x * tiles_y;
+			m_tile_next.reset(new atomic<unsigned int>[m_num_tiles]);
+		}
+		for (unsigned int t = 0; t < m_num_tiles; ++t)
+			m_tile_next[t].store(0u, memory_order_relaxed);
+
+		// the node words of every primitive but depth and next
+		m_attributes.resize(attributes.size());
+		thread_pool.run(static_cast<unsigned int>((attributes.size() + 4095) / 4096), [&](unsigned int batch, unsigned int)
+		{
+			const size_t end = min(attributes.size(), static_cast<size_t>(batch + 1) * 4096);
+			for (size_t prim = static_cast<size_t>(batch) * 4096; prim < end; ++prim)
+			{
+				const NodeTypeData& data = attributes[prim];
+				m_attributes[prim].normal	= encodeNormal(data.normal);
+				m_attributes[prim].specular = (data.specular >> 8) & 0xFFu;
+				// the opacity of ior_opacity.y in the alpha of the albedo
+				m_attributes[prim].albedo_opacity = (data.albedo & 0x00FFFFFFu) | (((data.ior_opacity >> 8) & 0xFFu) << 24);
+			}
+		});
+
+		// [DepthBoundsCompute], counting the fragments of every tile
+		m_depth_bounds.resize(width, height, 2);
+		m_depth_bounds.clearLayer(0, 0xFFFFFFFFu, thread_pool);
+		m_depth_bounds.clearLayer(1, 0u, thread_pool);
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int)
+		{
+			const unsigned int Z = floatBitsToUint(-pecsZ);
+			m_tile_next[(y / PACKED_TILE_SIZE) * tiles_x + x / PACKED_TILE_SIZE].fetch_add(1u, memory_order_relaxed);
+			m_depth_bounds.atomicMin(x, y, 0, Z);
+			m_depth_bounds.atomicMax(x, y, 1, Z);
+		});
+
+		// the range of every tile, after the null node
+		unsigned int total = 1;
+		for (unsigned int t = 0; t < m_num_tiles; ++t)
+		{
+			const unsigned int count = m_tile_next[t].load(memory_order_relaxed);
+			if (count > MAX_TILE_FRAGMENTS)
+				throw runtime_error("AB_LL_Packed: a tile holds more fragments than the 24-bit next offsets reach");
+			m_tile_next[t].store(total, memory_order_relaxed);
+			total += count;
+		}
+		if (total > m_nodes.size() || 2u * total < m_nodes.size())
+		{
+			m_nodes.resize(total);
+			m_albedo.resize(total);
+			m_nodes.shrink_to_fit();
+			m_albedo.shrink_to_fit();
+		}
+
+		// [Peel]
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int prim)
+		{
+			const unsigned int index = m_tile_next[(y / PACKED_TILE_SIZE) * tiles_x + x / PACKED_TILE_SIZE].fetch_add(1u, memory_order_relaxed);
+
+			const float depth_near = uintBitsToFloat(m_depth_bounds(x, y, 0).load(memory_order_relaxed));
+			const float depth_far  = uintBitsToFloat(m_depth_bounds(x, y, 1).load(memory_order_relaxed));
+			// fmaxf maps the NaN of a single-depth pixel to 0
+			const unsigned int depth = packUnorm((-pecsZ - depth_near) / (depth_far - depth_near), 65535.0f);
+
+			const unsigned int next	  = m_head(x, y).exchange(index, memory_order_relaxed);
+			const unsigned int offset = next ? next - index : 0u;
+			const PackedAttributes& data = m_attributes[prim];
+			m_nodes[index].depth_normal	 = (depth << 16) | data.normal;
+			m_nodes[index].next_specular = (offset << 8) | data.specular;
+			m_albedo[index] = data.albedo_opacity;
+		});
+
+		m_fragment_count = total - 1u;
+		m_dropped_count	 = 0;
+	}
+
+	void PackedABuffer::resolve(ThreadPool& thread_pool)
+	{
+		const unsigned int width	  = m_head.width();
+		const unsigned int max_layers = max(m_settings.max_layers, 1u);
+		thread_pool.run(m_head.height(), [&](unsigned int y, unsigned int)
+		{
+			vector<unsigned int> fragments_id(max_layers);
+			vector<float>		 fragments_depth(max_layers);
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				unsigned int index = m_head(x, y).load(memory_order_relaxed);
+				if (index == 0u)
+					continue;
+
+				// 1. LOAD, the quantized depths negated to sort them as pecsZ
+				unsigned int counter = 0;
+				while (index != 0u && counter < max_layers)
+				{
+					fragments_id[counter]	 = index;
+					fragments_depth[counter] = -static_cast<float>(m_nodes[index].depth_normal >> 16);
+					index = getNext(index);
+					counter++;
+				}
+
+				// 2. SORT
+				sortFragments(&fragments_id[0], &fragments_depth[0], static_cast<int>(counter), static_cast<int>(m_settings.insert_vs_shell), m_settings.sort_networks);
+
+				// 3. HEAD
+				m_head(x, y).store(fragments_id[0], memory_order_relaxed);
+
+				// 4. NEXT
+				for (unsigned int i = 0; i < counter; i++)
+				{
+					const unsigned int offset = (i + 1 < counter) ? fragments_id[i + 1] - fragments_id[i] : 0u;
+					m_nodes[fragments_id[i]].next_specular = (offset << 8) | (m_nodes[fragments_id[i]].next_specular & 0xFFu);
+				}
+			}
+		});
+	}
+
+	float PackedABuffer::getNodeDepth(unsigned int x, unsigned int y, unsigned int index) const
+	{
+		const float depth_near = uintBitsToFloat(m_depth_bounds(x, y, 0).load(memory_order_relaxed));
+		const float depth_far  = uintBitsToFloat(m_depth_bounds(x, y, 1).load(memory_order_relaxed));
+		return -(depth_near + (depth_far - depth_near) * unpackUnorm(m_nodes[index].depth_normal >> 16, 65535.0f));
+	}
+
+	NodeTypeData PackedABuffer::getNodeData(unsigned int index) const
+	{
+		const unsigned int albedo_opacity = m_albedo[index];
+		NodeTypeData data;
+		data.albedo		 = albedo_opacity & 0x00FFFFFFu;
+		// normal_encode_spheremap1
+		const float3 n = decodeNormal(m_nodes[index].depth_normal & 0xFFFFu);
+		const float	 f = sqrtf(8.0f * n.z + 8.0f);
+		data.normal		 = packUnorm2x16((f > 0.0f) ? make_float2(n.x / f + 0.5f, n.y / f + 0.5f) : make_float2(0.5f, 0.5f));
+		data.specular	 = ((m_nodes[index].next_specular & 0xFFu) << 8) | 0xFF000000u;
+		// the index of refraction computeFragmentAttributes writes to every fragment
+		data.ior_opacity = packUnorm(0.1f, 255.0f) | ((albedo_opacity >> 24) << 8);
+		return data;
+	}
+
+	unsigned int PackedABuffer::getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const
+	{
+		unsigned int count = 0;
+		for (unsigned int index = m_head(x, y).load(memory_order_relaxed); index != 0u && count < max_depths; index = getNext(index))
+			depths[count++] = getNodeDepth(x, y, index);
+		return count;
+	}
+
+	bool PackedABuffer::traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const
+	{
+		for (unsigned int index = m_head(x, y).load(memory_order_relaxed); index != 0u; index = getNext(index))
+		{
+			const float node_depth = getNodeDepth(x, y, index);
+			if (node_depth <= minZ)
+				return false;
+			if (node_depth <= maxZ)
+			{
+				depth = node_depth;
+				data  = getNodeData(index);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t PackedABuffer::memoryUsage(void) const
+	{
+		return m_head.memoryUsage() + m_depth_bounds.memoryUsage() + m_num_tiles * sizeof(unsigned int) +
+			   m_nodes.size() * sizeof(NodeTypePacked) + m_albedo.size() * sizeof(unsigned int) + m_attributes.size() * sizeof(PackedAttributes);
+	}
+
+	// [Factory]
+
+	const char* const ABUFFER_METHODS[] =
+	{
+		"AB_LL",			"AB_LL_BUN",			"AB_LLD",			"AB_LLD_BUN",			"AB_SB",
+		"AB_LL_Decoupled",	"AB_LL_BUN_Decoupled",	"AB_LLD_Decoupled",	"AB_LLD_BUN_Decoupled",	"AB_SB_Decoupled",
+		"AB_KB",			"AB_KB_Decoupled",		"AB_LL_Packed"
+	};
+	const unsigned int NUM_ABUFFER_METHODS = sizeof(ABUFFER_METHODS) / sizeof(ABUFFER_METHODS[0]);
+
+	const char* const ABUFFER_BASE_METHODS[] = { "AB_LL", "AB_LL_BUN", "AB_LLD", "AB_LLD_BUN", "AB_SB", "AB_KB" };
+	const unsigned int NUM_ABUFFER_BASE_METHODS = sizeof(ABUFFER_BASE_METHODS) / sizeof(ABUFFER_BASE_METHODS[0]);
+
+	const char* getFragmentLayoutSuffix(FragmentLayout layout)
+	{
+		switch (layout)
+		{
+		case FL_AOS:		return "";
+		case FL_DECOUPLED:	return "_Decoupled";
+		case FL_SOA:		return "_SoA";
+		case FL_AOSOA8:		return "_AoSoA8";
+		}
+		return "";
+	}
+
+	template<FragmentLayout LAYOUT>
+	static ABuffer* createABuffer(const string& base, const ABufferSettings& settings)
+	{
+		if		(base == "AB_LL")		return new LinkedListABuffer<false, LAYOUT>(settings, false);
+		else if (base == "AB_LL_BUN")	return new LinkedListABuffer<false, LAYOUT>(settings, true);
+		else if (base == "AB_LLD")		return new LinkedListABuffer<true, LAYOUT>(settings, false);
+		else if (base == "AB_LLD_BUN")	return new LinkedListABuffer<true, LAYOUT>(settings, true);
+		else if (base == "AB_SB")		return new SBuffer<LAYOUT>(settings);
+		else if (base == "AB_KB")		return new KBuffer<LAYOUT>(settings);
+		return 0;
+	}
+
+	unique_ptr<ABuffer> createABuffer(const string& method, const ABufferSettings& settings)
+	{
+		ABuffer* abuffer = 0;
+		if (method == "AB_LL_Packed")
+			abuffer = new PackedABuffer(settings);
+		for (int layout = FL_AOSOA8; layout >= FL_AOS && !abuffer; --layout)
+		{
+			const string suffix = getFragmentLayoutSuffix(static_cast<FragmentLayout>(layout));
+			if (method.size() < suffix.size() || method.compare(method.size() - suffix.size(), suffix.size(), suffix) != 0)
+				continue;
+			const string base = method.substr(0, method.size() - suffix.size());
+			switch (layout)
+			{
+			case FL_AOS:		abuffer = createABuffer<FL_AOS>(base, settings); break;
+			case FL_DECOUPLED:	abuffer = createABuffer<FL_DECOUPLED>(base, settings); break;
+			case FL_SOA:		abuffer = createABuffer<FL_SOA>(base, settings); break;
+			case FL_AOSOA8:		abuffer = createABuffer<FL_AOSOA8>(base, settings); break;
+			}
+		}
+		if (!abuffer)
+			throw invalid_argument("Unknown A-buffer method '" + method + "'");
+		return unique_ptr<ABuffer>(abuffer);
+	}
+
+	void computeFragmentAttributes(const TriangleMesh& mesh, const RasterCamera& camera, vector<NodeTypeData>& attributes)
+	{
+		const float3 axis_x = normalize(camera.U);
+		const float3 axis_y = normalize(camera.V);
+		const float3 axis_z = -normalize(camera.W);
+
+		attributes.resize(mesh.size());
+		for (unsigned int prim = 0; prim < mesh.size(); ++prim)
+		{
+			const int3	 v_idx = mesh.vindex_buffer[prim];
+			const float3 p0 = mesh.vertex_buffer[v_idx.x], p1 = mesh.vertex_buffer[v_idx.y], p2 = mesh.vertex_buffer[v_idx.z];
+			float3 n = cross(p1 - p0, p2 - p0);
+			n = (dot(n, n) > 0.0f) ? normalize(n) : make_float3(0.0f, 0.0f, 1.0f);
+
+			// the normal faces the camera, in eye space
+			float3 Necs = make_float3(dot(n, axis_x), dot(n, axis_y), dot(n, axis_z));
+			if (dot(p0 - camera.eye, n) > 0.0f)
+				Necs = -Necs;
+			const float f = sqrtf(8.0f * Necs.z + 8.0f);
+			const float2 out_normal = (f > 0.0f) ? make_float2(Necs.x / f + 0.5f, Necs.y / f + 0.5f) : make_float2(0.5f, 0.5f);
+
+			float4 albedo = make_float4(1.0f);
+			float  phong_exp = 0.0f;
+			if (prim < mesh.material_buffer.size() && mesh.material_buffer[prim] < mesh.materials.size())
+			{
+				const ObjMaterial& material = mesh.materials[mesh.material_buffer[prim]];
+				float2 uv = make_float2(0.0f, 0.0f);
+				const int3 t_idx = (prim < mesh.tindex_buffer.size()) ? mesh.tindex_buffer[prim] : make_int3(-1, -1, -1);
+				if (!mesh.texcoord_buffer.empty() && t_idx.x >= 0 && t_idx.y >= 0 && t_idx.z >= 0)
+					uv = (mesh.texcoord_buffer[t_idx.x] + mesh.texcoord_buffer[t_idx.y] + mesh.texcoord_buffer[t_idx.z]) / 3.0f;
+				albedo	  = tex2D(material.diffuse_map, uv.x, uv.y);
+				phong_exp = material.phong_exp;
+			}
+
+			NodeTypeData& data = attributes[prim];
+			data.albedo		 = packUnorm4x8(make_float4(make_float3(albedo), 0.0f));
+			data.normal		 = packUnorm2x16(out_normal);
+			data.specular	 = packUnorm4x8(make_float4(0.0f, fminf(phong_exp / 128.0f, 1.0f), 0.0f, 1.0f));
+			data.ior_opacity = packUnorm4x8(make_float4(0.1f, albedo.w, 0.0f, 0.0f));
+		}
+	}
+
+	float3 decodeSpheremapNormal(unsigned int normal)
+	{
+		const float2 fenc = make_float2(unpackUnorm(normal & 0xFFFFu, 65535.0f) * 4.0f - 2.0f, unpackUnorm(normal >> 16, 65535.0f) * 4.0f - 2.0f);
+		const float	 f = fenc.x * fenc.x + fenc.y * fenc.y;
+		const float	 g = sqrtf(fmaxf(1.0f - f / 4.0f, 0.0f));
+		return make_float3(fenc.x * g, fenc.y * g, 1.0f - f / 2.0f);
+	}
+
+	float4 unpackUnorm4x8(unsigned int bits)
+	{
+		return make_float4(unpackUnorm(bits & 0xFFu, 255.0f), unpackUnorm((bits >> 8) & 0xFFu, 255.0f), unpackUnorm((bits >> 16) & 0xFFu, 255.0f), unpackUnorm(bits >> 24, 255.0f));
+	}
+}
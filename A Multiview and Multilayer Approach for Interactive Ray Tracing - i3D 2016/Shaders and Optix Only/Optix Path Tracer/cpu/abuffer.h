@@ -0,0 +1,413 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Multifragment engine of the CPU backend: the A-buffer variants of GLSL/A-Buffer Shaders,
+// built from the fragments of the software rasterizer with the same passes and atomics
+
+#pragma once
+
+#include "fragment_sort.h"
+#include "fragment_storage.h"
+#include "rasterizer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// Packed Version
+	// ID node of AB_LL_Packed, 8 bytes: the depth quantized to 16 bits between the depth
+	// bounds of its pixel above the octahedral normal, 8 bits per axis, and the signed
+	// offset of the next node, 0 for none, above the Phong exponent of specular.y. The
+	// albedo and opacity of node i are the unorm 8-bit word i of a separate buffer.
+	struct NodeTypePacked
+	{
+		unsigned int	depth_normal;
+		unsigned int	next_specular;
+	};
+
+	// The GLSL bit casts, for the depths kept in r32ui images
+	inline unsigned int floatBitsToUint(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline float uintBitsToFloat(unsigned int bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// r32ui uimage2DArray with the GLSL image atomics. Layers are stored one after the other.
+	class AtomicImage
+	{
+	public:
+		AtomicImage() : m_width(0), m_height(0), m_layers(0) {}
+
+		// Reallocates when the size changes; the texels are undefined until cleared
+		void	resize(unsigned int width, unsigned int height, unsigned int layers);
+		void	clear(unsigned int value, ThreadPool& thread_pool);
+		void	clearLayer(unsigned int layer, unsigned int value, ThreadPool& thread_pool);
+
+		std::atomic<unsigned int>&			operator()(unsigned int x, unsigned int y, unsigned int layer = 0)		 { return m_texels[(static_cast<size_t>(layer) * m_height + y) * m_width + x]; }
+		const std::atomic<unsigned int>&	operator()(unsigned int x, unsigned int y, unsigned int layer = 0) const { return m_texels[(static_cast<size_t>(layer) * m_height + y) * m_width + x]; }
+
+		// imageAtomicMin/imageAtomicMax; return the previous value
+		unsigned int	atomicMin(unsigned int x, unsigned int y, unsigned int layer, unsigned int value);
+		unsigned int	atomicMax(unsigned int x, unsigned int y, unsigned int layer, unsigned int value);
+
+		unsigned int	width(void) const  { return m_width; }
+		unsigned int	height(void) const { return m_height; }
+		unsigned int	layers(void) const { return m_layers; }
+		size_t			memoryUsage(void) const { return static_cast<size_t>(m_width) * m_height * m_layers * sizeof(unsigned int); }
+
+	private:
+		unsigned int	m_width;
+		unsigned int	m_height;
+		unsigned int	m_layers;
+		std::unique_ptr<std::atomic<unsigned int>[]>	m_texels;
+	};
+
+	// Depth ranges of the buckets of a pixel, between the nearest and farthest fragment
+	enum BucketDistribution
+	{
+		BUCKETS_UNIFORM = 0,		// MMRT_Store and the _BUN variants: equal ranges
+		BUCKETS_LOGARITHMIC,		// ranges growing geometrically with the distance, as perspective spreads the fragments
+		BUCKETS_EQUALIZED			// equal fragment counts, from a histogram counted by a pass before peeling
+	};
+
+	const char*	getBucketDistributionName(BucketDistribution distribution);
+	// "uniform", "log" or "equalized"; returns false for unknown names
+	bool		parseBucketDistribution(const std::string& name, BucketDistribution& distribution);
+
+	// Bucket of a fragment within the depth bounds of its pixel, the floatBitsToUint of the
+	// minimum and maximum eye-space distance in layers 0 and 1, as the _BUN variants and
+	// the depth-complexity telemetry split them. For BUCKETS_EQUALIZED, equalize counts the
+	// fragments of every pixel in HISTOGRAM_BINS uniform bins per bucket, and the boundaries
+	// between the buckets are placed where the cumulative count crosses each multiple of a
+	// bucket's share, interpolating within the bins.
+	class DepthBuckets
+	{
+	public:
+		DepthBuckets(BucketDistribution distribution, unsigned int buckets) : m_distribution(distribution), m_buckets(std::max(buckets, 1u)) {}
+
+		// The pass between the depth bounds and the bucket lookups; nothing to do but for
+		// BUCKETS_EQUALIZED with more than one bucket
+		void	equalize(const Rasterizer& rasterizer, const AtomicImage& depth_bounds, ThreadPool& thread_pool);
+		unsigned int	getBucket(const AtomicImage& depth_bounds, unsigned int x, unsigned int y, float Z) const;
+
+		unsigned int	buckets(void) const		{ return m_buckets; }
+		size_t			memoryUsage(void) const { return m_bounds.size() * sizeof(float) + m_histogram.memoryUsage(); }
+
+	private:
+		// Histogram bins per bucket of BUCKETS_EQUALIZED, and their 16-bit counters packed
+		// in pairs
+		enum { HISTOGRAM_BINS = 4 };
+
+		BucketDistribution	m_distribution;
+		unsigned int		m_buckets;
+		// the distances between consecutive buckets, buckets - 1 per pixel side by side,
+		// and the histogram they come from
+		std::vector<float>	m_bounds;
+		AtomicImage			m_histogram;
+	};
+
+	// Screen tiles of the S-buffer counters (hashFunction)
+	enum SBufferCounterLayout
+	{
+		SB_COUNTERS_GLSL = 0,		// s-buffer.h: 256 x 192 tiles, column-major, 4 per column, extended past COUNTERS as needed
+		SB_COUNTERS_TILED,			// a grid of sb_counters tiles shaped after the viewport, row-major
+		SB_COUNTERS_MORTON			// the same grid, numbered along a Morton curve
+	};
+
+	const char*	getCounterLayoutName(SBufferCounterLayout layout);
+	// "glsl", "tiled" or "morton"; returns false for unknown names
+	bool		parseCounterLayout(const std::string& name, SBufferCounterLayout& layout);
+
+	// The A-buffer attributes of the demo .scene files and the shader defines they set
+	struct ABufferSettings
+	{
+		unsigned int	buckets;				// BUCKET_SIZE, depth subdivisions per pixel of the _BUN variants
+		BucketDistribution	bucket_distribution;	// of the depths over the buckets, uniform in the shaders
+		unsigned int	max_layers;				// ABUFFER_GLOBAL_SIZE, fragments sorted per pixel, or per bucket
+		unsigned int	insert_vs_shell;		// INSERT_VS_SHELL, largest fragment count sorted by insertion
+		unsigned int	prealloc_fragments;		// nodes.length() of the linked-list variants, including the null node
+		bool			exact_allocation;		// linked-list nodes sized to the fragment count rather than prealloc_fragments
+		bool			scan_prefix_sum;		// S-buffer ranges from a scan in pixel order rather than atomics on shared counters
+		bool			sort_networks;			// resolve with the SIMD sorting networks where they are faster than INSERT_VS_SHELL
+		bool			radix_resolve;			// S-buffer resolve by one radix sort of all fragments rather than per pixel
+		unsigned int	sb_counters;			// COUNTERS, of the tiled and Morton layouts
+		SBufferCounterLayout	sb_counter_layout;
+		bool			sb_pad_counters;		// one cache line per S-buffer counter
+		unsigned int	kbuffer_size;			// k, fragments kept per pixel by the k+-buffer variants
+
+		ABufferSettings() : buckets(4), bucket_distribution(BUCKETS_UNIFORM), max_layers(50), insert_vs_shell(16), prealloc_fragments(5000000), exact_allocation(true), scan_prefix_sum(true),
+			sort_networks(true), radix_resolve(false), sb_counters(32), sb_counter_layout(SB_COUNTERS_MORTON), sb_pad_counters(true),
+			kbuffer_size(8) {}
+	};
+
+	class ABuffer
+	{
+	public:
+		ABuffer() : m_fragment_count(0), m_dropped_count(0), m_overflow_count(0) {}
+		virtual ~ABuffer() {}
+
+		// Runs the geometry passes of the variant over the rasterizer's fragments, and the
+		// screen passes between them. attributes holds the data written along with each
+		// fragment, per primitive, see computeFragmentAttributes.
+		virtual void	build(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool) = 0;
+		// Sorts the fragments of every pixel front to back, up to max_layers of them
+		virtual void	resolve(ThreadPool& thread_pool) = 0;
+
+		// Writes the depths (pecsZ) of a pixel in storage order, front to back after resolve,
+		// and returns how many were written
+		virtual unsigned int	getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const = 0;
+
+		// The trace test of MMRT, after resolve: finds the front-most fragment of the pixel
+		// with minZ < pecsZ <= maxZ among those sorted, and returns its depth and attributes
+		virtual bool	traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const = 0;
+
+		// bytes of all images and buffers of the variant
+		virtual size_t	memoryUsage(void) const = 0;
+
+		// fragments stored by the last build, and those lost because the node buffer, or the
+		// k slots of a k+-buffer pixel, were full
+		unsigned long long	getFragmentCount(void) const { return m_fragment_count; }
+		unsigned long long	getDroppedCount(void) const	 { return m_dropped_count; }
+		// builds, since construction, whose node buffer ran out and was enlarged and filled again
+		unsigned long long	getOverflowCount(void) const { return m_overflow_count; }
+
+	protected:
+		unsigned long long	m_fragment_count;
+		unsigned long long	m_dropped_count;
+		unsigned long long	m_overflow_count;
+	};
+
+	// Linked-list variants: AB_LL, AB_LLD (double links and tails), their bucketed _BUN
+	// versions, and the same in every FragmentLayout: _Decoupled, the versions that keep the
+	// attributes in a separate buffer, and _SoA and _AoSoA8.
+	// One node is allocated per fragment from a global counter and pushed to the head of
+	// its pixel, or of its bucket, with an atomic exchange. With exact_allocation, the node
+	// buffer holds as many nodes as there are fragments: it is sized by a counting pass,
+	// which the _BUN variants fold into their depth bounds pass and the others run only
+	// while they have no nodes, and a peel pass that runs out is repeated in a buffer of
+	// the size it asked for.
+	// The _BUN variants split the depth bounds of every pixel into buckets by
+	// ABufferSettings::bucket_distribution, with DepthBuckets between the depth bounds pass
+	// and peeling.
+	template<bool DOUBLE, FragmentLayout LAYOUT>
+	class LinkedListABuffer : public ABuffer
+	{
+	public:
+		typedef FragmentStorage<LAYOUT, DOUBLE ? 2 : 1> Storage;
+
+		LinkedListABuffer(const ABufferSettings& settings, bool bucketed);
+
+		void	build(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool);
+		void	resolve(ThreadPool& thread_pool);
+		unsigned int	getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const;
+		bool	traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const;
+		size_t	memoryUsage(void) const;
+
+		// one layer per bucket; the tails are empty for single links
+		const AtomicImage&			getHeads(void) const		{ return m_head; }
+		const AtomicImage&			getTails(void) const		{ return m_tail; }
+		// floatBitsToUint of the minimum and maximum eye-space distance, layers 0 and 1
+		const AtomicImage&			getDepthBounds(void) const	{ return m_depth_bounds; }
+		const Storage&				getNodes(void) const		{ return m_nodes; }
+
+		// Bucket of a fragment at eye-space distance Z, within the pixel's depth bounds; the
+		// peel pass and the trace tests of the buckets go through it
+		unsigned int	getBucket(unsigned int x, unsigned int y, float Z) const;
+		// Frees the nodes, heads and tails once the lists have been copied elsewhere; the
+		// depth bounds stay for getBucket, and the next build allocates the lists again
+		void	releaseLists(void)	{ m_nodes.resize(0); m_head.resize(0, 0, 0); m_tail.resize(0, 0, 0); }
+
+	private:
+		ABufferSettings				m_settings;
+		bool						m_bucketed;
+		unsigned int				m_buckets;
+		AtomicImage					m_head;
+		AtomicImage					m_tail;
+		AtomicImage					m_depth_bounds;
+		DepthBuckets				m_depth_buckets;
+		Storage						m_nodes;
+		std::atomic<unsigned int>	m_next_address;
+
+		void	resizeNodes(unsigned int num_nodes);
+		void	peel(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool);
+	};
+
+	// S-buffer variants, AB_SB and AB_SB_Decoupled, and AB_SB_SoA and AB_SB_AoSoA8: a counting pass sizes every pixel, a
+	// prefix sum over a few shared counters (head_s) assigns each pixel a contiguous range,
+	// and the peel pass fills it. The node buffer is allocated to the exact fragment count.
+	// The counters belong to screen tiles, as ABufferSettings::sb_counter_layout lays them
+	// out for the viewport of each build; the ranges of a counter follow those of the one
+	// before it, so that the Morton layout keeps the fragments of nearby tiles together.
+	// With ABufferSettings::scan_prefix_sum, the ranges come from a parallel exclusive scan
+	// of the pixel counts instead, which places them in pixel order whatever the thread
+	// timing, and the shared counters stay 0. With ABufferSettings::radix_resolve, resolve
+	// sorts all fragments of all pixels with a FragmentRadixSort, max_layers aside, and
+	// copies each pixel's span back to its range.
+	template<FragmentLayout LAYOUT>
+	class SBuffer : public ABuffer
+	{
+	public:
+		typedef FragmentStorage<LAYOUT, 0> Storage;
+
+		explicit SBuffer(const ABufferSettings& settings) : m_settings(settings), m_counters(0), m_counter_stride(1), m_prefix_sum_time(0.0) {}
+
+		void	build(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool);
+		void	resolve(ThreadPool& thread_pool);
+		unsigned int	getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const;
+		bool	traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const;
+		size_t	memoryUsage(void) const;
+
+		// hashFunction of s-buffer.h: the counter shared by the pixel's screen tile, as laid
+		// out by the last build
+		unsigned int	hashFunction(unsigned int x, unsigned int y) const { return m_tile_counters[m_tile_rows[y] + m_tile_columns[x]]; }
+		unsigned int	getCounterCount(void) const { return m_counters; }
+
+		// seconds spent by the last build between the counting and the peel pass
+		double		getPrefixSumTime(void) const { return m_prefix_sum_time; }
+
+	private:
+		ABufferSettings				m_settings;
+		unsigned int				m_counters;		// COUNTERS
+		unsigned int				m_counter_stride;	// of m_head_s, in counters
+		AtomicImage					m_counter;		// fragments per pixel
+		AtomicImage					m_head;			// next free address of the pixel within its counter's range
+		std::unique_ptr<std::atomic<unsigned int>[]>	m_head_s;	// counter totals
+		std::vector<unsigned int>	m_counter_offsets;	// exclusive prefix sums of the totals
+		std::vector<unsigned int>	m_tile_columns;	// tile of every column
+		std::vector<unsigned int>	m_tile_rows;	// first tile of every row, in m_tile_counters
+		std::vector<unsigned int>	m_tile_counters;	// counter of every tile
+		Storage						m_nodes;
+		std::vector<unsigned int>	m_tile_sums;	// scanPixelRanges
+		double						m_prefix_sum_time;
+		FragmentRadixSort			m_radix_sort;
+		Storage						m_resolved_nodes;	// resolveRadix
+
+		// first node of the pixel's range, the address the resolve step starts from
+		unsigned int	getPixelBase(unsigned int x, unsigned int y) const;
+		void			layoutCounters(unsigned int width, unsigned int height);
+		void			scanPixelRanges(ThreadPool& thread_pool);
+		void			resolveRadix(ThreadPool& thread_pool);
+	};
+
+	// k+-buffer variants, AB_KB in every FragmentLayout, from [VPF15]: each pixel owns
+	// kbuffer_size fragment slots, so that the memory is fixed whatever the depth complexity.
+	// The peel pass fills the slots of a pixel and then replaces the farthest fragment it
+	// holds, the max of its array, when a closer one arrives, under a per-pixel spin lock.
+	// The k closest fragments are kept; the others are counted as dropped. Resolve sorts
+	// the slots front to back.
+	template<FragmentLayout LAYOUT>
+	class KBuffer : public ABuffer
+	{
+	public:
+		typedef FragmentStorage<LAYOUT, 0> Storage;
+
+		explicit KBuffer(const ABufferSettings& settings) : m_settings(settings), m_k(std::max(settings.kbuffer_size, 1u)) {}
+
+		void	build(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool);
+		void	resolve(ThreadPool& thread_pool);
+		unsigned int	getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const;
+		bool	traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const;
+		size_t	memoryUsage(void) const;
+
+		// fragments of every pixel, up to k
+		const AtomicImage&	getCounters(void) const { return m_counter; }
+		// slot i of pixel (x, y) is fragment (y * width + x) * k + i
+		const Storage&		getNodes(void) const	{ return m_nodes; }
+
+	private:
+		ABufferSettings				m_settings;
+		unsigned int				m_k;
+		AtomicImage					m_counter;
+		AtomicImage					m_semaphore;
+		Storage						m_nodes;
+
+		unsigned int	getPixelBase(unsigned int x, unsigned int y) const { return (y * m_counter.width() + x) * m_k; }
+	};
+
+	// AB_LL_Packed, a CPU-only variant: a single linked list per pixel of NodeTypePacked, 12
+	// bytes per fragment with the albedo, instead of the 24 of AB_LL or the 12 + 16 of
+	// AB_LLD_Decoupled. The depth bounds pass of the _BUN variants also counts the fragments
+	// of every PACKED_TILE_SIZE^2 tile, and each tile allocates its nodes from its own
+	// contiguous range, so that the offsets between the nodes of a list fit in 24 bits.
+	// Throws std::runtime_error from build when a tile holds more fragments than that.
+	class PackedABuffer : public ABuffer
+	{
+	public:
+		enum { PACKED_TILE_SIZE = 8, MAX_TILE_FRAGMENTS = (1 << 23) - 1 };
+
+		explicit PackedABuffer(const ABufferSettings& settings) : m_settings(settings), m_num_tiles(0) {}
+
+		void	build(const Rasterizer& rasterizer, const std::vector<NodeTypeData>& attributes, ThreadPool& thread_pool);
+		void	resolve(ThreadPool& thread_pool);
+		unsigned int	getPixelDepths(unsigned int x, unsigned int y, float* depths, unsigned int max_depths) const;
+		bool	traceTest(unsigned int x, unsigned int y, float minZ, float maxZ, float& depth, NodeTypeData& data) const;
+		size_t	memoryUsage(void) const;
+
+		const AtomicImage&					getHeads(void) const		{ return m_head; }
+		const AtomicImage&					getDepthBounds(void) const	{ return m_depth_bounds; }
+		const std::vector<NodeTypePacked>&	getNodes(void) const		{ return m_nodes; }
+
+		// pecsZ of a node of the pixel, and its attributes in the NodeTypeData encoding
+		float			getNodeDepth(unsigned int x, unsigned int y, unsigned int index) const;
+		NodeTypeData	getNodeData(unsigned int index) const;
+		// node following index in its list, 0 at the end
+		unsigned int	getNext(unsigned int index) const
+		{
+			const int offset = static_cast<int>(m_nodes[index].next_specular) >> 8;
+			return offset ? index + static_cast<unsigned int>(offset) : 0u;
+		}
+
+		// 16-bit octahedral normals, from the normal_encode_spheremap1 words of NodeTypeData
+		static unsigned int		encodeNormal(unsigned int spheremap);
+		static optix::float3	decodeNormal(unsigned int octahedral);
+
+	private:
+		ABufferSettings				m_settings;
+		AtomicImage					m_head;
+		AtomicImage					m_depth_bounds;
+		unsigned int				m_num_tiles;
+		std::unique_ptr<std::atomic<unsigned int>[]>	m_tile_next;	// fragment counts, then next free node of each tile
+		std::vector<NodeTypePacked>	m_nodes;
+		std::vector<unsigned int>	m_albedo;
+		// the fields of the node words that come from the primitive
+		struct PackedAttributes
+		{
+			unsigned int	normal;
+			unsigned int	specular;
+			unsigned int	albedo_opacity;
+		};
+		std::vector<PackedAttributes>	m_attributes;
+	};
+
+	// Names of the variants, as the GLSL/A-Buffer Shaders directories, and AB_KB and AB_LL_Packed
+	extern const char* const	ABUFFER_METHODS[];
+	extern const unsigned int	NUM_ABUFFER_METHODS;
+	// The same without the _Decoupled ones, to which createABuffer takes any layout suffix
+	extern const char* const	ABUFFER_BASE_METHODS[];
+	extern const unsigned int	NUM_ABUFFER_BASE_METHODS;
+
+	// Throws std::invalid_argument for unknown method names
+	std::unique_ptr<ABuffer>	createABuffer(const std::string& method, const ABufferSettings& settings);
+
+	// Fills one NodeTypeData per primitive, as the peel shaders of the demo pack them: the
+	// diffuse texture at the triangle centroid, the eye-space geometric normal encoded with
+	// normal_encode_spheremap1, the Phong exponent and an opaque, unit index of refraction
+	void	computeFragmentAttributes(const TriangleMesh& mesh, const RasterCamera& camera, std::vector<NodeTypeData>& attributes);
+
+	// normal_decode_spheremap1 of the normal word of NodeTypeData
+	optix::float3	decodeSpheremapNormal(unsigned int normal);
+	// unpackUnorm4x8 of the albedo, specular and ior_opacity words of NodeTypeData
+	optix::float4	unpackUnorm4x8(unsigned int bits);
+}
@@ -0,0 +1,84 @@
+#include "accel.h"
+#include "bvh.h"
+#include "compact_bvh.h"
+#include "kdtree.h"
+
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	void Accel::intersectPacket(RayPacket& packet) const
+	{
+		for (unsigned int lane = 0; lane < packet.size; ++lane)
+		{
+			if (packet.tmin[lane] > packet.tmax[lane])
+				continue;
+			Ray ray = make_Ray(make_float3(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]),
+				make_float3(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]), 0u, packet.tmin[lane], packet.tmax[lane]);
+			Hit hit;
+			if (!intersect(ray, hit))
+				continue;
+			packet.tmax[lane]	 = hit.t;
+			packet.primIdx[lane] = hit.primIdx;
+			packet.beta[lane]	 = hit.beta;
+			packet.gamma[lane]	 = hit.gamma;
+		}
+	}
+
+	bool NoAccel::intersect(const Ray& ray, Hit& hit) const
+	{
+		Ray current = ray;
+		bool found = false;
+		for (unsigned int i = 0; i < m_mesh->size(); ++i)
+			found |= intersect_primitive(*m_mesh, i, current, hit);
+		return found;
+	}
+
+	bool NoAccel::occluded(const Ray& ray) const
+	{
+		Ray current = ray;
+		Hit hit;
+		for (unsigned int i = 0; i < m_mesh->size(); ++i)
+			if (intersect_primitive(*m_mesh, i, current, hit))
+				return true;
+		return false;
+	}
+
+	// BVH builders produce a binary Bvh, or its quantized 4-wide collapse for the BvhCompact traverser
+	static Accel* createBvh(Bvh::BuildMethod method, const string& traverser)
+	{
+		if (traverser == "Bvh")
+			return new Bvh(method);
+		if (traverser == "BvhCompact")
+			return new CompactBvh(method);
+		return 0;
+	}
+
+	unique_ptr<Accel> createAccel(const string& builder, const string& traverser)
+	{
+		// There is no treelet restructuring on the CPU: Trbvh, like the plain Bvh builder,
+		// produces a binned SAH hierarchy
+		Accel* accel = 0;
+		if		(builder == "Trbvh" || builder == "Bvh" || builder == "BvhCompact")
+			accel = createBvh(Bvh::BM_BINNED_SAH, traverser);
+		else if (builder == "Sbvh")
+			accel = createBvh(Bvh::BM_SPATIAL_SPLITS, traverser);
+		else if (builder == "MedianBvh")
+			accel = createBvh(Bvh::BM_MEDIAN, traverser);
+		else if (builder == "Lbvh")
+			accel = createBvh(Bvh::BM_MORTON, traverser);
+		else if (builder == "TriangleKdTree" || builder == "KdTree")
+			accel = (traverser == "KdTree") ? new KdTree() : 0;
+		else if (builder == "NoAccel")
+			accel = (traverser == "NoAccel") ? new NoAccel() : 0;
+		else
+			throw invalid_argument("Unknown acceleration builder '" + builder + "'");
+
+		if (!accel)
+			throw invalid_argument("Traverser '" + traverser + "' cannot be used with builder '" + builder + "'");
+		return unique_ptr<Accel>(accel);
+	}
+}
@@ -0,0 +1,129 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Acceleration structure interface of the CPU backend, the counterpart of optix::Acceleration
+
+#pragma once
+
+#include "mapped_file.h"
+#include "triangle_mesh.h"
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	struct Hit
+	{
+		float	t;
+		int		primIdx;
+		float	beta;
+		float	gamma;
+	};
+
+	// Tests primitive primIdx of the mesh and, on a hit, records it and shortens ray.tmax
+	inline bool intersect_primitive(const TriangleMesh& mesh, unsigned int primIdx, Ray& ray, Hit& hit)
+	{
+		const int3 v_idx = mesh.vindex_buffer[primIdx];
+		float3 n;
+		float  t, beta, gamma;
+		if (!intersect_triangle(ray, mesh.vertex_buffer[v_idx.x], mesh.vertex_buffer[v_idx.y], mesh.vertex_buffer[v_idx.z], n, t, beta, gamma))
+			return false;
+		ray.tmax	= t;
+		hit.t		= t;
+		hit.primIdx	= static_cast<int>(primIdx);
+		hit.beta	= beta;
+		hit.gamma	= gamma;
+		return true;
+	}
+
+	// Rays traced together by Accel::intersectPacket, in SoA layout. Lanes at or past
+	// size, or with tmin > tmax, are inactive.
+	struct RayPacket
+	{
+		enum { MAX_SIZE = 16 };
+
+		float			origin[3][MAX_SIZE];
+		float			direction[3][MAX_SIZE];
+		float			tmin[MAX_SIZE];
+		float			tmax[MAX_SIZE];		// shortened to the closest hit
+		int				primIdx[MAX_SIZE];	// -1 where nothing was hit
+		float			beta[MAX_SIZE];
+		float			gamma[MAX_SIZE];
+		unsigned int	size;
+
+		void	setRay(unsigned int lane, const Ray& ray)
+		{
+			origin[0][lane]	   = ray.origin.x;		origin[1][lane]	   = ray.origin.y;		origin[2][lane]	   = ray.origin.z;
+			direction[0][lane] = ray.direction.x;	direction[1][lane] = ray.direction.y;	direction[2][lane] = ray.direction.z;
+			tmin[lane]		   = ray.tmin;
+			tmax[lane]		   = ray.tmax;
+			primIdx[lane]	   = -1;
+		}
+
+		void	disable(unsigned int lane)
+		{
+			origin[0][lane]	   = origin[1][lane]	= origin[2][lane]	 = 0.0f;
+			direction[0][lane] = direction[1][lane] = direction[2][lane] = 1.0f;
+			tmin[lane]		   = 1.0f;
+			tmax[lane]		   = 0.0f;
+			primIdx[lane]	   = -1;
+		}
+
+		bool	getHit(unsigned int lane, Hit& hit) const
+		{
+			hit.t		= tmax[lane];
+			hit.primIdx	= primIdx[lane];
+			hit.beta	= beta[lane];
+			hit.gamma	= gamma[lane];
+			return primIdx[lane] >= 0;
+		}
+	};
+
+	class Accel
+	{
+	public:
+		virtual ~Accel() {}
+
+		// The mesh must outlive the structure
+		virtual void	build(const TriangleMesh& mesh) = 0;
+
+		// closest hit within [ray.tmin, ray.tmax]
+		virtual bool	intersect(const Ray& ray, Hit& hit) const = 0;
+		// any hit within [ray.tmin, ray.tmax]
+		virtual bool	occluded(const Ray& ray) const = 0;
+		// closest hit of every active lane; traces the lanes one by one unless overridden
+		virtual void	intersectPacket(RayPacket& packet) const;
+
+		// bytes held by the structure, excluding the mesh itself
+		virtual size_t	memoryUsage(void) const = 0;
+
+		// AccelCache support: save writes the built structure, load adopts one that save wrote
+		// for the same mesh, from offset to offset + size of the file. Loaded arrays are read in
+		// place from the mapping, which the structure keeps alive. Both return false for
+		// structures that are not cached.
+		virtual bool	save(std::ostream&) const { return false; }
+		virtual bool	load(const std::shared_ptr<const MappedFile>&, size_t, size_t, const TriangleMesh&) { return false; }
+	};
+
+	// Tests every triangle, as the "NoAccel" builder
+	class NoAccel : public Accel
+	{
+	public:
+		NoAccel() : m_mesh(0) {}
+
+		void	build(const TriangleMesh& mesh) { m_mesh = &mesh; }
+		bool	intersect(const Ray& ray, Hit& hit) const;
+		bool	occluded(const Ray& ray) const;
+		size_t	memoryUsage(void) const { return 0; }
+
+	private:
+		const TriangleMesh*	m_mesh;
+	};
+
+	// Creates the structure for an OptiX builder/traverser pair, e.g. ("Sbvh", "Bvh").
+	// Throws std::invalid_argument on unknown names or on a traverser that cannot
+	// walk the builder's output, as OptiX validation would.
+	std::unique_ptr<Accel> createAccel(const std::string& builder, const std::string& traverser);
+}
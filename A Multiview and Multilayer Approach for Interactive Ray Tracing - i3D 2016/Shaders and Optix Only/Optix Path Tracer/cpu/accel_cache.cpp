@@ -0,0 +1,171 @@
+#include "accel_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace cpu
+{
+	static const char			ACCEL_CACHE_MAGIC[8]	= "ACCACHE";
+	static const unsigned int	ACCEL_CACHE_VERSION		= 2;		// bump when a cached layout or builder changes
+	static const size_t			ACCEL_CACHE_KEY_SIZE	= 64;
+
+	struct AccelCacheHeader
+	{
+		char				magic[8];
+		unsigned int		version;
+		unsigned int		payload_offset;
+		unsigned long long	model_hash;
+		unsigned long long	model_size;
+		unsigned long long	payload_size;
+		char				key[ACCEL_CACHE_KEY_SIZE];		// null-terminated
+	};
+
+	// 64-bit FNV-1a over 8-byte words and then the remaining bytes; the model is hashed
+	// on every start, so this favours speed over the byte-wise original
+	static unsigned long long hashBytes(const unsigned char* data, size_t size)
+	{
+		const unsigned long long prime = 1099511628211ull;
+		unsigned long long hash = 14695981039346656037ull;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			unsigned long long word;
+			memcpy(&word, data + i, 8);
+			hash = (hash ^ word) * prime;
+		}
+		for (; i < size; ++i)
+			hash = (hash ^ data[i]) * prime;
+		return hash;
+	}
+
+	static string baseName(const string& path)
+	{
+		const size_t separator = path.find_last_of("/\\");
+		return (separator == string::npos) ? path : path.substr(separator + 1);
+	}
+
+	string getDirectoryName(const string& path)
+	{
+		const size_t separator = path.find_last_of("/\\");
+		if (separator == string::npos)
+			return ".";
+		return (separator == 0) ? path.substr(0, 1) : path.substr(0, separator);
+	}
+
+	AccelCache::AccelCache(const string& directory, const string& model_path, const string& key) :
+		m_key(key),
+		m_model_hash(0),
+		m_model_size(0)
+	{
+		if (directory.empty())
+			return;
+		if (key.size() >= ACCEL_CACHE_KEY_SIZE)
+			throw invalid_argument("Acceleration cache key '" + key + "' is too long");
+
+		MappedFile model(model_path);
+		m_model_size = model.size();
+		m_model_hash = hashBytes(model.data(), model.size());
+		m_filename	 = directory + "/" + baseName(model_path) + "." + key + ".accel";
+	}
+
+	shared_ptr<const MappedFile> AccelCache::open(size_t& payload_offset, size_t& payload_size) const
+	{
+		if (!enabled())
+			return shared_ptr<const MappedFile>();
+
+		shared_ptr<const MappedFile> file;
+		try
+		{
+			file = make_shared<MappedFile>(m_filename);
+		}
+		catch (runtime_error&)
+		{
+			return shared_ptr<const MappedFile>();
+		}
+
+		AccelCacheHeader header;
+		if (file->size() < sizeof(header))
+			return shared_ptr<const MappedFile>();
+		memcpy(&header, file->data(), sizeof(header));
+		header.key[ACCEL_CACHE_KEY_SIZE - 1] = '\0';
+
+		if (memcmp(header.magic, ACCEL_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != ACCEL_CACHE_VERSION ||
+			header.model_hash != m_model_hash ||
+			header.model_size != m_model_size ||
+			m_key != header.key ||
+			header.payload_offset < sizeof(header) ||
+			header.payload_offset > file->size() ||
+			header.payload_size > file->size() - header.payload_offset)
+			return shared_ptr<const MappedFile>();
+
+		payload_offset = header.payload_offset;
+		payload_size   = static_cast<size_t>(header.payload_size);
+		return file;
+	}
+
+	bool AccelCache::write(const function<bool(ostream&)>& write_payload) const
+	{
+		if (!enabled())
+			return false;
+
+		// unique per run, for concurrent writers of the same entry
+		const string temporary = m_filename + "." + to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+		bool written = false;
+		{
+			ofstream out(temporary.c_str(), ios::out | ios::binary | ios::trunc);
+			if (!out)
+				return false;
+
+			AccelCacheHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, ACCEL_CACHE_MAGIC, sizeof(header.magic));
+			header.version		  = ACCEL_CACHE_VERSION;
+			header.payload_offset = static_cast<unsigned int>((sizeof(header) + ACCEL_CACHE_ALIGNMENT - 1) / ACCEL_CACHE_ALIGNMENT * ACCEL_CACHE_ALIGNMENT);
+			header.model_hash	  = m_model_hash;
+			header.model_size	  = m_model_size;
+			m_key.copy(header.key, ACCEL_CACHE_KEY_SIZE - 1);
+
+			// the payload size is filled in once known
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			writeCacheArray(out, static_cast<const char*>(0), 0);
+			if (write_payload(out) && out)
+			{
+				header.payload_size = static_cast<unsigned long long>(out.tellp()) - header.payload_offset;
+				out.seekp(0);
+				out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				out.close();
+				written = !out.fail();
+			}
+		}
+
+#if defined(_WIN32)
+		// rename does not replace existing files on Windows
+		if (written)
+			remove(m_filename.c_str());
+#endif
+		if (!written || rename(temporary.c_str(), m_filename.c_str()) != 0)
+		{
+			remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool AccelCache::load(Accel& accel, const TriangleMesh& mesh) const
+	{
+		size_t offset, size;
+		shared_ptr<const MappedFile> file = open(offset, size);
+		return file && accel.load(file, offset, size, mesh);
+	}
+
+	bool AccelCache::save(const Accel& accel) const
+	{
+		return write([&accel](ostream& out) { return accel.save(out); });
+	}
+}
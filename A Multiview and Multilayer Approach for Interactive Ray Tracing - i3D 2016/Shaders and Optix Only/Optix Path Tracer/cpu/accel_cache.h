@@ -0,0 +1,79 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// On-disk cache of built acceleration structures, loaded by memory mapping
+
+#pragma once
+
+#include "accel.h"
+#include "mapped_file.h"
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace cpu
+{
+	// Payload arrays start at multiples of this many bytes from the start of the file
+	static const size_t ACCEL_CACHE_ALIGNMENT = 64;
+
+	// One file per model and structure: <directory>/<model file>.<key>.accel, where the key
+	// names the builder and anything else that changes the structure. The header records a
+	// hash and the size of the model file; an entry whose model has changed since is stale,
+	// and is rebuilt and overwritten.
+	class AccelCache
+	{
+	public:
+		// An empty directory disables the cache. Otherwise hashes the model file, throwing
+		// std::runtime_error if it cannot be read.
+		AccelCache(const std::string& directory, const std::string& model_path, const std::string& key);
+
+		bool				enabled(void) const { return !m_filename.empty(); }
+		const std::string&	getFilename(void) const { return m_filename; }
+
+		// Maps a valid entry and locates its payload; returns null if missing or stale
+		std::shared_ptr<const MappedFile>	open(size_t& payload_offset, size_t& payload_size) const;
+		// Writes the payload to a temporary file that replaces the entry once complete, so
+		// that a concurrent or interrupted run never sees a partial entry. Returns false
+		// on I/O errors or if write_payload does.
+		bool	write(const std::function<bool(std::ostream&)>& write_payload) const;
+
+		// Accel::load from a valid entry / Accel::save to a new one
+		bool	load(Accel& accel, const TriangleMesh& mesh) const;
+		bool	save(const Accel& accel) const;
+
+	private:
+		std::string			m_filename;
+		std::string			m_key;
+		unsigned long long	m_model_hash;
+		unsigned long long	m_model_size;
+	};
+
+	// Directory part of a file path, "." for a bare file name; the default cache directory
+	// is that of the model
+	std::string	getDirectoryName(const std::string& path);
+
+	// Payload helpers for Accel::save/load. Arrays are padded to ACCEL_CACHE_ALIGNMENT,
+	// so that loaded views are as aligned as their element types require.
+	template<typename T>
+	void writeCacheArray(std::ostream& out, const T* data, size_t count)
+	{
+		static const char padding[ACCEL_CACHE_ALIGNMENT] = {};
+		const size_t position = static_cast<size_t>(out.tellp());
+		out.write(padding, (ACCEL_CACHE_ALIGNMENT - position % ACCEL_CACHE_ALIGNMENT) % ACCEL_CACHE_ALIGNMENT);
+		if (count > 0)
+			out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+	}
+
+	// Views count elements at the next aligned position from offset, which is advanced past
+	// them; returns false if they extend past end
+	template<typename T>
+	bool readCacheArray(const MappedFile& file, size_t& offset, size_t end, size_t count, ArrayView<T>& view)
+	{
+		offset = (offset + ACCEL_CACHE_ALIGNMENT - 1) / ACCEL_CACHE_ALIGNMENT * ACCEL_CACHE_ALIGNMENT;
+		if (offset > end || count > (end - offset) / sizeof(T))
+			return false;
+		view = ArrayView<T>(reinterpret_cast<const T*>(file.data() + offset), count);
+		offset += count * sizeof(T);
+		return true;
+	}
+}
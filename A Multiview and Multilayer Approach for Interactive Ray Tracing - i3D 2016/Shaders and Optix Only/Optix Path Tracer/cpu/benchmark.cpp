@@ -0,0 +1,1039 @@
+#include "benchmark.h"
+#include "fragment_sort.h"
+#include "simd.h"
+#include "../cuda/random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	struct AccelType
+	{
+		const char* builder;
+		const char* traverser;
+	};
+
+	// Trbvh, the BvhCompact builder and TriangleKdTree share the builders below; NoAccel is
+	// left out, as it tests every triangle for every ray
+	static const AccelType BENCHMARK_ACCELS[] =
+	{
+		{ "Bvh",		"Bvh"			},
+		{ "MedianBvh",	"Bvh"			},
+		{ "Sbvh",		"Bvh"			},
+		{ "Lbvh",		"Bvh"			},
+		{ "Bvh",		"BvhCompact"	},
+		{ "Sbvh",		"BvhCompact"	},
+		{ "KdTree",		"KdTree"		},
+	};
+
+	static const unsigned int RAY_BATCH = 4096;
+
+	// A-buffer passes are timed this many times and the fastest run is reported
+	static const unsigned int ABUFFER_REPETITIONS = 3;
+
+	struct RaySet
+	{
+		const char*		name;
+		bool			any_hit;
+		vector<Ray>		rays;
+		vector<float>	reference;		// hit distance, or -1 for misses
+	};
+
+	// Traces all rays of the set and returns the elapsed time
+	static double traceRays(const Accel& accel, const RaySet& set, vector<float>& result, ThreadPool& thread_pool)
+	{
+		result.resize(set.rays.size());
+		const unsigned int num_rays	   = static_cast<unsigned int>(set.rays.size());
+		const unsigned int num_batches = (num_rays + RAY_BATCH - 1) / RAY_BATCH;
+
+		double start = currentTime();
+		thread_pool.run(num_batches, [&](unsigned int batch, unsigned int)
+		{
+			const unsigned int end = min(num_rays, (batch + 1) * RAY_BATCH);
+			for (unsigned int i = batch * RAY_BATCH; i < end; ++i)
+			{
+				Hit hit;
+				if (set.any_hit)
+					result[i] = accel.occluded(set.rays[i]) ? 0.0f : -1.0f;
+				else
+					result[i] = accel.intersect(set.rays[i], hit) ? hit.t : -1.0f;
+			}
+		});
+		return currentTime() - start;
+	}
+
+	// Same as traceRays for closest hits, packet_size consecutive rays at a time
+	static double tracePackets(const Accel& accel, const RaySet& set, unsigned int packet_size, vector<float>& result, ThreadPool& thread_pool)
+	{
+		result.resize(set.rays.size());
+		const unsigned int num_rays	   = static_cast<unsigned int>(set.rays.size());
+		const unsigned int num_batches = (num_rays + RAY_BATCH - 1) / RAY_BATCH;
+
+		double start = currentTime();
+		thread_pool.run(num_batches, [&](unsigned int batch, unsigned int)
+		{
+			const unsigned int end = min(num_rays, (batch + 1) * RAY_BATCH);
+			RayPacket packet;
+			for (unsigned int first = batch * RAY_BATCH; first < end; first += packet_size)
+			{
+				packet.size = min(packet_size, end - first);
+				for (unsigned int lane = 0; lane < packet.size; ++lane)
+					packet.setRay(lane, set.rays[first + lane]);
+				accel.intersectPacket(packet);
+				for (unsigned int lane = 0; lane < packet.size; ++lane)
+					result[first + lane] = (packet.primIdx[lane] >= 0) ? packet.tmax[lane] : -1.0f;
+			}
+		});
+		return currentTime() - start;
+	}
+
+	static unsigned int countMismatches(const vector<float>& result, const vector<float>& reference)
+	{
+		unsigned int mismatches = 0;
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			if ((result[i] < 0.0f) != (reference[i] < 0.0f))
+				++mismatches;
+			else if (fabsf(result[i] - reference[i]) > 1.e-4f * max(1.0f, reference[i]))
+				++mismatches;
+		}
+		return mismatches;
+	}
+
+	void benchmarkAccels(const Context& context, ThreadPool& thread_pool)
+	{
+		const TriangleMesh& mesh = *context.mesh;
+		const unsigned int width  = context.output_buffer.width;
+		const unsigned int height = context.output_buffer.height;
+
+		RaySet sets[3];
+		sets[0].name = "primary";	sets[0].any_hit = false;
+		sets[1].name = "shadow";	sets[1].any_hit = true;
+		sets[2].name = "diffuse";	sets[2].any_hit = false;
+
+		// primary rays through the pixel centers, as pinhole_camera without AA
+		float2 inv_screen = 1.0f / make_float2(static_cast<float>(width), static_cast<float>(height)) * 2.f;
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				float2 d = make_float2(static_cast<float>(x), static_cast<float>(y)) * inv_screen - 1.f;
+				float3 ray_direction = normalize(d.x*context.camera.U + d.y*context.camera.V + context.camera.W);
+				sets[0].rays.push_back(make_Ray(context.camera.eye, ray_direction, context.pt.radiance_ray_type, context.scene_epsilon, DEFAULT_MAX));
+			}
+
+		// secondary rays spawned from the primary hits of the reference structure
+		unique_ptr<Accel> reference = createAccel(BENCHMARK_ACCELS[0].builder, BENCHMARK_ACCELS[0].traverser);
+		reference->build(mesh);
+		for (unsigned int i = 0; i < sets[0].rays.size(); ++i)
+		{
+			const Ray& ray = sets[0].rays[i];
+			Hit hit;
+			if (!reference->intersect(ray, hit))
+				continue;
+
+			Attributes attributes;
+			mesh_attributes(mesh, hit.primIdx, hit.beta, hit.gamma, attributes);
+			float3 normal	= normalize(faceforward(attributes.geometric_normal, -ray.direction, attributes.geometric_normal));
+			float3 hitpoint	= ray.origin + hit.t * ray.direction;
+
+			if (!context.lights.empty())
+			{
+				float3 L	= make_float3(context.lights[0].pos) - hitpoint;
+				float Ldist	= length(L);
+				sets[1].rays.push_back(make_Ray(hitpoint, L / Ldist, context.pt.shadow_ray_type, context.scene_epsilon, Ldist - context.scene_epsilon));
+			}
+
+			unsigned int seed = tea<16>(i, 0);
+			float3 p, U, V;
+			cosine_sample_hemisphere(rnd(seed), rnd(seed), p);
+			createONB(normal, U, V);
+			float3 ray_direction = normalize(p.x*U + p.y*V + p.z*normal);
+			sets[2].rays.push_back(make_Ray(hitpoint, ray_direction, context.pt.radiance_ray_type, context.scene_epsilon, DEFAULT_MAX));
+		}
+		for (int s = 0; s < 3; ++s)
+			traceRays(*reference, sets[s], sets[s].reference, thread_pool);
+		reference.reset();
+
+		// primary rays are also traced in packets of the width of the SIMD level
+		const SimdLevel		simd_level	= getSimdLevel();
+		const unsigned int	packet_size	= (simd_level == SIMD_AVX512) ? 16 : 8;
+
+		cout << "Triangles : " << mesh.size() << ", threads : " << thread_pool.size() << ", SIMD : " << getSimdLevelName(simd_level) << ", rays : "
+			 << sets[0].rays.size() << " primary, " << sets[1].rays.size() << " shadow, " << sets[2].rays.size() << " diffuse\n";
+		printf("%-12s %-10s %10s %11s %10s %14s %14s %14s %14s %11s\n", "Builder", "Traverser", "Build (s)", "Memory (MB)",
+			"Bytes/tri", "Primary Mr/s", "Packet Mr/s", "Shadow Mr/s", "Diffuse Mr/s", "Mismatches");
+
+		for (size_t a = 0; a < sizeof(BENCHMARK_ACCELS) / sizeof(AccelType); ++a)
+		{
+			unique_ptr<Accel> accel = createAccel(BENCHMARK_ACCELS[a].builder, BENCHMARK_ACCELS[a].traverser);
+
+			double start = currentTime();
+			accel->build(mesh);
+			double build_time = currentTime() - start;
+			size_t memory = accel->memoryUsage();
+
+			double mrays[3];
+			unsigned int mismatches = 0;
+			for (int s = 0; s < 3; ++s)
+			{
+				vector<float> result;
+				double time = traceRays(*accel, sets[s], result, thread_pool);
+				mrays[s] = (time > 0.0) ? sets[s].rays.size() / time * 1.e-6 : 0.0;
+				mismatches += countMismatches(result, sets[s].reference);
+			}
+
+			vector<float> result;
+			double time = tracePackets(*accel, sets[0], packet_size, result, thread_pool);
+			double packet_mrays = (time > 0.0) ? sets[0].rays.size() / time * 1.e-6 : 0.0;
+			mismatches += countMismatches(result, sets[0].reference);
+
+			printf("%-12s %-10s %10.3f %11.2f %10.1f %14.2f %14.2f %14.2f %14.2f %11u\n", BENCHMARK_ACCELS[a].builder, BENCHMARK_ACCELS[a].traverser,
+				build_time, memory / (1024.0 * 1024.0), mesh.size() ? static_cast<double>(memory) / mesh.size() : 0.0,
+				mrays[0], packet_mrays, mrays[1], mrays[2], mismatches);
+			fflush(stdout);
+		}
+	}
+
+	// Fragments a pixel of the variant holds at most: k for the k+-buffers, all otherwise
+	static unsigned int getPixelCapacity(const string& method, const ABufferSettings& settings)
+	{
+		return (method.compare(0, 5, "AB_KB") == 0) ? max(settings.kbuffer_size, 1u) : ~0u;
+	}
+
+	// Pixels that do not hold all of their fragments, up to capacity, or whose first
+	// max_layers are not in front-to-back order
+	static unsigned int countResolveErrors(const ABuffer& abuffer, const AtomicImage& counts, unsigned int max_layers, vector<float>& depths,
+		unsigned int capacity = ~0u)
+	{
+		unsigned int errors = 0;
+		for (unsigned int y = 0; y < counts.height(); ++y)
+			for (unsigned int x = 0; x < counts.width(); ++x)
+			{
+				const unsigned int count = abuffer.getPixelDepths(x, y, &depths[0], static_cast<unsigned int>(depths.size()));
+				bool valid = (count == min(counts(x, y).load(), capacity));
+				for (unsigned int i = 1; valid && i < min(count, max_layers); ++i)
+					valid = depths[i - 1] >= depths[i];
+				errors += valid ? 0 : 1;
+			}
+		return errors;
+	}
+
+	// Fragment counts of the sort benchmark, one per pixel
+	struct DepthComplexity
+	{
+		const char*				name;
+		vector<unsigned int>	counts;
+	};
+
+	static const unsigned int	SORT_BENCHMARK_PIXELS = 1u << 18;
+	static const unsigned int	SORT_BENCHMARK_TAIL	  = 1024;
+
+	// Geometric distribution of the given mean, capped at max_count
+	static unsigned int geometricCount(unsigned int& seed, float mean, unsigned int max_count)
+	{
+		const float u = rnd(seed);
+		const unsigned int count = 1u + static_cast<unsigned int>(logf(1.0f - u) / logf(1.0f - 1.0f / mean));
+		return min(count, max_count);
+	}
+
+	// Pareto distribution of shape alpha starting at 1, capped at max_count
+	static unsigned int paretoCount(unsigned int& seed, float alpha, unsigned int max_count)
+	{
+		const float u = 1.0f - rnd(seed);
+		return min(static_cast<unsigned int>(powf(u, -1.0f / alpha)), max_count);
+	}
+
+	// Sorts the same per-pixel depth lists, generated from each distribution of counts,
+	// with the GLSL sort, with the sorting networks at every supported SIMD level and with
+	// one FragmentRadixSort of all pixels, on one thread. Prints nanoseconds per pixel and
+	// the pixels whose order differs from the GLSL sort.
+	static void benchmarkFragmentSort(const vector<unsigned int>& scene_counts, const ABufferSettings& settings)
+	{
+		const unsigned int max_count = max(settings.max_layers, 1u);
+		vector<DepthComplexity> distributions(6);
+		distributions[0].name	= "Scene";
+		distributions[0].counts = scene_counts;
+		distributions[1].name	= "Uniform 1-8";
+		distributions[2].name	= "Geometric, mean 4";
+		distributions[3].name	= "Geometric, mean 16";
+		distributions[4].name	= "Uniform 1-max layers";
+		distributions[5].name	= "Pareto 1.2, max 1024";
+		unsigned int seed = tea<16>(1, 2);
+		for (unsigned int i = 0; i < SORT_BENCHMARK_PIXELS; ++i)
+		{
+			distributions[1].counts.push_back(min(1u + static_cast<unsigned int>(rnd(seed) * 8.0f), 8u));
+			distributions[2].counts.push_back(geometricCount(seed, 4.0f, max_count));
+			distributions[3].counts.push_back(geometricCount(seed, 16.0f, max_count));
+			distributions[4].counts.push_back(min(1u + static_cast<unsigned int>(rnd(seed) * max_count), max_count));
+			distributions[5].counts.push_back(paretoCount(seed, 1.2f, SORT_BENCHMARK_TAIL));
+		}
+
+		const SimdLevel simd_level = getSimdLevel();
+		printf("%-22s %6s %5s %12s", "Depth complexity", "Mean", "Max", "GLSL (ns)");
+		for (int level = SIMD_AVX2; level <= simd_level; ++level)
+			printf(" %10s (ns) %7s", getSimdLevelName(static_cast<SimdLevel>(level)), "Errors");
+		printf(" %15s %7s\n", "Radix (ns)", "Errors");
+
+		ThreadPool single_thread(1);
+		FragmentRadixSort radix_sort;
+
+		for (size_t d = 0; d < distributions.size(); ++d)
+		{
+			const vector<unsigned int>& counts = distributions[d].counts;
+			if (counts.empty())
+				continue;
+
+			// pecsZ of the fragments, ids in the order of a linked-list load
+			vector<unsigned int> offsets(counts.size() + 1, 0u);
+			for (size_t i = 0; i < counts.size(); ++i)
+				offsets[i + 1] = offsets[i] + counts[i];
+			vector<float>		 depths(offsets.back());
+			vector<unsigned int> ids(offsets.back());
+			for (size_t i = 0; i < depths.size(); ++i)
+			{
+				depths[i] = -1.0f - 99.0f * rnd(seed);
+				ids[i]	  = static_cast<unsigned int>(depths.size() - i);
+			}
+
+			unsigned int max_pixel = 0;
+			for (size_t i = 0; i < counts.size(); ++i)
+				max_pixel = max(max_pixel, offsets[i + 1] - offsets[i]);
+			printf("%-22s %6.2f %5u", distributions[d].name, static_cast<double>(depths.size()) / counts.size(), max_pixel);
+
+			// the GLSL sort, whose result the networks must reproduce
+			vector<float>		 reference_depths;
+			vector<unsigned int> reference_ids;
+			for (int level = SIMD_SCALAR; level <= simd_level; ++level)
+			{
+				setSimdLevel(static_cast<SimdLevel>(level));
+				const bool networks = (level != SIMD_SCALAR);
+				vector<float>		 sorted_depths;
+				vector<unsigned int> sorted_ids;
+				double sort_time = DBL_MAX;
+				for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+				{
+					sorted_depths = depths;
+					sorted_ids	  = ids;
+					const double start = currentTime();
+					for (size_t i = 0; i < counts.size(); ++i)
+						sortFragments(&sorted_ids[offsets[i]], &sorted_depths[offsets[i]], static_cast<int>(offsets[i + 1] - offsets[i]),
+							static_cast<int>(settings.insert_vs_shell), networks);
+					sort_time = min(sort_time, currentTime() - start);
+				}
+
+				if (!networks)
+				{
+					reference_depths.swap(sorted_depths);
+					reference_ids.swap(sorted_ids);
+					printf(" %12.1f", sort_time * 1e9 / counts.size());
+					continue;
+				}
+
+				// equal depths may keep their ids in another order
+				unsigned int errors = 0;
+				for (size_t i = 0; i < counts.size(); ++i)
+				{
+					bool valid = true;
+					unsigned long long id_sum = 0, reference_id_sum = 0;
+					for (unsigned int f = offsets[i]; f < offsets[i + 1]; ++f)
+					{
+						valid = valid && sorted_depths[f] == reference_depths[f];
+						id_sum			 += sorted_ids[f];
+						reference_id_sum += reference_ids[f];
+					}
+					errors += (valid && id_sum == reference_id_sum) ? 0 : 1;
+				}
+				printf(" %15.1f %7u", sort_time * 1e9 / counts.size(), errors);
+			}
+			setSimdLevel(simd_level);
+
+			// all pixels at once; the distributions have no empty pixels, so that pixel i
+			// starts at offsets[i] of the order
+			double sort_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				const double start = currentTime();
+				radix_sort.reset(static_cast<unsigned int>(depths.size()), static_cast<unsigned int>(counts.size()));
+				for (unsigned int i = 0; i < counts.size(); ++i)
+					for (unsigned int f = offsets[i]; f < offsets[i + 1]; ++f)
+						radix_sort.setFragment(f, i, depths[f]);
+				radix_sort.sort(single_thread);
+				sort_time = min(sort_time, currentTime() - start);
+			}
+			const unsigned int* order = radix_sort.getOrder();
+			unsigned int errors = 0;
+			for (size_t i = 0; i < counts.size(); ++i)
+			{
+				bool valid = true;
+				for (unsigned int f = offsets[i]; f < offsets[i + 1]; ++f)
+					valid = valid && depths[order[f]] == reference_depths[f];
+				errors += valid ? 0 : 1;
+			}
+			printf(" %15.1f %7u\n", sort_time * 1e9 / counts.size(), errors);
+			fflush(stdout);
+		}
+	}
+
+	// Trace tests of the packed nodes' accuracy, per pixel with fragments
+	static const unsigned int	PACKED_BENCHMARK_QUERIES = 16;
+
+	// Compares AB_LL_Packed with the variants that store exact depths: the bytes each
+	// fragment takes, the build and resolve times, and the MMRT trace test, a hit where a
+	// fragment lies in (minZ, maxZ], on ray segments placed around the fragments of every
+	// pixel, with AB_LL as the reference. Segments end within a few depth quantization
+	// steps of a fragment and span up to a quarter of the pixel's depth range.
+	static void benchmarkPackedNodes(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, const AtomicImage& counts,
+		const ABufferSettings& settings, ThreadPool& thread_pool)
+	{
+		const unsigned int width  = counts.width();
+		const unsigned int height = counts.height();
+		unsigned int max_count = 0;
+		unsigned long long num_fragments = 0;
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				max_count = max(max_count, counts(x, y).load());
+				num_fragments += counts(x, y).load();
+			}
+
+		unique_ptr<ABuffer> reference = createABuffer("AB_LL", settings);
+		reference->build(rasterizer, attributes, thread_pool);
+		reference->resolve(thread_pool);
+
+		static const char* const methods[] = { "AB_LL", "AB_LL_BUN", "AB_LLD_BUN_Decoupled", "AB_LL_Packed" };
+		printf("%-22s %10s %11s %11s %13s %16s %11s %11s %9s\n", "Packed nodes", "Bytes/frag", "Memory (MB)", "Build (ms)", "Resolve (ms)",
+			"Depth err (max)", "Queries", "False hits", "Misses");
+		vector<float> reference_depths(max_count + 1), depths(max_count + 1);
+		for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); ++m)
+		{
+			unique_ptr<ABuffer> abuffer = createABuffer(methods[m], settings);
+			double build_time = DBL_MAX, resolve_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				double start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				build_time = min(build_time, currentTime() - start);
+
+				start = currentTime();
+				abuffer->resolve(thread_pool);
+				resolve_time = min(resolve_time, currentTime() - start);
+			}
+
+			// the largest depth error relative to the depth range of its pixel
+			unsigned int seed = tea<16>(3, 4);
+			unsigned long long queries = 0, false_hits = 0, misses = 0;
+			double max_error = 0.0;
+			for (unsigned int y = 0; y < height; ++y)
+				for (unsigned int x = 0; x < width; ++x)
+				{
+					const unsigned int count = reference->getPixelDepths(x, y, &reference_depths[0], max_count + 1);
+					if (count == 0 || abuffer->getPixelDepths(x, y, &depths[0], max_count + 1) != count)
+						continue;
+
+					const float range = reference_depths[0] - reference_depths[count - 1];
+					for (unsigned int i = 0; i < count && range > 0.0f; ++i)
+						max_error = max(max_error, static_cast<double>(fabsf(depths[i] - reference_depths[i]) / range));
+
+					const float step = range / 65535.0f;
+					for (unsigned int q = 0; q < PACKED_BENCHMARK_QUERIES; ++q)
+					{
+						const unsigned int fragment = min(static_cast<unsigned int>(rnd(seed) * count), count - 1);
+						const float maxZ = reference_depths[fragment] + (rnd(seed) * 2.0f - 1.0f) * 4.0f * step;
+						const float minZ = maxZ - rnd(seed) * 0.25f * range;
+						bool reference_hit = false, hit = false;
+						for (unsigned int i = 0; i < count; ++i)
+						{
+							reference_hit = reference_hit || (reference_depths[i] <= maxZ && reference_depths[i] > minZ);
+							hit			  = hit || (depths[i] <= maxZ && depths[i] > minZ);
+						}
+						queries++;
+						false_hits += (hit && !reference_hit) ? 1 : 0;
+						misses	   += (!hit && reference_hit) ? 1 : 0;
+					}
+				}
+
+			const size_t memory = abuffer->memoryUsage();
+			printf("%-22s %10.1f %11.2f %11.2f %13.2f %16.2e %11llu %11llu %9llu\n", methods[m],
+				num_fragments ? static_cast<double>(memory) / num_fragments : 0.0, memory / (1024.0 * 1024.0), build_time * 1000.0,
+				resolve_time * 1000.0, max_error, queries, false_hits, misses);
+			fflush(stdout);
+		}
+
+		// the octahedral normals against the spheremap ones they replace
+		double sum_angle = 0.0, max_angle = 0.0;
+		for (size_t prim = 0; prim < attributes.size(); ++prim)
+		{
+			const float3 n = normalize(decodeSpheremapNormal(attributes[prim].normal));
+			const float3 p = PackedABuffer::decodeNormal(PackedABuffer::encodeNormal(attributes[prim].normal));
+			const double angle = acos(min(max(static_cast<double>(dot(n, p)), -1.0), 1.0)) * 180.0 / M_PI;
+			sum_angle += angle;
+			max_angle  = max(max_angle, angle);
+		}
+		printf("Octahedral normals : %.3f deg mean, %.3f deg max error\n", attributes.empty() ? 0.0 : sum_angle / attributes.size(), max_angle);
+	}
+
+	// A ray segment of the trace test benchmark, within one pixel
+	struct TraceQuery
+	{
+		unsigned int	x, y;
+		float			minZ, maxZ;
+	};
+
+	static const unsigned int	TRACE_QUERIES_PER_PIXEL = 8;
+	static const unsigned int	TRACE_QUERY_BATCH		= 4096;
+
+	// Runs every query through the trace test and returns the elapsed time; the hits are
+	// written as their depth, and NaN for misses, and their albedo
+	static double traceQueries(const ABuffer& abuffer, const vector<TraceQuery>& queries, vector<float>& depths, vector<unsigned int>& albedos, ThreadPool& thread_pool)
+	{
+		depths.resize(queries.size());
+		albedos.resize(queries.size());
+		const double start = currentTime();
+		thread_pool.run(static_cast<unsigned int>((queries.size() + TRACE_QUERY_BATCH - 1) / TRACE_QUERY_BATCH), [&](unsigned int batch, unsigned int)
+		{
+			const size_t end = min(queries.size(), static_cast<size_t>(batch + 1) * TRACE_QUERY_BATCH);
+			for (size_t q = static_cast<size_t>(batch) * TRACE_QUERY_BATCH; q < end; ++q)
+			{
+				const TraceQuery& query = queries[q];
+				float depth;
+				NodeTypeData data;
+				const bool hit = abuffer.traceTest(query.x, query.y, query.minZ, query.maxZ, depth, data);
+				depths[q]  = hit ? depth : NAN;
+				albedos[q] = hit ? data.albedo : 0u;
+			}
+		});
+		return currentTime() - start;
+	}
+
+	// TRACE_QUERIES_PER_PIXEL segments of random length in the depth range of every pixel
+	// with fragments in the resolved reference
+	static void makeTraceQueries(const ABuffer& reference, const AtomicImage& counts, vector<float>& depths, vector<TraceQuery>& queries)
+	{
+		queries.clear();
+		unsigned int seed = tea<16>(5, 6);
+		for (unsigned int y = 0; y < counts.height(); ++y)
+			for (unsigned int x = 0; x < counts.width(); ++x)
+			{
+				const unsigned int count = reference.getPixelDepths(x, y, &depths[0], static_cast<unsigned int>(depths.size()));
+				if (count == 0)
+					continue;
+				const float front = depths[0], back = depths[count - 1];
+				const float range = max(front - back, 1e-3f * fabsf(front));
+				for (unsigned int q = 0; q < TRACE_QUERIES_PER_PIXEL; ++q)
+				{
+					TraceQuery query;
+					query.x	   = x;
+					query.y	   = y;
+					query.maxZ = front + range * (0.1f - 1.2f * rnd(seed));
+					query.minZ = query.maxZ - range * 0.5f * rnd(seed);
+					queries.push_back(query);
+				}
+			}
+	}
+
+	// Every variant in every FragmentLayout, sharing one implementation: build, resolve and
+	// trace test times on the queries of makeTraceQueries. Mismatches are the queries whose
+	// hit differs from the AoS layout of the same variant.
+	static void benchmarkFragmentLayouts(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, const AtomicImage& counts,
+		const ABufferSettings& settings, ThreadPool& thread_pool, vector<float>& depths)
+	{
+		unique_ptr<ABuffer> reference = createABuffer("AB_LL", settings);
+		reference->build(rasterizer, attributes, thread_pool);
+		reference->resolve(thread_pool);
+
+		vector<TraceQuery> queries;
+		makeTraceQueries(*reference, counts, depths, queries);
+
+		printf("%-22s %-10s %11s %11s %13s %11s %9s %11s\n", "Fragment layouts", "Layout", "Memory (MB)", "Build (ms)", "Resolve (ms)", "Trace (ms)",
+			"Errors", "Mismatches");
+		vector<float> reference_depths, trace_depths;
+		vector<unsigned int> reference_albedos, trace_albedos;
+		for (unsigned int m = 0; m < NUM_ABUFFER_BASE_METHODS; ++m)
+			for (int layout = FL_AOS; layout <= FL_AOSOA8; ++layout)
+			{
+				const string method = string(ABUFFER_BASE_METHODS[m]) + getFragmentLayoutSuffix(static_cast<FragmentLayout>(layout));
+				unique_ptr<ABuffer> abuffer = createABuffer(method, settings);
+				double build_time = DBL_MAX, resolve_time = DBL_MAX, trace_time = DBL_MAX;
+				for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+				{
+					double start = currentTime();
+					abuffer->build(rasterizer, attributes, thread_pool);
+					build_time = min(build_time, currentTime() - start);
+
+					start = currentTime();
+					abuffer->resolve(thread_pool);
+					resolve_time = min(resolve_time, currentTime() - start);
+
+					trace_time = min(trace_time, traceQueries(*abuffer, queries, trace_depths, trace_albedos, thread_pool));
+				}
+
+				if (layout == FL_AOS)
+				{
+					reference_depths.swap(trace_depths);
+					reference_albedos.swap(trace_albedos);
+				}
+				unsigned int mismatches = 0;
+				for (size_t q = 0; layout != FL_AOS && q < queries.size(); ++q)
+				{
+					const bool same_hit = (isnan(trace_depths[q]) && isnan(reference_depths[q])) || trace_depths[q] == reference_depths[q];
+					mismatches += (same_hit && trace_albedos[q] == reference_albedos[q]) ? 0 : 1;
+				}
+
+				printf("%-22s %-10s %11.2f %11.2f %13.2f %11.2f %9u %11u\n", ABUFFER_BASE_METHODS[m],
+					(layout == FL_AOS) ? "AoS" : getFragmentLayoutSuffix(static_cast<FragmentLayout>(layout)) + 1, abuffer->memoryUsage() / (1024.0 * 1024.0),
+					build_time * 1000.0, resolve_time * 1000.0, trace_time * 1000.0, countResolveErrors(*abuffer, counts, settings.max_layers, depths, getPixelCapacity(method, settings)), mismatches);
+				fflush(stdout);
+			}
+		printf("Trace queries : %llu\n", static_cast<unsigned long long>(queries.size()));
+	}
+
+	// The k+-buffer for k = 1, 2, 4... up to the largest depth complexity: memory, fixed
+	// for a viewport whatever the scene, times, fragments and pixels beyond k, and the
+	// trace test queries whose hit differs from AB_LL, which holds every fragment
+	static void benchmarkKBuffer(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, const AtomicImage& counts,
+		const ABufferSettings& settings, ThreadPool& thread_pool, vector<float>& depths)
+	{
+		unique_ptr<ABuffer> reference = createABuffer("AB_LL", settings);
+		reference->build(rasterizer, attributes, thread_pool);
+		reference->resolve(thread_pool);
+
+		vector<TraceQuery> queries;
+		makeTraceQueries(*reference, counts, depths, queries);
+		vector<float> reference_depths, trace_depths;
+		vector<unsigned int> reference_albedos, trace_albedos;
+		const double reference_time = traceQueries(*reference, queries, reference_depths, reference_albedos, thread_pool);
+		printf("%-22s %5s %11s %11s %13s %11s %11s %10s %9s %11s\n", "k+-buffer", "k", "Memory (MB)", "Build (ms)", "Resolve (ms)", "Trace (ms)",
+			"Dropped", "Truncated", "Errors", "Mismatches");
+		printf("%-22s %5s %11.2f %11s %13s %11.2f\n", "AB_LL", "-", reference->memoryUsage() / (1024.0 * 1024.0), "-", "-", reference_time * 1000.0);
+
+		const unsigned int max_count = static_cast<unsigned int>(depths.size()) - 1;
+		for (unsigned int k = 1; ; k = min(2 * k, max_count))
+		{
+			ABufferSettings kb_settings = settings;
+			kb_settings.kbuffer_size = k;
+			KBuffer<FL_DECOUPLED> kbuffer(kb_settings);
+			double build_time = DBL_MAX, resolve_time = DBL_MAX, trace_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				double start = currentTime();
+				kbuffer.build(rasterizer, attributes, thread_pool);
+				build_time = min(build_time, currentTime() - start);
+
+				start = currentTime();
+				kbuffer.resolve(thread_pool);
+				resolve_time = min(resolve_time, currentTime() - start);
+
+				trace_time = min(trace_time, traceQueries(kbuffer, queries, trace_depths, trace_albedos, thread_pool));
+			}
+
+			unsigned int truncated = 0;
+			for (unsigned int y = 0; y < counts.height(); ++y)
+				for (unsigned int x = 0; x < counts.width(); ++x)
+					truncated += (counts(x, y).load() > k) ? 1 : 0;
+			unsigned int mismatches = 0;
+			for (size_t q = 0; q < queries.size(); ++q)
+			{
+				const bool same_hit = (isnan(trace_depths[q]) && isnan(reference_depths[q])) || trace_depths[q] == reference_depths[q];
+				mismatches += (same_hit && trace_albedos[q] == reference_albedos[q]) ? 0 : 1;
+			}
+
+			printf("%-22s %5u %11.2f %11.2f %13.2f %11.2f %11llu %10u %9u %11u\n", "AB_KB_Decoupled", k, kbuffer.memoryUsage() / (1024.0 * 1024.0),
+				build_time * 1000.0, resolve_time * 1000.0, trace_time * 1000.0, kbuffer.getDroppedCount(), truncated,
+				countResolveErrors(kbuffer, counts, settings.max_layers, depths, k), mismatches);
+			fflush(stdout);
+			if (k >= max_count)
+				break;
+		}
+	}
+
+	struct CounterLayout
+	{
+		SBufferCounterLayout	layout;
+		unsigned int			counters;
+		bool					padded;
+	};
+
+	static const CounterLayout	BENCHMARK_COUNTER_LAYOUTS[] =
+	{
+		{ SB_COUNTERS_GLSL,		32,		false	},
+		{ SB_COUNTERS_GLSL,		32,		true	},
+		{ SB_COUNTERS_TILED,	32,		false	},
+		{ SB_COUNTERS_TILED,	32,		true	},
+		{ SB_COUNTERS_MORTON,	32,		true	},
+		{ SB_COUNTERS_MORTON,	256,	false	},
+		{ SB_COUNTERS_MORTON,	256,	true	},
+		{ SB_COUNTERS_MORTON,	4096,	true	},
+	};
+
+	// The atomic prefix sum of AB_SB, the stage where the threads contend for the counters,
+	// with every counter layout on 1, 2, 4... threads, up to twice the hardware threads and
+	// at least 8. Prints the fastest stage time of each, and the resolve time and resolve
+	// errors on the last thread count.
+	static void benchmarkCounterContention(const Rasterizer& rasterizer, const vector<NodeTypeData>& attributes, const AtomicImage& counts,
+		const ABufferSettings& settings, vector<float>& depths)
+	{
+		vector<unsigned int> thread_counts;
+		for (unsigned int threads = 1; threads <= max(8u, 2u * thread::hardware_concurrency()); threads *= 2)
+			thread_counts.push_back(threads);
+
+		printf("%-22s %-7s %8s %6s", "S-buffer counters", "Layout", "Counters", "Padded");
+		for (size_t t = 0; t < thread_counts.size(); ++t)
+			printf(" %5u thr (ms)", thread_counts[t]);
+		printf(" %13s %9s\n", "Resolve (ms)", "Errors");
+
+		for (size_t l = 0; l < sizeof(BENCHMARK_COUNTER_LAYOUTS) / sizeof(BENCHMARK_COUNTER_LAYOUTS[0]); ++l)
+		{
+			const CounterLayout& layout = BENCHMARK_COUNTER_LAYOUTS[l];
+			ABufferSettings sb_settings = settings;
+			sb_settings.scan_prefix_sum	  = false;
+			sb_settings.sb_counter_layout = layout.layout;
+			sb_settings.sb_counters		  = layout.counters;
+			sb_settings.sb_pad_counters	  = layout.padded;
+			SBuffer<FL_DECOUPLED> sbuffer(sb_settings);
+
+			printf("%-22s %-7s %8s %6s", "AB_SB_Decoupled", getCounterLayoutName(layout.layout),
+				(layout.layout == SB_COUNTERS_GLSL) ? "-" : to_string(layout.counters).c_str(), layout.padded ? "yes" : "no");
+			double resolve_time = DBL_MAX;
+			for (size_t t = 0; t < thread_counts.size(); ++t)
+			{
+				ThreadPool thread_pool(thread_counts[t]);
+				double prefix_sum_time = DBL_MAX;
+				for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+				{
+					sbuffer.build(rasterizer, attributes, thread_pool);
+					prefix_sum_time = min(prefix_sum_time, sbuffer.getPrefixSumTime());
+					if (t + 1 == thread_counts.size())
+					{
+						const double start = currentTime();
+						sbuffer.resolve(thread_pool);
+						resolve_time = min(resolve_time, currentTime() - start);
+					}
+				}
+				printf(" %14.3f", prefix_sum_time * 1000.0);
+			}
+			printf(" %13.2f %9u\n", resolve_time * 1000.0, countResolveErrors(sbuffer, counts, settings.max_layers, depths));
+			fflush(stdout);
+		}
+	}
+
+	void benchmarkABuffers(const Context& context, const ABufferSettings& settings, ThreadPool& thread_pool)
+	{
+		const TriangleMesh& mesh = *context.mesh;
+		const unsigned int width  = context.output_buffer.width;
+		const unsigned int height = context.output_buffer.height;
+		const RasterCamera camera = { context.camera.eye, context.camera.U, context.camera.V, context.camera.W, context.scene_epsilon };
+
+		Rasterizer rasterizer;
+		double start = currentTime();
+		rasterizer.setup(mesh, camera, width, height, thread_pool);
+		const double setup_time = currentTime() - start;
+
+		vector<NodeTypeData> attributes;
+		computeFragmentAttributes(mesh, camera, attributes);
+
+		// the fragments of every pixel, counted by a pass that does nothing else
+		AtomicImage counts;
+		counts.resize(width, height, 1);
+		double raster_time = DBL_MAX;
+		for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+		{
+			counts.clear(0u, thread_pool);
+			start = currentTime();
+			rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float, unsigned int)
+			{
+				counts(x, y).fetch_add(1u, memory_order_relaxed);
+			});
+			raster_time = min(raster_time, currentTime() - start);
+		}
+
+		unsigned long long num_fragments = 0;
+		unsigned int covered_pixels = 0, max_count = 0;
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned int count = counts(x, y).load();
+				num_fragments += count;
+				covered_pixels += (count > 0) ? 1 : 0;
+				max_count = max(max_count, count);
+			}
+
+		cout << "Triangles : " << mesh.size() << " (" << rasterizer.getTriangleCount() << " after clipping), threads : " << thread_pool.size()
+			 << ", viewport : " << width << "x" << height << ", fragments : " << num_fragments << ", depth complexity : "
+			 << (covered_pixels ? static_cast<double>(num_fragments) / covered_pixels : 0.0) << " mean, " << max_count << " max\n";
+		cout << "Buckets : " << settings.buckets << ", max layers : " << settings.max_layers << ", insert vs shell : " << settings.insert_vs_shell
+			 << ", preallocated fragments : " << (settings.exact_allocation ? string("exact") : to_string(settings.prealloc_fragments)) << "\n";
+		printf("Setup : %.2f ms, rasterization : %.2f ms per geometry pass\n", setup_time * 1000.0, raster_time * 1000.0);
+		printf("%-22s %11s %13s %11s %10s %11s %9s\n", "Method", "Build (ms)", "Resolve (ms)", "Memory (MB)", "Bytes/frag", "Dropped", "Errors");
+
+		vector<float> depths(max_count + 1);
+		for (unsigned int m = 0; m < NUM_ABUFFER_METHODS; ++m)
+		{
+			unique_ptr<ABuffer> abuffer = createABuffer(ABUFFER_METHODS[m], settings);
+
+			double build_time = DBL_MAX, resolve_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				build_time = min(build_time, currentTime() - start);
+
+				start = currentTime();
+				abuffer->resolve(thread_pool);
+				resolve_time = min(resolve_time, currentTime() - start);
+			}
+
+			const unsigned int errors = countResolveErrors(*abuffer, counts, settings.max_layers, depths, getPixelCapacity(ABUFFER_METHODS[m], settings));
+			const size_t memory = abuffer->memoryUsage();
+			printf("%-22s %11.2f %13.2f %11.2f %10.1f %11llu %9u\n", ABUFFER_METHODS[m], build_time * 1000.0, resolve_time * 1000.0,
+				memory / (1024.0 * 1024.0), num_fragments ? static_cast<double>(memory) / num_fragments : 0.0, abuffer->getDroppedCount(), errors);
+			fflush(stdout);
+		}
+
+		// the linked lists with either allocation: exact pools are timed on their first build,
+		// which counts and allocates, on later ones, and on a build after a smaller viewport,
+		// which runs out of nodes unless the bounds pass counted them
+		Rasterizer half_rasterizer;
+		half_rasterizer.setup(mesh, camera, max(width / 2, 1u), max(height / 2, 1u), thread_pool);
+		printf("%-22s %15s %11s %11s %15s %11s %14s %11s %10s %9s\n", "Linked list", "Prealloc (ms)", "Memory (MB)", "Dropped",
+			"First build (ms)", "Build (ms)", "Growing (ms)", "Memory (MB)", "Overflows", "Errors");
+		for (unsigned int m = 0; m < NUM_ABUFFER_METHODS; ++m)
+		{
+			if (string(ABUFFER_METHODS[m]).compare(0, 5, "AB_LL") != 0 || string(ABUFFER_METHODS[m]) == "AB_LL_Packed")
+				continue;
+
+			ABufferSettings prealloc_settings = settings;
+			prealloc_settings.exact_allocation = false;
+			unique_ptr<ABuffer> abuffer = createABuffer(ABUFFER_METHODS[m], prealloc_settings);
+			double prealloc_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				prealloc_time = min(prealloc_time, currentTime() - start);
+			}
+			const size_t prealloc_memory = abuffer->memoryUsage();
+			const unsigned long long dropped = abuffer->getDroppedCount();
+
+			ABufferSettings exact_settings = settings;
+			exact_settings.exact_allocation = true;
+			double first_time = DBL_MAX, build_time = DBL_MAX, growing_time = DBL_MAX;
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				abuffer = createABuffer(ABUFFER_METHODS[m], exact_settings);
+				start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				first_time = min(first_time, currentTime() - start);
+			}
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				build_time = min(build_time, currentTime() - start);
+			}
+			unsigned long long overflows = abuffer->getOverflowCount();
+			for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+			{
+				abuffer->build(half_rasterizer, attributes, thread_pool);
+				start = currentTime();
+				abuffer->build(rasterizer, attributes, thread_pool);
+				growing_time = min(growing_time, currentTime() - start);
+			}
+			overflows = abuffer->getOverflowCount() - overflows;
+			abuffer->resolve(thread_pool);
+
+			printf("%-22s %15.2f %11.2f %11llu %15.2f %11.2f %14.2f %11.2f %10llu %9u\n", ABUFFER_METHODS[m], prealloc_time * 1000.0,
+				prealloc_memory / (1024.0 * 1024.0), dropped, first_time * 1000.0, build_time * 1000.0, growing_time * 1000.0,
+				abuffer->memoryUsage() / (1024.0 * 1024.0), overflows, countResolveErrors(*abuffer, counts, settings.max_layers, depths));
+			fflush(stdout);
+		}
+
+		benchmarkPackedNodes(rasterizer, attributes, counts, settings, thread_pool);
+		benchmarkFragmentLayouts(rasterizer, attributes, counts, settings, thread_pool, depths);
+		benchmarkKBuffer(rasterizer, attributes, counts, settings, thread_pool, depths);
+
+		// the S-buffer once more with either prefix sum and either resolve
+		printf("%-22s %-12s %-10s %16s %11s %13s %9s\n", "S-buffer", "Prefix sum", "Resolve", "Prefix sum (ms)", "Build (ms)", "Resolve (ms)", "Errors");
+		for (int decoupled = 0; decoupled < 2; ++decoupled)
+			for (int mode = 0; mode < 4; ++mode)
+			{
+				const bool scan = (mode & 1) != 0, radix = (mode & 2) != 0;
+				ABufferSettings sb_settings = settings;
+				sb_settings.scan_prefix_sum = scan;
+				sb_settings.radix_resolve	= radix;
+				unique_ptr<ABuffer> abuffer(decoupled ? static_cast<ABuffer*>(new SBuffer<FL_DECOUPLED>(sb_settings)) : new SBuffer<FL_AOS>(sb_settings));
+
+				double prefix_sum_time = DBL_MAX, build_time = DBL_MAX, resolve_time = DBL_MAX;
+				for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+				{
+					start = currentTime();
+					abuffer->build(rasterizer, attributes, thread_pool);
+					build_time = min(build_time, currentTime() - start);
+					prefix_sum_time = min(prefix_sum_time, decoupled ? static_cast<SBuffer<FL_DECOUPLED>&>(*abuffer).getPrefixSumTime() : static_cast<SBuffer<FL_AOS>&>(*abuffer).getPrefixSumTime());
+
+					start = currentTime();
+					abuffer->resolve(thread_pool);
+					resolve_time = min(resolve_time, currentTime() - start);
+				}
+				printf("%-22s %-12s %-10s %16.3f %11.2f %13.2f %9u\n", decoupled ? "AB_SB_Decoupled" : "AB_SB", scan ? "scan" : "atomic",
+					radix ? "radix" : "per pixel", prefix_sum_time * 1000.0, build_time * 1000.0, resolve_time * 1000.0,
+					countResolveErrors(*abuffer, counts, settings.max_layers, depths));
+				fflush(stdout);
+			}
+
+		benchmarkCounterContention(rasterizer, attributes, counts, settings, depths);
+
+		// the sorting step alone, on the depth complexity of the view and synthetic ones
+		vector<unsigned int> scene_counts;
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				if (counts(x, y).load() > 0u)
+					scene_counts.push_back(min(counts(x, y).load(), max(settings.max_layers, 1u)));
+		benchmarkFragmentSort(scene_counts, settings);
+	}
+
+	// Texels of all levels that differ between two pyramids of the same views
+	static unsigned int countPyramidErrors(const DepthBoundsPyramid& pyramid, const DepthBoundsPyramid& reference)
+	{
+		unsigned int errors = 0;
+		for (unsigned int v = 0; v < pyramid.getViewCount(); ++v)
+			for (unsigned int lod = 0; lod < pyramid.getLevels(v); ++lod)
+			{
+				const uint2 size = pyramid.getSize(v, lod);
+				for (unsigned int y = 0; y < size.y; ++y)
+					for (unsigned int x = 0; x < size.x; ++x)
+						errors += (pyramid(v, lod, x, y).x != reference(v, lod, x, y).x || pyramid(v, lod, x, y).y != reference(v, lod, x, y).y) ? 1 : 0;
+			}
+		return errors;
+	}
+
+	void benchmarkDepthBounds(const Context& context, const MMRTSettings& settings, ThreadPool& thread_pool)
+	{
+		const TriangleMesh& mesh = *context.mesh;
+		const unsigned int width  = context.output_buffer.width;
+		const unsigned int height = context.output_buffer.height;
+		const RasterCamera camera = { context.camera.eye, context.camera.U, context.camera.V, context.camera.W, settings.near_plane };
+		const float scene_length = length(mesh.sceneBBox().extent());
+
+		MMRTTracer still(settings);
+		still.build(mesh, camera, width, height, scene_length, thread_pool);
+
+		// the character: of the objects, the triangles connected through shared vertices,
+		// under a tenth of the scene across, the one closest to the nearest surface at the
+		// center of the view, moved by its own size along U
+		const DepthBoundsPyramid& still_bounds = still.getDepthBounds();
+		const float center_depth = still_bounds(MMRT_FACE_PRIMARY, 0, width / 2, height / 2).x;
+		const float3 center = (center_depth > -FLT_MAX) ? camera.eye + normalize(camera.W) * -center_depth : mesh.sceneBBox().center();
+
+		vector<unsigned int> parents(mesh.vertex_buffer.size());
+		for (size_t i = 0; i < parents.size(); ++i)
+			parents[i] = static_cast<unsigned int>(i);
+		auto find = [&](unsigned int i) { while (parents[i] != i) i = parents[i] = parents[parents[i]]; return i; };
+		for (unsigned int t = 0; t < mesh.size(); ++t)
+		{
+			const int3& v = mesh.vindex_buffer[t];
+			parents[find(v.y)] = find(v.x);
+			parents[find(v.z)] = find(v.x);
+		}
+		vector<Aabb> objects(parents.size());
+		for (unsigned int t = 0; t < mesh.size(); ++t)
+		{
+			const int3& v = mesh.vindex_buffer[t];
+			Aabb& object = objects[find(v.x)];
+			object.include(mesh.vertex_buffer[v.x]);
+			object.include(mesh.vertex_buffer[v.y]);
+			object.include(mesh.vertex_buffer[v.z]);
+		}
+		unsigned int character = 0;
+		float character_distance = FLT_MAX;
+		for (unsigned int i = 0; i < objects.size(); ++i)
+		{
+			if (!objects[i].valid() || length(objects[i].extent()) >= scene_length * 0.1f)
+				continue;
+			const float distance = length(objects[i].center() - center);
+			if (distance < character_distance)
+			{
+				character			= i;
+				character_distance	= distance;
+			}
+		}
+
+		TriangleMesh moved_mesh = mesh;
+		unsigned int moved_triangles = 0;
+		if (character_distance < FLT_MAX)
+		{
+			const float3 offset = normalize(camera.U) * length(objects[character].extent());
+			for (size_t i = 0; i < parents.size(); ++i)
+				if (find(static_cast<unsigned int>(i)) == character)
+					moved_mesh.vertex_buffer[i] += offset;
+			for (unsigned int t = 0; t < mesh.size(); ++t)
+				moved_triangles += (find(mesh.vindex_buffer[t].x) == character) ? 1 : 0;
+		}
+
+		MMRTTracer moved(settings);
+		moved.build(moved_mesh, camera, width, height, scene_length, thread_pool);
+
+		vector<uint2>				sizes;
+		vector<const AtomicImage*>	frames[2];
+		for (unsigned int v = 0; v < still.getViewCount(); ++v)
+		{
+			sizes.push_back(make_uint2(still.getView(v).width, still.getView(v).height));
+			frames[0].push_back(&still.getView(v).abuffer->getDepthBounds());
+			frames[1].push_back(&moved.getView(v).abuffer->getDepthBounds());
+		}
+
+		cout << "Triangles : " << mesh.size() << " (" << moved_triangles << " moved), views : " << sizes.size() << " of " << width << "x" << height;
+		if (sizes.size() > 1)
+			cout << " and " << sizes[1].x << "x" << sizes[1].y;
+		cout << ", threads : " << thread_pool.size() << "\n";
+		printf("%-22s %-7s %11s %11s %11s %13s %9s\n", "Depth bounds", "SIMD", "Update (ms)", "Reduce (ms)", "Total (ms)", "Dirty tiles", "Errors");
+
+		// the full rebuilds of both frames, to check the incremental updates against
+		DepthBoundsPyramid references[2];
+		for (unsigned int f = 0; f < 2; ++f)
+		{
+			references[f].reset(sizes);
+			references[f].update(frames[f], thread_pool);
+			references[f].build(thread_pool, true);
+		}
+
+		const SimdLevel simd_level = getSimdLevel();
+		const char*		modes[] = { "Full rebuild", "Static frame", "Object moved" };
+		for (int level = SIMD_SCALAR; level <= simd_level; ++level)
+		{
+			setSimdLevel(static_cast<SimdLevel>(level));
+			for (unsigned int mode = 0; mode < 3; ++mode)
+			{
+				DepthBoundsPyramid pyramid;
+				pyramid.reset(sizes);
+				pyramid.update(frames[0], thread_pool);
+				pyramid.build(thread_pool, true);
+
+				double update_time = DBL_MAX, reduce_time = DBL_MAX;
+				unsigned int frame = 0, errors = 0;
+				for (unsigned int r = 0; r < ABUFFER_REPETITIONS; ++r)
+				{
+					// the object moves back and forth between the two frames
+					frame = (mode == 1) ? 0 : ((r + 1) & 1);
+					double start = currentTime();
+					pyramid.update(frames[frame], thread_pool);
+					update_time = min(update_time, currentTime() - start);
+					start = currentTime();
+					pyramid.build(thread_pool, mode == 0);
+					reduce_time = min(reduce_time, currentTime() - start);
+					errors += countPyramidErrors(pyramid, references[frame]);
+				}
+				printf("%-22s %-7s %11.3f %11.3f %11.3f %6u/%-6u %9u\n", modes[mode], getSimdLevelName(static_cast<SimdLevel>(level)),
+					update_time * 1000.0, reduce_time * 1000.0, (update_time + reduce_time) * 1000.0, pyramid.getDirtyTileCount(), pyramid.getTileCount(), errors);
+				fflush(stdout);
+			}
+		}
+		setSimdLevel(simd_level);
+	}
+}
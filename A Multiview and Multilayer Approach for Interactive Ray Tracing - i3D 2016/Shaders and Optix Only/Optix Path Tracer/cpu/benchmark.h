@@ -0,0 +1,38 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Build and traversal benchmark of the CPU acceleration structures
+
+#pragma once
+
+#include "abuffer.h"
+#include "context.h"
+#include "mmrt.h"
+#include "thread_pool.h"
+
+namespace cpu
+{
+	// Builds every CPU acceleration structure over context.mesh and traces the same
+	// primary, shadow and diffuse rays through each of them, one ray per pixel of the
+	// output buffer as seen from context.camera; the primary rays are traced once more in
+	// packets. Prints build time, memory footprint, rays/s and the number of results that
+	// disagree with the binned SAH BVH.
+	void benchmarkAccels(const Context& context, ThreadPool& thread_pool);
+
+	// Rasterizes context.mesh over the output buffer as seen from context.camera and builds
+	// and resolves every A-buffer variant from the fragments, with the given settings.
+	// Prints construction and resolve time, memory footprint and bytes per fragment, the
+	// fragments dropped by a full node buffer and the pixels whose resolved fragments are not
+	// all of theirs in front-to-back order. The rasterization time of the fragments alone is
+	// reported first, as the share of construction that all variants pay once per pass.
+	// Last, the per-pixel sort alone is timed on the depth complexity of the view and on
+	// synthetic ones, with the GLSL sort and with the sorting networks.
+	void benchmarkABuffers(const Context& context, const ABufferSettings& settings, ThreadPool& thread_pool);
+
+	// Builds the MMRT views of context.mesh around context.camera twice, the second time
+	// with the triangles around the nearest surface at the center of the view moved
+	// sideways, as a character walking through a static scene. Times the depth-bounds
+	// pyramids of all views rebuilt in full against the incremental update, on a frame
+	// where nothing moved and on frames that alternate between the two, at every SIMD
+	// level. Prints the tiles reduced and the texels that differ from a full rebuild.
+	void benchmarkDepthBounds(const Context& context, const MMRTSettings& settings, ThreadPool& thread_pool);
+}
@@ -0,0 +1,431 @@
+#include "bvh.h"
+#include "accel_cache.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const int			SAH_BINS		= 32;
+	static const unsigned int	MAX_LEAF_SIZE	= 8;
+	static const int			STACK_SIZE		= 64;
+	static const unsigned int	MAX_DEPTH		= 48;		// keeps traversal within its stack
+	static const float			SIMD_LEAF_COST	= 2.0f;		// one 8-wide triangle test, relative to a traversal step
+
+	struct BuildTask
+	{
+		unsigned int node;
+		unsigned int begin;
+		unsigned int end;
+		unsigned int depth;
+	};
+
+	// Leading record of a cached Bvh, followed by its arrays
+	struct BvhCacheHeader
+	{
+		unsigned int method;
+		unsigned int num_nodes;
+		unsigned int num_prim_indices;
+		unsigned int num_leaf_triangles;
+		unsigned int num_leaf_groups;
+	};
+
+	void Bvh::build(const TriangleMesh& mesh)
+	{
+		m_mesh = &mesh;
+		m_mapping.reset();
+		m_nodes.clear();
+		m_prim_indices.clear();
+		m_leaf_triangles.clear();
+		m_leaf_groups.clear();
+
+		// primitive references, skipping degenerate triangles as mesh_bounds does
+		vector<Aabb> prim_bounds;
+		for (unsigned int i = 0; i < mesh.size(); ++i)
+		{
+			Aabb aabb = mesh.bounds(i);
+			if (!aabb.valid())
+				continue;
+			m_prim_indices.push_back(i);
+			prim_bounds.push_back(aabb);
+		}
+
+		if (m_prim_indices.empty())
+		{
+			m_nodes.push_back(BvhNode());
+			m_nodes[0].bmin  = m_nodes[0].bmax = make_float3(0.0f);
+			m_nodes[0].first = m_nodes[0].count = 0;
+			bindArrays();
+			return;
+		}
+
+		switch (m_method)
+		{
+		case BM_SPATIAL_SPLITS:	buildSpatialSplits(prim_bounds);	break;
+		case BM_MORTON:			buildMorton(prim_bounds);			break;
+		default:				buildObjectSplits(prim_bounds);		break;
+		}
+
+		if (m_simd_leaves && getSimdLevel() >= SIMD_AVX2)
+			packLeafTriangles();
+		bindArrays();
+	}
+
+	void Bvh::bindArrays(void)
+	{
+		m_node_array		  = ArrayView<BvhNode>(m_nodes);
+		m_prim_index_array	  = ArrayView<unsigned int>(m_prim_indices);
+		m_leaf_triangle_array = ArrayView<BvhTriangles8>(m_leaf_triangles);
+		m_leaf_group_array	  = ArrayView<unsigned int>(m_leaf_groups);
+	}
+
+	bool Bvh::save(ostream& out) const
+	{
+		BvhCacheHeader header;
+		header.method			  = static_cast<unsigned int>(m_method);
+		header.num_nodes		  = static_cast<unsigned int>(m_node_array.size);
+		header.num_prim_indices	  = static_cast<unsigned int>(m_prim_index_array.size);
+		header.num_leaf_triangles = static_cast<unsigned int>(m_leaf_triangle_array.size);
+		header.num_leaf_groups	  = static_cast<unsigned int>(m_leaf_group_array.size);
+		writeCacheArray(out, &header, 1);
+		writeCacheArray(out, m_node_array.data, m_node_array.size);
+		writeCacheArray(out, m_prim_index_array.data, m_prim_index_array.size);
+		writeCacheArray(out, m_leaf_triangle_array.data, m_leaf_triangle_array.size);
+		writeCacheArray(out, m_leaf_group_array.data, m_leaf_group_array.size);
+		return !out.fail();
+	}
+
+	// Depth of the deepest leaf, or ~0u when the nodes do not form a tree whose children come
+	// after their parent, as all builders store them. The stack of a traversal holds at most
+	// one node per level, so the cached trees are checked against MAX_DEPTH before use.
+	static unsigned int getTreeDepth(const ArrayView<BvhNode>& nodes)
+	{
+		if (nodes.size == 1)
+			return 0;
+		vector<unsigned int> depth(nodes.size, 0u);
+		unsigned int max_depth = 0;
+		for (size_t n = 0; n < nodes.size; ++n)
+		{
+			const BvhNode& node = nodes[n];
+			if (node.count > 0)
+			{
+				max_depth = max(max_depth, depth[n]);
+				continue;
+			}
+			if (node.first <= n || node.first + 1 >= nodes.size)
+				return ~0u;
+			depth[node.first] = depth[node.first + 1] = depth[n] + 1;
+		}
+		return max_depth;
+	}
+
+	bool Bvh::load(const shared_ptr<const MappedFile>& file, size_t offset, size_t size, const TriangleMesh& mesh)
+	{
+		const size_t end = offset + size;
+		ArrayView<BvhCacheHeader> header;
+		if (!readCacheArray(*file, offset, end, 1, header) || header[0].method != static_cast<unsigned int>(m_method) ||
+			header[0].num_nodes == 0 || (header[0].num_leaf_groups != 0 && header[0].num_leaf_groups != header[0].num_nodes))
+			return false;
+
+		ArrayView<BvhNode>			nodes;
+		ArrayView<unsigned int>		prim_indices, leaf_groups;
+		ArrayView<BvhTriangles8>	leaf_triangles;
+		if (!readCacheArray(*file, offset, end, header[0].num_nodes, nodes) ||
+			!readCacheArray(*file, offset, end, header[0].num_prim_indices, prim_indices) ||
+			!readCacheArray(*file, offset, end, header[0].num_leaf_triangles, leaf_triangles) ||
+			!readCacheArray(*file, offset, end, header[0].num_leaf_groups, leaf_groups) ||
+			getTreeDepth(nodes) > MAX_DEPTH)
+			return false;
+
+		m_mesh = &mesh;
+		m_nodes.clear();
+		m_prim_indices.clear();
+		m_leaf_triangles.clear();
+		m_leaf_groups.clear();
+		m_node_array		  = nodes;
+		m_prim_index_array	  = prim_indices;
+		m_leaf_triangle_array = leaf_triangles;
+		m_leaf_group_array	  = leaf_groups;
+		m_mapping			  = file;
+		return true;
+	}
+
+	void Bvh::packLeafTriangles(void)
+	{
+		m_leaf_groups.assign(m_nodes.size(), NO_LEAF_GROUP);
+		for (size_t n = 0; n < m_nodes.size(); ++n)
+		{
+			const BvhNode& node = m_nodes[n];
+			if (node.count < MIN_SIMD_LEAF_SIZE)
+				continue;
+			m_leaf_groups[n] = static_cast<unsigned int>(m_leaf_triangles.size());
+			for (unsigned int first = 0; first < node.count; first += 8)
+			{
+				BvhTriangles8 group;
+				for (unsigned int lane = 0; lane < 8; ++lane)
+				{
+					const unsigned int prim  = m_prim_indices[node.first + min(first + lane, node.count - 1)];
+					const int3		   v_idx = m_mesh->vindex_buffer[prim];
+					const float3 p0 = m_mesh->vertex_buffer[v_idx.x];
+					const float3 e0 = m_mesh->vertex_buffer[v_idx.y] - p0;
+					const float3 e1 = p0 - m_mesh->vertex_buffer[v_idx.z];
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						group.p0[axis][lane] = component(p0, axis);
+						group.e0[axis][lane] = component(e0, axis);
+						group.e1[axis][lane] = component(e1, axis);
+					}
+					group.prim[lane] = prim;
+				}
+				m_leaf_triangles.push_back(group);
+			}
+		}
+		// no leaf large enough, e.g. the median and LBVH builds of at most 2 triangles per leaf
+		if (m_leaf_triangles.empty())
+			m_leaf_groups.clear();
+	}
+
+	size_t Bvh::memoryUsage(void) const
+	{
+		return m_node_array.size * sizeof(BvhNode) + m_prim_index_array.size * sizeof(unsigned int) +
+			m_leaf_triangle_array.size * sizeof(BvhTriangles8) + m_leaf_group_array.size * sizeof(unsigned int);
+	}
+
+	// SAH cost of intersecting count primitives, in groups of 8 when the leaf is packed for 8-wide tests
+	static inline float leafCost(unsigned int count, bool simd_leaves)
+	{
+		return (simd_leaves && count >= MIN_SIMD_LEAF_SIZE) ? SIMD_LEAF_COST * static_cast<float>((count + 7) / 8) : static_cast<float>(count);
+	}
+
+	void Bvh::buildObjectSplits(const vector<Aabb>& prim_bounds)
+	{
+		const bool simd_leaves = m_simd_leaves && getSimdLevel() >= SIMD_AVX2;
+
+		vector<float3> centroids(prim_bounds.size());
+		for (size_t i = 0; i < prim_bounds.size(); ++i)
+			centroids[i] = prim_bounds[i].center();
+
+		m_nodes.reserve(2 * prim_bounds.size());
+		m_nodes.push_back(BvhNode());
+
+		// sorted alongside m_prim_indices
+		vector<unsigned int> order(m_prim_indices.size());
+		for (unsigned int i = 0; i < order.size(); ++i)
+			order[i] = i;
+
+		vector<BuildTask> tasks;
+		BuildTask root = { 0u, 0u, static_cast<unsigned int>(order.size()), 0u };
+		tasks.push_back(root);
+
+		while (!tasks.empty())
+		{
+			BuildTask task = tasks.back();
+			tasks.pop_back();
+
+			Aabb bounds, centroid_bounds;
+			for (unsigned int i = task.begin; i < task.end; ++i)
+			{
+				bounds.include(prim_bounds[order[i]]);
+				centroid_bounds.include(centroids[order[i]]);
+			}
+
+			BvhNode& node = m_nodes[task.node];
+			node.bmin  = bounds.m_min;
+			node.bmax  = bounds.m_max;
+			node.first = task.begin;
+			node.count = task.end - task.begin;
+
+			const unsigned int count = task.end - task.begin;
+			if (count <= 2 || task.depth >= MAX_DEPTH)
+				continue;
+
+			// [Binned SAH]
+			int   best_axis = -1, best_split = 0;
+			float best_cost = leafCost(count, simd_leaves);
+			for (int axis = 0; axis < 3 && m_method == BM_BINNED_SAH; ++axis)
+			{
+				const float cmin   = component(centroid_bounds.m_min, axis);
+				const float extent = component(centroid_bounds.m_max, axis) - cmin;
+				if (extent <= 0.0f)
+					continue;
+				const float scale = SAH_BINS / extent;
+
+				Aabb		 bin_bounds[SAH_BINS];
+				unsigned int bin_count[SAH_BINS] = { 0 };
+				for (unsigned int i = task.begin; i < task.end; ++i)
+				{
+					int b = min(SAH_BINS - 1, static_cast<int>((component(centroids[order[i]], axis) - cmin) * scale));
+					bin_bounds[b].include(prim_bounds[order[i]]);
+					bin_count[b]++;
+				}
+
+				// sweep from the right, then evaluate from the left
+				float		 right_area[SAH_BINS];
+				Aabb		 right;
+				unsigned int right_count = 0;
+				for (int b = SAH_BINS - 1; b > 0; --b)
+				{
+					right.include(bin_bounds[b]);
+					right_count += bin_count[b];
+					right_area[b] = right_count ? right.area() * leafCost(right_count, simd_leaves) : 0.0f;
+				}
+
+				Aabb		 left;
+				unsigned int left_count = 0;
+				const float	 inv_area = 1.0f / bounds.area();
+				for (int b = 0; b < SAH_BINS - 1; ++b)
+				{
+					left.include(bin_bounds[b]);
+					left_count += bin_count[b];
+					if (left_count == 0 || left_count == count)
+						continue;
+					float cost = 1.0f + (left.area() * leafCost(left_count, simd_leaves) + right_area[b + 1]) * inv_area;
+					if (cost < best_cost)
+					{
+						best_cost  = cost;
+						best_axis  = axis;
+						best_split = b;
+					}
+				}
+			}
+
+			unsigned int mid;
+			if (best_axis >= 0)
+			{
+				const float cmin  = component(centroid_bounds.m_min, best_axis);
+				const float scale = SAH_BINS / (component(centroid_bounds.m_max, best_axis) - cmin);
+				mid = static_cast<unsigned int>(partition(order.begin() + task.begin, order.begin() + task.end,
+					[&](unsigned int i) { return min(SAH_BINS - 1, static_cast<int>((component(centroids[i], best_axis) - cmin) * scale)) <= best_split; })
+					- order.begin());
+			}
+			else if (count > MAX_LEAF_SIZE || m_method == BM_MEDIAN)
+			{
+				// median on the largest extent; also the fallback when SAH finds no profitable
+				// split but there are too many primitives for a leaf
+				int axis = centroid_bounds.longestAxis();
+				mid = task.begin + count / 2;
+				nth_element(order.begin() + task.begin, order.begin() + mid, order.begin() + task.end,
+					[&](unsigned int a, unsigned int b) { return component(centroids[a], axis) < component(centroids[b], axis); });
+			}
+			else
+				continue;
+
+			const unsigned int left_child = static_cast<unsigned int>(m_nodes.size());
+			m_nodes.push_back(BvhNode());
+			m_nodes.push_back(BvhNode());
+			m_nodes[task.node].first = left_child;
+			m_nodes[task.node].count = 0;
+
+			BuildTask right_task = { left_child + 1, mid, task.end, task.depth + 1 };
+			BuildTask left_task  = { left_child, task.begin, mid, task.depth + 1 };
+			tasks.push_back(right_task);
+			tasks.push_back(left_task);
+		}
+
+		vector<unsigned int> prim_indices(order.size());
+		for (unsigned int i = 0; i < order.size(); ++i)
+			prim_indices[i] = m_prim_indices[order[i]];
+		m_prim_indices.swap(prim_indices);
+	}
+
+	static inline bool intersect_box(const BvhNode& node, const float3& origin, const float3& inv_dir, float tmin, float tmax, float& tnear)
+	{
+		// std::min/max rather than fminf/fmaxf, which are library calls on the host
+		float3 t0 = (node.bmin - origin) * inv_dir;
+		float3 t1 = (node.bmax - origin) * inv_dir;
+		tnear = max(max(tmin, min(t0.x, t1.x)), max(min(t0.y, t1.y), min(t0.z, t1.z)));
+		float tfar = min(min(tmax, max(t0.x, t1.x)), min(max(t0.y, t1.y), max(t0.z, t1.z)));
+		return tnear <= tfar;
+	}
+
+	template<bool ANY_HIT>
+	static inline bool traverse(const BvhNode* nodes, const unsigned int* prim_indices,
+		const TriangleMesh& mesh, Ray ray, Hit& hit)
+	{
+		const float3 inv_dir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+		bool found = false;
+		unsigned int stack[STACK_SIZE];
+		int sp = 0;
+		unsigned int current = 0;
+		float tnear;
+		if (!intersect_box(nodes[0], ray.origin, inv_dir, ray.tmin, ray.tmax, tnear))
+			return false;
+
+		for (;;)
+		{
+			const BvhNode& node = nodes[current];
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.first; i < node.first + node.count; ++i)
+				{
+					if (intersect_primitive(mesh, prim_indices[i], ray, hit))
+					{
+						if (ANY_HIT)
+							return true;
+						found = true;
+					}
+				}
+			}
+			else
+			{
+				float tnear_left, tnear_right;
+				bool left  = intersect_box(nodes[node.first],	  ray.origin, inv_dir, ray.tmin, ray.tmax, tnear_left);
+				bool right = intersect_box(nodes[node.first + 1], ray.origin, inv_dir, ray.tmin, ray.tmax, tnear_right);
+				if (left && right)
+				{
+					// visit the nearest child first
+					unsigned int near_child = node.first, far_child = node.first + 1;
+					if (tnear_right < tnear_left)
+						swap(near_child, far_child);
+					assert(sp < STACK_SIZE);
+					stack[sp++] = far_child;
+					current = near_child;
+					continue;
+				}
+				if (left)  { current = node.first;	   continue; }
+				if (right) { current = node.first + 1; continue; }
+			}
+
+			if (sp == 0)
+				break;
+			current = stack[--sp];
+		}
+		return found;
+	}
+
+	bool Bvh::intersect(const Ray& ray, Hit& hit) const
+	{
+		if (!m_leaf_triangle_array.empty() && getSimdLevel() >= SIMD_AVX2)
+			return traverseAvx2(m_node_array.data, m_leaf_group_array.data, m_leaf_triangle_array.data, *m_mesh, m_prim_index_array.data, ray, hit, false);
+		return traverse<false>(m_node_array.data, m_prim_index_array.data, *m_mesh, ray, hit);
+	}
+
+	bool Bvh::occluded(const Ray& ray) const
+	{
+		Hit hit;
+		if (!m_leaf_triangle_array.empty() && getSimdLevel() >= SIMD_AVX2)
+			return traverseAvx2(m_node_array.data, m_leaf_group_array.data, m_leaf_triangle_array.data, *m_mesh, m_prim_index_array.data, ray, hit, true);
+		return traverse<true>(m_node_array.data, m_prim_index_array.data, *m_mesh, ray, hit);
+	}
+
+	void Bvh::intersectPacket(RayPacket& packet) const
+	{
+		const SimdLevel level = getSimdLevel();
+		if (m_prim_index_array.empty())
+			return;
+		if (level >= SIMD_AVX512)
+			intersectPacketAvx512(m_node_array.data, *m_mesh, m_prim_index_array.data, packet);
+		else if (level >= SIMD_AVX2)
+		{
+			for (unsigned int base = 0; base < packet.size; base += 8)
+				intersectPacketAvx2(m_node_array.data, *m_mesh, m_prim_index_array.data, packet, base);
+		}
+		else
+			Accel::intersectPacket(packet);
+	}
+}
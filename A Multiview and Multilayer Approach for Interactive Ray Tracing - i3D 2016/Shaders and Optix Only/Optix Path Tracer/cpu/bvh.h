@@ -0,0 +1,102 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Binary BVH of the CPU backend. The node layout and traversal are shared by all
+// BVH builders; they differ only in how the primitives are split.
+
+#pragma once
+
+#include "accel.h"
+#include <optixu/optixu_aabb_namespace.h>
+#include <vector>
+
+namespace cpu
+{
+	// 32 bytes. Inner nodes (count == 0) store their two children at first and first + 1,
+	// leaves store count primitives starting at first in the primitive index list
+	struct BvhNode
+	{
+		float3			bmin;
+		unsigned int	first;
+		float3			bmax;
+		unsigned int	count;
+	};
+
+	// Up to 8 triangles of a leaf in SoA layout, for the single-ray AVX2 leaf test.
+	// Edges as in intersect_triangle; lanes past the end of the leaf repeat its last triangle.
+	struct BvhTriangles8
+	{
+		float			p0[3][8];
+		float			e0[3][8];		// p1 - p0
+		float			e1[3][8];		// p0 - p2
+		unsigned int	prim[8];
+	};
+
+	// Leaves with fewer triangles are not packed: their groups would be mostly padding, and
+	// testing them one at a time costs no more than one 8-wide test (SIMD_LEAF_COST)
+	static const unsigned int	MIN_SIMD_LEAF_SIZE	= 3;
+	// Leaf group of the unpacked leaves and the inner nodes
+	static const unsigned int	NO_LEAF_GROUP		= 0xFFFFFFFFu;
+
+	class Bvh : public Accel
+	{
+	public:
+		enum BuildMethod
+		{
+			BM_BINNED_SAH = 0,		// binned SAH object splits
+			BM_MEDIAN,				// object median on the largest centroid extent
+			BM_SPATIAL_SPLITS,		// SBVH: binned SAH object and spatial splits
+			BM_MORTON				// LBVH: radix splits of sorted Morton codes
+		};
+
+		// simd_leaves: size the leaves for, and pack them into, 8-wide triangle tests when AVX2
+		// is available at build time; structures that only borrow the hierarchy turn it off
+		explicit Bvh(BuildMethod method = BM_BINNED_SAH, bool simd_leaves = true) : m_method(method), m_simd_leaves(simd_leaves), m_mesh(0) {}
+
+		void	build(const TriangleMesh& mesh);
+		bool	intersect(const Ray& ray, Hit& hit) const;
+		bool	occluded(const Ray& ray) const;
+		void	intersectPacket(RayPacket& packet) const;
+		size_t	memoryUsage(void) const;
+		bool	save(std::ostream& out) const;
+		bool	load(const std::shared_ptr<const MappedFile>& file, size_t offset, size_t size, const TriangleMesh& mesh);
+
+		unsigned int	getNodeCount(void) const { return static_cast<unsigned int>(m_node_array.size); }
+		const ArrayView<BvhNode>&		getNodes(void) const { return m_node_array; }
+		const ArrayView<unsigned int>&	getPrimIndices(void) const { return m_prim_index_array; }
+
+	private:
+		BuildMethod					m_method;
+		bool						m_simd_leaves;
+		const TriangleMesh*			m_mesh;
+		std::vector<BvhNode>		m_nodes;
+		std::vector<unsigned int>	m_prim_indices;
+		// filled when AVX2 is selected at build time: the first triangle group of each leaf node
+		// of at least MIN_SIMD_LEAF_SIZE triangles, NO_LEAF_GROUP for the other nodes
+		std::vector<BvhTriangles8>	m_leaf_triangles;
+		std::vector<unsigned int>	m_leaf_groups;
+
+		// the arrays traversed: views of the vectors above after build(), or of the mapped
+		// cache file after load(), in which case the vectors stay empty
+		ArrayView<BvhNode>					m_node_array;
+		ArrayView<unsigned int>				m_prim_index_array;
+		ArrayView<BvhTriangles8>			m_leaf_triangle_array;
+		ArrayView<unsigned int>				m_leaf_group_array;
+		std::shared_ptr<const MappedFile>	m_mapping;
+
+		void	bindArrays(void);
+		void	packLeafTriangles(void);
+		void	buildObjectSplits(const std::vector<Aabb>& prim_bounds);
+		void	buildSpatialSplits(const std::vector<Aabb>& prim_bounds);
+		void	buildMorton(const std::vector<Aabb>& prim_bounds);
+	};
+
+	// Kernels of bvh_simd.cpp, compiled for their instruction set; callers check getSimdLevel().
+	// traverseAvx2 is the single-ray traversal with 8-wide tests of the packed leaves, the packet
+	// kernels trace 8 lanes starting at base, or all 16 lanes, with one box test per node for the packet.
+	bool	traverseAvx2(const BvhNode* nodes, const unsigned int* leaf_groups, const BvhTriangles8* leaf_triangles,
+				const TriangleMesh& mesh, const unsigned int* prim_indices, Ray ray, Hit& hit, bool any_hit);
+	void	intersectPacketAvx2(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+				RayPacket& packet, unsigned int base);
+	void	intersectPacketAvx512(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+				RayPacket& packet);
+}
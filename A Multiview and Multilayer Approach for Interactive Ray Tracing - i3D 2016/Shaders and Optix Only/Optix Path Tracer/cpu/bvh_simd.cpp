@@ -0,0 +1,443 @@
+#include "bvh.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <immintrin.h>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const int	STACK_SIZE			= 64;
+	static const int	PACKET_STACK_SIZE	= 128;
+
+	static inline unsigned int firstLane(unsigned int bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return static_cast<unsigned int>(index);
+#else
+		return static_cast<unsigned int>(__builtin_ctz(bits));
+#endif
+	}
+
+	// Triangle vertices in the form intersect_triangle uses them
+	struct PacketTriangle
+	{
+		float3 p0, e0, e1, n;
+	};
+
+	static inline PacketTriangle packetTriangle(const TriangleMesh& mesh, unsigned int prim)
+	{
+		const int3 v_idx = mesh.vindex_buffer[prim];
+		PacketTriangle triangle;
+		triangle.p0 = mesh.vertex_buffer[v_idx.x];
+		triangle.e0 = mesh.vertex_buffer[v_idx.y] - triangle.p0;
+		triangle.e1 = triangle.p0 - mesh.vertex_buffer[v_idx.z];
+		triangle.n	= cross(triangle.e1, triangle.e0);
+		return triangle;
+	}
+
+	// Orders the children of an inner node for a packet: the child whose center lies
+	// first along the direction of the given ray is visited first
+	static inline bool leftChildFirst(const BvhNode* nodes, const BvhNode& node, const float3& direction)
+	{
+		const BvhNode& left	 = nodes[node.first];
+		const BvhNode& right = nodes[node.first + 1];
+		return dot((left.bmin + left.bmax) - (right.bmin + right.bmax), direction) <= 0.0f;
+	}
+
+	//
+	// AVX2
+	//
+	// The operations follow intersect_box and intersect_triangle one to one and no FMA is
+	// enabled, so that every lane computes the same result as the scalar code. std::min(a, b)
+	// returns a when the comparison fails, as _mm256_min_ps(b, a) does.
+	//
+	CPU_TARGET_AVX2 static inline __m256 min8(__m256 a, __m256 b) { return _mm256_min_ps(b, a); }
+	CPU_TARGET_AVX2 static inline __m256 max8(__m256 a, __m256 b) { return _mm256_max_ps(b, a); }
+
+	CPU_TARGET_AVX2 static inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+	}
+
+	CPU_TARGET_AVX2 static inline __m256 hmin8(__m256 v)
+	{
+		v = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+		v = _mm256_min_ps(v, _mm256_permute_ps(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm256_min_ps(v, _mm256_permute_ps(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+
+	CPU_TARGET_AVX2 static inline bool intersect_box(const BvhNode& node, const float3& origin, const float3& inv_dir, float tmin, float tmax, float& tnear)
+	{
+		float3 t0 = (node.bmin - origin) * inv_dir;
+		float3 t1 = (node.bmax - origin) * inv_dir;
+		tnear = max(max(tmin, min(t0.x, t1.x)), max(min(t0.y, t1.y), min(t0.z, t1.z)));
+		float tfar = min(min(tmax, max(t0.x, t1.x)), min(max(t0.y, t1.y), max(t0.z, t1.z)));
+		return tnear <= tfar;
+	}
+
+	// One ray against the 8 triangles of a group; returns the mask of the lanes hit within (tmin, tmax)
+	CPU_TARGET_AVX2 static inline __m256 intersect_triangles8(const BvhTriangles8& group, const __m256 o[3], const __m256 d[3],
+		__m256 tmin, __m256 tmax, __m256& t, __m256& beta, __m256& gamma)
+	{
+		const __m256 p0x = _mm256_loadu_ps(group.p0[0]), p0y = _mm256_loadu_ps(group.p0[1]), p0z = _mm256_loadu_ps(group.p0[2]);
+		const __m256 e0x = _mm256_loadu_ps(group.e0[0]), e0y = _mm256_loadu_ps(group.e0[1]), e0z = _mm256_loadu_ps(group.e0[2]);
+		const __m256 e1x = _mm256_loadu_ps(group.e1[0]), e1y = _mm256_loadu_ps(group.e1[1]), e1z = _mm256_loadu_ps(group.e1[2]);
+
+		// n = cross(e1, e0)
+		const __m256 nx = _mm256_sub_ps(_mm256_mul_ps(e1y, e0z), _mm256_mul_ps(e1z, e0y));
+		const __m256 ny = _mm256_sub_ps(_mm256_mul_ps(e1z, e0x), _mm256_mul_ps(e1x, e0z));
+		const __m256 nz = _mm256_sub_ps(_mm256_mul_ps(e1x, e0y), _mm256_mul_ps(e1y, e0x));
+
+		// e2 = (1 / dot(n, d)) * (p0 - o)
+		const __m256 rcp = _mm256_div_ps(_mm256_set1_ps(1.0f), dot8(nx, ny, nz, d[0], d[1], d[2]));
+		const __m256 e2x = _mm256_mul_ps(rcp, _mm256_sub_ps(p0x, o[0]));
+		const __m256 e2y = _mm256_mul_ps(rcp, _mm256_sub_ps(p0y, o[1]));
+		const __m256 e2z = _mm256_mul_ps(rcp, _mm256_sub_ps(p0z, o[2]));
+
+		// i = cross(d, e2)
+		const __m256 ix = _mm256_sub_ps(_mm256_mul_ps(d[1], e2z), _mm256_mul_ps(d[2], e2y));
+		const __m256 iy = _mm256_sub_ps(_mm256_mul_ps(d[2], e2x), _mm256_mul_ps(d[0], e2z));
+		const __m256 iz = _mm256_sub_ps(_mm256_mul_ps(d[0], e2y), _mm256_mul_ps(d[1], e2x));
+
+		beta  = dot8(ix, iy, iz, e1x, e1y, e1z);
+		gamma = dot8(ix, iy, iz, e0x, e0y, e0z);
+		t	  = dot8(nx, ny, nz, e2x, e2y, e2z);
+
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(t, tmax, _CMP_LT_OQ), _mm256_cmp_ps(t, tmin, _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(beta, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(gamma, zero, _CMP_GE_OQ));
+		return _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(beta, gamma), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+	}
+
+	CPU_TARGET_AVX2 static bool traverseAvx2Impl(const BvhNode* nodes, const unsigned int* leaf_groups, const BvhTriangles8* leaf_triangles,
+		const TriangleMesh& mesh, const unsigned int* prim_indices, Ray ray, Hit& hit, bool any_hit)
+	{
+		const float3 inv_dir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+		const __m256 o[3] = { _mm256_set1_ps(ray.origin.x),	   _mm256_set1_ps(ray.origin.y),	_mm256_set1_ps(ray.origin.z)	};
+		const __m256 d[3] = { _mm256_set1_ps(ray.direction.x), _mm256_set1_ps(ray.direction.y), _mm256_set1_ps(ray.direction.z) };
+		const __m256 tmin = _mm256_set1_ps(ray.tmin);
+
+		bool found = false;
+		unsigned int stack[STACK_SIZE];
+		int sp = 0;
+		unsigned int current = 0;
+		float tnear;
+		if (!intersect_box(nodes[0], ray.origin, inv_dir, ray.tmin, ray.tmax, tnear))
+			return false;
+
+		for (;;)
+		{
+			const BvhNode& node = nodes[current];
+			if (node.count > 0 && leaf_groups[current] == NO_LEAF_GROUP)
+			{
+				for (unsigned int i = node.first; i < node.first + node.count; ++i)
+				{
+					if (intersect_primitive(mesh, prim_indices[i], ray, hit))
+					{
+						if (any_hit)
+							return true;
+						found = true;
+					}
+				}
+			}
+			else if (node.count > 0)
+			{
+				const BvhTriangles8* group = leaf_triangles + leaf_groups[current];
+				for (unsigned int first = 0; first < node.count; first += 8, ++group)
+				{
+					__m256 t, beta, gamma;
+					const __m256 mask = intersect_triangles8(*group, o, d, tmin, _mm256_set1_ps(ray.tmax), t, beta, gamma);
+					unsigned int bits = static_cast<unsigned int>(_mm256_movemask_ps(mask));
+					if (bits == 0)
+						continue;
+					if (any_hit)
+						return true;
+
+					// the closest of the lanes hit, the first one on ties as in the scalar loop
+					const __m256 t_hit = _mm256_blendv_ps(_mm256_set1_ps(DEFAULT_MAX), t, mask);
+					bits &= static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(t_hit, hmin8(t_hit), _CMP_EQ_OQ)));
+					const unsigned int lane = firstLane(bits);
+
+					float t_lanes[8], beta_lanes[8], gamma_lanes[8];
+					_mm256_storeu_ps(t_lanes, t);
+					_mm256_storeu_ps(beta_lanes, beta);
+					_mm256_storeu_ps(gamma_lanes, gamma);
+					ray.tmax	= t_lanes[lane];
+					hit.t		= t_lanes[lane];
+					hit.primIdx	= static_cast<int>(group->prim[lane]);
+					hit.beta	= beta_lanes[lane];
+					hit.gamma	= gamma_lanes[lane];
+					found		= true;
+				}
+			}
+			else
+			{
+				float tnear_left, tnear_right;
+				bool left  = intersect_box(nodes[node.first],	  ray.origin, inv_dir, ray.tmin, ray.tmax, tnear_left);
+				bool right = intersect_box(nodes[node.first + 1], ray.origin, inv_dir, ray.tmin, ray.tmax, tnear_right);
+				if (left && right)
+				{
+					unsigned int near_child = node.first, far_child = node.first + 1;
+					if (tnear_right < tnear_left)
+						swap(near_child, far_child);
+					assert(sp < STACK_SIZE);
+					stack[sp++] = far_child;
+					current = near_child;
+					continue;
+				}
+				if (left)  { current = node.first;	   continue; }
+				if (right) { current = node.first + 1; continue; }
+			}
+
+			if (sp == 0)
+				break;
+			current = stack[--sp];
+		}
+		return found;
+	}
+
+	CPU_TARGET_AVX2 static void intersectPacketAvx2Impl(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+		RayPacket& packet, unsigned int base)
+	{
+		const unsigned int lanes = min(8u, packet.size - base);
+		__m256 o[3], d[3], inv_dir[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			o[axis]		  = _mm256_loadu_ps(&packet.origin[axis][base]);
+			d[axis]		  = _mm256_loadu_ps(&packet.direction[axis][base]);
+			inv_dir[axis] = _mm256_div_ps(_mm256_set1_ps(1.0f), d[axis]);
+		}
+		const __m256 tmin = _mm256_loadu_ps(&packet.tmin[base]);
+		__m256 tmax		  = _mm256_loadu_ps(&packet.tmax[base]);
+		__m256 prim		  = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		__m256 beta		  = _mm256_setzero_ps();
+		__m256 gamma	  = _mm256_setzero_ps();
+
+		const __m256 active = _mm256_and_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ),
+			_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(lanes)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))));
+		if (_mm256_movemask_ps(active) == 0)
+			return;
+
+		unsigned int stack[PACKET_STACK_SIZE];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0)
+		{
+			const unsigned int	current = stack[--sp];
+			const BvhNode&		node	= nodes[current];
+
+			// the lanes that enter the node, tested against their closest hit so far
+			const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmin.x), o[0]), inv_dir[0]);
+			const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmin.y), o[1]), inv_dir[1]);
+			const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmin.z), o[2]), inv_dir[2]);
+			const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmax.x), o[0]), inv_dir[0]);
+			const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmax.y), o[1]), inv_dir[1]);
+			const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bmax.z), o[2]), inv_dir[2]);
+			const __m256 tnear = max8(max8(tmin, min8(t0x, t1x)), max8(min8(t0y, t1y), min8(t0z, t1z)));
+			const __m256 tfar  = min8(min8(tmax, max8(t0x, t1x)), min8(max8(t0y, t1y), max8(t0z, t1z)));
+			const __m256 mask  = _mm256_and_ps(active, _mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ));
+			const int	 bits  = _mm256_movemask_ps(mask);
+			if (bits == 0)
+				continue;
+
+			if (node.count > 0)
+			{
+				const __m256 zero = _mm256_setzero_ps();
+				const __m256 one  = _mm256_set1_ps(1.0f);
+				for (unsigned int i = node.first; i < node.first + node.count; ++i)
+				{
+					const PacketTriangle tri = packetTriangle(mesh, prim_indices[i]);
+					const __m256 p0x = _mm256_set1_ps(tri.p0.x), p0y = _mm256_set1_ps(tri.p0.y), p0z = _mm256_set1_ps(tri.p0.z);
+					const __m256 e0x = _mm256_set1_ps(tri.e0.x), e0y = _mm256_set1_ps(tri.e0.y), e0z = _mm256_set1_ps(tri.e0.z);
+					const __m256 e1x = _mm256_set1_ps(tri.e1.x), e1y = _mm256_set1_ps(tri.e1.y), e1z = _mm256_set1_ps(tri.e1.z);
+					const __m256 nx	 = _mm256_set1_ps(tri.n.x),	 ny	 = _mm256_set1_ps(tri.n.y),	 nz	 = _mm256_set1_ps(tri.n.z);
+
+					const __m256 rcp = _mm256_div_ps(one, dot8(nx, ny, nz, d[0], d[1], d[2]));
+					const __m256 e2x = _mm256_mul_ps(rcp, _mm256_sub_ps(p0x, o[0]));
+					const __m256 e2y = _mm256_mul_ps(rcp, _mm256_sub_ps(p0y, o[1]));
+					const __m256 e2z = _mm256_mul_ps(rcp, _mm256_sub_ps(p0z, o[2]));
+					const __m256 ix	 = _mm256_sub_ps(_mm256_mul_ps(d[1], e2z), _mm256_mul_ps(d[2], e2y));
+					const __m256 iy	 = _mm256_sub_ps(_mm256_mul_ps(d[2], e2x), _mm256_mul_ps(d[0], e2z));
+					const __m256 iz	 = _mm256_sub_ps(_mm256_mul_ps(d[0], e2y), _mm256_mul_ps(d[1], e2x));
+					const __m256 b	 = dot8(ix, iy, iz, e1x, e1y, e1z);
+					const __m256 g	 = dot8(ix, iy, iz, e0x, e0y, e0z);
+					const __m256 t	 = dot8(nx, ny, nz, e2x, e2y, e2z);
+
+					__m256 hit = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmax, _CMP_LT_OQ));
+					hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, tmin, _CMP_GT_OQ));
+					hit = _mm256_and_ps(hit, _mm256_cmp_ps(b, zero, _CMP_GE_OQ));
+					hit = _mm256_and_ps(hit, _mm256_cmp_ps(g, zero, _CMP_GE_OQ));
+					hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(b, g), one, _CMP_LE_OQ));
+					if (_mm256_movemask_ps(hit) == 0)
+						continue;
+
+					tmax  = _mm256_blendv_ps(tmax, t, hit);
+					beta  = _mm256_blendv_ps(beta, b, hit);
+					gamma = _mm256_blendv_ps(gamma, g, hit);
+					prim  = _mm256_blendv_ps(prim, _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(prim_indices[i]))), hit);
+				}
+			}
+			else
+			{
+				assert(sp + 2 <= PACKET_STACK_SIZE);
+				const unsigned int lane = firstLane(static_cast<unsigned int>(bits));
+				const float3 direction	= make_float3(packet.direction[0][base + lane], packet.direction[1][base + lane], packet.direction[2][base + lane]);
+				const bool left_first	= leftChildFirst(nodes, node, direction);
+				stack[sp++] = left_first ? node.first + 1 : node.first;
+				stack[sp++] = left_first ? node.first	  : node.first + 1;
+			}
+		}
+
+		const __m256i store = _mm256_castps_si256(active);
+		_mm256_maskstore_ps(&packet.tmax[base], store, tmax);
+		_mm256_maskstore_ps(&packet.beta[base], store, beta);
+		_mm256_maskstore_ps(&packet.gamma[base], store, gamma);
+		_mm256_maskstore_ps(reinterpret_cast<float*>(&packet.primIdx[base]), store, prim);
+	}
+
+	//
+	// AVX-512: the packet kernel over 16 lanes
+	//
+	// GCC 12 reports the deliberately undefined operand (__Y) of the unmasked AVX-512
+	// intrinsics it inlines here as uninitialized. AVX-512F also brings FMA, which GCC would
+	// contract the multiplies and adds into, so that the hits would differ from the scalar
+	// and AVX2 ones in the last bits.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+	CPU_TARGET_AVX512 static inline __m512 min16(__m512 a, __m512 b) { return _mm512_min_ps(b, a); }
+	CPU_TARGET_AVX512 static inline __m512 max16(__m512 a, __m512 b) { return _mm512_max_ps(b, a); }
+
+	CPU_TARGET_AVX512 static inline __m512 dot16(__m512 ax, __m512 ay, __m512 az, __m512 bx, __m512 by, __m512 bz)
+	{
+		return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ax, bx), _mm512_mul_ps(ay, by)), _mm512_mul_ps(az, bz));
+	}
+
+	CPU_TARGET_AVX512 static void intersectPacketAvx512Impl(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+		RayPacket& packet)
+	{
+		const unsigned int lanes = min(static_cast<unsigned int>(RayPacket::MAX_SIZE), packet.size);
+		__m512 o[3], d[3], inv_dir[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			o[axis]		  = _mm512_loadu_ps(packet.origin[axis]);
+			d[axis]		  = _mm512_loadu_ps(packet.direction[axis]);
+			inv_dir[axis] = _mm512_div_ps(_mm512_set1_ps(1.0f), d[axis]);
+		}
+		const __m512 tmin  = _mm512_loadu_ps(packet.tmin);
+		__m512		 tmax  = _mm512_loadu_ps(packet.tmax);
+		__m512i		 prim  = _mm512_set1_epi32(-1);
+		__m512		 beta  = _mm512_setzero_ps();
+		__m512		 gamma = _mm512_setzero_ps();
+
+		const __mmask16 active = _mm512_cmp_ps_mask(tmin, tmax, _CMP_LE_OQ) & static_cast<__mmask16>((1u << lanes) - 1u);
+		if (active == 0)
+			return;
+
+		unsigned int stack[PACKET_STACK_SIZE];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0)
+		{
+			const unsigned int	current = stack[--sp];
+			const BvhNode&		node	= nodes[current];
+
+			const __m512 t0x = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmin.x), o[0]), inv_dir[0]);
+			const __m512 t0y = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmin.y), o[1]), inv_dir[1]);
+			const __m512 t0z = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmin.z), o[2]), inv_dir[2]);
+			const __m512 t1x = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmax.x), o[0]), inv_dir[0]);
+			const __m512 t1y = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmax.y), o[1]), inv_dir[1]);
+			const __m512 t1z = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.bmax.z), o[2]), inv_dir[2]);
+			const __m512 tnear = max16(max16(tmin, min16(t0x, t1x)), max16(min16(t0y, t1y), min16(t0z, t1z)));
+			const __m512 tfar  = min16(min16(tmax, max16(t0x, t1x)), min16(max16(t0y, t1y), max16(t0z, t1z)));
+			const __mmask16 mask = _mm512_mask_cmp_ps_mask(active, tnear, tfar, _CMP_LE_OQ);
+			if (mask == 0)
+				continue;
+
+			if (node.count > 0)
+			{
+				const __m512 zero = _mm512_setzero_ps();
+				const __m512 one  = _mm512_set1_ps(1.0f);
+				for (unsigned int i = node.first; i < node.first + node.count; ++i)
+				{
+					const PacketTriangle tri = packetTriangle(mesh, prim_indices[i]);
+					const __m512 p0x = _mm512_set1_ps(tri.p0.x), p0y = _mm512_set1_ps(tri.p0.y), p0z = _mm512_set1_ps(tri.p0.z);
+					const __m512 e0x = _mm512_set1_ps(tri.e0.x), e0y = _mm512_set1_ps(tri.e0.y), e0z = _mm512_set1_ps(tri.e0.z);
+					const __m512 e1x = _mm512_set1_ps(tri.e1.x), e1y = _mm512_set1_ps(tri.e1.y), e1z = _mm512_set1_ps(tri.e1.z);
+					const __m512 nx	 = _mm512_set1_ps(tri.n.x),	 ny	 = _mm512_set1_ps(tri.n.y),	 nz	 = _mm512_set1_ps(tri.n.z);
+
+					const __m512 rcp = _mm512_div_ps(one, dot16(nx, ny, nz, d[0], d[1], d[2]));
+					const __m512 e2x = _mm512_mul_ps(rcp, _mm512_sub_ps(p0x, o[0]));
+					const __m512 e2y = _mm512_mul_ps(rcp, _mm512_sub_ps(p0y, o[1]));
+					const __m512 e2z = _mm512_mul_ps(rcp, _mm512_sub_ps(p0z, o[2]));
+					const __m512 ix	 = _mm512_sub_ps(_mm512_mul_ps(d[1], e2z), _mm512_mul_ps(d[2], e2y));
+					const __m512 iy	 = _mm512_sub_ps(_mm512_mul_ps(d[2], e2x), _mm512_mul_ps(d[0], e2z));
+					const __m512 iz	 = _mm512_sub_ps(_mm512_mul_ps(d[0], e2y), _mm512_mul_ps(d[1], e2x));
+					const __m512 b	 = dot16(ix, iy, iz, e1x, e1y, e1z);
+					const __m512 g	 = dot16(ix, iy, iz, e0x, e0y, e0z);
+					const __m512 t	 = dot16(nx, ny, nz, e2x, e2y, e2z);
+
+					__mmask16 hit = _mm512_mask_cmp_ps_mask(mask, t, tmax, _CMP_LT_OQ);
+					hit = _mm512_mask_cmp_ps_mask(hit, t, tmin, _CMP_GT_OQ);
+					hit = _mm512_mask_cmp_ps_mask(hit, b, zero, _CMP_GE_OQ);
+					hit = _mm512_mask_cmp_ps_mask(hit, g, zero, _CMP_GE_OQ);
+					hit = _mm512_mask_cmp_ps_mask(hit, _mm512_add_ps(b, g), one, _CMP_LE_OQ);
+					if (hit == 0)
+						continue;
+
+					tmax  = _mm512_mask_blend_ps(hit, tmax, t);
+					beta  = _mm512_mask_blend_ps(hit, beta, b);
+					gamma = _mm512_mask_blend_ps(hit, gamma, g);
+					prim  = _mm512_mask_blend_epi32(hit, prim, _mm512_set1_epi32(static_cast<int>(prim_indices[i])));
+				}
+			}
+			else
+			{
+				assert(sp + 2 <= PACKET_STACK_SIZE);
+				const unsigned int lane = firstLane(mask);
+				const float3 direction	= make_float3(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]);
+				const bool left_first	= leftChildFirst(nodes, node, direction);
+				stack[sp++] = left_first ? node.first + 1 : node.first;
+				stack[sp++] = left_first ? node.first	  : node.first + 1;
+			}
+		}
+
+		_mm512_mask_storeu_ps(packet.tmax, active, tmax);
+		_mm512_mask_storeu_ps(packet.beta, active, beta);
+		_mm512_mask_storeu_ps(packet.gamma, active, gamma);
+		_mm512_mask_storeu_epi32(packet.primIdx, active, prim);
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#pragma GCC diagnostic pop
+#endif
+
+	bool traverseAvx2(const BvhNode* nodes, const unsigned int* leaf_groups, const BvhTriangles8* leaf_triangles,
+		const TriangleMesh& mesh, const unsigned int* prim_indices, Ray ray, Hit& hit, bool any_hit)
+	{
+		return traverseAvx2Impl(nodes, leaf_groups, leaf_triangles, mesh, prim_indices, ray, hit, any_hit);
+	}
+
+	void intersectPacketAvx2(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+		RayPacket& packet, unsigned int base)
+	{
+		intersectPacketAvx2Impl(nodes, mesh, prim_indices, packet, base);
+	}
+
+	void intersectPacketAvx512(const BvhNode* nodes, const TriangleMesh& mesh, const unsigned int* prim_indices,
+		RayPacket& packet)
+	{
+		intersectPacketAvx512Impl(nodes, mesh, prim_indices, packet);
+	}
+}
@@ -0,0 +1,274 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host port of the ray generation and miss programs in cuda/camera.cu
+
+#include "context.h"
+#include "../cuda/random.h"
+
+using namespace optix;
+
+namespace cpu
+{
+	// Runs the closest hit or miss program for an intersection that is already known
+	static void shade(const Context& context, const Ray& ray, const Hit& hit, PerRayData_radiance& prd)
+	{
+		if (hit.primIdx >= 0)
+		{
+			Attributes attributes;
+			mesh_attributes(*context.mesh, hit.primIdx, hit.beta, hit.gamma, attributes);
+			closest_hit_radiance(context, ray, hit.t, attributes, prd);
+		}
+		else
+			background_miss(context, ray, prd);
+	}
+
+	void trace(const Context& context, const Ray& ray, PerRayData_radiance& prd)
+	{
+		Hit hit;
+		if (!context.top_object->intersect(ray, hit))
+			hit.primIdx = -1;
+		shade(context, ray, hit, prd);
+	}
+
+	void trace(const Context& context, const Ray& ray, PerRayData_shadow& prd)
+	{
+		if (context.top_shadower->occluded(ray))
+			any_hit_shadow(prd);
+	}
+
+	// Monte Carlo strategy (Russian Roulette) as stopping criterion
+	bool russian_roulette(const Context& context, PerRayData_radiance& prd)
+	{
+		if (prd.done || prd.depth < static_cast<int>(context.pt.rr_begin_depth))
+			return true;
+		float pcont = fminf(fmaxf(prd.attenuation), 1.0f);
+		if (rnd(prd.seed) >= pcont)
+			return false;
+		prd.attenuation /= pcont;
+		return true;
+	}
+
+	// Follows one camera path from the eye for up to max_depth bounces. The hit of the
+	// camera ray is traced here unless camera_hit already holds it.
+	static float3 trace_path(const Context& context, float3 ray_direction, const Hit* camera_hit, unsigned int& seed, unsigned int& num_rays)
+	{
+		float3 ray_origin = context.camera.eye;
+
+		PerRayData_radiance prd;
+		prd.result		 = make_float3(0.f);
+		prd.attenuation  = make_float3(1.f);
+		prd.done		 = false;
+		prd.seed		 = seed;
+		prd.depth		 = 0;
+		prd.num_rays	 = 0;
+
+		while (!prd.done && prd.depth < context.max_depth)
+		{
+			Ray ray = make_Ray(ray_origin, ray_direction, context.pt.radiance_ray_type, context.scene_epsilon, DEFAULT_MAX);
+			if (prd.depth == 0 && camera_hit)
+				shade(context, ray, *camera_hit, prd);
+			else
+				trace(context, ray, prd);
+			num_rays++;
+
+			prd.result += prd.radiance * prd.attenuation;
+
+			if (!russian_roulette(context, prd))
+				break;
+
+			prd.depth++;
+			ray_origin	  = prd.origin;
+			ray_direction = prd.direction;
+		}
+
+		num_rays += prd.num_rays;
+		seed	  = prd.seed;
+		return prd.result;
+	}
+
+	// Adaptive sampling: a pixel is no longer traced once the relative MSE of its mean,
+	// estimated from the luminance variance across frames, falls below adaptive_threshold
+	// Squared means are offset by 0.01 as in cpu::relativeMSE, so that dark pixels converge
+	static void update_variance(Context& context, const uint2& launch_index, const float3& pixel_color, unsigned int frame)
+	{
+		const float frames = static_cast<float>(frame);
+		const float l = luminance(pixel_color);
+		float4& stats = context.variance_buffer[launch_index];
+		if (frame <= 1)
+			stats = make_float4(0.0f);
+		stats.x += l;
+		stats.y += l * l;
+		if (frame >= context.pt.adaptive_min_frames)
+		{
+			const float mean	 = stats.x / frames;
+			const float variance = fmaxf(stats.y / frames - mean * mean, 0.0f) * frames / (frames - 1.0f);
+			if (variance / frames <= context.pt.adaptive_threshold * (mean * mean + 0.01f))
+				stats.z = frames;
+		}
+	}
+
+	// Progressive accumulation of the frame: the sum of the pixel's tile holds all frames since
+	// the last reset, and the output buffer their average, as the running blend of camera.cu
+	void accumulate(Context& context, const uint2& launch_index, const float3& pixel_color, unsigned int num_rays)
+	{
+		context.ray_count_buffer[launch_index] = num_rays;
+
+		const Tile* tile;
+		float4& sum = context.accumulation_buffer.pixel(launch_index, tile);
+		if (tile->frames > 1)
+			sum += make_float4(pixel_color, 0.0f);
+		else
+			sum = make_float4(pixel_color, 0.0f);
+		context.output_buffer[launch_index] = sum / static_cast<float>(tile->frames);
+
+		if (context.pt.adaptive_threshold > 0.0f)
+			update_variance(context, launch_index, pixel_color, tile->frames);
+	}
+
+	bool pixel_converged(const Context& context, const uint2& launch_index)
+	{
+		return context.pt.adaptive_threshold > 0.0f &&
+			context.accumulation_buffer.tile(launch_index).frames > 1 &&
+			context.variance_buffer[launch_index].z != 0.0f;
+	}
+
+#if defined (AA)
+	// Rotated grid of the NUM_SAMPLES positions within a pixel, one per row and column of a 4x4 grid
+	static const float AA_PATTERN[NUM_SAMPLES][2] =
+	{
+		{ NUM3_8, NUM1_8 },
+		{ NUM7_8, NUM3_8 },
+		{ NUM5_8, NUM7_8 },
+		{ NUM1_8, NUM5_8 }
+	};
+#endif
+
+	float2 camera_sample_position(const Context& context, const uint2& launch_index, unsigned int sample)
+	{
+#if defined (AA)
+		const unsigned int sqrt_num_samples = context.pt.sqrt_num_samples;
+		unsigned int seed = tea<4>(tea<16>(context.output_buffer.width*launch_index.y + launch_index.x, context.pt.frame_number), sample + 1u);
+		const float2 jitter = make_float2(rnd(seed), rnd(seed));
+		// jittered within the cell of the grid, so that progressive frames still converge
+		if (sqrt_num_samples*sqrt_num_samples == NUM_SAMPLES)
+			return make_float2(AA_PATTERN[sample][0], AA_PATTERN[sample][1]) + (jitter - 0.5f) / static_cast<float>(NUM_SAMPLES);
+		return (make_float2(static_cast<float>(sample % sqrt_num_samples), static_cast<float>(sample / sqrt_num_samples)) + jitter) / static_cast<float>(sqrt_num_samples);
+#else
+		return make_float2(0.0f);
+#endif
+	}
+
+	unsigned int camera_sample_seed(const Context& context, const uint2& launch_index, unsigned int sample)
+	{
+		const Buffer& output_buffer = context.output_buffer;
+		return tea<16>(output_buffer.width*(launch_index.y + sample*output_buffer.height) + launch_index.x, context.pt.frame_number);
+	}
+
+	float3 camera_ray_direction(const Context& context, const uint2& launch_index, unsigned int sample)
+	{
+		const Buffer& output_buffer = context.output_buffer;
+		float2 inv_screen	= 1.0f / make_float2(static_cast<float>(output_buffer.width), static_cast<float>(output_buffer.height)) * 2.f;
+		float2 pixel		= make_float2(static_cast<float>(launch_index.x), static_cast<float>(launch_index.y)) * inv_screen - 1.f;
+		float2 d			= pixel + camera_sample_position(context, launch_index, sample)*inv_screen;
+		return normalize(d.x*context.camera.U + d.y*context.camera.V + context.camera.W);
+	}
+
+	//
+	// Perspective Camera
+	//
+	void pinhole_camera(Context& context, const uint2& launch_index)
+	{
+		if (pixel_converged(context, launch_index))
+		{
+			context.ray_count_buffer[launch_index] = 0;
+			return;
+		}
+
+		const unsigned int sqrt_num_samples = context.pt.sqrt_num_samples;
+		const unsigned int samples_per_pixel = sqrt_num_samples*sqrt_num_samples;
+
+		float3 result = make_float3(0.0f);
+		unsigned int num_rays = 0;
+		for (unsigned int sample = 0; sample < samples_per_pixel; ++sample)
+		{
+			unsigned int seed	 = camera_sample_seed(context, launch_index, sample);
+			float3 ray_direction = camera_ray_direction(context, launch_index, sample);
+			result += trace_path(context, ray_direction, 0, seed, num_rays);
+		}
+
+		accumulate(context, launch_index, result / static_cast<float>(sqrt_num_samples*sqrt_num_samples), num_rays);
+	}
+
+#if defined (AA)
+	uint2 packet_block_size(const Context& context)
+	{
+		const unsigned int num_pixels = context.packet_size / NUM_SAMPLES;
+		return make_uint2(2u, num_pixels > 2u ? num_pixels / 2u : 1u);
+	}
+
+	void pinhole_camera_packet(Context& context, const uint2& launch_index)
+	{
+		static const unsigned int MAX_PIXELS = RayPacket::MAX_SIZE / NUM_SAMPLES;
+
+		Buffer& output_buffer = context.output_buffer;
+		const uint2 block	= packet_block_size(context);
+		const unsigned int num_pixels = block.x * block.y;
+
+		uint2			pixels[MAX_PIXELS];
+		bool			active[MAX_PIXELS];
+		RayPacket		packet;
+		packet.size = num_pixels * NUM_SAMPLES;
+		for (unsigned int p = 0; p < num_pixels; ++p)
+		{
+			pixels[p] = make_uint2(launch_index.x + p % block.x, launch_index.y + p / block.x);
+			active[p] = pixels[p].x < output_buffer.width && pixels[p].y < output_buffer.height;
+			if (active[p] && pixel_converged(context, pixels[p]))
+			{
+				context.ray_count_buffer[pixels[p]] = 0;
+				active[p] = false;
+			}
+			if (!active[p])
+			{
+				for (unsigned int s = 0; s < NUM_SAMPLES; ++s)
+					packet.disable(p * NUM_SAMPLES + s);
+				continue;
+			}
+
+			for (unsigned int s = 0; s < NUM_SAMPLES; ++s)
+			{
+				float3 ray_direction = camera_ray_direction(context, pixels[p], s);
+				packet.setRay(p * NUM_SAMPLES + s, make_Ray(context.camera.eye, ray_direction, context.pt.radiance_ray_type, context.scene_epsilon, DEFAULT_MAX));
+			}
+		}
+
+		context.top_object->intersectPacket(packet);
+
+		for (unsigned int p = 0; p < num_pixels; ++p)
+		{
+			if (!active[p])
+				continue;
+
+			float3 result = make_float3(0.0f);
+			unsigned int num_rays = 0;
+			for (unsigned int s = 0; s < NUM_SAMPLES; ++s)
+			{
+				const unsigned int lane = p * NUM_SAMPLES + s;
+				float3 ray_direction = make_float3(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]);
+				Hit hit;
+				packet.getHit(lane, hit);
+				unsigned int seed = camera_sample_seed(context, pixels[p], s);
+				result += trace_path(context, ray_direction, &hit, seed, num_rays);
+			}
+			accumulate(context, pixels[p], result / static_cast<float>(NUM_SAMPLES), num_rays);
+		}
+	}
+#endif
+	//
+	// Returns background color for miss rays
+	//
+	void background_miss(const Context& context, const Ray& /*ray*/, PerRayData_radiance& prd)
+	{
+		prd.radiance = context.color.background;
+		prd.done = true;
+	}
+}
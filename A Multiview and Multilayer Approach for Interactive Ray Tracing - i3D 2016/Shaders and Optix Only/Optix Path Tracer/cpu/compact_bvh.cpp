@@ -0,0 +1,393 @@
+#include "compact_bvh.h"
+#include "accel_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_COMPACT_BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const int			STACK_SIZE	= 256;
+	static const unsigned int	NO_NODE		= 0xFFFFFFFFu;
+
+	static_assert(sizeof(CompactBvhNode) == 64, "CompactBvhNode must fill one cache line");
+
+	// A subtree while collapsing: an inner node of the binary BVH, or a range of primitive
+	// references that becomes a leaf once it has at most MAX_LEAF_COUNT of them
+	struct CollapseItem
+	{
+		Aabb			bounds;
+		unsigned int	node;		// NO_NODE for ranges
+		unsigned int	first;
+		unsigned int	count;
+	};
+
+	struct CollapseTask
+	{
+		CollapseItem	item;
+		unsigned int	parent;		// the wide node and child slot that reference it
+		unsigned int	slot;
+	};
+
+	// Leading record of a cached CompactBvh, followed by its arrays
+	struct CompactBvhCacheHeader
+	{
+		unsigned int method;
+		unsigned int num_nodes;
+		unsigned int num_prim_indices;
+	};
+
+	static CollapseItem makeItem(const ArrayView<BvhNode>& nodes, unsigned int index)
+	{
+		const BvhNode& node = nodes[index];
+		CollapseItem item;
+		item.bounds = Aabb(node.bmin, node.bmax);
+		item.node	= (node.count == 0) ? index : NO_NODE;
+		item.first	= node.first;
+		item.count	= node.count;
+		return item;
+	}
+
+	static inline bool isOpenable(const CollapseItem& item)
+	{
+		return item.node != NO_NODE || item.count > CompactBvhNode::MAX_LEAF_COUNT;
+	}
+
+	// Splits an inner node into its two children, or a range that is too large for a leaf into halves
+	static void openItem(const ArrayView<BvhNode>& nodes, const TriangleMesh& mesh, const vector<unsigned int>& prim_indices,
+		const CollapseItem& item, CollapseItem& left, CollapseItem& right)
+	{
+		if (item.node != NO_NODE)
+		{
+			left  = makeItem(nodes, nodes[item.node].first);
+			right = makeItem(nodes, nodes[item.node].first + 1);
+			return;
+		}
+
+		const unsigned int half = item.count / 2;
+		left.node  = right.node = NO_NODE;
+		left.first = item.first;		left.count	= half;
+		right.first = item.first + half;	right.count = item.count - half;
+		left.bounds.invalidate();
+		right.bounds.invalidate();
+		for (unsigned int i = left.first; i < left.first + left.count; ++i)
+			left.bounds.include(mesh.bounds(prim_indices[i]));
+		for (unsigned int i = right.first; i < right.first + right.count; ++i)
+			right.bounds.include(mesh.bounds(prim_indices[i]));
+	}
+
+	// 2^exponent, built from its bits
+	static inline float exponentScale(signed char exponent)
+	{
+		const unsigned int bits = static_cast<unsigned int>(exponent + 127) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return scale;
+	}
+
+	// Child bounds in the frame of their union. The scale is the smallest power of two that
+	// covers the extent in 255 steps, and each bound is rounded outwards until the decoded
+	// value, computed as in the traversal, encloses the original.
+	static void quantize(const CollapseItem* children, unsigned int num_children, CompactBvhNode& node)
+	{
+		Aabb parent;
+		for (unsigned int c = 0; c < num_children; ++c)
+			parent.include(children[c].bounds);
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float lo	   = component(parent.m_min, axis);
+			const float extent = component(parent.m_max, axis) - lo;
+			int exponent;
+			frexpf(extent / 255.0f, &exponent);
+			exponent = min(max(exponent, -120), 127);
+			const float scale = exponentScale(static_cast<signed char>(exponent));
+
+			node.origin[axis]	= lo;
+			node.exponent[axis]	= static_cast<signed char>(exponent);
+			for (unsigned int c = 0; c < 4; ++c)
+			{
+				if (c >= num_children)
+				{
+					node.qmin[axis][c] = node.qmax[axis][c] = 0;
+					continue;
+				}
+				const float cmin = component(children[c].bounds.m_min, axis);
+				const float cmax = component(children[c].bounds.m_max, axis);
+				int qmin = min(max(static_cast<int>(floorf((cmin - lo) / scale)), 0), 255);
+				int qmax = min(max(static_cast<int>(ceilf((cmax - lo) / scale)), 0), 255);
+				while (qmin > 0 && lo + static_cast<float>(qmin) * scale > cmin)
+					--qmin;
+				while (qmax < 255 && lo + static_cast<float>(qmax) * scale < cmax)
+					++qmax;
+				node.qmin[axis][c] = static_cast<unsigned char>(qmin);
+				node.qmax[axis][c] = static_cast<unsigned char>(qmax);
+			}
+		}
+	}
+
+	void CompactBvh::build(const TriangleMesh& mesh)
+	{
+		m_mesh = &mesh;
+		m_mapping.reset();
+
+		// leaves are tested one triangle at a time, so the binary hierarchy is built for that
+		Bvh binary(m_method, false);
+		binary.build(mesh);
+		const ArrayView<BvhNode>&		binary_nodes = binary.getNodes();
+		const ArrayView<unsigned int>&	binary_prims = binary.getPrimIndices();
+		m_prim_indices.assign(binary_prims.data, binary_prims.data + binary_prims.size);
+		if (m_prim_indices.size() > CompactBvhNode::MAX_LEAF_FIRST + 1u)
+			throw runtime_error("Too many primitive references for BvhCompact");
+
+		vector<CompactBvhNode> nodes;
+		vector<CollapseTask> tasks;
+		if (!m_prim_indices.empty())
+		{
+			nodes.reserve(binary_nodes.size / 3 + 1);
+			CollapseTask root = { makeItem(binary_nodes, 0), NO_NODE, 0 };
+			tasks.push_back(root);
+		}
+
+		while (!tasks.empty())
+		{
+			const CollapseTask task = tasks.back();
+			tasks.pop_back();
+
+			// open the child with the largest surface area until there are four
+			CollapseItem children[4];
+			unsigned int num_children = 0;
+			if (isOpenable(task.item))
+			{
+				openItem(binary_nodes, mesh, m_prim_indices, task.item, children[0], children[1]);
+				num_children = 2;
+			}
+			else
+				children[num_children++] = task.item;	// the whole scene is a single leaf
+			while (num_children < 4)
+			{
+				int	  largest	   = -1;
+				float largest_area = -1.0f;
+				for (unsigned int c = 0; c < num_children; ++c)
+				{
+					if (isOpenable(children[c]) && children[c].bounds.area() > largest_area)
+					{
+						largest		 = static_cast<int>(c);
+						largest_area = children[c].bounds.area();
+					}
+				}
+				if (largest < 0)
+					break;
+				const CollapseItem item = children[largest];
+				openItem(binary_nodes, mesh, m_prim_indices, item, children[largest], children[num_children++]);
+			}
+
+			const unsigned int index = static_cast<unsigned int>(nodes.size());
+			nodes.push_back(CompactBvhNode());
+			CompactBvhNode& node = nodes.back();
+			memset(&node, 0, sizeof(node));
+			node.num_children = static_cast<unsigned char>(num_children);
+			quantize(children, num_children, node);
+			if (task.parent != NO_NODE)
+				nodes[task.parent].child[task.slot] = index;
+
+			// pushed in reverse, so that the first child is stored right after its parent
+			for (unsigned int c = num_children; c-- > 0;)
+			{
+				if (isOpenable(children[c]))
+				{
+					CollapseTask child = { children[c], index, c };
+					tasks.push_back(child);
+				}
+				else
+					node.child[c] = CompactBvhNode::LEAF_FLAG | ((children[c].count - 1) << CompactBvhNode::LEAF_COUNT_SHIFT) | children[c].first;
+			}
+		}
+
+		// vectors are only 16-byte aligned; nodes start on a cache line so that each one fills a single line
+		m_node_storage.assign(nodes.size() * sizeof(CompactBvhNode) + 63, 0);
+		unsigned char* base = &m_node_storage[0] + (64 - reinterpret_cast<size_t>(&m_node_storage[0]) % 64) % 64;
+		if (!nodes.empty())
+			memcpy(base, &nodes[0], nodes.size() * sizeof(CompactBvhNode));
+		m_node_array	   = ArrayView<CompactBvhNode>(reinterpret_cast<const CompactBvhNode*>(base), nodes.size());
+		m_prim_index_array = ArrayView<unsigned int>(m_prim_indices);
+	}
+
+	size_t CompactBvh::memoryUsage(void) const
+	{
+		return m_node_array.size * sizeof(CompactBvhNode) + m_prim_index_array.size * sizeof(unsigned int);
+	}
+
+	bool CompactBvh::save(ostream& out) const
+	{
+		CompactBvhCacheHeader header;
+		header.method			= static_cast<unsigned int>(m_method);
+		header.num_nodes		= static_cast<unsigned int>(m_node_array.size);
+		header.num_prim_indices	= static_cast<unsigned int>(m_prim_index_array.size);
+		writeCacheArray(out, &header, 1);
+		writeCacheArray(out, m_node_array.data, m_node_array.size);
+		writeCacheArray(out, m_prim_index_array.data, m_prim_index_array.size);
+		return !out.fail();
+	}
+
+	bool CompactBvh::load(const shared_ptr<const MappedFile>& file, size_t offset, size_t size, const TriangleMesh& mesh)
+	{
+		const size_t end = offset + size;
+		ArrayView<CompactBvhCacheHeader> header;
+		if (!readCacheArray(*file, offset, end, 1, header) || header[0].method != static_cast<unsigned int>(m_method))
+			return false;
+
+		ArrayView<CompactBvhNode> nodes;
+		ArrayView<unsigned int>	  prim_indices;
+		if (!readCacheArray(*file, offset, end, header[0].num_nodes, nodes) ||
+			!readCacheArray(*file, offset, end, header[0].num_prim_indices, prim_indices))
+			return false;
+
+		m_mesh = &mesh;
+		m_node_storage.clear();
+		m_prim_indices.clear();
+		m_node_array	   = nodes;
+		m_prim_index_array = prim_indices;
+		m_mapping		   = file;
+		return true;
+	}
+
+	// Slab test of the children of a node. Returns the mask of children hit and their entry
+	// distances. Axes on which a distance is NaN (a zero direction component on a slab plane)
+	// do not cull, so that the quantized boxes stay conservative.
+	static inline unsigned int intersectChildren(const CompactBvhNode& node, const float3& origin, const float3& inv_dir,
+		float tmin, float tmax, float tnear_out[4])
+	{
+#if defined(CPU_COMPACT_BVH_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		__m128 tnear = _mm_set1_ps(tmin);
+		__m128 tfar	 = _mm_set1_ps(tmax);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int qmin, qmax;
+			memcpy(&qmin, node.qmin[axis], sizeof(qmin));
+			memcpy(&qmax, node.qmax[axis], sizeof(qmax));
+			const __m128 qlo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(qmin), zero), zero));
+			const __m128 qhi = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(qmax), zero), zero));
+
+			const __m128 frame = _mm_set1_ps(node.origin[axis]);
+			const __m128 scale = _mm_set1_ps(exponentScale(node.exponent[axis]));
+			const __m128 o	   = _mm_set1_ps(component(origin, axis));
+			const __m128 inv   = _mm_set1_ps(component(inv_dir, axis));
+			const __m128 t0	   = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(frame, _mm_mul_ps(qlo, scale)), o), inv);
+			const __m128 t1	   = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(frame, _mm_mul_ps(qhi, scale)), o), inv);
+			tnear = _mm_max_ps(_mm_min_ps(t0, t1), tnear);
+			tfar  = _mm_min_ps(_mm_max_ps(t0, t1), tfar);
+		}
+		_mm_storeu_ps(tnear_out, tnear);
+		return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar))) & ((1u << node.num_children) - 1u);
+#else
+		unsigned int mask = 0;
+		for (unsigned int c = 0; c < node.num_children; ++c)
+		{
+			float tnear = tmin, tfar = tmax;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float scale = exponentScale(node.exponent[axis]);
+				const float t0 = (node.origin[axis] + static_cast<float>(node.qmin[axis][c]) * scale - component(origin, axis)) * component(inv_dir, axis);
+				const float t1 = (node.origin[axis] + static_cast<float>(node.qmax[axis][c]) * scale - component(origin, axis)) * component(inv_dir, axis);
+				const float tlo = (t0 < t1) ? t0 : t1;
+				const float thi = (t0 > t1) ? t0 : t1;
+				tnear = (tlo > tnear) ? tlo : tnear;
+				tfar  = (thi < tfar) ? thi : tfar;
+			}
+			tnear_out[c] = tnear;
+			if (tnear <= tfar)
+				mask |= 1u << c;
+		}
+		return mask;
+#endif
+	}
+
+	template<bool ANY_HIT>
+	bool CompactBvh::traverse(Ray ray, Hit& hit) const
+	{
+		if (m_node_array.empty())
+			return false;
+
+		const float3 inv_dir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+		struct StackEntry
+		{
+			unsigned int	ref;
+			float			tnear;
+		};
+		StackEntry stack[STACK_SIZE];
+		int sp = 0;
+		stack[sp].ref	  = 0;
+		stack[sp++].tnear = ray.tmin;
+
+		bool found = false;
+		while (sp > 0)
+		{
+			const StackEntry entry = stack[--sp];
+			// a closer hit was found after it was pushed
+			if (entry.tnear > ray.tmax)
+				continue;
+
+			if (entry.ref & CompactBvhNode::LEAF_FLAG)
+			{
+				const unsigned int first = entry.ref & CompactBvhNode::MAX_LEAF_FIRST;
+				const unsigned int count = ((entry.ref >> CompactBvhNode::LEAF_COUNT_SHIFT) & 15u) + 1;
+				for (unsigned int i = first; i < first + count; ++i)
+				{
+					if (intersect_primitive(*m_mesh, m_prim_index_array[i], ray, hit))
+					{
+						if (ANY_HIT)
+							return true;
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			const CompactBvhNode& node = m_node_array[entry.ref];
+			float tnear[4];
+			const unsigned int mask = intersectChildren(node, ray.origin, inv_dir, ray.tmin, ray.tmax, tnear);
+
+			// push far to near, so that the nearest child is visited next
+			unsigned int order[4];
+			int num_hit = 0;
+			for (unsigned int c = 0; c < 4; ++c)
+			{
+				if (!(mask & (1u << c)))
+					continue;
+				int k = num_hit++;
+				for (; k > 0 && tnear[order[k - 1]] < tnear[c]; --k)
+					order[k] = order[k - 1];
+				order[k] = c;
+			}
+			for (int k = 0; k < num_hit && sp < STACK_SIZE; ++k)
+			{
+				stack[sp].ref	  = node.child[order[k]];
+				stack[sp++].tnear = tnear[order[k]];
+			}
+		}
+		return found;
+	}
+
+	bool CompactBvh::intersect(const Ray& ray, Hit& hit) const
+	{
+		return traverse<false>(ray, hit);
+	}
+
+	bool CompactBvh::occluded(const Ray& ray) const
+	{
+		Hit hit;
+		return traverse<true>(ray, hit);
+	}
+}
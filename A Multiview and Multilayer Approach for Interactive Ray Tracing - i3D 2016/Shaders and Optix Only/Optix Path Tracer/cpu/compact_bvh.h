@@ -0,0 +1,64 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Quantized 4-wide BVH of the CPU backend, the "BvhCompact" traverser. A binary BVH
+// is collapsed into nodes of up to four children whose bounds are stored in 8 bits.
+
+#pragma once
+
+#include "bvh.h"
+
+namespace cpu
+{
+	// 64 bytes, one cache line. Child c spans origin + q * 2^exponent on each axis, for q
+	// from qmin[axis][c] to qmax[axis][c], rounded outwards when quantized. child[c] is the
+	// index of an inner node or, with LEAF_FLAG set, a leaf of up to MAX_LEAF_COUNT primitive
+	// references: the first in bits 0-26 and the count minus one in bits 27-30.
+	struct CompactBvhNode
+	{
+		enum
+		{
+			LEAF_FLAG		 = 0x80000000u,
+			LEAF_COUNT_SHIFT = 27,
+			MAX_LEAF_COUNT	 = 16,
+			MAX_LEAF_FIRST	 = (1u << 27) - 1
+		};
+
+		float			origin[3];
+		signed char		exponent[3];
+		unsigned char	num_children;
+		unsigned char	qmin[3][4];
+		unsigned char	qmax[3][4];
+		unsigned int	child[4];
+		unsigned int	padding[2];
+	};
+
+	class CompactBvh : public Accel
+	{
+	public:
+		// The binary hierarchy is built with the given Bvh method before it is collapsed
+		explicit CompactBvh(Bvh::BuildMethod method = Bvh::BM_BINNED_SAH) : m_method(method), m_mesh(0) {}
+
+		void	build(const TriangleMesh& mesh);
+		bool	intersect(const Ray& ray, Hit& hit) const;
+		bool	occluded(const Ray& ray) const;
+		size_t	memoryUsage(void) const;
+		bool	save(std::ostream& out) const;
+		bool	load(const std::shared_ptr<const MappedFile>& file, size_t offset, size_t size, const TriangleMesh& mesh);
+
+		unsigned int	getNodeCount(void) const { return static_cast<unsigned int>(m_node_array.size); }
+
+	private:
+		Bvh::BuildMethod			m_method;
+		const TriangleMesh*			m_mesh;
+		std::vector<unsigned char>	m_node_storage;		// nodes, from its first 64-byte boundary
+		std::vector<unsigned int>	m_prim_indices;
+
+		// views of the vectors above after build(), or of the mapped cache file after load()
+		ArrayView<CompactBvhNode>			m_node_array;
+		ArrayView<unsigned int>				m_prim_index_array;
+		std::shared_ptr<const MappedFile>	m_mapping;
+
+		template<bool ANY_HIT>
+		bool	traverse(Ray ray, Hit& hit) const;
+	};
+}
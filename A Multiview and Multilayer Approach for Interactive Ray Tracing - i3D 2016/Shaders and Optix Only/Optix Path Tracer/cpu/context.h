@@ -0,0 +1,115 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Launch state of the CPU backend. Each member corresponds to an rtDeclareVariable
+// or rtBuffer of the cuda/ programs, grouped in the same namespaces.
+
+#pragma once
+
+#include "../commonStructs.h"
+#include "accel.h"
+#include "helpers.h"
+#include "tiles.h"
+#include "triangle_mesh.h"
+#include <vector>
+
+namespace cpu
+{
+	// rtBuffer<T, 2> equivalent
+	template<typename T>
+	struct Buffer2D
+	{
+		unsigned int		width;
+		unsigned int		height;
+		std::vector<T>		data;
+
+		Buffer2D() : width(0), height(0) {}
+
+		void	resize(unsigned int w, unsigned int h) { width = w; height = h; data.assign(w * h, T()); }
+
+		T&			operator[](const uint2& index)		 { return data[index.y * width + index.x]; }
+		const T&	operator[](const uint2& index) const { return data[index.y * width + index.x]; }
+	};
+
+	typedef Buffer2D<float4> Buffer;
+
+	struct Context
+	{
+		Buffer					output_buffer;
+		Buffer2D<unsigned int>	ray_count_buffer;		// rays traced per launch index in the last launch
+		Buffer					variance_buffer;		// luminance sum and squared sum over the frames, frame of convergence (0 while sampled)
+		TileBuffer				accumulation_buffer;	// frames are accumulated per tile; Tile::frames counts them
+		int						max_depth;
+		float					scene_epsilon;
+		unsigned int			packet_size;			// camera rays per pinhole_camera_packet packet, 8 or 16
+
+		const TriangleMesh*		mesh;
+		const Accel*			top_object;
+		const Accel*			top_shadower;
+
+		std::vector<BasicLight>	lights;
+		std::vector<LightAlias>	light_alias_table;		// one entry per light, see buildLightAliasTable
+		float3					ambient_light_color;
+
+		struct
+		{
+			float3 eye, U, V, W;
+		} camera;
+
+		struct
+		{
+			float3 background;
+			float3 exception;
+		} color;
+
+		struct
+		{
+			unsigned int frame_number;
+			unsigned int sqrt_num_samples;
+			unsigned int rr_begin_depth;		// bounce from which Russian roulette ends paths
+			float		 adaptive_threshold;	// relative MSE of converged pixels, 0 disables adaptive sampling
+			unsigned int adaptive_min_frames;	// frames before a pixel may converge
+			unsigned int radiance_ray_type;
+			unsigned int shadow_ray_type;
+		} pt;
+
+		Context() : max_depth(1), scene_epsilon(1.e-3f), packet_size(0), mesh(0), top_object(0), top_shadower(0) {}
+	};
+
+	// Ray generation, run once per launch index. The frame counter of the tile holding
+	// launch_index must already account for the frame being traced.
+	void pinhole_camera(Context& context, const uint2& launch_index);
+	// Where sample of the sqrt_num_samples^2 of a pixel falls, in pixels from its corner,
+	// with AA: jittered within the cell of the rotated grid of AA_PATTERN for NUM_SAMPLES
+	// samples, and of a square grid otherwise. The jitter has a random sequence of its own,
+	// so that the paths are the same whichever order the camera rays are generated in.
+	float2 camera_sample_position(const Context& context, const uint2& launch_index, unsigned int sample);
+	// Seed of the path of one sample: the pixel's seed for sample 0, offset by sample image
+	// sizes for the others, so that every sample has a sequence of its own
+	unsigned int camera_sample_seed(const Context& context, const uint2& launch_index, unsigned int sample);
+	// The camera ray of one sample of pinhole_camera, through camera_sample_position
+	float3 camera_ray_direction(const Context& context, const uint2& launch_index, unsigned int sample);
+	// Adds the frame's color of a pixel to its tile and writes the running average to the output
+	void accumulate(Context& context, const uint2& launch_index, const float3& pixel_color, unsigned int num_rays);
+	// Adaptive sampling: true once the pixel has converged in an earlier frame since the last reset,
+	// in which case it is not traced and keeps its output
+	bool pixel_converged(const Context& context, const uint2& launch_index);
+	// Russian roulette after a bounce from rr_begin_depth on: false ends the path, otherwise
+	// the attenuation is divided by the probability to continue
+	bool russian_roulette(const Context& context, PerRayData_radiance& prd);
+#if defined (AA)
+	// pinhole_camera over the block of packet_size / NUM_SAMPLES pixels (2x1 or 2x2) starting
+	// at launch_index: the NUM_SAMPLES camera rays of each pixel follow the AA pattern and
+	// are traced as one packet, the rest of each path continues ray by ray
+	void pinhole_camera_packet(Context& context, const uint2& launch_index);
+	uint2 packet_block_size(const Context& context);
+#endif
+
+	// rtTrace equivalents: invoke the closest hit/miss or any hit programs
+	void trace(const Context& context, const Ray& ray, PerRayData_radiance& prd);
+	void trace(const Context& context, const Ray& ray, PerRayData_shadow& prd);
+
+	// Miss, closest hit and any hit programs
+	void background_miss(const Context& context, const Ray& ray, PerRayData_radiance& prd);
+	void closest_hit_radiance(const Context& context, const Ray& ray, float t_hit, const Attributes& attributes, PerRayData_radiance& prd);
+	void any_hit_shadow(PerRayData_shadow& prd);
+}
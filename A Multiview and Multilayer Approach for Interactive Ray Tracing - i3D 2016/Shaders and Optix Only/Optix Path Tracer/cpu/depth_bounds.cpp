@@ -0,0 +1,231 @@
+#include "depth_bounds.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <immintrin.h>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// Reduces count texels of a level from the 2x2 texels below each, in rows row0 and row1
+	// of the finer level: out[i] = max(row0[2i], row0[2i + 1], row1[2i], row1[2i + 1])
+	typedef void (*ReduceRowFunction)(const float2* row0, const float2* row1, float2* out, unsigned int count);
+
+	static inline float2 max2(const float2& a, const float2& b) { return make_float2(fmaxf(a.x, b.x), fmaxf(a.y, b.y)); }
+
+	static void reduceRowScalar(const float2* row0, const float2* row1, float2* out, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+			out[i] = max2(max2(row0[2 * i], row0[2 * i + 1]), max2(row1[2 * i], row1[2 * i + 1]));
+	}
+
+	// A texel is a pair of floats, so a register of 2n floats holds n texels. The two rows
+	// are reduced vertically first; the horizontal pairs then sit in neighbouring 64-bit
+	// lanes, which are split into even and odd registers of whole texels and reduced.
+
+	//
+	// AVX2, 4 texels per iteration
+	//
+	CPU_TARGET_AVX2 static void reduceRowAvx2(const float2* row0, const float2* row1, float2* out, unsigned int count)
+	{
+		const float* r0 = reinterpret_cast<const float*>(row0);
+		const float* r1 = reinterpret_cast<const float*>(row1);
+		float*		 o	= reinterpret_cast<float*>(out);
+		unsigned int i = 0;
+		for (; i + 4 <= count; i += 4, r0 += 16, r1 += 16, o += 8)
+		{
+			const __m256d v0   = _mm256_castps_pd(_mm256_max_ps(_mm256_loadu_ps(r0),	 _mm256_loadu_ps(r1)));
+			const __m256d v1   = _mm256_castps_pd(_mm256_max_ps(_mm256_loadu_ps(r0 + 8), _mm256_loadu_ps(r1 + 8)));
+			// [v0 texel 0, v1 texel 0, v0 texel 2, v1 texel 2] and the odd texels
+			const __m256  even = _mm256_castpd_ps(_mm256_shuffle_pd(v0, v1, 0x0));
+			const __m256  odd  = _mm256_castpd_ps(_mm256_shuffle_pd(v0, v1, 0xF));
+			const __m256d m	   = _mm256_castps_pd(_mm256_max_ps(even, odd));
+			_mm256_storeu_ps(o, _mm256_castpd_ps(_mm256_permute4x64_pd(m, _MM_SHUFFLE(3, 1, 2, 0))));
+		}
+		reduceRowScalar(row0 + 2 * i, row1 + 2 * i, out + i, count - i);
+	}
+
+	//
+	// AVX-512, 8 texels per iteration
+	//
+	// __Y of the unmasked intrinsics in avx512fintrin.h is left undefined on purpose, which
+	// GCC 12 reports as uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+	CPU_TARGET_AVX512 static void reduceRowAvx512(const float2* row0, const float2* row1, float2* out, unsigned int count)
+	{
+		const __m512i even_lanes = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+		const __m512i odd_lanes	 = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+		const float* r0 = reinterpret_cast<const float*>(row0);
+		const float* r1 = reinterpret_cast<const float*>(row1);
+		float*		 o	= reinterpret_cast<float*>(out);
+		unsigned int i = 0;
+		for (; i + 8 <= count; i += 8, r0 += 32, r1 += 32, o += 16)
+		{
+			const __m512d v0   = _mm512_castps_pd(_mm512_max_ps(_mm512_loadu_ps(r0),		_mm512_loadu_ps(r1)));
+			const __m512d v1   = _mm512_castps_pd(_mm512_max_ps(_mm512_loadu_ps(r0 + 16), _mm512_loadu_ps(r1 + 16)));
+			const __m512  even = _mm512_castpd_ps(_mm512_permutex2var_pd(v0, even_lanes, v1));
+			const __m512  odd  = _mm512_castpd_ps(_mm512_permutex2var_pd(v0, odd_lanes, v1));
+			_mm512_storeu_ps(o, _mm512_max_ps(even, odd));
+		}
+		reduceRowAvx2(row0 + 2 * i, row1 + 2 * i, out + i, count - i);
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+	static ReduceRowFunction getReduceRow(void)
+	{
+		const SimdLevel level = getSimdLevel();
+		return (level >= SIMD_AVX512) ? reduceRowAvx512 : ((level >= SIMD_AVX2) ? reduceRowAvx2 : reduceRowScalar);
+	}
+
+	// Reduces the texels [x0, x1) x [y0, y1) of level lod from level lod - 1. Texels past
+	// the last row or column of the finer level read the last one again, which leaves
+	// the max unchanged.
+	static void reduceBlock(const vector<uint2>& sizes, const vector<size_t>& offsets, float2* texels, unsigned int lod,
+		unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1, ReduceRowFunction reduce_row)
+	{
+		const uint2		   fine		= sizes[lod - 1];
+		const uint2		   coarse	= sizes[lod];
+		const unsigned int pairs_end = min(x1, fine.x / 2);
+		for (unsigned int y = y0; y < y1; ++y)
+		{
+			const float2* row0 = texels + offsets[lod - 1] + static_cast<size_t>(2 * y) * fine.x;
+			const float2* row1 = (2 * y + 1 < fine.y) ? row0 + fine.x : row0;
+			float2*		  out  = texels + offsets[lod] + static_cast<size_t>(y) * coarse.x;
+			if (x0 < pairs_end)
+				reduce_row(row0 + 2 * x0, row1 + 2 * x0, out + x0, pairs_end - x0);
+			for (unsigned int x = max(x0, pairs_end); x < x1; ++x)
+				out[x] = max2(row0[2 * x], row1[2 * x]);
+		}
+	}
+
+	void DepthBoundsPyramid::reset(const vector<uint2>& view_sizes)
+	{
+		m_views.assign(view_sizes.size(), View());
+		for (size_t v = 0; v < view_sizes.size(); ++v)
+		{
+			View& view = m_views[v];
+			uint2 size = view_sizes[v];
+			size_t texels = 0;
+			for (;;)
+			{
+				view.sizes.push_back(size);
+				view.offsets.push_back(texels);
+				texels += static_cast<size_t>(size.x) * size.y;
+				if (size.x <= 1 && size.y <= 1)
+					break;
+				size = make_uint2((size.x + 1) / 2, (size.y + 1) / 2);
+			}
+			view.texels.resize(texels);
+			view.tiles = make_uint2((view_sizes[v].x + TILE_SIZE - 1) / TILE_SIZE, (view_sizes[v].y + TILE_SIZE - 1) / TILE_SIZE);
+			view.dirty.assign(static_cast<size_t>(view.tiles.x) * view.tiles.y, 1);
+		}
+	}
+
+	unsigned int DepthBoundsPyramid::getTileCount(void) const
+	{
+		unsigned int tiles = 0;
+		for (size_t v = 0; v < m_views.size(); ++v)
+			tiles += static_cast<unsigned int>(m_views[v].dirty.size());
+		return tiles;
+	}
+
+	size_t DepthBoundsPyramid::memoryUsage(void) const
+	{
+		size_t bytes = 0;
+		for (size_t v = 0; v < m_views.size(); ++v)
+			bytes += m_views[v].texels.size() * sizeof(float2) + m_views[v].dirty.size();
+		return bytes;
+	}
+
+	unsigned int DepthBoundsPyramid::update(const vector<const AtomicImage*>& depth_bounds, ThreadPool& thread_pool)
+	{
+		// the tiles of all views are numbered one after the other
+		vector<unsigned int> first_tile(m_views.size() + 1, 0);
+		for (size_t v = 0; v < m_views.size(); ++v)
+			first_tile[v + 1] = first_tile[v] + static_cast<unsigned int>(m_views[v].dirty.size());
+
+		atomic<unsigned int> marked(0);
+		thread_pool.run(first_tile.back(), [&](unsigned int index, unsigned int)
+		{
+			const unsigned int v	= static_cast<unsigned int>(upper_bound(first_tile.begin(), first_tile.end(), index) - first_tile.begin()) - 1;
+			const unsigned int tile = index - first_tile[v];
+			View&			   view	  = m_views[v];
+			const AtomicImage& bounds = *depth_bounds[v];
+			const unsigned int x0 = (tile % view.tiles.x) * TILE_SIZE, x1 = min(x0 + TILE_SIZE, view.sizes[0].x);
+			const unsigned int y0 = (tile / view.tiles.x) * TILE_SIZE, y1 = min(y0 + TILE_SIZE, view.sizes[0].y);
+
+			bool changed = false;
+			for (unsigned int y = y0; y < y1; ++y)
+			{
+				float2* row = &view.texels[static_cast<size_t>(y) * view.sizes[0].x];
+				for (unsigned int x = x0; x < x1; ++x)
+				{
+					const unsigned int near_bits = bounds(x, y, 0).load(memory_order_relaxed);
+					const float2 texel = (near_bits == 0xFFFFFFFFu) ? make_float2(-FLT_MAX, 0.0f) :
+						make_float2(-uintBitsToFloat(near_bits), uintBitsToFloat(bounds(x, y, 1).load(memory_order_relaxed)));
+					changed |= texel.x != row[x].x || texel.y != row[x].y;
+					row[x] = texel;
+				}
+			}
+			if (changed && !view.dirty[tile])
+			{
+				view.dirty[tile] = 1;
+				marked.fetch_add(1, memory_order_relaxed);
+			}
+		});
+		return marked.load();
+	}
+
+	void DepthBoundsPyramid::build(ThreadPool& thread_pool, bool full)
+	{
+		const ReduceRowFunction reduce_row = getReduceRow();
+
+		// the dirty tiles of all views, and the views they belong to
+		vector<uint2>		 jobs;
+		vector<unsigned int> views;
+		for (unsigned int v = 0; v < m_views.size(); ++v)
+		{
+			const size_t first = jobs.size();
+			for (unsigned int tile = 0; tile < m_views[v].dirty.size(); ++tile)
+				if (full || m_views[v].dirty[tile])
+					jobs.push_back(make_uint2(v, tile));
+			if (jobs.size() > first)
+				views.push_back(v);
+		}
+		m_dirty_tiles = static_cast<unsigned int>(jobs.size());
+
+		// the levels within each tile, up to one texel per tile
+		thread_pool.run(static_cast<unsigned int>(jobs.size()), [&](unsigned int index, unsigned int)
+		{
+			View&			   view	  = m_views[jobs[index].x];
+			const unsigned int tile	  = jobs[index].y;
+			const unsigned int levels = min(static_cast<unsigned int>(view.sizes.size()), static_cast<unsigned int>(TILE_LEVELS) + 1);
+			for (unsigned int lod = 1; lod < levels; ++lod)
+			{
+				const unsigned int extent = TILE_SIZE >> lod;
+				const unsigned int x0 = (tile % view.tiles.x) * extent, x1 = min(x0 + extent, view.sizes[lod].x);
+				const unsigned int y0 = (tile / view.tiles.x) * extent, y1 = min(y0 + extent, view.sizes[lod].y);
+				reduceBlock(view.sizes, view.offsets, &view.texels[0], lod, x0, x1, y0, y1, reduce_row);
+			}
+			view.dirty[tile] = 0;
+		});
+
+		// the levels above, a few hundred texels per view at most
+		thread_pool.run(static_cast<unsigned int>(views.size()), [&](unsigned int index, unsigned int)
+		{
+			View& view = m_views[views[index]];
+			for (unsigned int lod = TILE_LEVELS + 1; lod < view.sizes.size(); ++lod)
+				reduceBlock(view.sizes, view.offsets, &view.texels[0], lod, 0, view.sizes[lod].x, 0, view.sizes[lod].y, reduce_row);
+		});
+	}
+}
@@ -0,0 +1,73 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Min/max depth-bounds pyramids of the MMRT views (MMRT_DepthBoundsCompute and
+// MMRT_DepthBoundsMipMap), built for all views at once and updated incrementally
+
+#pragma once
+
+#include "abuffer.h"
+#include "thread_pool.h"
+#include <vector>
+
+namespace cpu
+{
+	// Every texel holds, over the pixels below it, the largest pecsZ (the nearest fragment,
+	// negated distance) in x and the farthest distance in y, so that both reduce by max;
+	// empty texels hold -FLT_MAX and 0. Levels halve, rounding up, down to 1x1.
+	//
+	// Level 0 is split into tiles of TILE_SIZE x TILE_SIZE pixels. update() compares the new
+	// depth bounds of each view with the stored ones and marks the tiles that changed; build()
+	// then reduces the mip chains of the dirty tiles of all views in one pass over the thread
+	// pool, 2x2 at a time on AVX-512 or AVX2 registers, and rebuilds the few levels coarser
+	// than a tile of the views that changed. A frame where only one object moved reduces
+	// only the tiles it covered before and after.
+	class DepthBoundsPyramid
+	{
+	public:
+		// A power of two, so that the tiles of every level up to TILE_LEVELS line up
+		enum { TILE_SIZE = 32, TILE_LEVELS = 5 };
+
+		DepthBoundsPyramid() : m_dirty_tiles(0) {}
+
+		// Sizes the pyramids of the views; their contents are undefined and all tiles dirty
+		void	reset(const std::vector<uint2>& view_sizes);
+
+		// Stores the depth bounds of the A-buffer of every view, as AbstractABuffer::build
+		// leaves them (floatBitsToUint of the nearest and farthest distance, 0xFFFFFFFF in the
+		// first layer when empty), in level 0 and marks the tiles that changed dirty. The
+		// images must have the sizes given to reset. Returns the tiles marked by this call.
+		unsigned int	update(const std::vector<const AtomicImage*>& depth_bounds, ThreadPool& thread_pool);
+
+		// Reduces the levels above the dirty tiles, or above all of them with full, and
+		// clears the dirty marks
+		void	build(ThreadPool& thread_pool, bool full = false);
+
+		unsigned int	getViewCount(void) const				{ return static_cast<unsigned int>(m_views.size()); }
+		unsigned int	getLevels(unsigned int view) const		{ return static_cast<unsigned int>(m_views[view].sizes.size()); }
+		uint2			getSize(unsigned int view, unsigned int lod) const { return m_views[view].sizes[lod]; }
+		const float2*	getLevel(unsigned int view, unsigned int lod) const { return &m_views[view].texels[m_views[view].offsets[lod]]; }
+		const float2&	operator()(unsigned int view, unsigned int lod, unsigned int x, unsigned int y) const
+		{
+			const View& v = m_views[view];
+			return v.texels[v.offsets[lod] + static_cast<size_t>(y) * v.sizes[lod].x + x];
+		}
+
+		// Tiles over all views, and those reduced by the last build
+		unsigned int	getTileCount(void) const;
+		unsigned int	getDirtyTileCount(void) const			{ return m_dirty_tiles; }
+		size_t			memoryUsage(void) const;
+
+	private:
+		struct View
+		{
+			std::vector<uint2>			sizes;		// per level
+			std::vector<size_t>			offsets;	// of each level in texels
+			std::vector<float2>			texels;
+			uint2						tiles;
+			std::vector<unsigned char>	dirty;		// per tile
+		};
+
+		std::vector<View>	m_views;
+		unsigned int		m_dirty_tiles;
+	};
+}
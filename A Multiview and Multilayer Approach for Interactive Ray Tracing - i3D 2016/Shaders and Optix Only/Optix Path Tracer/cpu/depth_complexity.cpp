@@ -0,0 +1,201 @@
+#include "depth_complexity.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const double			PERCENTILES[]		= { 50.0, 90.0, 95.0, 99.0, 99.9, 100.0 };
+	static const unsigned int	NUM_PERCENTILES		= sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+	// headroom of the node pool over the fragments of the measured view
+	static const double			PREALLOC_HEADROOM	= 1.25;
+
+	unsigned int getPercentile(const vector<unsigned long long>& histogram, double percentile)
+	{
+		unsigned long long total = 0;
+		for (size_t count = 1; count < histogram.size(); ++count)
+			total += histogram[count];
+		if (total == 0)
+			return 0;
+
+		const double threshold = min(max(percentile, 0.0), 100.0) * 0.01 * static_cast<double>(total);
+		unsigned long long sum = 0;
+		for (size_t count = 1; count < histogram.size(); ++count)
+		{
+			sum += histogram[count];
+			if (static_cast<double>(sum) >= threshold)
+				return static_cast<unsigned int>(count);
+		}
+		return static_cast<unsigned int>(histogram.size()) - 1;
+	}
+
+	void measureDepthComplexity(const Rasterizer& rasterizer, unsigned int buckets, BucketDistribution distribution, ThreadPool& thread_pool, DepthComplexityStats& depth_complexity)
+	{
+		const unsigned int width  = rasterizer.width();
+		const unsigned int height = rasterizer.height();
+
+		// the fragment counts and, as the _BUN variants measure them, the depth bounds
+		AtomicImage counts, depth_bounds;
+		counts.resize(width, height, 1);
+		counts.clear(0u, thread_pool);
+		depth_bounds.resize(width, height, 2);
+		depth_bounds.clearLayer(0, 0xFFFFFFFFu, thread_pool);
+		depth_bounds.clearLayer(1, 0u, thread_pool);
+		rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int)
+		{
+			const unsigned int Z = floatBitsToUint(-pecsZ);
+			counts(x, y).fetch_add(1u, memory_order_relaxed);
+			depth_bounds.atomicMin(x, y, 0, Z);
+			depth_bounds.atomicMax(x, y, 1, Z);
+		});
+
+		depth_complexity.width				 = width;
+		depth_complexity.height				 = height;
+		depth_complexity.bucket_distribution = distribution;
+		depth_complexity.fragments			 = 0;
+		depth_complexity.histogram.assign(1, 0);
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned int count = counts(x, y).load(memory_order_relaxed);
+				if (count >= depth_complexity.histogram.size())
+					depth_complexity.histogram.resize(count + 1, 0);
+				depth_complexity.histogram[count]++;
+				depth_complexity.fragments += count;
+			}
+
+		vector<unsigned int> bucket_counts;
+		for (unsigned int b = 1; b <= MAX_TELEMETRY_BUCKETS; b *= 2)
+			bucket_counts.push_back(b);
+		if (buckets > 0 && find(bucket_counts.begin(), bucket_counts.end(), buckets) == bucket_counts.end())
+			bucket_counts.insert(upper_bound(bucket_counts.begin(), bucket_counts.end(), buckets), buckets);
+
+		// one more pass per bucket count, with the buckets of the _BUN variants, and before it
+		// the histogram pass of BUCKETS_EQUALIZED
+		AtomicImage bucket_fragments;
+		depth_complexity.bucket_occupancy.resize(bucket_counts.size());
+		for (size_t b = 0; b < bucket_counts.size(); ++b)
+		{
+			const unsigned int num_buckets = bucket_counts[b];
+			DepthBuckets depth_buckets(distribution, num_buckets);
+			depth_buckets.equalize(rasterizer, depth_bounds, thread_pool);
+			bucket_fragments.resize(width, height, num_buckets);
+			bucket_fragments.clear(0u, thread_pool);
+			rasterizer.rasterize(thread_pool, [&](unsigned int x, unsigned int y, float pecsZ, unsigned int)
+			{
+				bucket_fragments(x, y, depth_buckets.getBucket(depth_bounds, x, y, -pecsZ)).fetch_add(1u, memory_order_relaxed);
+			});
+
+			BucketOccupancy& occupancy = depth_complexity.bucket_occupancy[b];
+			occupancy.buckets = num_buckets;
+			occupancy.fragments.assign(num_buckets, 0);
+			occupancy.occupied.assign(num_buckets, 0);
+			occupancy.histogram.assign(1, 0);
+			for (unsigned int bucket = 0; bucket < num_buckets; ++bucket)
+				for (unsigned int y = 0; y < height; ++y)
+					for (unsigned int x = 0; x < width; ++x)
+					{
+						if (counts(x, y).load(memory_order_relaxed) == 0u)
+							continue;
+						const unsigned int count = bucket_fragments(x, y, bucket).load(memory_order_relaxed);
+						if (count >= occupancy.histogram.size())
+							occupancy.histogram.resize(count + 1, 0);
+						occupancy.histogram[count]++;
+						occupancy.fragments[bucket] += count;
+						occupancy.occupied[bucket]	+= (count > 0u) ? 1 : 0;
+					}
+		}
+	}
+
+	void sizeABuffer(const DepthComplexityStats& depth_complexity, double percentile, ABufferSettings& settings)
+	{
+		settings.max_layers = max(getPercentile(depth_complexity.histogram, percentile), 1u);
+
+		for (size_t b = 0; b < depth_complexity.bucket_occupancy.size(); ++b)
+		{
+			settings.buckets = depth_complexity.bucket_occupancy[b].buckets;
+			if (getPercentile(depth_complexity.bucket_occupancy[b].histogram, percentile) <= settings.insert_vs_shell)
+				break;
+		}
+
+		settings.prealloc_fragments = static_cast<unsigned int>(min(ceil(static_cast<double>(depth_complexity.fragments) * PREALLOC_HEADROOM) + 1.0, 4294967295.0));
+		settings.exact_allocation	= false;
+	}
+
+	// [JSON]
+
+	static void writeArray(ofstream& out, const vector<unsigned long long>& values)
+	{
+		out << "[";
+		for (size_t i = 0; i < values.size(); ++i)
+			out << (i ? ", " : "") << values[i];
+		out << "]";
+	}
+
+	static void writePercentiles(ofstream& out, const vector<unsigned long long>& histogram)
+	{
+		out << "{";
+		for (unsigned int p = 0; p < NUM_PERCENTILES; ++p)
+			out << (p ? ", " : "") << "\"" << PERCENTILES[p] << "\": " << getPercentile(histogram, PERCENTILES[p]);
+		out << "}";
+	}
+
+	static void writeSettings(ofstream& out, const ABufferSettings& settings)
+	{
+		out << "{\"max_layers\": " << settings.max_layers << ", \"buckets\": " << settings.buckets
+			<< ", \"prealloc_fragments\": " << settings.prealloc_fragments << ", \"exact_allocation\": " << (settings.exact_allocation ? "true" : "false") << "}";
+	}
+
+	void writeDepthComplexityJson(const string& filename, const DepthComplexityStats& depth_complexity, const ABufferSettings& settings)
+	{
+		ofstream out(filename.c_str());
+		if (!out)
+			throw runtime_error("Could not write '" + filename + "'");
+
+		const unsigned long long covered_pixels = depth_complexity.getCoveredPixels();
+		out << "{\n";
+		out << "\t\"viewport\": [" << depth_complexity.width << ", " << depth_complexity.height << "],\n";
+		out << "\t\"fragments\": " << depth_complexity.fragments << ",\n";
+		out << "\t\"covered_pixels\": " << covered_pixels << ",\n";
+		out << "\t\"mean\": " << (covered_pixels ? static_cast<double>(depth_complexity.fragments) / covered_pixels : 0.0) << ",\n";
+		out << "\t\"max\": " << depth_complexity.getMaxCount() << ",\n";
+		out << "\t\"bucket_distribution\": \"" << getBucketDistributionName(depth_complexity.bucket_distribution) << "\",\n";
+		out << "\t\"percentiles\": ";
+		writePercentiles(out, depth_complexity.histogram);
+		out << ",\n\t\"histogram\": ";
+		writeArray(out, depth_complexity.histogram);
+		out << ",\n\t\"buckets\": [\n";
+		for (size_t b = 0; b < depth_complexity.bucket_occupancy.size(); ++b)
+		{
+			const BucketOccupancy& occupancy = depth_complexity.bucket_occupancy[b];
+			out << "\t\t{\n\t\t\t\"buckets\": " << occupancy.buckets << ",\n\t\t\t\"fragments\": ";
+			writeArray(out, occupancy.fragments);
+			out << ",\n\t\t\t\"occupied_pixels\": ";
+			writeArray(out, occupancy.occupied);
+			out << ",\n\t\t\t\"percentiles\": ";
+			writePercentiles(out, occupancy.histogram);
+			out << ",\n\t\t\t\"histogram\": ";
+			writeArray(out, occupancy.histogram);
+			out << "\n\t\t}" << (b + 1 < depth_complexity.bucket_occupancy.size() ? "," : "") << "\n";
+		}
+		out << "\t],\n\t\"settings\": ";
+		writeSettings(out, settings);
+		out << ",\n\t\"sized_settings\": {\n";
+		for (unsigned int p = 0; p < NUM_PERCENTILES; ++p)
+		{
+			ABufferSettings sized = settings;
+			sizeABuffer(depth_complexity, PERCENTILES[p], sized);
+			out << "\t\t\"" << PERCENTILES[p] << "\": ";
+			writeSettings(out, sized);
+			out << (p + 1 < NUM_PERCENTILES ? "," : "") << "\n";
+		}
+		out << "\t}\n}\n";
+		if (!out)
+			throw runtime_error("Could not write '" + filename + "'");
+	}
+}
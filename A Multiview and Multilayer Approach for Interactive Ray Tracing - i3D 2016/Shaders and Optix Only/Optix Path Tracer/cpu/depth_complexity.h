@@ -0,0 +1,60 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Depth-complexity telemetry of the A-buffer: fragment counts per pixel and per depth
+// bucket of a view, exported as JSON and used to size max_layers, buckets and
+// prealloc_fragments for a scene and view
+
+#pragma once
+
+#include "abuffer.h"
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// Bucket counts measured beside ABufferSettings::buckets: 1, 2, 4... up to this
+	static const unsigned int	MAX_TELEMETRY_BUCKETS = 16;
+
+	// Fragments of the pixels with a given number of buckets, split as the _BUN variants
+	// split them, by DepthBuckets between the depth bounds of each pixel
+	struct BucketOccupancy
+	{
+		unsigned int						buckets;
+		std::vector<unsigned long long>		fragments;		// per bucket index, over all pixels
+		std::vector<unsigned long long>		occupied;		// per bucket index, pixels with fragments in it
+		std::vector<unsigned long long>		histogram;		// buckets of covered pixels per fragment count
+	};
+
+	struct DepthComplexityStats
+	{
+		unsigned int					width, height;
+		BucketDistribution				bucket_distribution;
+		unsigned long long				fragments;
+		std::vector<unsigned long long>	histogram;			// pixels per fragment count, 0 up to the maximum
+		std::vector<BucketOccupancy>	bucket_occupancy;	// by increasing bucket count
+
+		unsigned long long	getCoveredPixels(void) const { return histogram.empty() ? 0 : static_cast<unsigned long long>(width) * height - histogram[0]; }
+		unsigned int		getMaxCount(void) const		 { return histogram.empty() ? 0 : static_cast<unsigned int>(histogram.size()) - 1; }
+	};
+
+	// Smallest fragment count that at least percentile % of the counted entries do not
+	// exceed; entries of count 0 are left out, as are the empty pixels and buckets
+	unsigned int	getPercentile(const std::vector<unsigned long long>& histogram, double percentile);
+
+	// Counts the fragments of every pixel in one geometry pass, along with its depth
+	// bounds, and then splits them into buckets of the given distribution with one more
+	// pass per bucket count, two for BUCKETS_EQUALIZED
+	void	measureDepthComplexity(const Rasterizer& rasterizer, unsigned int buckets, BucketDistribution distribution, ThreadPool& thread_pool, DepthComplexityStats& depth_complexity);
+
+	// Writes the histograms, their 50th to 100th percentiles and the bucket occupancy, along
+	// with the current settings and those that sizeABuffer would choose at each percentile
+	void	writeDepthComplexityJson(const std::string& filename, const DepthComplexityStats& depth_complexity, const ABufferSettings& settings);
+
+	// Sizes the A-buffer for the view, so that percentile % of the pixels hold no more
+	// fragments than max_layers: buckets becomes the smallest measured count whose buckets
+	// stay within insert_vs_shell fragments at the same percentile, so that the resolve
+	// sorts them by insertion, and the fixed node pool of prealloc_fragments, which
+	// exact_allocation is turned off for, holds the fragments of the view and a quarter more
+	// for the views around it
+	void	sizeABuffer(const DepthComplexityStats& depth_complexity, double percentile, ABufferSettings& settings);
+}
@@ -0,0 +1,401 @@
+#include "fragment_sort.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+using namespace std;
+
+namespace cpu
+{
+	// Lanes whose index has the given bit set, for the strides within a register
+	static const unsigned int	LANE_BITS[8] = { 0x00, 0xAA, 0xCC, 0x00, 0xF0, 0x00, 0x00, 0x00 };
+
+	// In the stage of a bitonic network with block size k and stride j, key i keeps the
+	// larger key of the pair (i, i ^ j) when it is the upper one in an ascending block or
+	// the lower one in a descending block. Returns these lanes of the register of width
+	// lanes whose first key is base, for strides below lanes.
+	static inline unsigned int maxLanes(unsigned int base, unsigned int k, unsigned int j, unsigned int lanes)
+	{
+		const unsigned int block = (k < lanes) ? LANE_BITS[k] : ((base & k) ? 0xFFu : 0x00u);
+		return (LANE_BITS[j] ^ block) & ((1u << lanes) - 1u);
+	}
+
+	// The keys hold the float bits of the depth flipped so that they order as unsigned
+	// integers, then inverted so that they ascend as the depths descend, above the id.
+	// Keys past num are all ones and stay at the end.
+
+	//
+	// AVX-512, 8 keys per register
+	//
+	// GCC 12 takes the undefined source operand of the unmasked AVX-512 intrinsics, __Y in
+	// avx512fintrin.h, for an uninitialized variable once they are inlined here
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+	CPU_TARGET_AVX512 static inline __m512i swapLanes8(__m512i v, unsigned int j)
+	{
+		switch (j)
+		{
+		case 1:	 return _mm512_permutex_epi64(v, _MM_SHUFFLE(2, 3, 0, 1));
+		case 2:	 return _mm512_permutex_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+		default: return _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2));
+		}
+	}
+
+	template<int REGISTERS>
+	CPU_TARGET_AVX512 static void bitonicSortAvx512(unsigned int* ids, float* depths, int num)
+	{
+		const __m512i ones = _mm512_set1_epi32(-1);
+		const __m512i sign = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+		__m512i v[REGISTERS];
+		__mmask8 valid[REGISTERS];
+		CPU_UNROLL
+		for (int r = 0; r < REGISTERS; ++r)
+		{
+			const int count = num - 8 * r;
+			valid[r] = static_cast<__mmask8>(count >= 8 ? 0xFF : (count > 0 ? (1u << count) - 1u : 0u));
+			if (valid[r] == 0)
+			{
+				v[r] = ones;
+				continue;
+			}
+			const __m512i bits = _mm512_maskz_loadu_epi32(valid[r], depths + 8 * r);
+			const __m512i id   = _mm512_maskz_loadu_epi32(valid[r], ids + 8 * r);
+			const __m512i key  = _mm512_xor_si512(bits, _mm512_or_si512(_mm512_srai_epi32(bits, 31), sign));
+			v[r] = _mm512_or_si512(_mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(_mm512_xor_si512(key, ones))), 32),
+								   _mm512_cvtepu32_epi64(_mm512_castsi512_si256(id)));
+			v[r] = _mm512_mask_blend_epi64(valid[r], ones, v[r]);
+		}
+
+		CPU_UNROLL
+		for (unsigned int k = 2; k <= 8u * REGISTERS; k <<= 1)
+			CPU_UNROLL
+			for (unsigned int j = k >> 1; j > 0; j >>= 1)
+			{
+				if (j >= 8)
+				{
+					// pairs of whole registers, j / 8 of them apart
+					CPU_UNROLL
+					for (unsigned int pair = 0; pair < REGISTERS / 2; ++pair)
+					{
+						const unsigned int span = j / 8;
+						const unsigned int r	= (pair / span) * 2 * span + pair % span;
+						const unsigned int q	= r + span;
+						const __m512i lo = _mm512_min_epu64(v[r], v[q]);
+						const __m512i hi = _mm512_max_epu64(v[r], v[q]);
+						const bool ascending = ((r * 8) & k) == 0;
+						v[r] = ascending ? lo : hi;
+						v[q] = ascending ? hi : lo;
+					}
+				}
+				else
+				{
+					CPU_UNROLL
+					for (unsigned int r = 0; r < REGISTERS; ++r)
+					{
+						const __m512i p	 = swapLanes8(v[r], j);
+						const __m512i lo = _mm512_min_epu64(v[r], p);
+						const __m512i hi = _mm512_max_epu64(v[r], p);
+						v[r] = _mm512_mask_blend_epi64(static_cast<__mmask8>(maxLanes(r * 8, k, j, 8)), lo, hi);
+					}
+				}
+			}
+
+		for (int r = 0; r < REGISTERS && 8 * r < num; ++r)
+		{
+			const __m512i key  = _mm512_xor_si512(_mm512_srli_epi64(v[r], 32), ones);
+			const __m512i bits = _mm512_xor_si512(key, _mm512_or_si512(_mm512_xor_si512(_mm512_srai_epi32(key, 31), ones), sign));
+			_mm512_mask_cvtepi64_storeu_epi32(ids + 8 * r, valid[r], v[r]);
+			_mm512_mask_cvtepi64_storeu_epi32(depths + 8 * r, valid[r], bits);
+		}
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+	//
+	// AVX2, 4 keys per register. There is no unsigned 64-bit comparison, so the keys are
+	// sorted with their sign bit flipped.
+	//
+	CPU_TARGET_AVX2 static inline __m256i swapLanes4(__m256i v, unsigned int j)
+	{
+		return (j == 1) ? _mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 3, 0, 1)) : _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+	}
+
+	CPU_TARGET_AVX2 static inline void minMax4(__m256i a, __m256i b, __m256i& lo, __m256i& hi)
+	{
+		const __m256i greater = _mm256_cmpgt_epi64(a, b);
+		lo = _mm256_blendv_epi8(a, b, greater);
+		hi = _mm256_blendv_epi8(b, a, greater);
+	}
+
+	template<int REGISTERS>
+	CPU_TARGET_AVX2 static void bitonicSortAvx2(unsigned int* ids, float* depths, int num)
+	{
+		const __m128i ones	  = _mm_set1_epi32(-1);
+		const __m128i sign	  = _mm_set1_epi32(static_cast<int>(0x80000000u));
+		const __m256i sign64  = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ull));
+		const __m256i low	  = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+		__m256i v[REGISTERS];
+		__m128i valid[REGISTERS];
+		CPU_UNROLL
+		for (int r = 0; r < REGISTERS; ++r)
+		{
+			const int count = num - 4 * r;
+			valid[r] = _mm_cmpgt_epi32(_mm_set1_epi32(count), _mm_setr_epi32(0, 1, 2, 3));
+			if (count <= 0)
+			{
+				v[r] = _mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFll);
+				continue;
+			}
+			const __m128i bits = _mm_maskload_epi32(reinterpret_cast<const int*>(depths + 4 * r), valid[r]);
+			const __m128i id   = _mm_maskload_epi32(reinterpret_cast<const int*>(ids + 4 * r), valid[r]);
+			const __m128i key  = _mm_xor_si128(bits, _mm_or_si128(_mm_srai_epi32(bits, 31), sign));
+			v[r] = _mm256_or_si256(_mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm_xor_si128(key, ones)), 32), _mm256_cvtepu32_epi64(id));
+			v[r] = _mm256_xor_si256(_mm256_blendv_epi8(_mm256_set1_epi64x(-1), v[r], _mm256_cvtepi32_epi64(valid[r])), sign64);
+		}
+
+		CPU_UNROLL
+		for (unsigned int k = 2; k <= 4u * REGISTERS; k <<= 1)
+			CPU_UNROLL
+			for (unsigned int j = k >> 1; j > 0; j >>= 1)
+			{
+				if (j >= 4)
+				{
+					CPU_UNROLL
+					for (unsigned int pair = 0; pair < REGISTERS / 2; ++pair)
+					{
+						const unsigned int span = j / 4;
+						const unsigned int r	= (pair / span) * 2 * span + pair % span;
+						const unsigned int q	= r + span;
+						__m256i lo, hi;
+						minMax4(v[r], v[q], lo, hi);
+						const bool ascending = ((r * 4) & k) == 0;
+						v[r] = ascending ? lo : hi;
+						v[q] = ascending ? hi : lo;
+					}
+				}
+				else
+				{
+					CPU_UNROLL
+					for (unsigned int r = 0; r < REGISTERS; ++r)
+					{
+						__m256i lo, hi;
+						minMax4(v[r], swapLanes4(v[r], j), lo, hi);
+						const unsigned int mask = maxLanes(r * 4, k, j, 4);
+						const __m256i select = _mm256_set_epi64x((mask & 8) ? -1 : 0, (mask & 4) ? -1 : 0, (mask & 2) ? -1 : 0, (mask & 1) ? -1 : 0);
+						v[r] = _mm256_blendv_epi8(lo, hi, select);
+					}
+				}
+			}
+
+		for (int r = 0; r < REGISTERS && 4 * r < num; ++r)
+		{
+			const __m256i keys = _mm256_xor_si256(v[r], sign64);
+			const __m128i id   = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(keys, low));
+			const __m128i key  = _mm_xor_si128(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_srli_epi64(keys, 32), low)), ones);
+			const __m128i bits = _mm_xor_si128(key, _mm_or_si128(_mm_xor_si128(_mm_srai_epi32(key, 31), ones), sign));
+			_mm_maskstore_epi32(reinterpret_cast<int*>(ids + 4 * r), valid[r], id);
+			_mm_maskstore_epi32(reinterpret_cast<int*>(depths + 4 * r), valid[r], bits);
+		}
+	}
+
+	bool sortFragmentsNetwork(unsigned int* ids, float* depths, int num)
+	{
+		if (num < MIN_NETWORK_SORT || num > MAX_NETWORK_SORT)
+			return false;
+		const SimdLevel level = getSimdLevel();
+		if (level == SIMD_SCALAR)
+			return false;
+
+		if (level >= SIMD_AVX512)
+		{
+			if (num <= 8)		bitonicSortAvx512<1>(ids, depths, num);
+			else if (num <= 16)	bitonicSortAvx512<2>(ids, depths, num);
+			else if (num <= 32)	bitonicSortAvx512<4>(ids, depths, num);
+			else				bitonicSortAvx512<8>(ids, depths, num);
+		}
+		else
+		{
+			if (num <= 8)		bitonicSortAvx2<2>(ids, depths, num);
+			else if (num <= 16)	bitonicSortAvx2<4>(ids, depths, num);
+			else if (num <= 32)	bitonicSortAvx2<8>(ids, depths, num);
+			else				bitonicSortAvx2<16>(ids, depths, num);
+		}
+		return true;
+	}
+
+	void sortFragmentsShell(unsigned int* ids, float* depths, int num)
+	{
+		int inc = num >> 1;
+		while (inc > 0)
+		{
+			for (int i = inc; i < num; ++i)
+			{
+				const float		 tmp_depth = depths[i];
+				const unsigned int tmp_id  = ids[i];
+				int j = i;
+				while (j >= inc && depths[j - inc] < tmp_depth)
+				{
+					ids[j]	  = ids[j - inc];
+					depths[j] = depths[j - inc];
+					j -= inc;
+				}
+				depths[j] = tmp_depth;
+				ids[j]	  = tmp_id;
+			}
+			inc = static_cast<int>(inc / 2.2f + 0.5f);
+		}
+	}
+
+	void sortFragmentsInsertion(unsigned int* ids, float* depths, int num)
+	{
+		for (int j = 1; j < num; ++j)
+		{
+			const float		   key_depth = depths[j];
+			const unsigned int key_id	 = ids[j];
+			int i = j - 1;
+			while (i >= 0 && depths[i] < key_depth)
+			{
+				depths[i + 1] = depths[i];
+				ids[i + 1]	  = ids[i];
+				--i;
+			}
+			ids[i + 1]	  = key_id;
+			depths[i + 1] = key_depth;
+		}
+	}
+
+	void sortFragments(unsigned int* ids, float* depths, int num, int insert_vs_shell, bool networks)
+	{
+		if (networks && sortFragmentsNetwork(ids, depths, num))
+			return;
+		if (num <= insert_vs_shell)
+			sortFragmentsInsertion(ids, depths, num);
+		else
+			sortFragmentsShell(ids, depths, num);
+	}
+
+	// [FragmentRadixSort]
+
+	// keys of each block are counted and scattered by one task
+	static const unsigned int	RADIX_BLOCK_SIZE = 1u << 16;
+	static const unsigned int	RADIX_BITS		 = 8;
+	static const unsigned int	RADIX_DIGITS	 = 1u << RADIX_BITS;
+
+	static unsigned int bitsFor(unsigned int count)
+	{
+		unsigned int bits = 0;
+		while (bits < 32 && (1ull << bits) < count)
+			bits++;
+		return bits;
+	}
+
+	void FragmentRadixSort::reset(unsigned int num, unsigned int num_pixels)
+	{
+		m_num		 = num;
+		m_pixel_bits = bitsFor(num_pixels);
+		m_index_bits = bitsFor(num);
+		m_depth_bits = min(static_cast<unsigned int>(MAX_DEPTH_BITS), 64u - m_pixel_bits - m_index_bits);
+		m_keys[0].resize(num);
+		m_keys[1].resize(num);
+		m_depths.resize(num);
+		m_order.resize(num);
+		m_span_starts.resize(num_pixels);
+	}
+
+	size_t FragmentRadixSort::memoryUsage(void) const
+	{
+		return 2 * m_keys[0].size() * sizeof(unsigned long long) + m_depths.size() * sizeof(float) +
+			   (m_histograms.size() + m_order.size() + m_span_starts.size()) * sizeof(unsigned int);
+	}
+
+	void FragmentRadixSort::sort(ThreadPool& thread_pool)
+	{
+		const unsigned int num_blocks = (m_num + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+		const unsigned int key_end	  = m_index_bits + m_depth_bits + m_pixel_bits;
+		m_histograms.resize(static_cast<size_t>(num_blocks) * RADIX_DIGITS);
+
+		int source = 0;
+		for (unsigned int shift = m_index_bits; shift < key_end; shift += RADIX_BITS)
+		{
+			const unsigned long long* keys = m_num ? &m_keys[source][0] : 0;
+			thread_pool.run(num_blocks, [&](unsigned int block, unsigned int)
+			{
+				unsigned int* histogram = &m_histograms[static_cast<size_t>(block) * RADIX_DIGITS];
+				fill(histogram, histogram + RADIX_DIGITS, 0u);
+				const unsigned int end = min(m_num, (block + 1) * RADIX_BLOCK_SIZE);
+				for (unsigned int i = block * RADIX_BLOCK_SIZE; i < end; ++i)
+					histogram[(keys[i] >> shift) & (RADIX_DIGITS - 1)]++;
+			});
+
+			// digits major, blocks minor, so that every block scatters stably after the
+			// blocks before it; a digit shared by all keys needs no pass
+			unsigned int offset = 0;
+			bool single_digit = false;
+			for (unsigned int digit = 0; digit < RADIX_DIGITS; ++digit)
+			{
+				const unsigned int digit_offset = offset;
+				for (unsigned int block = 0; block < num_blocks; ++block)
+				{
+					unsigned int& count = m_histograms[static_cast<size_t>(block) * RADIX_DIGITS + digit];
+					const unsigned int block_count = count;
+					count  = offset;
+					offset += block_count;
+				}
+				single_digit = single_digit || (offset - digit_offset == m_num);
+			}
+			if (single_digit)
+				continue;
+
+			unsigned long long* keys_out = &m_keys[1 - source][0];
+			thread_pool.run(num_blocks, [&](unsigned int block, unsigned int)
+			{
+				unsigned int* offsets = &m_histograms[static_cast<size_t>(block) * RADIX_DIGITS];
+				const unsigned int end = min(m_num, (block + 1) * RADIX_BLOCK_SIZE);
+				for (unsigned int i = block * RADIX_BLOCK_SIZE; i < end; ++i)
+					keys_out[offsets[(keys[i] >> shift) & (RADIX_DIGITS - 1)]++] = keys[i];
+			});
+			source = 1 - source;
+		}
+
+		// the fragment indices, the first fragment of every pixel and an insertion sort of
+		// each run of equal keys by the exact depth
+		const unsigned long long* keys = m_num ? &m_keys[source][0] : 0;
+		const unsigned long long index_mask = (1ull << m_index_bits) - 1ull;
+		const unsigned int pixel_shift = m_index_bits + m_depth_bits;
+		thread_pool.run(num_blocks, [&](unsigned int block, unsigned int)
+		{
+			const unsigned int end = min(m_num, (block + 1) * RADIX_BLOCK_SIZE);
+			for (unsigned int i = block * RADIX_BLOCK_SIZE; i < end; ++i)
+			{
+				m_order[i] = static_cast<unsigned int>(keys[i] & index_mask);
+				if (i == 0 || (keys[i] >> pixel_shift) != (keys[i - 1] >> pixel_shift))
+					m_span_starts[keys[i] >> pixel_shift] = i;
+			}
+		});
+		thread_pool.run(num_blocks, [&](unsigned int block, unsigned int)
+		{
+			const unsigned int end = min(m_num, (block + 1) * RADIX_BLOCK_SIZE);
+			for (unsigned int i = block * RADIX_BLOCK_SIZE; i < end; ++i)
+			{
+				if (i != 0 && (keys[i] >> m_index_bits) == (keys[i - 1] >> m_index_bits))
+					continue;
+				unsigned int run_end = i + 1;
+				while (run_end < m_num && (keys[run_end] >> m_index_bits) == (keys[i] >> m_index_bits))
+					run_end++;
+				for (unsigned int j = i + 1; j < run_end; ++j)
+				{
+					const unsigned int value = m_order[j];
+					unsigned int k = j;
+					for (; k > i && m_depths[m_order[k - 1]] < m_depths[value]; --k)
+						m_order[k] = m_order[k - 1];
+					m_order[k] = value;
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,85 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Per-pixel fragment sorting of the A-buffer resolve step, ported from GLSL/include files/sort.h
+
+#pragma once
+
+#include "thread_pool.h"
+#include <cstring>
+#include <vector>
+
+namespace cpu
+{
+	// Fragment counts sorted by sortFragmentsNetwork. Below the minimum, packing the keys
+	// costs more than insertion sort.
+	static const int	MIN_NETWORK_SORT = 6;
+	static const int	MAX_NETWORK_SORT = 64;
+
+	// Sorts num (depth, id) pairs by decreasing depth, i.e. front to back for the negative
+	// eye-space depths (pecsZ) of the A-buffer. Insertion sort up to insert_vs_shell
+	// fragments (INSERT_VS_SHELL), shell sort above. With networks, the counts that
+	// sortFragmentsNetwork handles at the current SIMD level go through it instead.
+	void	sortFragments(unsigned int* ids, float* depths, int num, int insert_vs_shell, bool networks = false);
+
+	void	sortFragmentsInsertion(unsigned int* ids, float* depths, int num);
+	void	sortFragmentsShell(unsigned int* ids, float* depths, int num);
+
+	// Packs every pair into a 64-bit key, the depth in an order-preserving encoding above
+	// the id, and sorts the keys with the smallest bitonic network of 8, 16, 32 or 64 keys
+	// that holds num, on AVX-512 or AVX2 registers. Fragments of equal depth end up in id
+	// order rather than in their original order. Returns false, leaving the arrays as they
+	// are, when num is outside [MIN_NETWORK_SORT, MAX_NETWORK_SORT] or getSimdLevel() is
+	// SIMD_SCALAR.
+	bool	sortFragmentsNetwork(unsigned int* ids, float* depths, int num);
+
+	// Sorts the fragments of all pixels at once, rather than pixel by pixel: a parallel LSD
+	// radix sort, 8 bits per pass, of 64-bit keys that hold the pixel, the depth quantized
+	// to the bits left over, up to MAX_DEPTH_BITS, and the fragment index. Fragments that
+	// share a quantized depth keep their input order, and are then ordered by their exact
+	// depth within each pixel. The result lists the fragments by increasing pixel and front
+	// to back within each, so that every pixel occupies one span, as in a sorted S-buffer.
+	class FragmentRadixSort
+	{
+	public:
+		// The top of the depth's order-preserving encoding: 24 bits keep 16 bits of
+		// mantissa, a relative precision of 2^-16
+		enum { MAX_DEPTH_BITS = 24 };
+
+		FragmentRadixSort() : m_num(0), m_pixel_bits(0), m_depth_bits(0), m_index_bits(0) {}
+
+		// Sizes the buffers for num fragments over num_pixels pixels
+		void	reset(unsigned int num, unsigned int num_pixels);
+		// Fragment i lies in pixel at depth (pecsZ); may be called concurrently for different i
+		void	setFragment(unsigned int i, unsigned int pixel, float depth);
+		void	sort(ThreadPool& thread_pool);
+
+		// Fragment indices in sorted order
+		const unsigned int*	getOrder(void) const { return m_order.empty() ? 0 : &m_order[0]; }
+		// Position in getOrder of the first fragment of a pixel; undefined for empty pixels
+		unsigned int		getSpanStart(unsigned int pixel) const { return m_span_starts[pixel]; }
+
+		size_t				memoryUsage(void) const;
+
+	private:
+		unsigned int						m_num;
+		unsigned int						m_pixel_bits;
+		unsigned int						m_depth_bits;
+		unsigned int						m_index_bits;
+		std::vector<unsigned long long>		m_keys[2];
+		std::vector<float>					m_depths;
+		std::vector<unsigned int>			m_histograms;	// RADIX_DIGITS per block
+		std::vector<unsigned int>			m_order;
+		std::vector<unsigned int>			m_span_starts;
+	};
+
+	inline void FragmentRadixSort::setFragment(unsigned int i, unsigned int pixel, float depth)
+	{
+		// inverted, so that the keys ascend front to back
+		unsigned int bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		bits = ~((bits & 0x80000000u) ? ~bits : (bits | 0x80000000u));
+		const unsigned long long quantized = m_depth_bits ? (bits >> (32 - m_depth_bits)) : 0u;
+		m_keys[0][i] = (((static_cast<unsigned long long>(pixel) << m_depth_bits) | quantized) << m_index_bits) | i;
+		m_depths[i]	 = depth;
+	}
+}
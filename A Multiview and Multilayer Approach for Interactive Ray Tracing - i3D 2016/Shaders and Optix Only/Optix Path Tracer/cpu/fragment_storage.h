@@ -0,0 +1,219 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Fragment records of the A-buffer variants, and the buffers that store them in any of
+// the memory layouts of FragmentLayout
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+namespace cpu
+{
+	// Counterparts of GLSL/include files/data_structs.h. Index 0 of the linked-list node
+	// buffers is the null pointer.
+
+	// Non-Decoupled Versions
+	struct NodeTypeDataLL
+	{
+		float			depth;
+		unsigned int	next;
+
+		unsigned int	albedo;
+		unsigned int	normal;
+		unsigned int	specular;
+		unsigned int	ior_opacity;
+	};
+
+	struct NodeTypeDataLL_Double
+	{
+		float			depth;
+
+		unsigned int	albedo;
+		unsigned int	normal;
+		unsigned int	specular;
+		unsigned int	ior_opacity;
+
+		unsigned int	next;
+		unsigned int	prev;
+	};
+
+	struct NodeTypeDataSB
+	{
+		float			depth;
+
+		unsigned int	albedo;
+		unsigned int	normal;
+		unsigned int	specular;
+		unsigned int	ior_opacity;
+	};
+
+	// Decoupled Versions
+	// NodeTypeData (Attributes)
+	struct NodeTypeData
+	{
+		unsigned int	albedo;
+		unsigned int	normal;
+		unsigned int	specular;
+		unsigned int	ior_opacity;
+	};
+
+	// ID Buffers
+	struct NodeTypeSB
+	{
+		float			depth;
+		unsigned int	index;
+	};
+
+	struct NodeTypeLL
+	{
+		float			depth;
+		unsigned int	next;
+	};
+
+	struct NodeTypeLL_Double
+	{
+		float			depth;
+
+		unsigned int	next;
+		unsigned int	prev;
+	};
+
+	// How the fields of the fragments are laid out in memory. The records of the first two
+	// are those of data_structs.h; the A-buffer variants take the layout name as a suffix.
+	enum FragmentLayout
+	{
+		FL_AOS = 0,			// one record per fragment, its depth and links followed by its attributes
+		FL_DECOUPLED,		// ID records of the depth and links, and NodeTypeData records
+		FL_SOA,				// one array per field
+		FL_AOSOA8			// blocks of 8 fragments, with one array of 8 values per field
+	};
+
+	// "", "_Decoupled", "_SoA" or "_AoSoA8"
+	const char*	getFragmentLayoutSuffix(FragmentLayout layout);
+
+	// The fragments of an A-buffer, with LINKS pointers each: 0 for the S-buffer, 1 for
+	// next, 2 for next and prev. Every field is a 32-bit word, and each layout only changes
+	// where the words go, so that the variants read and write them through the accessors
+	// below whatever their layout. The decoupled S-buffer IDs also hold the index of their
+	// attributes (NodeTypeSB), which stay in place when the IDs are sorted. The buffer may
+	// be written concurrently at different indices.
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	class FragmentStorage
+	{
+	public:
+		enum
+		{
+			INDEXED	   = (LAYOUT == FL_DECOUPLED && LINKS == 0) ? 1 : 0,
+			ID_WORDS   = 1 + LINKS + INDEXED,
+			DATA_WORDS = 4,
+			WORDS	   = ID_WORDS + DATA_WORDS,
+			BLOCK_SIZE = 8
+		};
+
+		FragmentStorage() : m_size(0) {}
+
+		unsigned int	size(void) const { return m_size; }
+		// Keeps the first fragments and zeroes new ones; shrinking releases the memory
+		void			resize(unsigned int size);
+		size_t			memoryUsage(void) const;
+
+		float			getDepth(unsigned int i) const			{ float depth; const unsigned int bits = word(0, i); memcpy(&depth, &bits, sizeof(depth)); return depth; }
+		void			setDepth(unsigned int i, float depth)	{ memcpy(&word(0, i), &depth, sizeof(depth)); }
+		// links, of the linked lists only; prev of the double ones
+		unsigned int	getNext(unsigned int i) const			{ return word(1, i); }
+		void			setNext(unsigned int i, unsigned int next)	{ word(1, i) = next; }
+		unsigned int	getPrev(unsigned int i) const			{ return word(2, i); }
+		void			setPrev(unsigned int i, unsigned int prev)	{ word(2, i) = prev; }
+		// the fragment whose attributes are those of i
+		unsigned int	getIndex(unsigned int i) const			{ return INDEXED ? word(1, i) : i; }
+		void			setIndex(unsigned int i, unsigned int index) { if (INDEXED) word(1, i) = index; }
+
+		NodeTypeData	getData(unsigned int i) const;
+		void			setData(unsigned int i, const NodeTypeData& data);
+
+		// Copies all fields of fragment i of another buffer to fragment j
+		void			copy(unsigned int j, const FragmentStorage& other, unsigned int i);
+		void			swap(FragmentStorage& other) { std::swap(m_size, other.m_size); m_ids.swap(other.m_ids); m_data.swap(other.m_data); for (int f = 0; f < WORDS; ++f) m_fields[f].swap(other.m_fields[f]); }
+
+	private:
+		unsigned int				m_size;
+		std::vector<unsigned int>	m_ids;				// AoS records, decoupled IDs, AoSoA blocks
+		std::vector<unsigned int>	m_data;				// decoupled attributes
+		std::vector<unsigned int>	m_fields[WORDS];	// SoA arrays
+
+		unsigned int& word(unsigned int field, unsigned int i)
+		{
+			switch (LAYOUT)
+			{
+			case FL_AOS:		return m_ids[static_cast<size_t>(i) * WORDS + field];
+			case FL_DECOUPLED:	return (field < ID_WORDS) ? m_ids[static_cast<size_t>(i) * ID_WORDS + field] : m_data[static_cast<size_t>(i) * DATA_WORDS + field - ID_WORDS];
+			case FL_SOA:		return m_fields[field][i];
+			default:			return m_ids[(static_cast<size_t>(i) / BLOCK_SIZE * WORDS + field) * BLOCK_SIZE + i % BLOCK_SIZE];
+			}
+		}
+		const unsigned int& word(unsigned int field, unsigned int i) const { return const_cast<FragmentStorage*>(this)->word(field, i); }
+	};
+
+	static_assert(FragmentStorage<FL_AOS, 0>::WORDS * 4 == sizeof(NodeTypeDataSB) && FragmentStorage<FL_AOS, 1>::WORDS * 4 == sizeof(NodeTypeDataLL) &&
+				  FragmentStorage<FL_AOS, 2>::WORDS * 4 == sizeof(NodeTypeDataLL_Double), "AoS records differ from data_structs.h");
+	static_assert(FragmentStorage<FL_DECOUPLED, 0>::ID_WORDS * 4 == sizeof(NodeTypeSB) && FragmentStorage<FL_DECOUPLED, 1>::ID_WORDS * 4 == sizeof(NodeTypeLL) &&
+				  FragmentStorage<FL_DECOUPLED, 2>::ID_WORDS * 4 == sizeof(NodeTypeLL_Double), "ID records differ from data_structs.h");
+
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	void FragmentStorage<LAYOUT, LINKS>::resize(unsigned int size)
+	{
+		const bool shrink = size < m_size;
+		m_size = size;
+		switch (LAYOUT)
+		{
+		case FL_AOS:		m_ids.resize(static_cast<size_t>(size) * WORDS); break;
+		case FL_DECOUPLED:	m_ids.resize(static_cast<size_t>(size) * ID_WORDS); m_data.resize(static_cast<size_t>(size) * DATA_WORDS); break;
+		case FL_SOA:		for (int f = 0; f < WORDS; ++f) m_fields[f].resize(size); break;
+		default:			m_ids.resize(static_cast<size_t>(size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE * WORDS); break;
+		}
+		if (shrink)
+		{
+			m_ids.shrink_to_fit();
+			m_data.shrink_to_fit();
+			for (int f = 0; f < WORDS; ++f)
+				m_fields[f].shrink_to_fit();
+		}
+	}
+
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	size_t FragmentStorage<LAYOUT, LINKS>::memoryUsage(void) const
+	{
+		size_t words = m_ids.capacity() + m_data.capacity();
+		for (int f = 0; f < WORDS; ++f)
+			words += m_fields[f].capacity();
+		return words * sizeof(unsigned int);
+	}
+
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	NodeTypeData FragmentStorage<LAYOUT, LINKS>::getData(unsigned int i) const
+	{
+		NodeTypeData data;
+		data.albedo		 = word(ID_WORDS + 0, i);
+		data.normal		 = word(ID_WORDS + 1, i);
+		data.specular	 = word(ID_WORDS + 2, i);
+		data.ior_opacity = word(ID_WORDS + 3, i);
+		return data;
+	}
+
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	void FragmentStorage<LAYOUT, LINKS>::setData(unsigned int i, const NodeTypeData& data)
+	{
+		word(ID_WORDS + 0, i) = data.albedo;
+		word(ID_WORDS + 1, i) = data.normal;
+		word(ID_WORDS + 2, i) = data.specular;
+		word(ID_WORDS + 3, i) = data.ior_opacity;
+	}
+
+	template<FragmentLayout LAYOUT, unsigned int LINKS>
+	void FragmentStorage<LAYOUT, LINKS>::copy(unsigned int j, const FragmentStorage& other, unsigned int i)
+	{
+		for (unsigned int f = 0; f < WORDS; ++f)
+			word(f, j) = other.word(f, i);
+	}
+}
@@ -0,0 +1,84 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host-side counterparts of the device helpers in cuda/helpers.h, used by the CPU backend
+
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace cpu
+{
+	using namespace optix;
+
+	// RT_DEFAULT_MAX equivalent
+	const float	DEFAULT_MAX = FLT_MAX;
+
+	struct Ray
+	{
+		float3			origin;
+		float3			direction;
+		unsigned int	ray_type;
+		float			tmin;
+		float			tmax;
+	};
+
+	inline Ray make_Ray(const float3& origin, const float3& direction, unsigned int ray_type, float tmin, float tmax)
+	{
+		Ray ray = { origin, direction, ray_type, tmin, tmax };
+		return ray;
+	}
+
+	struct PerRayData_radiance
+	{
+		float3	result;
+		float3	radiance;
+		float3	attenuation;
+		float3	origin;
+		float3	direction;
+
+		unsigned int seed;
+		int depth;
+		int done;
+		unsigned int num_rays;	// shadow rays traced by the closest hit programs
+	};
+
+	struct PerRayData_shadow
+	{
+		bool inShadow;
+	};
+
+	// sutilCurrentTime equivalent, in seconds
+	inline double currentTime(void)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// v.x, v.y or v.z for axis 0, 1 or 2
+	inline float component(const float3& v, int axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	inline float& component(float3& v, int axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	inline float degrees(const float radians)
+	{
+		return radians * (180.0f / M_PIf);
+	}
+
+	// Create ONB from normalalized vector
+	inline void createONB(const float3& n, float3& U, float3& V)
+	{
+		U = cross(n, make_float3(0.0f, 1.0f, 0.0f));
+		if (dot(U, U) < 1.e-3f)
+			U = cross(n, make_float3(1.0f, 0.0f, 0.0f));
+		U = normalize(U);
+		V = cross(n, U);
+	}
+}
@@ -0,0 +1,86 @@
+#include "image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace cpu
+{
+	bool savePFM(const string& filename, const float4* data, unsigned int width, unsigned int height)
+	{
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (!file)
+			return false;
+
+		// a negative scale denotes little-endian data; PFM rows are stored bottom-up as well
+		fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+		vector<float> row(3 * width);
+		bool ok = true;
+		for (unsigned int y = 0; y < height && ok; ++y)
+		{
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const float4& c = data[y * width + x];
+				row[3 * x + 0] = c.x;
+				row[3 * x + 1] = c.y;
+				row[3 * x + 2] = c.z;
+			}
+			ok = fwrite(&row[0], sizeof(float), row.size(), file) == row.size();
+		}
+		return fclose(file) == 0 && ok;
+	}
+
+	bool loadPFM(const string& filename, vector<float4>& data, unsigned int& width, unsigned int& height)
+	{
+		FILE* file = fopen(filename.c_str(), "rb");
+		if (!file)
+			return false;
+
+		char type[3] = { 0 };
+		float scale;
+		if (fscanf(file, "%2s %u %u %f", type, &width, &height, &scale) != 4 || fgetc(file) == EOF ||
+			(strcmp(type, "PF") != 0 && strcmp(type, "Pf") != 0) || width == 0 || height == 0)
+		{
+			fclose(file);
+			return false;
+		}
+		const unsigned int channels = (type[1] == 'F') ? 3 : 1;
+
+		// a positive scale denotes big-endian data
+		const unsigned short one = 1;
+		const bool swap_bytes = (scale > 0.0f) == (*reinterpret_cast<const unsigned char*>(&one) == 1);
+
+		data.resize(static_cast<size_t>(width) * height);
+		vector<float> row(channels * width);
+		bool ok = true;
+		for (unsigned int y = 0; y < height && ok; ++y)
+		{
+			ok = fread(&row[0], sizeof(float), row.size(), file) == row.size();
+			for (size_t i = 0; i < row.size() && ok && swap_bytes; ++i)
+			{
+				unsigned char* bytes = reinterpret_cast<unsigned char*>(&row[i]);
+				swap(bytes[0], bytes[3]);
+				swap(bytes[1], bytes[2]);
+			}
+			for (unsigned int x = 0; x < width && ok; ++x)
+				data[y * width + x] = (channels == 3) ? make_float4(row[3 * x + 0], row[3 * x + 1], row[3 * x + 2], 0.0f) : make_float4(row[x], row[x], row[x], 0.0f);
+		}
+		fclose(file);
+		return ok;
+	}
+
+	double relativeMSE(const float4* image, const float4* reference, size_t num_pixels)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < num_pixels; ++i)
+		{
+			const float3 difference = make_float3(image[i]) - make_float3(reference[i]);
+			const float3 squared	= make_float3(reference[i]) * make_float3(reference[i]) + make_float3(0.01f);
+			sum += difference.x * difference.x / squared.x + difference.y * difference.y / squared.y + difference.z * difference.z / squared.z;
+		}
+		return (num_pixels > 0) ? sum / (3.0 * num_pixels) : 0.0;
+	}
+}
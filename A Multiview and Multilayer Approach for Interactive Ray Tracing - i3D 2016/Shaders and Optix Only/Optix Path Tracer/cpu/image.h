@@ -0,0 +1,22 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Image input and output for the CPU backend
+
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	using namespace optix;
+
+	// Writes the RGB channels of a bottom-up float4 image as a little-endian PFM
+	bool savePFM(const std::string& filename, const float4* data, unsigned int width, unsigned int height);
+	// Reads an RGB or greyscale PFM of either byte order, in the row order of savePFM
+	bool loadPFM(const std::string& filename, std::vector<float4>& data, unsigned int& width, unsigned int& height);
+
+	// Mean over the RGB channels of (image - reference)^2 / (reference^2 + 0.01)
+	double relativeMSE(const float4* image, const float4* reference, size_t num_pixels);
+}
@@ -0,0 +1,348 @@
+#include "kdtree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const float	TRAVERSAL_COST		= 1.0f;
+	static const float	INTERSECTION_COST	= 1.5f;
+	static const float	EMPTY_BONUS			= 0.8f;		// cost factor of splits with an empty side
+	static const int	MAX_DEPTH			= 48;		// keeps traversal within its stack
+	static const int	STACK_SIZE			= 64;
+	// the traversal stack holds at most one far child per level; kd-trees are always built,
+	// never loaded from the accel cache, so the depth cap of the builder bounds it in release
+	// builds as well
+	static_assert(MAX_DEPTH < STACK_SIZE, "the kd-tree traversal stack must hold a path of MAX_DEPTH nodes");
+
+	// sorted by position, then by type, so that at equal positions ends precede planars precede starts
+	enum KdEventType
+	{
+		KD_EVENT_END = 0,
+		KD_EVENT_PLANAR,
+		KD_EVENT_START
+	};
+
+	struct KdEvent
+	{
+		float		position;
+		KdEventType	type;
+
+		bool operator<(const KdEvent& other) const
+		{
+			return position < other.position || (position == other.position && type < other.type);
+		}
+	};
+
+	struct KdTask
+	{
+		vector<unsigned int>	prims;
+		Aabb					bounds;
+		int						depth;
+		int						parent;		// patched with the index of this node when it is the above child
+	};
+
+	// Bounds of the part of the triangle inside the box ("perfect splits"),
+	// invalid if the triangle does not cross the box
+	static Aabb clipTriangle(const TriangleMesh& mesh, unsigned int prim, const Aabb& box)
+	{
+		const int3 v_idx = mesh.vindex_buffer[prim];
+		float3 polygon[9], clipped[9];
+		polygon[0] = mesh.vertex_buffer[v_idx.x];
+		polygon[1] = mesh.vertex_buffer[v_idx.y];
+		polygon[2] = mesh.vertex_buffer[v_idx.z];
+		int count = 3;
+
+		// Sutherland-Hodgman against the six planes of the box
+		for (int plane = 0; plane < 6 && count > 0; ++plane)
+		{
+			const int	axis	 = plane >> 1;
+			const bool	is_max	 = (plane & 1) != 0;
+			const float position = component(is_max ? box.m_max : box.m_min, axis);
+
+			int clipped_count = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const float3& v0 = polygon[i];
+				const float3& v1 = polygon[(i + 1) % count];
+				const float d0 = is_max ? position - component(v0, axis) : component(v0, axis) - position;
+				const float d1 = is_max ? position - component(v1, axis) : component(v1, axis) - position;
+				if (d0 >= 0.0f)
+					clipped[clipped_count++] = v0;
+				if ((d0 < 0.0f && d1 > 0.0f) || (d0 > 0.0f && d1 < 0.0f))
+				{
+					float3 p = lerp(v0, v1, d0 / (d0 - d1));
+					component(p, axis) = position;
+					clipped[clipped_count++] = p;
+				}
+			}
+			count = clipped_count;
+			for (int i = 0; i < count; ++i)
+				polygon[i] = clipped[i];
+		}
+
+		Aabb bounds;
+		for (int i = 0; i < count; ++i)
+			bounds.include(polygon[i]);
+		if (count > 0)
+			bounds.intersection(box);
+		return bounds;
+	}
+
+	void KdTree::build(const TriangleMesh& mesh)
+	{
+		m_mesh = &mesh;
+		m_nodes.clear();
+		m_prim_indices.clear();
+		m_bounds.invalidate();
+
+		KdTask root;
+		for (unsigned int i = 0; i < mesh.size(); ++i)
+		{
+			Aabb aabb = mesh.bounds(i);
+			if (!aabb.valid())
+				continue;
+			root.prims.push_back(i);
+			m_bounds.include(aabb);
+		}
+		root.bounds = m_bounds;
+		root.depth	= 0;
+		root.parent = -1;
+
+		const int max_depth = min(MAX_DEPTH, static_cast<int>(8.0f + 1.3f * log2(max(1.0f, static_cast<float>(root.prims.size())))));
+
+		vector<KdTask> tasks;
+		tasks.push_back(move(root));
+		vector<Aabb>	clipped;
+		vector<KdEvent>	events;
+		while (!tasks.empty())
+		{
+			KdTask task = move(tasks.back());
+			tasks.pop_back();
+
+			const unsigned int node_index = static_cast<unsigned int>(m_nodes.size());
+			m_nodes.push_back(KdNode());
+			if (task.parent >= 0)
+				m_nodes[task.parent].flags |= node_index << 2;
+
+			// the parts of the triangles inside the node
+			clipped.resize(task.prims.size());
+			unsigned int count = 0;
+			for (size_t i = 0; i < task.prims.size(); ++i)
+			{
+				Aabb aabb = clipTriangle(mesh, task.prims[i], task.bounds);
+				if (!aabb.valid())
+					continue;
+				task.prims[count] = task.prims[i];
+				clipped[count++]  = aabb;
+			}
+			task.prims.resize(count);
+
+			// [SAH event sweep]
+			const float inv_area  = 1.0f / max(task.bounds.area(), 1.e-30f);
+			const float leaf_cost = INTERSECTION_COST * count;
+			float	best_cost	  = leaf_cost;
+			int		best_axis	  = -1;
+			float	best_position = 0.0f;
+			bool	planar_left	  = false;
+			for (int axis = 0; axis < 3 && count > 1 && task.depth < max_depth; ++axis)
+			{
+				events.clear();
+				for (unsigned int i = 0; i < count; ++i)
+				{
+					const float lo = component(clipped[i].m_min, axis);
+					const float hi = component(clipped[i].m_max, axis);
+					if (lo == hi)
+					{
+						KdEvent planar = { lo, KD_EVENT_PLANAR };
+						events.push_back(planar);
+					}
+					else
+					{
+						KdEvent start = { lo, KD_EVENT_START };
+						KdEvent end   = { hi, KD_EVENT_END };
+						events.push_back(start);
+						events.push_back(end);
+					}
+				}
+				sort(events.begin(), events.end());
+
+				const float bmin = component(task.bounds.m_min, axis);
+				const float bmax = component(task.bounds.m_max, axis);
+				unsigned int num_left = 0, num_right = count;
+				for (size_t i = 0; i < events.size();)
+				{
+					const float position = events[i].position;
+					unsigned int num_end = 0, num_planar = 0, num_start = 0;
+					while (i < events.size() && events[i].position == position && events[i].type == KD_EVENT_END)		{ ++num_end;	++i; }
+					while (i < events.size() && events[i].position == position && events[i].type == KD_EVENT_PLANAR)	{ ++num_planar; ++i; }
+					while (i < events.size() && events[i].position == position && events[i].type == KD_EVENT_START)	{ ++num_start;	++i; }
+
+					num_right -= num_planar + num_end;
+					if (position > bmin && position < bmax)
+					{
+						Aabb left = task.bounds, right = task.bounds;
+						component(left.m_max, axis)	 = position;
+						component(right.m_min, axis) = position;
+						const float p_left	= left.area() * inv_area;
+						const float p_right = right.area() * inv_area;
+
+						// planar primitives go to either side, whichever is cheaper
+						for (int side = 0; side < 2; ++side)
+						{
+							const unsigned int nl = num_left  + (side == 0 ? num_planar : 0);
+							const unsigned int nr = num_right + (side == 1 ? num_planar : 0);
+							const float bonus = (nl == 0 || nr == 0) ? EMPTY_BONUS : 1.0f;
+							const float cost  = bonus * (TRAVERSAL_COST + INTERSECTION_COST * (p_left * nl + p_right * nr));
+							if (cost < best_cost)
+							{
+								best_cost	  = cost;
+								best_axis	  = axis;
+								best_position = position;
+								planar_left	  = (side == 0);
+							}
+						}
+					}
+					num_left += num_start + num_planar;
+				}
+			}
+
+			if (best_axis < 0)
+			{
+				KdNode& leaf = m_nodes[node_index];
+				leaf.first = static_cast<unsigned int>(m_prim_indices.size());
+				leaf.flags = 3u | (count << 2);
+				m_prim_indices.insert(m_prim_indices.end(), task.prims.begin(), task.prims.end());
+				continue;
+			}
+
+			KdTask below, above;
+			below.bounds = above.bounds = task.bounds;
+			component(below.bounds.m_max, best_axis) = best_position;
+			component(above.bounds.m_min, best_axis) = best_position;
+			below.depth	 = above.depth = task.depth + 1;
+			below.parent = -1;
+			above.parent = static_cast<int>(node_index);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				const float lo = component(clipped[i].m_min, best_axis);
+				const float hi = component(clipped[i].m_max, best_axis);
+				if (lo == best_position && hi == best_position)
+					(planar_left ? below : above).prims.push_back(task.prims[i]);
+				else
+				{
+					if (lo < best_position)
+						below.prims.push_back(task.prims[i]);
+					if (hi > best_position)
+						above.prims.push_back(task.prims[i]);
+				}
+			}
+
+			KdNode& node = m_nodes[node_index];
+			node.split = best_position;
+			node.flags = static_cast<unsigned int>(best_axis);
+
+			// the child below is popped next, so it is stored right after its parent
+			vector<unsigned int>().swap(task.prims);
+			tasks.push_back(move(above));
+			tasks.push_back(move(below));
+		}
+	}
+
+	size_t KdTree::memoryUsage(void) const
+	{
+		return m_nodes.size() * sizeof(KdNode) + m_prim_indices.size() * sizeof(unsigned int);
+	}
+
+	template<bool ANY_HIT>
+	bool KdTree::traverse(Ray ray, Hit& hit) const
+	{
+		const float3 inv_dir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+		float3 t0 = (m_bounds.m_min - ray.origin) * inv_dir;
+		float3 t1 = (m_bounds.m_max - ray.origin) * inv_dir;
+		float tmin = max(max(ray.tmin, min(t0.x, t1.x)), max(min(t0.y, t1.y), min(t0.z, t1.z)));
+		float tmax = min(min(ray.tmax, max(t0.x, t1.x)), min(max(t0.y, t1.y), max(t0.z, t1.z)));
+		if (tmin > tmax)
+			return false;
+
+		struct
+		{
+			unsigned int	node;
+			float			tmin;
+			float			tmax;
+		} stack[STACK_SIZE];
+		int sp = 0;
+
+		bool found = false;
+		unsigned int current = 0;
+		for (;;)
+		{
+			// a closer hit has already been found
+			if (ray.tmax < tmin)
+				break;
+
+			const KdNode& node = m_nodes[current];
+			if (!node.isLeaf())
+			{
+				const int	axis	= node.axis();
+				const float origin	= component(ray.origin, axis);
+				const float tplane	= (node.split - origin) * component(inv_dir, axis);
+
+				const bool below_first = origin < node.split || (origin == node.split && component(ray.direction, axis) <= 0.0f);
+				const unsigned int first  = below_first ? current + 1 : node.aboveChild();
+				const unsigned int second = below_first ? node.aboveChild() : current + 1;
+
+				if (tplane > tmax || tplane <= 0.0f)
+					current = first;
+				else if (tplane < tmin)
+					current = second;
+				else
+				{
+					assert(sp < STACK_SIZE);
+					stack[sp].node = second;
+					stack[sp].tmin = tplane;
+					stack[sp].tmax = tmax;
+					++sp;
+					current = first;
+					tmax	= tplane;
+				}
+				continue;
+			}
+
+			for (unsigned int i = node.first; i < node.first + node.count(); ++i)
+			{
+				if (intersect_primitive(*m_mesh, m_prim_indices[i], ray, hit))
+				{
+					if (ANY_HIT)
+						return true;
+					found = true;
+				}
+			}
+
+			if (sp == 0)
+				break;
+			--sp;
+			current = stack[sp].node;
+			tmin	= stack[sp].tmin;
+			tmax	= stack[sp].tmax;
+		}
+		return found;
+	}
+
+	bool KdTree::intersect(const Ray& ray, Hit& hit) const
+	{
+		return !m_nodes.empty() && traverse<false>(ray, hit);
+	}
+
+	bool KdTree::occluded(const Ray& ray) const
+	{
+		Hit hit;
+		return !m_nodes.empty() && traverse<true>(ray, hit);
+	}
+}
@@ -0,0 +1,51 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// SAH kd-tree of the CPU backend, built with the O(N log^2 N) event sweep of
+// I. Wald and V. Havran, "On building fast kd-trees for ray tracing", RT 2006
+
+#pragma once
+
+#include "accel.h"
+#include <optixu/optixu_aabb_namespace.h>
+#include <vector>
+
+namespace cpu
+{
+	// 8 bytes, stored depth-first so that the child below the split follows its parent.
+	// flags: bits 0-1 split axis (3 for leaves), bits 2-31 index of the child above the
+	// split (inner nodes) or number of primitives (leaves)
+	struct KdNode
+	{
+		union
+		{
+			float			split;
+			unsigned int	first;		// leaves: offset in the primitive index list
+		};
+		unsigned int		flags;
+
+		bool			isLeaf(void) const		{ return (flags & 3u) == 3u; }
+		int				axis(void) const		{ return static_cast<int>(flags & 3u); }
+		unsigned int	aboveChild(void) const	{ return flags >> 2; }
+		unsigned int	count(void) const		{ return flags >> 2; }
+	};
+
+	class KdTree : public Accel
+	{
+	public:
+		KdTree() : m_mesh(0) {}
+
+		void	build(const TriangleMesh& mesh);
+		bool	intersect(const Ray& ray, Hit& hit) const;
+		bool	occluded(const Ray& ray) const;
+		size_t	memoryUsage(void) const;
+
+	private:
+		const TriangleMesh*			m_mesh;
+		Aabb						m_bounds;
+		std::vector<KdNode>			m_nodes;
+		std::vector<unsigned int>	m_prim_indices;
+
+		template<bool ANY_HIT>
+		bool	traverse(Ray ray, Hit& hit) const;
+	};
+}
@@ -0,0 +1,144 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// Linear BVH, after C. Lauterbach et al., "Fast BVH Construction on GPUs", EG 2009.
+	// Primitives are sorted along a 30-bit Morton curve of their centroids and each
+	// node is split where the highest differing bit of its code range flips.
+
+	static const unsigned int MAX_LEAF_SIZE = 2;
+	static const unsigned int MAX_DEPTH		= 48;	// keeps traversal within its stack
+
+	struct LbvhTask
+	{
+		unsigned int node;
+		unsigned int begin;
+		unsigned int end;
+		unsigned int depth;
+	};
+
+	// Inserts two zero bits after each of the 10 lowest bits of v
+	static inline unsigned int expandBits(unsigned int v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// p in [0,1]^3
+	static inline unsigned int morton3D(const float3& p)
+	{
+		unsigned int x = static_cast<unsigned int>(min(max(p.x * 1024.0f, 0.0f), 1023.0f));
+		unsigned int y = static_cast<unsigned int>(min(max(p.y * 1024.0f, 0.0f), 1023.0f));
+		unsigned int z = static_cast<unsigned int>(min(max(p.z * 1024.0f, 0.0f), 1023.0f));
+		return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+	}
+
+	void Bvh::buildMorton(const vector<Aabb>& prim_bounds)
+	{
+		const unsigned int num_prims = static_cast<unsigned int>(prim_bounds.size());
+
+		Aabb centroid_bounds;
+		for (unsigned int i = 0; i < num_prims; ++i)
+			centroid_bounds.include(prim_bounds[i].center());
+		float3 extent = centroid_bounds.extent();
+		float3 inv_extent = make_float3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+										extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+										extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		// (code, reference) pairs, so that the sort is stable for equal codes
+		vector<unsigned long long> keys(num_prims);
+		for (unsigned int i = 0; i < num_prims; ++i)
+		{
+			unsigned int code = morton3D((prim_bounds[i].center() - centroid_bounds.m_min) * inv_extent);
+			keys[i] = (static_cast<unsigned long long>(code) << 32) | i;
+		}
+		sort(keys.begin(), keys.end());
+
+		vector<unsigned int> codes(num_prims), order(num_prims);
+		for (unsigned int i = 0; i < num_prims; ++i)
+		{
+			codes[i] = static_cast<unsigned int>(keys[i] >> 32);
+			order[i] = static_cast<unsigned int>(keys[i] & 0xFFFFFFFFu);
+		}
+
+		// topology, top-down; children are always stored after their parent
+		m_nodes.reserve(2 * num_prims);
+		m_nodes.push_back(BvhNode());
+
+		vector<LbvhTask> tasks;
+		LbvhTask root = { 0u, 0u, num_prims, 0u };
+		tasks.push_back(root);
+		while (!tasks.empty())
+		{
+			LbvhTask task = tasks.back();
+			tasks.pop_back();
+
+			m_nodes[task.node].first = task.begin;
+			m_nodes[task.node].count = task.end - task.begin;
+			if (task.end - task.begin <= MAX_LEAF_SIZE || task.depth >= MAX_DEPTH)
+				continue;
+
+			unsigned int mid;
+			const unsigned int first_code = codes[task.begin];
+			const unsigned int last_code  = codes[task.end - 1];
+			if (first_code == last_code)
+				mid = (task.begin + task.end) / 2;
+			else
+			{
+				// all codes in the range share the bits above the highest differing one,
+				// so the range is sorted by that bit
+				unsigned int bit = 31;
+				while (!((first_code ^ last_code) & (1u << bit)))
+					--bit;
+				const unsigned int mask = 1u << bit;
+				mid = static_cast<unsigned int>(partition_point(codes.begin() + task.begin, codes.begin() + task.end,
+					[mask](unsigned int code) { return (code & mask) == 0; }) - codes.begin());
+			}
+
+			const unsigned int left_child = static_cast<unsigned int>(m_nodes.size());
+			m_nodes.push_back(BvhNode());
+			m_nodes.push_back(BvhNode());
+			m_nodes[task.node].first = left_child;
+			m_nodes[task.node].count = 0;
+
+			LbvhTask right_task = { left_child + 1, mid, task.end, task.depth + 1 };
+			LbvhTask left_task  = { left_child, task.begin, mid, task.depth + 1 };
+			tasks.push_back(right_task);
+			tasks.push_back(left_task);
+		}
+
+		// bounds, bottom-up
+		for (size_t n = m_nodes.size(); n-- > 0;)
+		{
+			BvhNode& node = m_nodes[n];
+			Aabb bounds;
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.first; i < node.first + node.count; ++i)
+					bounds.include(prim_bounds[order[i]]);
+			}
+			else
+			{
+				const BvhNode& left	 = m_nodes[node.first];
+				const BvhNode& right = m_nodes[node.first + 1];
+				bounds.include(Aabb(left.bmin, left.bmax));
+				bounds.include(Aabb(right.bmin, right.bmax));
+			}
+			node.bmin = bounds.m_min;
+			node.bmax = bounds.m_max;
+		}
+
+		vector<unsigned int> prim_indices(num_prims);
+		for (unsigned int i = 0; i < num_prims; ++i)
+			prim_indices[i] = m_prim_indices[order[i]];
+		m_prim_indices.swap(prim_indices);
+	}
+}
@@ -0,0 +1,175 @@
+#include "lights.h"
+
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	typedef map<string, string> XmlAttributes;
+
+	// Attributes of a start tag, given the text between its name and the closing '>'.
+	// Values may be single or double quoted and '=' may be surrounded by spaces.
+	static XmlAttributes parseAttributes(const string& tag)
+	{
+		XmlAttributes attributes;
+		size_t i = 0;
+		while (i < tag.size())
+		{
+			while (i < tag.size() && (isspace(static_cast<unsigned char>(tag[i])) || tag[i] == '/'))
+				++i;
+			const size_t name_begin = i;
+			while (i < tag.size() && !isspace(static_cast<unsigned char>(tag[i])) && tag[i] != '=' && tag[i] != '/')
+				++i;
+			const string name = tag.substr(name_begin, i - name_begin);
+			while (i < tag.size() && isspace(static_cast<unsigned char>(tag[i])))
+				++i;
+			if (i >= tag.size() || tag[i] != '=')
+			{
+				if (!name.empty())
+					attributes[name] = "";
+				else if (i < tag.size())
+					++i;
+				continue;
+			}
+
+			++i;
+			while (i < tag.size() && isspace(static_cast<unsigned char>(tag[i])))
+				++i;
+			if (i >= tag.size() || (tag[i] != '"' && tag[i] != '\''))
+				break;
+			const char   quote		 = tag[i++];
+			const size_t value_end	 = tag.find(quote, i);
+			if (value_end == string::npos)
+				break;
+			attributes[name] = tag.substr(i, value_end - i);
+			i = value_end + 1;
+		}
+		return attributes;
+	}
+
+	static string attribute(const XmlAttributes& attributes, const string& name, const string& default_value)
+	{
+		XmlAttributes::const_iterator it = attributes.find(name);
+		return (it != attributes.end()) ? it->second : default_value;
+	}
+
+	// "x y z" or "x, y, z"
+	static float3 parseFloat3(const string& value)
+	{
+		string text = value;
+		for (size_t i = 0; i < text.size(); ++i)
+			if (text[i] == ',')
+				text[i] = ' ';
+		float3 v = make_float3(0.0f);
+		istringstream stream(text);
+		stream >> v.x >> v.y >> v.z;
+		return v;
+	}
+
+	static float parseFloat(const string& value)
+	{
+		float v = 0.0f;
+		istringstream stream(value);
+		stream >> v;
+		return v;
+	}
+
+	void loadSceneLights(const string& filename, bool shadows_enabled, vector<BasicLight>& lights)
+	{
+		ifstream file(filename.c_str(), ios::in | ios::binary);
+		if (!file)
+			throw runtime_error("Could not open scene file '" + filename + "'");
+		stringstream contents;
+		contents << file.rdbuf();
+		string text = contents.str();
+
+		// commented-out nodes are not part of the scene
+		for (size_t begin = text.find("<!--"); begin != string::npos; begin = text.find("<!--", begin))
+		{
+			const size_t end = text.find("-->", begin + 4);
+			text.erase(begin, (end == string::npos) ? string::npos : end + 3 - begin);
+		}
+
+		lights.clear();
+		for (size_t begin = text.find("<light"); begin != string::npos; begin = text.find("<light", begin + 1))
+		{
+			const size_t name_end = begin + 6;
+			if (name_end >= text.size() || !(isspace(static_cast<unsigned char>(text[name_end])) || text[name_end] == '>' || text[name_end] == '/'))
+				continue;
+			const size_t tag_end = text.find('>', name_end);
+			if (tag_end == string::npos)
+				break;
+
+			const XmlAttributes attributes = parseAttributes(text.substr(name_end, tag_end - name_end));
+			if (attribute(attributes, "active", "true") == "false")
+				continue;
+
+			BasicLight light;
+			light.pos			= make_float4(parseFloat3(attribute(attributes, "position", "0 0 0")), 1.0f);
+			light.coneTarget	= parseFloat3(attribute(attributes, "target", "0 0 0"));
+			light.coneAngle		= (attribute(attributes, "conical", "false") == "true") ? 0.5f * parseFloat(attribute(attributes, "aperture", "360")) : 180.0f;
+			light.color			= parseFloat3(attribute(attributes, "color", "1 1 1"));
+			light.flux			= parseFloat(attribute(attributes, "flux", "1"));
+			light.casts_shadow	= (shadows_enabled && attribute(attributes, "shadows", "on") != "off") ? 1 : 0;
+			lights.push_back(light);
+		}
+	}
+
+	void buildLightAliasTable(const vector<BasicLight>& lights, vector<LightAlias>& table)
+	{
+		const unsigned int num_lights = static_cast<unsigned int>(lights.size());
+		table.resize(num_lights);
+		if (num_lights == 0)
+			return;
+
+		vector<double> weights(num_lights);
+		double total = 0.0;
+		for (unsigned int i = 0; i < num_lights; ++i)
+		{
+			const float3& c = lights[i].color;
+			weights[i] = max(0.0, static_cast<double>(lights[i].flux) * (0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z));
+			total += weights[i];
+		}
+		if (total <= 0.0)
+		{
+			weights.assign(num_lights, 1.0);
+			total = num_lights;
+		}
+
+		// scaled so that the average is 1; slots below 1 borrow from slots above it
+		vector<double>		 scaled(num_lights);
+		vector<unsigned int> small, large;
+		for (unsigned int i = 0; i < num_lights; ++i)
+		{
+			table[i].pdf = static_cast<float>(weights[i] / total);
+			scaled[i]	 = weights[i] * num_lights / total;
+			(scaled[i] < 1.0 ? small : large).push_back(i);
+		}
+		while (!small.empty() && !large.empty())
+		{
+			const unsigned int s = small.back(); small.pop_back();
+			const unsigned int l = large.back(); large.pop_back();
+			table[s].probability = static_cast<float>(scaled[s]);
+			table[s].alias		 = l;
+			scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+			(scaled[l] < 1.0 ? small : large).push_back(l);
+		}
+		// the remainder is 1 up to rounding
+		for (size_t i = 0; i < small.size(); ++i)
+		{
+			table[small[i]].probability = 1.0f;
+			table[small[i]].alias		= small[i];
+		}
+		for (size_t i = 0; i < large.size(); ++i)
+		{
+			table[large[i]].probability = 1.0f;
+			table[large[i]].alias		= large[i];
+		}
+	}
+}
@@ -0,0 +1,23 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Scene lights shared by the OptiX and CPU renderers: loading from the demo .scene files
+// and the alias table used to sample them
+
+#pragma once
+
+#include "../commonStructs.h"
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// Reads the active <light> nodes of an XEngine .scene file (Demo/EngineData) as point
+	// lights. Conical lights keep half their aperture as the cone angle; the rest light
+	// all directions. Shadows follow the "shadows" attribute unless shadows_enabled is
+	// false. Throws std::runtime_error if the file cannot be read.
+	void loadSceneLights(const std::string& filename, bool shadows_enabled, std::vector<BasicLight>& lights);
+
+	// Alias table over the lights, in proportion to flux times the luminance of their
+	// color; uniform if no light carries power
+	void buildLightAliasTable(const std::vector<BasicLight>& lights, std::vector<LightAlias>& table);
+}
@@ -0,0 +1,91 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace cpu
+{
+#if defined(_WIN32)
+	MappedFile::MappedFile(const string& filename) : m_data(0), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(0)
+	{
+		m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+		if (m_file == INVALID_HANDLE_VALUE)
+			throw runtime_error("Could not open '" + filename + "'");
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size))
+		{
+			CloseHandle(m_file);
+			throw runtime_error("Could not read the size of '" + filename + "'");
+		}
+		m_size = static_cast<size_t>(size.QuadPart);
+		if (m_size == 0)
+			return;
+
+		m_mapping = CreateFileMappingA(m_file, 0, PAGE_READONLY, 0, 0, 0);
+		if (m_mapping)
+			m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data)
+		{
+			if (m_mapping)
+				CloseHandle(m_mapping);
+			CloseHandle(m_file);
+			throw runtime_error("Could not map '" + filename + "'");
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		CloseHandle(m_file);
+	}
+#else
+	MappedFile::MappedFile(const string& filename) : m_data(0), m_size(0)
+	{
+		const int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw runtime_error("Could not open '" + filename + "'");
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			close(fd);
+			throw runtime_error("Could not read the size of '" + filename + "'");
+		}
+		m_size = static_cast<size_t>(info.st_size);
+		if (m_size == 0)
+		{
+			close(fd);
+			return;
+		}
+
+		// the mapping keeps its own reference to the file
+		void* data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+			throw runtime_error("Could not map '" + filename + "'");
+		m_data = static_cast<const unsigned char*>(data);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_data)
+			munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+#endif
+}
@@ -0,0 +1,50 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Read-only memory-mapped files and the array views that read from them in place
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// A whole file mapped read-only; pages are loaded on first access
+	class MappedFile
+	{
+	public:
+		// Throws std::runtime_error if the file cannot be opened or mapped
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		const unsigned char*	data(void) const { return m_data; }
+		size_t					size(void) const { return m_size; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const unsigned char*	m_data;
+		size_t					m_size;
+#if defined(_WIN32)
+		void*					m_file;
+		void*					m_mapping;
+#endif
+	};
+
+	// Non-owning view of a contiguous array, either a vector or a region of a MappedFile
+	template<typename T>
+	struct ArrayView
+	{
+		const T*	data;
+		size_t		size;
+
+		ArrayView() : data(0), size(0) {}
+		ArrayView(const T* d, size_t s) : data(d), size(s) {}
+		explicit ArrayView(const std::vector<T>& v) : data(v.empty() ? 0 : &v[0]), size(v.size()) {}
+
+		bool		empty(void) const { return size == 0; }
+		const T&	operator[](size_t index) const { return data[index]; }
+	};
+}
@@ -0,0 +1,1118 @@
+#include "mmrt.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// trace_define.h
+	static const float	EPSILON			= 0.0000001f;
+	static const float	EMISSION_MULT	= 100.0f;
+	static const int	INVALID_RESULT	= -1;
+	static const int	INVALID_LOD		= -2;
+
+	// MMRT_tracing_hiz.glsl
+	static const int	ABUFFER_FACE_NO_HIT_EXIT				= -1;
+	static const int	ABUFFER_FACE_HIT						= 1;
+	static const int	ABUFFER_FACE_NO_HIT_CONTINUE_VIEWPORT	= 2;
+	static const int	ABUFFER_FACE_NO_HIT_CONTINUE_NEAR_PLANE	= 3;
+
+	static const int	VIEWPORT_NO_EXIT	= -1;
+	static const int	VIEWPORT_EXIT_UP	= 0;
+	static const int	VIEWPORT_EXIT_DOWN	= 1;
+	static const int	VIEWPORT_EXIT_RIGHT	= 2;
+	static const int	VIEWPORT_EXIT_LEFT	= 3;
+
+	// isSkyBox of MMRT_AO and MMRT_PT: large emission is the sky
+	static const float	AO_SKY_EMISSION = 990.0f;
+	static const float	PT_SKY_EMISSION = 30.0f;
+
+	// uniform_time between progressive frames
+	static const float	FRAME_TIME = 1.0f / 60.0f;
+	static const unsigned int	SHADOW_RAY_TYPE = 1;
+
+	MMRTLight makeMMRTLight(const BasicLight& light)
+	{
+		MMRTLight mmrt_light;
+		mmrt_light.position			  = make_float3(light.pos);
+		const float3 to_target		  = light.coneTarget - mmrt_light.position;
+		mmrt_light.direction		  = (dot(to_target, to_target) > 0.0f) ? normalize(to_target) : make_float3(0.0f, -1.0f, 0.0f);
+		mmrt_light.color			  = light.color * light.flux;
+		mmrt_light.conical			  = light.coneAngle < 180.0f;
+		mmrt_light.cosine_umbra		  = cosf(light.coneAngle * M_PIf / 180.0f);
+		mmrt_light.cosine_penumbra	  = mmrt_light.cosine_umbra;
+		mmrt_light.spotlight_exponent = 1.0f;
+		mmrt_light.casts_shadow		  = light.casts_shadow != 0;
+		return mmrt_light;
+	}
+
+	MMRTStatistics& MMRTStatistics::operator+=(const MMRTStatistics& other)
+	{
+		rays	  += other.rays;
+		hits	  += other.hits;
+		faces	  += other.faces;
+		searches  += other.searches;
+		buckets	  += other.buckets;
+		fragments += other.fragments;
+		frustum_tests += other.frustum_tests;
+		skipped	  += other.skipped;
+		for (int face = 0; face < MMRT_MAX_FACES; ++face)
+			entries[face] += other.entries[face];
+		return *this;
+	}
+
+	// [Views]
+
+	// uniform_pixel_proj: eye space to homogeneous pixel coordinates, w = -z
+	static inline float4 projectToPixel(const MMRTView& view, const float3& pecs)
+	{
+		const float half_width = 0.5f * static_cast<float>(view.width), half_height = 0.5f * static_cast<float>(view.height);
+		return make_float4(pecs.x * half_width / view.tan_x - pecs.z * half_width, pecs.y * half_height / view.tan_y - pecs.z * half_height, pecs.z, -pecs.z);
+	}
+
+	// projectZ: eye-space Z to the [0, 1] depth of uniform_proj
+	static inline float projectZ(const MMRTView& view, float pecsZ)
+	{
+		const float n = view.camera.near, f = view.far_plane;
+		const float tmpZ = (-pecsZ * (n + f) - 2.0f * n * f) / (-pecsZ * (f - n));
+		return tmpZ * 0.5f + 0.5f;
+	}
+
+	// clamp(H.xyz, -H.w, H.w) == H.xyz for H = uniform_proj * pecs
+	static inline bool isInsideFrustum(const MMRTView& view, const float3& pecs)
+	{
+		const float n = view.camera.near, f = view.far_plane;
+		const float w = -pecs.z;
+		const float z = (-pecs.z * (f + n) - 2.0f * n * f) / (f - n);
+		return fabsf(pecs.x / view.tan_x) <= w && fabsf(pecs.y / view.tan_y) <= w && fabsf(z) <= w;
+	}
+
+	void MMRTTracer::build(const TriangleMesh& mesh, const RasterCamera& camera, unsigned int width, unsigned int height, float scene_length, ThreadPool& thread_pool)
+	{
+		if (m_settings.faces != 1 && m_settings.faces != MMRT_MAX_FACES)
+			throw invalid_argument("MMRT traces either a single view or the primary view and a cubemap");
+
+		m_scene_length = scene_length;
+		const float		   far_plane	   = (m_settings.far_plane > 0.0f) ? m_settings.far_plane : scene_length;
+		const unsigned int face_resolution = (m_settings.face_resolution > 0) ? m_settings.face_resolution : height;
+
+		// W, U and V of the cube faces, unit length for a 90 degree field of view
+		const float3 right = normalize(camera.U), up = normalize(camera.V), forward = normalize(camera.W);
+		const float3 face_axes[MMRT_MAX_FACES][3] =
+		{
+			{ camera.W, camera.U, camera.V },
+			{  forward,	 right,	   up },
+			{ -forward, -right,	   up },
+			{ -right,	 forward,  up },
+			{  right,	-forward,  up },
+			{ -up,		 right,	   forward },
+			{  up,		 right,	  -forward }
+		};
+
+		m_views.clear();
+		m_views.resize(m_settings.faces);
+		vector<NodeTypeData> attributes;
+		for (unsigned int face = 0; face < m_settings.faces; ++face)
+		{
+			MMRTView& view	 = m_views[face];
+			view.camera.eye	 = camera.eye;
+			view.camera.W	 = face_axes[face][0];
+			view.camera.U	 = face_axes[face][1];
+			view.camera.V	 = face_axes[face][2];
+			view.camera.near = m_settings.near_plane;
+			view.far_plane	 = far_plane;
+			view.width		 = (face == MMRT_FACE_PRIMARY) ? width  : face_resolution;
+			view.height		 = (face == MMRT_FACE_PRIMARY) ? height : face_resolution;
+			view.axis_x		 = normalize(view.camera.U);
+			view.axis_y		 = normalize(view.camera.V);
+			view.axis_z		 = -normalize(view.camera.W);
+			view.tan_x		 = length(view.camera.U) / length(view.camera.W);
+			view.tan_y		 = length(view.camera.V) / length(view.camera.W);
+
+			// MMRT_Store and MMRT_Reorder
+			Rasterizer rasterizer;
+			rasterizer.setup(mesh, view.camera, view.width, view.height, thread_pool);
+			computeFragmentAttributes(mesh, view.camera, attributes);
+			view.abuffer.reset(new MMRTABuffer(m_settings.abuffer, true));
+			view.abuffer->build(rasterizer, attributes, thread_pool);
+			view.abuffer->resolve(thread_pool);
+			if (m_settings.compact_buckets)
+			{
+				view.spans.build(*view.abuffer, thread_pool);
+				view.abuffer->releaseLists();
+			}
+		}
+
+		// the cube face across each edge of every cube face is the one looking along the
+		// axis that leaves through it
+		for (unsigned int face = 0; face < m_settings.faces; ++face)
+		{
+			const MMRTView& view = m_views[face];
+			const float3 edge_axes[4] = { view.axis_y, -view.axis_y, view.axis_x, -view.axis_x };
+			for (int edge = VIEWPORT_EXIT_UP; edge <= VIEWPORT_EXIT_LEFT; ++edge)
+				m_neighbors[face][edge] = (face == MMRT_FACE_PRIMARY || m_settings.faces == 1) ? -1 : getCubeFace(edge_axes[edge]);
+		}
+		buildDepthBounds(thread_pool);
+	}
+
+	// The cube face that a direction from the eye, in world space, points into
+	int MMRTTracer::getCubeFace(const float3& direction) const
+	{
+		// x along right, y along up and z against forward
+		const float3 d = m_views[MMRT_FACE_FRONT].toEyeVector(direction);
+		const float3 a = make_float3(fabsf(d.x), fabsf(d.y), fabsf(d.z));
+		if (a.x >= a.y && a.x >= a.z)
+			return (d.x > 0.0f) ? MMRT_FACE_RIGHT : MMRT_FACE_LEFT;
+		if (a.y >= a.z)
+			return (d.y > 0.0f) ? MMRT_FACE_TOP : MMRT_FACE_BOTTOM;
+		return (d.z < 0.0f) ? MMRT_FACE_FRONT : MMRT_FACE_BACK;
+	}
+
+	void MMRTBucketSpans::build(const MMRTABuffer& abuffer, ThreadPool& thread_pool)
+	{
+		const AtomicImage&			 heads = abuffer.getHeads();
+		const MMRTABuffer::Storage&	 nodes = abuffer.getNodes();
+		const unsigned int			 height = heads.height();
+		m_width	  = heads.width();
+		m_buckets = heads.layers();
+		m_offsets.assign(static_cast<size_t>(m_width) * height * m_buckets + 1, 0u);
+
+		// the length of every list, in the offset of the span after its own
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			for (unsigned int x = 0; x < m_width; ++x)
+				for (unsigned int b = 0; b < m_buckets; ++b)
+				{
+					unsigned int count = 0;
+					for (unsigned int index = heads(x, y, b).load(memory_order_relaxed); index != 0u; index = nodes.getNext(index))
+						count++;
+					m_offsets[getSpan(x, y, b) + 1] = count;
+				}
+		});
+
+		// the spans start past the null fragment
+		m_offsets[0] = 1u;
+		for (size_t span = 1; span < m_offsets.size(); ++span)
+			m_offsets[span] += m_offsets[span - 1];
+		m_nodes.resize(m_offsets.back());
+
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			for (unsigned int x = 0; x < m_width; ++x)
+				for (unsigned int b = 0; b < m_buckets; ++b)
+				{
+					unsigned int i = getBegin(x, y, b);
+					for (unsigned int index = heads(x, y, b).load(memory_order_relaxed); index != 0u; index = nodes.getNext(index), ++i)
+					{
+						m_nodes.setDepth(i, nodes.getDepth(index));
+						m_nodes.setData(i, nodes.getData(index));
+					}
+				}
+		});
+	}
+
+	// MMRT_DepthBoundsCompute and MMRT_DepthBoundsMipMap, for all views at once. The
+	// pyramids of the previous build are kept while the view sizes stay the same, so that
+	// only the tiles whose depth bounds changed are reduced again.
+	void MMRTTracer::buildDepthBounds(ThreadPool& thread_pool)
+	{
+		vector<uint2>				sizes(m_views.size());
+		vector<const AtomicImage*>	depth_bounds(m_views.size());
+		for (size_t v = 0; v < m_views.size(); ++v)
+		{
+			sizes[v]		= make_uint2(m_views[v].width, m_views[v].height);
+			depth_bounds[v] = &m_views[v].abuffer->getDepthBounds();
+		}
+
+		bool same_sizes = m_depth_bounds.getViewCount() == sizes.size();
+		for (unsigned int v = 0; same_sizes && v < sizes.size(); ++v)
+			same_sizes = m_depth_bounds.getSize(v, 0).x == sizes[v].x && m_depth_bounds.getSize(v, 0).y == sizes[v].y;
+		if (!same_sizes)
+			m_depth_bounds.reset(sizes);
+
+		m_depth_bounds.update(depth_bounds, thread_pool);
+		m_depth_bounds.build(thread_pool);
+	}
+
+	size_t MMRTTracer::memoryUsage(void) const
+	{
+		size_t bytes = m_depth_bounds.memoryUsage();
+		for (size_t v = 0; v < m_views.size(); ++v)
+			bytes += (m_views[v].abuffer ? m_views[v].abuffer->memoryUsage() : 0) + m_views[v].spans.memoryUsage();
+		return bytes;
+	}
+
+	// [Tracing]
+
+	// ray_hit_a_buffer_search: tests the ray's Z extents against the depth bounds of the
+	// tile at lod, and at lod 0, searches the buckets they overlap for the first fragment
+	// within THICKNESS, in the order the ray crosses them, through their linked lists or
+	// their compacted spans. Returns the node index, or INVALID_RESULT or INVALID_LOD.
+	int MMRTTracer::search(int face, int x, int y, float minZ, float maxZ, int increment, float divstep, int lod, MMRTStatistics& statistics) const
+	{
+		statistics.searches++;
+
+		// maxZ out of bounds
+		if (maxZ >= 0.0f)
+			return INVALID_RESULT;
+
+		const float maxZ_thickness = maxZ + m_settings.thickness;
+
+		// early skip if out of Z-slice bounds; texels outside the view read as empty
+		const int	lod_x = static_cast<int>(static_cast<float>(x) * divstep);
+		const int	lod_y = static_cast<int>(static_cast<float>(y) * divstep);
+		const uint2 size  = m_depth_bounds.getSize(face, lod);
+		if (lod_x < 0 || lod_y < 0 || lod_x >= static_cast<int>(size.x) || lod_y >= static_cast<int>(size.y))
+			return INVALID_RESULT;
+		const float2 depths		= m_depth_bounds(face, lod, lod_x, lod_y);
+		const float	 depth_near = -depths.x;
+		if (minZ >= -depth_near)
+			return INVALID_RESULT;
+		const float	 depth_far	= depths.y;
+		if (maxZ_thickness <= -depth_far)
+			return INVALID_RESULT;
+
+		// inside the tile, but not at the lowest lod: refine
+		if (lod > 0)
+			return INVALID_LOD;
+
+		const MMRTABuffer&	abuffer = *m_views[face].abuffer;
+		const int			buckets = static_cast<int>(m_settings.compact_buckets ? m_views[face].spans.getBuckets() : abuffer.getHeads().layers());
+
+		// the buckets of the segment, by the distribution that MMRT_Store peeled them with;
+		// for uniform buckets, int(float(BUCKET_SIZE) * normalized) clamped to them
+		const int b0 = (maxZ_thickness >= -depth_near) ? 0 : static_cast<int>(abuffer.getBucket(x, y, -maxZ_thickness));
+		const int b1 = (b0 == buckets - 1 || minZ <= -depth_far) ? buckets - 1 : static_cast<int>(abuffer.getBucket(x, y, -minZ));
+		const int d	 = max(0, abs(b1 - b0));
+
+		// increment is positive if the ray moves away from the camera, negative towards it,
+		// which walks the buckets and their fragments back to front
+		const bool reverseZ = increment < 0;
+		const int  inc		= reverseZ ? -1 : 1;
+		int		   b		= reverseZ ? b1 : b0;
+
+		int index_max = INVALID_RESULT;
+		if (m_settings.compact_buckets)
+		{
+			const MMRTBucketSpans&			 spans = m_views[face].spans;
+			const MMRTBucketSpans::Storage&	 nodes = spans.getNodes();
+			for (int i = 0; i <= d && index_max <= 0; i++, b += inc)
+			{
+				const unsigned int begin = spans.getBegin(x, y, b), end = spans.getEnd(x, y, b);
+				if (begin == end)
+					continue;
+
+				statistics.buckets++;
+				for (unsigned int k = 0; k < end - begin && index_max < 0; ++k)
+				{
+					const unsigned int index = reverseZ ? end - 1 - k : begin + k;
+					statistics.fragments++;
+					const float depth = nodes.getDepth(index);
+					if (depth <= maxZ_thickness && depth > minZ)
+						index_max = static_cast<int>(index);
+				}
+			}
+			return index_max;
+		}
+
+		const AtomicImage&			 heads = abuffer.getHeads();
+		const AtomicImage&			 tails = abuffer.getTails();
+		const MMRTABuffer::Storage&	 nodes = abuffer.getNodes();
+		for (int i = 0; i <= d && index_max <= 0; i++, b += inc)
+		{
+			const unsigned int head = heads(x, y, b).load(memory_order_relaxed);
+			if (head == 0u)
+				continue;
+
+			statistics.buckets++;
+			unsigned int index = reverseZ ? tails(x, y, b).load(memory_order_relaxed) : head;
+			while (index != 0u && index_max < 0)
+			{
+				statistics.fragments++;
+				const float depth = nodes.getDepth(index);
+				if (depth <= maxZ_thickness && depth > minZ)
+					index_max = static_cast<int>(index);
+				index = reverseZ ? nodes.getPrev(index) : nodes.getNext(index);
+			}
+		}
+		return index_max;
+	}
+
+	// clipViewport: clips P0-P1 against viewport (x0, y0, x1, y1) and records the edge
+	// it leaves through. P0 must be inside the viewport.
+	static float clipViewport(const float2& P0, const float2& P1, const float4& viewport, int& viewport_exit)
+	{
+		float alpha		= 1.0f;
+		float tmp_alpha = 1.0f;
+		viewport_exit	= VIEWPORT_NO_EXIT;
+
+		if (P1.y > viewport.w)
+		{
+			tmp_alpha	  = (viewport.w - P0.y) / (P1.y - P0.y);
+			viewport_exit = VIEWPORT_EXIT_UP;
+		}
+		else if (P1.y < viewport.y)
+		{
+			tmp_alpha	  = (viewport.y - P0.y) / (P1.y - P0.y);
+			viewport_exit = VIEWPORT_EXIT_DOWN;
+		}
+
+		if (P1.x > viewport.z)
+		{
+			alpha		  = fminf(tmp_alpha, (viewport.z - P0.x) / (P1.x - P0.x));
+			viewport_exit = (alpha < tmp_alpha) ? VIEWPORT_EXIT_RIGHT : viewport_exit;
+		}
+		else if (P1.x < viewport.x)
+		{
+			alpha		  = fminf(tmp_alpha, (viewport.x - P0.x) / (P1.x - P0.x));
+			viewport_exit = (alpha < tmp_alpha) ? VIEWPORT_EXIT_LEFT : viewport_exit;
+		}
+		else
+			alpha = tmp_alpha;
+
+		return alpha;
+	}
+
+	// clipViewportLod: the same against the tile of a lod, without the exit edge
+	static inline float clipViewportLod(const float2& P0, const float2& P1, const float4& viewport)
+	{
+		float alpha = 1.0f;
+		if (P1.y > viewport.w || P1.y < viewport.y)
+			alpha = (((P1.y > viewport.w) ? viewport.w : viewport.y) - P0.y) / (P1.y - P0.y);
+		if (P1.x > viewport.z || P1.x < viewport.x)
+			alpha = fminf(alpha, (((P1.x > viewport.z) ? viewport.z : viewport.x) - P0.x) / (P1.x - P0.x));
+		return alpha;
+	}
+
+	static inline float2 swizzleYX(const float2& v)						{ return make_float2(v.y, v.x); }
+	static inline float	 sign(float v)										{ return (v > 0.0f) ? 1.0f : ((v < 0.0f) ? -1.0f : 0.0f); }
+
+	// traceScreenSpaceRay_abuffer_cube: marches the ray hierarchically through the
+	// depth-bounds pyramid of one view, in homogeneous screen space after McGuire and
+	// Mara, and searches the A-buffer at lod 0. Returns ABUFFER_FACE_HIT with the vertex,
+	// or, with a cubemap, where to continue the ray in new_hitpoint, and for
+	// ABUFFER_FACE_NO_HIT_CONTINUE_VIEWPORT, the edge it left through in viewport_exit.
+	int MMRTTracer::traceFace(const float3& csOrigin, const float3& csDirection, int iteration, float* remaining_distance, float jitter, int face,
+		float3& new_hitpoint, int& viewport_exit, MMRTVertex& new_vertex, MMRTStatistics& statistics) const
+	{
+		statistics.faces++;
+		const MMRTView& view = m_views[face];
+		int result = ABUFFER_FACE_NO_HIT_EXIT;
+
+		// clip with the near and far planes; rays parallel to them are not clipped
+		const float near_plane = view.camera.near, far_plane = view.far_plane;
+		const float range	   = remaining_distance ? *remaining_distance : m_scene_length;
+		const float2 denom	   = make_float2(-csDirection.z, csDirection.z);
+		float length_to_near = (denom.x != 0.0f) ? -(-csOrigin.z - near_plane) / denom.x : range;
+		length_to_near		 = (length_to_near < range && length_to_near > EPSILON) ? length_to_near : range;
+		float length_to_far	 = (denom.y != 0.0f) ? -(csOrigin.z + far_plane) / denom.y : range;
+		length_to_far		 = (length_to_far < range && length_to_far > EPSILON) ? length_to_far : range;
+		const float	 clipped_length = fminf(length_to_near, length_to_far);
+		const float3 csEndPoint		= csDirection * clipped_length + csOrigin;
+
+		// project into screen space
+		const float4 H0 = projectToPixel(view, csOrigin);
+		const float4 H1 = projectToPixel(view, csEndPoint);
+		const float k0 = 1.0f / H0.w;
+		const float k1 = 1.0f / H1.w;
+
+		// switch the original points to values that interpolate linearly in 2D
+		const float4 Q_k0 = make_float4(csOrigin * k0, k0);
+		float4		 Q_k1 = make_float4(csEndPoint * k1, k1);
+		float2 P0 = make_float2(H0.x, H0.y) * Q_k0.w;
+		float2 P1 = make_float2(H1.x, H1.y) * Q_k1.w;
+
+		// positive is away from the camera, negative towards it
+		const int signdz = -static_cast<int>(sign(csEndPoint.z - csOrigin.z));
+
+		int layer = INVALID_RESULT;
+
+		// clip to the viewport
+		const float4 viewport = make_float4(0.5f, 0.5f, static_cast<float>(view.width) - 0.5f, static_cast<float>(view.height) - 0.5f);
+		float alpha = clipViewport(P0, P1, viewport, viewport_exit);
+		P1	 = lerp(P0, P1, alpha);
+		Q_k1 = lerp(Q_k0, Q_k1, alpha);
+
+		if (remaining_distance)
+		{
+			const float3 new_end = make_float3(Q_k1) / Q_k1.w;
+			*remaining_distance	 = fmaxf(0.0f, *remaining_distance - length(new_end - csOrigin));
+		}
+
+		float2 delta = P1 - P0;
+
+		// permute so that the primary iteration is in x
+		const bool permute = fabsf(delta.x) < fabsf(delta.y);
+		if (permute)
+		{
+			delta = swizzleYX(delta);
+			P1	  = swizzleYX(P1);
+			P0	  = swizzleYX(P0);
+		}
+
+		// a ray along the line of sight spans no pixels, nor does one whose origin is on
+		// the eye plane; the shader steps by NaN through both and leaves the view unhit
+		if (!(fabsf(delta.x) > 0.0f && fabsf(delta.x) < FLT_MAX))
+			return ABUFFER_FACE_NO_HIT_EXIT;
+
+		const float stepDirection = sign(delta.x);
+		const float invdx		  = stepDirection / delta.x;
+		const float2 dP			  = make_float2(stepDirection, invdx * delta.y);
+
+		// the derivatives of Q and k
+		const float4 dQ_k = (Q_k1 - Q_k0) * invdx;
+
+		// P1.x is never modified after this point, so pre-scale it by the step direction
+		// for a signed comparison
+		const float end = P1.x * stepDirection;
+
+		// slide P from P0 to P1 and Q_k from Q_k0 to Q_k1, starting at the next pixel
+		const float pixel_offset = (iteration == 0) ? 0.5f + jitter : jitter;
+		float2 P   = P0 + dP * pixel_offset;
+		float4 Q_k = Q_k0 + dQ_k * pixel_offset;
+
+		const float half_pixel_offset = 0.5f;
+		const int	lod_max			  = static_cast<int>(m_depth_bounds.getLevels(face)) - 1;
+		int			lod				  = 0;
+		float		divstep			  = 1.0f;
+		const float2 _P0 = permute ? swizzleYX(P0) : P0;
+		const float2 _P1 = permute ? swizzleYX(P1) : P1;
+
+		// the tile of P at lod, and the Z extents of the ray across it
+		float2 hitPixel, f_viewport_c;
+		float4 f_viewport, Q_k_tmp;
+		float  lod_alpha, rayZMin, rayZMax;
+		auto enterTile = [&]()
+		{
+			const float step_lod = static_cast<float>(1 << lod);
+			hitPixel	 = permute ? swizzleYX(P) : P;
+			f_viewport.x = floorf(hitPixel.x * divstep) * step_lod;
+			f_viewport.y = floorf(hitPixel.y * divstep) * step_lod;
+			f_viewport.z = f_viewport.x + step_lod;
+			f_viewport.w = f_viewport.y + step_lod;
+			f_viewport_c = make_float2(f_viewport.x + divstep * 0.5f, f_viewport.y + divstep * 0.5f);
+
+			lod_alpha = clipViewportLod(hitPixel, _P0, f_viewport);
+			Q_k_tmp	  = lerp(Q_k, Q_k0, lod_alpha);
+			rayZMin	  = Q_k_tmp.z / Q_k_tmp.w;
+
+			lod_alpha = clipViewportLod(hitPixel, _P1, f_viewport);
+			Q_k_tmp	  = lerp(Q_k, Q_k1, lod_alpha);
+			rayZMax	  = Q_k_tmp.z / Q_k_tmp.w;
+		};
+		enterTile();
+
+		while (P.x * stepDirection <= end && rayZMax < 0.0f)
+		{
+			if (rayZMin > rayZMax)
+				swap(rayZMin, rayZMax);
+
+			layer = search(face, static_cast<int>(f_viewport_c.x), static_cast<int>(f_viewport_c.y), rayZMin, rayZMax, signdz, divstep, lod, statistics);
+
+			// no hit: move past the exit of the tile and up a level
+			if (layer == INVALID_RESULT)
+			{
+				P	 = lerp(P, P1, lod_alpha);
+				Q_k	 = Q_k_tmp;
+				P	 = P + dP * half_pixel_offset;
+				Q_k	 = Q_k + dQ_k * half_pixel_offset;
+				lod	 = min(lod_max + 1, lod + 2);
+			}
+
+			// a hit at lod 0 ends the march at the current pixel
+			if (--lod < 0)
+			{
+				hitPixel = permute ? swizzleYX(P) : P;
+				break;
+			}
+			divstep = 1.0f / static_cast<float>(1 << lod);
+			enterTile();
+		}
+
+		if (layer > INVALID_RESULT)
+		{
+			createVertex(hitPixel, static_cast<unsigned int>(layer), face, new_vertex);
+			return ABUFFER_FACE_HIT;
+		}
+
+		if (m_views.size() > 1)
+		{
+			hitPixel = permute ? swizzleYX(P) : P;
+			float3 pecs = make_float3(Q_k) * (1.0f / Q_k.w);
+			const float pecs_pndcZ = projectZ(view, pecs.z);
+			// without a hit, the ray either leaves through the far plane and ends, or
+			// through another plane of the frustum and continues in another face
+			if (pecs_pndcZ >= 1.0f)
+				result = ABUFFER_FACE_NO_HIT_EXIT;
+			else if (pecs_pndcZ <= 0.0f)
+			{
+				new_hitpoint = csEndPoint + csDirection * 0.01f;
+				result		 = ABUFFER_FACE_NO_HIT_CONTINUE_NEAR_PLANE;
+			}
+			else if (alpha < 1.0f && P.x * stepDirection > end)
+			{
+				// the viewport is clipped at half-pixel boundaries, so some rays stop short
+				// of its edge; move them just outside it, into the next view
+				float		 _k1 = 1.0f / H1.w;
+				float3		 _Q1 = csEndPoint * _k1;
+				const float2 _P1e = make_float2(H1.x, H1.y) * _k1;
+				const float	 offset = 0.01f;
+				const float4 outer_viewport = make_float4(-offset, -offset, static_cast<float>(view.width) + offset, static_cast<float>(view.height) + offset);
+				alpha = clipViewport(hitPixel, _P1e, outer_viewport, viewport_exit);
+				_k1	  = lerp(Q_k.w, _k1, alpha);
+				_Q1	  = lerp(make_float3(Q_k), _Q1, alpha);
+				pecs		 = _Q1 / _k1;
+				new_hitpoint = pecs;
+				result		 = (alpha < 1.0f) ? ABUFFER_FACE_NO_HIT_CONTINUE_VIEWPORT : ABUFFER_FACE_NO_HIT_EXIT;
+				if (projectZ(view, pecs.z) <= 0.0f)
+				{
+					new_hitpoint = pecs + csDirection * near_plane;
+					result		 = ABUFFER_FACE_NO_HIT_CONTINUE_NEAR_PLANE;
+				}
+			}
+		}
+		return result;
+	}
+
+	bool MMRTTracer::trace(const float3& origin, const float3& direction, float jitter, int face, float remaining_distance, MMRTVertex& vertex, MMRTStatistics& statistics,
+		unsigned int skipped_faces) const
+	{
+		statistics.rays++;
+		statistics.entries[face]++;
+		float* const distance = (remaining_distance > 0.0f) ? &remaining_distance : 0;
+		float3 new_hitpoint = make_float3(0.0f);
+		int viewport_exit = VIEWPORT_NO_EXIT;
+		int result;
+
+		if (m_views.size() == 1)
+			result = traceFace(origin, direction, 0, distance, jitter, face, new_hitpoint, viewport_exit, vertex, statistics);
+		else
+		{
+			// each vertex stores its position in the eye space of view 0
+			float3 csOrigin	   = m_views[face].toEye(m_views[MMRT_FACE_PRIMARY].toWorld(origin));
+			float3 csDirection = m_views[face].toEyeVector(m_views[MMRT_FACE_PRIMARY].toWorldVector(direction));
+
+			bool used[MMRT_MAX_FACES] = { false };
+			const int num_views = static_cast<int>(m_views.size());
+			result = ABUFFER_FACE_NO_HIT_CONTINUE_VIEWPORT;
+			for (int counter = 0; result > ABUFFER_FACE_HIT && counter < num_views && (!distance || remaining_distance > 0.0f); ++counter)
+			{
+				result = traceFace(csOrigin, csDirection, counter, distance, jitter, face, new_hitpoint, viewport_exit, vertex, statistics);
+				if (result == ABUFFER_FACE_HIT || result == ABUFFER_FACE_NO_HIT_EXIT)
+					break;
+
+				// the ray left the face through its near plane or its viewport: continue in
+				// an unused cube face whose frustum holds the new point. The scheduler tries
+				// the face across the edge it left through, then the face its direction from
+				// the eye points into; the others are tested in order only if neither holds
+				// the point, at corners or past the far plane, or without the scheduler.
+				used[face] = true;
+				const float3 hitpoint = m_views[face].toWorld(new_hitpoint);
+				unsigned int tested = 0;
+				float3 pecs = make_float3(0.0f);
+				auto enters = [&](int i) -> bool
+				{
+					if (i < MMRT_FACE_FRONT || used[i] || (tested & (1u << i)))
+						return false;
+					tested |= 1u << i;
+					statistics.frustum_tests++;
+					pecs = m_views[i].toEye(hitpoint);
+					return isInsideFrustum(m_views[i], pecs);
+				};
+
+				int next = -1;
+				if (m_settings.schedule_faces)
+				{
+					const int across = (result == ABUFFER_FACE_NO_HIT_CONTINUE_VIEWPORT && viewport_exit != VIEWPORT_NO_EXIT) ? m_neighbors[face][viewport_exit] : -1;
+					const int ahead	 = getCubeFace(hitpoint - m_views[face].camera.eye);
+					next = enters(across) ? across : (enters(ahead) ? ahead : -1);
+				}
+				for (int i = MMRT_FACE_FRONT; i < num_views && next < 0; ++i)
+					if (enters(i))
+						next = i;
+
+				result = ABUFFER_FACE_NO_HIT_EXIT;
+				if (next < 0)
+					break;
+				statistics.entries[next]++;
+				if (skipped_faces & (1u << next))
+				{
+					statistics.skipped++;
+					break;
+				}
+				csOrigin	= pecs;
+				csDirection = m_views[next].toEyeVector(m_views[face].toWorldVector(csDirection));
+				face		= next;
+				result		= ABUFFER_FACE_NO_HIT_CONTINUE_NEAR_PLANE;
+			}
+		}
+
+		if (result == ABUFFER_FACE_HIT)
+			statistics.hits++;
+		return result == ABUFFER_FACE_HIT;
+	}
+
+	// The cube faces that fewer than MMRTSettings::skip_faces of the rays traced since
+	// the totals in before entered, as a mask of face bits; before moves on to the
+	// current totals
+	unsigned int MMRTTracer::getSkippedFaces(const vector<MMRTStatistics>& thread_statistics, MMRTStatistics& before) const
+	{
+		unsigned int skipped_faces = 0;
+		if (m_settings.skip_faces <= 0.0f)
+			return skipped_faces;
+
+		MMRTStatistics total;
+		for (size_t t = 0; t < thread_statistics.size(); ++t)
+			total += thread_statistics[t];
+		const unsigned long long rays = total.rays - before.rays;
+		for (unsigned int face = MMRT_FACE_FRONT; face < m_views.size() && rays > 0; ++face)
+			if (static_cast<double>(total.entries[face] - before.entries[face]) < m_settings.skip_faces * static_cast<double>(rays))
+				skipped_faces |= 1u << face;
+		before = total;
+		return skipped_faces;
+	}
+
+	// createVertex: the vertex of node id, seen at coords of a view
+	void MMRTTracer::createVertex(const float2& coords, unsigned int id, int face, MMRTVertex& vertex) const
+	{
+		const MMRTView&		view  = m_views[face];
+		const float			depth = m_settings.compact_buckets ? view.spans.getNodes().getDepth(id) : view.abuffer->getNodes().getDepth(id);
+		const NodeTypeData	node  = m_settings.compact_buckets ? view.spans.getNodes().getData(id) : view.abuffer->getNodes().getData(id);
+
+		// reconstruct_position_from_depth, without the round trip through projectZ
+		const float2 texcoord = make_float2(coords.x / static_cast<float>(view.width), coords.y / static_cast<float>(view.height));
+		vertex.position = make_float3((2.0f * texcoord.x - 1.0f) * view.tan_x * -depth, (2.0f * texcoord.y - 1.0f) * view.tan_y * -depth, depth);
+		vertex.normal	= decodeSpheremapNormal(node.normal);
+
+		const float4 spec_parameters = unpackUnorm4x8(node.specular);
+		const float4 ior_opacity	 = unpackUnorm4x8(node.ior_opacity);
+		vertex.color		= unpackUnorm4x8(node.albedo);
+		vertex.reflectivity = spec_parameters.x;
+		vertex.roughness	= 1.0f - spec_parameters.y;
+		vertex.metal		= spec_parameters.z;
+		if (ior_opacity.z > 0.0f)
+			vertex.color.w *= EMISSION_MULT;
+		vertex.ior		= ior_opacity.x * 10.0f;
+		vertex.opacity	= ior_opacity.y;
+		vertex.face		= face;
+
+		if (face > 0)
+		{
+			const MMRTView& primary = m_views[MMRT_FACE_PRIMARY];
+			vertex.position = primary.toEye(view.toWorld(vertex.position));
+			vertex.normal	= primary.toEyeVector(view.toWorldVector(vertex.normal));
+		}
+	}
+
+	// isABufferEmpty of the primary view
+	bool MMRTTracer::isEmpty(int x, int y) const
+	{
+		if (m_settings.compact_buckets)
+		{
+			const MMRTBucketSpans& spans = m_views[MMRT_FACE_PRIMARY].spans;
+			return spans.getBegin(x, y, 0) == spans.getEnd(x, y, spans.getBuckets() - 1);
+		}
+		const AtomicImage& heads = m_views[MMRT_FACE_PRIMARY].abuffer->getHeads();
+		for (unsigned int b = 0; b < heads.layers(); ++b)
+			if (heads(x, y, b).load(memory_order_relaxed) != 0u)
+				return false;
+		return true;
+	}
+
+	// The front fragment of the primary view, which the shading passes read from bucket 0
+	unsigned int MMRTTracer::getFrontFragment(int x, int y) const
+	{
+		if (m_settings.compact_buckets)
+			return m_views[MMRT_FACE_PRIMARY].spans.getBegin(x, y, 0);
+		return m_views[MMRT_FACE_PRIMARY].abuffer->getHeads()(x, y, 0).load(memory_order_relaxed);
+	}
+
+	// [Sampling]
+
+	static inline float fract(float value) { return value - floorf(value); }
+
+	// rand1n and rand2n of MMRT_basic_lib.glsl, in single precision as on the GPU
+	static inline float rand1n(const float2& seed)
+	{
+		const float dt = seed.x * 12.9898f + seed.y * 78.233f;
+		const float sn = dt - 2.0f * M_PIf * floorf(dt / (2.0f * M_PIf));
+		return fmaxf(0.01f, fract(sinf(sn) * 43758.5453f));
+	}
+
+	static inline float2 rand2n(const float2& seed)
+	{
+		return make_float2(rand1n(seed), rand1n(make_float2(seed.x * 11.0f, seed.y * 13.0f)));
+	}
+
+	// getSamplingSeed of a pixel, in the frame of uniform_progressive_sample and uniform_time
+	struct SamplingSeed
+	{
+		float2	texcoord;
+		float	progressive_sample;
+		float	time;
+
+		float2	get(float iteration) const { const float t = fract(time); return texcoord * 17.0f * (progressive_sample + t) * (iteration + t); }
+		// the PIXEL_ANTIALIASING offset of gl_FragCoord
+		float2	getPixelOffset(void) const { return rand2n(texcoord * 17.0f * (progressive_sample * 0.1f)) - 0.5f; }
+	};
+
+	static inline void getTangentFrame(const float3& normal, float3& tangent, float3& bitangent)
+	{
+		tangent = cross(normal, make_float3(0.0f, 1.0f, 0.0f));
+		if (dot(tangent, tangent) < 1.e-3f)
+			tangent = cross(normal, make_float3(1.0f, 0.0f, 0.0f));
+		tangent	  = normalize(tangent);
+		bitangent = cross(normal, tangent);
+	}
+
+	static inline float3 reflect(const float3& i, const float3& n)
+	{
+		return i - 2.0f * dot(n, i) * n;
+	}
+
+	// getNewSamplePositionUniformHemisphereSampling; the pdf is that of the shader
+	static float3 sampleUniformHemisphere(float& out_inv_pdf, const MMRTVertex& vertex, const SamplingSeed& seed, float bounce)
+	{
+		const float2 u	 = rand2n(seed.get(bounce));
+		const float	 r	 = sqrtf(fmaxf(0.0f, 1.0f - u.x * u.x));
+		const float	 phi = 2.0f * M_PIf * u.y;
+		float3 tangent, bitangent;
+		getTangentFrame(vertex.normal, tangent, bitangent);
+		out_inv_pdf = M_PIf * 0.5f;
+		return normalize(tangent * (r * cosf(phi)) + bitangent * (r * sinf(phi)) + vertex.normal * u.x);
+	}
+
+	// getNewSamplePositionCosineHemisphereSampling
+	static float3 sampleCosineHemisphere(float& out_inv_pdf, const MMRTVertex& vertex, const SamplingSeed& seed, float bounce)
+	{
+		const float2 r		  = rand2n(seed.get(bounce));
+		const float	 phi	  = r.x * 2.0f * M_PIf;
+		const float	 cosTheta = sqrtf(1.0f - r.y);
+		const float	 sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+		float3 tangent, bitangent;
+		getTangentFrame(vertex.normal, tangent, bitangent);
+		const float3 sample_dir = normalize(tangent * (cosf(phi) * sinTheta) + bitangent * (sinf(phi) * sinTheta) + vertex.normal * cosTheta);
+		const float d = fmaxf(0.0f, dot(vertex.normal, sample_dir));
+		out_inv_pdf = (d > 0.0f) ? M_PIf / d : 0.0f;
+		return sample_dir;
+	}
+
+	// [Lighting]
+	// MMRT_lighting.glsl with the Beckmann microfacet model and no transmission, which
+	// getNewSamplePositionNDFSampling never selects
+
+	static inline float Distribution_Phong(float NH, float m)
+	{
+		const float surface_smoothness = (1.0f - m) * 127.0f;
+		return powf(NH, surface_smoothness) * (surface_smoothness + 2.0f) / (2.0f * M_PIf);
+	}
+
+	static inline float Distribution_Beckmann(float NH, float m)
+	{
+		const float NH2 = NH * NH;
+		const float m2	= fmaxf(0.001f, m * m);
+		return expf((NH2 - 1.0f) / (m2 * NH2 + 0.001f)) / (M_PIf * m2 * NH2 * NH2 + 0.001f);
+	}
+
+	static inline float Geometric_Beckmann(float NO, float m)
+	{
+		const float a  = NO / (m * sqrtf(1.0f - NO * NO));
+		const float a2 = a * a;
+		return (a < 1.6f) ? (3.535f * a + 2.181f * a2) / (1.0f + 2.276f * a + 2.577f * a2) : 1.0f;
+	}
+
+	static inline float3 Fresnel_Schlick(const float3& R0, float NO)
+	{
+		const float u  = 1.0f - NO;
+		float		u5 = u * u;
+		u5 = u5 * u5 * u;
+		return fminf(make_float3(1.0f), R0 + (make_float3(1.0f) - R0) * u5);
+	}
+
+	// Microfacet_Lambert_BSDF, O towards the light or next vertex and I towards the previous one
+	static float3 Microfacet_Lambert_BSDF(const float3& O, const float3& I, const MMRTVertex& vertex)
+	{
+		const float3 H	= normalize(O + I);
+		const float	 NI = dot(vertex.normal, I);
+		const float	 NO = dot(vertex.normal, O);
+		const float	 NH = dot(vertex.normal, H);
+		const float	 HO = dot(H, O);
+
+		const float3 albedo = make_float3(vertex.color);
+		const float3 C0 = vertex.reflectivity * lerp(make_float3(1.0f), albedo, vertex.metal);
+		const float3 F	= Fresnel_Schlick(C0, fmaxf(0.0f, HO));
+		const float3 T	= make_float3(1.0f) - F;
+
+		float D = (NH <= 0.0f) ? 0.0f : Distribution_Beckmann(NH, vertex.roughness);
+		float G = (HO * NO <= 0.0f) ? 0.0f : Geometric_Beckmann(NO, vertex.roughness);
+
+		float3 specular_brdf;
+		if (vertex.roughness < 0.01f)
+		{
+			G = 1.0f;
+			D = (NH <= 0.0f) ? 0.0f : Distribution_Phong(NH, vertex.roughness);
+			specular_brdf = (NO * NI > 0.0f) ? D * G * F * 0.25f : make_float3(0.0f);
+		}
+		else
+			specular_brdf = (NO * NI > 0.0f) ? F * G * D * 0.25f / (0.001f + fabsf(NO) * fabsf(NI)) : make_float3(0.0f);
+
+		// diffuse from the transmitted energy, less for metals
+		const float3 diffuse_brdf = albedo * (1.0f / M_PIf) * T * (1.0f - vertex.metal) * vertex.opacity;
+		return diffuse_brdf + specular_brdf;
+	}
+
+	static inline float NdotL(const float3& vertex_to_next_dir, const MMRTVertex& vertex)
+	{
+		return fmaxf(0.0f, dot(vertex.normal, vertex_to_next_dir));
+	}
+
+	// getGeometricTerm; the visibility is 1, since the next vertex has been traced
+	static inline float getGeometricTerm(const float3& current_to_new_vertex_dir, const MMRTVertex& current_vertex, const MMRTVertex& next_vertex)
+	{
+		float geometric_term = NdotL(current_to_new_vertex_dir, current_vertex);
+		if (next_vertex.opacity == 1.0f)
+			geometric_term = (dot(next_vertex.normal, -current_to_new_vertex_dir) < 0.0f) ? 0.0f : geometric_term;
+		return geometric_term;
+	}
+
+	// getNewSamplePositionNDFSampling: a cosine-weighted direction for the diffuse part,
+	// the mirror direction for smooth surfaces and a Beckmann microfacet reflection otherwise
+	static float3 sampleNDF(float& out_inv_pdf, const float3& prev_vertex_position, const MMRTVertex& vertex, const SamplingSeed& seed, float bounce)
+	{
+		const float2 r = rand2n(seed.get(bounce));
+		const float3 I = normalize(vertex.position - prev_vertex_position);
+
+		const bool diffuse_sampling = r.x > vertex.reflectivity;
+		if (!diffuse_sampling && vertex.roughness < 0.01f)
+		{
+			out_inv_pdf = 1.0f;
+			return reflect(I, vertex.normal);
+		}
+		if (diffuse_sampling)
+			return sampleCosineHemisphere(out_inv_pdf, vertex, seed, bounce);
+
+		const float tantheta2 = -logf(r.x) * vertex.roughness * vertex.roughness;
+		const float costheta  = sqrtf(1.0f / (1.0f + tantheta2));
+		const float sintheta  = sqrtf(1.0f - costheta * costheta);
+		const float phi		  = 2.0f * M_PIf * r.y;
+
+		float3 right, front;
+		getTangentFrame(vertex.normal, right, front);
+		const float3 H = normalize(right * (cosf(phi) * sintheta) + front * (sinf(phi) * sintheta) + vertex.normal * costheta);
+
+		const float HI = dot(H, -I);
+		const float HN = dot(H, vertex.normal);
+		float3 sample_dir = reflect(I, H);
+
+		// on the wrong side of the hemisphere, fall back to cosine sampling rather than
+		// lose the sample; the pdf of the half vector is converted with 1 / (4 HI)
+		if (fmaxf(0.0f, HN) > 0.0f && fmaxf(0.0f, dot(sample_dir, vertex.normal)) > 0.0f)
+		{
+			const float pdf = Distribution_Beckmann(HN, vertex.roughness) * fabsf(HN) * 0.25f / fabsf(HI);
+			out_inv_pdf = 1.0f / fmaxf(0.001f, pdf);
+		}
+		else
+			sample_dir = sampleCosineHemisphere(out_inv_pdf, vertex, seed, bounce);
+		return sample_dir;
+	}
+
+	// check_spotlight: the part of the light that the cone lets through towards a vertex
+	static float check_spotlight(const MMRTLight& light, const float3& light_direction_ecs, const float3& vertex_to_light_direction_ecs)
+	{
+		if (!light.conical)
+			return 1.0f;
+		const float angle_vertex_spot_dir = dot(normalize(-vertex_to_light_direction_ecs), light_direction_ecs);
+		if (angle_vertex_spot_dir >= light.cosine_penumbra)
+			return 1.0f;
+		if (light.cosine_penumbra > angle_vertex_spot_dir && light.cosine_umbra < angle_vertex_spot_dir)
+			return powf((angle_vertex_spot_dir - light.cosine_umbra) / (light.cosine_penumbra - light.cosine_umbra), light.spotlight_exponent);
+		return 0.0f;
+	}
+
+	// store_color: blends the frame into the progressive average, with the sample count in w
+	static inline void storeColor(float4& stored_color, const float3& color, unsigned int frame)
+	{
+		const float  total_samples = (frame > 0) ? stored_color.w + 1.0f : 1.0f;
+		const float3 previous	   = (frame > 0) ? make_float3(stored_color) * stored_color.w : make_float3(0.0f);
+		stored_color = make_float4((color + previous) / total_samples, total_samples);
+	}
+
+	// [Rendering]
+
+	void MMRTTracer::renderAO(ThreadPool& thread_pool, Buffer& image, MMRTStatistics& statistics) const
+	{
+		const MMRTView&		view = m_views[MMRT_FACE_PRIMARY];
+		const unsigned int	samples_per_pixel = max(m_settings.samples_per_pixel, 1u);
+		image.resize(view.width, view.height);
+
+		vector<MMRTStatistics> thread_statistics(thread_pool.size());
+		MMRTStatistics frame_statistics;
+		unsigned int skipped_faces = 0;
+		for (unsigned int frame = 0; frame < m_settings.frames; ++frame)
+		{
+			const float time = m_settings.time + static_cast<float>(frame) * FRAME_TIME;
+			thread_pool.run(view.height, [&](unsigned int y, unsigned int thread)
+			{
+				MMRTStatistics& ray_statistics = thread_statistics[thread];
+				for (unsigned int x = 0; x < view.width; ++x)
+				{
+					float occlusion = 1.0f;
+					if (!isEmpty(x, y))
+					{
+						const float2 frag_coord = make_float2(x + 0.5f, y + 0.5f);
+						const SamplingSeed seed = { make_float2(frag_coord.x / view.width, frag_coord.y / view.height), static_cast<float>(frame), time };
+
+						// the front fragment, offset within the pixel for antialiasing over the frames
+						MMRTVertex current_vertex;
+						createVertex(frag_coord + seed.getPixelOffset(), getFrontFragment(x, y), MMRT_FACE_PRIMARY, current_vertex);
+						if (current_vertex.color.w <= AO_SKY_EMISSION)
+						{
+							float start_occlusion = 0.0f;
+							for (unsigned int i = 0; i < samples_per_pixel; i++)
+							{
+								const float r = rand1n(seed.get(static_cast<float>(i)));
+								float out_inv_pdf = 1.0f;
+								const float3 sample_dir = sampleUniformHemisphere(out_inv_pdf, current_vertex, seed, 1.0f);
+
+								MMRTVertex new_vertex;
+								const bool has_hit	 = trace(current_vertex.position, sample_dir, r * 0.5f + 0.5f, current_vertex.face, m_settings.ray_distance, new_vertex, ray_statistics, skipped_faces);
+								const bool hitSkybox = has_hit && new_vertex.color.w > AO_SKY_EMISSION;
+								start_occlusion += (has_hit && !hitSkybox) ? 0.0f : fmaxf(0.0f, dot(sample_dir, current_vertex.normal)) * out_inv_pdf;
+							}
+							const float total_occlusion = start_occlusion / static_cast<float>(samples_per_pixel);
+							occlusion = powf(total_occlusion * total_occlusion, 0.45f);
+						}
+					}
+					storeColor(image[make_uint2(x, y)], make_float3(occlusion), frame);
+				}
+			});
+			skipped_faces = getSkippedFaces(thread_statistics, frame_statistics);
+		}
+
+		for (size_t t = 0; t < thread_statistics.size(); ++t)
+			statistics += thread_statistics[t];
+	}
+
+	void MMRTTracer::renderPT(const MMRTLight& light, const Accel* shadower, float scene_epsilon, ThreadPool& thread_pool, Buffer& image, MMRTStatistics& statistics) const
+	{
+		const MMRTView&		view = m_views[MMRT_FACE_PRIMARY];
+		image.resize(view.width, view.height);
+
+		// the light uniforms are in the eye space of view 0
+		const float3 light_position_ecs	 = view.toEye(light.position);
+		const float3 light_direction_ecs = view.toEyeVector(light.direction);
+
+		// shadow: a ray to the light in place of the shadow map
+		auto shadow = [&](const float3& pecs) -> float
+		{
+			if (!shadower || !light.casts_shadow)
+				return 1.0f;
+			const float3 position = view.toWorld(pecs);
+			const float3 L		  = light.position - position;
+			const float	 distance = length(L);
+			return shadower->occluded(make_Ray(position, L / distance, SHADOW_RAY_TYPE, scene_epsilon, distance - scene_epsilon)) ? 0.0f : 1.0f;
+		};
+		// the direct lighting of a vertex, seen from prev_vertex_position
+		auto directLighting = [&](const MMRTVertex& vertex, const float3& prev_vertex_position) -> float3
+		{
+			float3		vertex_to_light_direction_ecs = light_position_ecs - vertex.position;
+			const float vertex_to_light_dist2		  = dot(vertex_to_light_direction_ecs, vertex_to_light_direction_ecs);
+			vertex_to_light_direction_ecs			  = normalize(vertex_to_light_direction_ecs);
+			const float spoteffect = check_spotlight(light, light_direction_ecs, vertex_to_light_direction_ecs);
+			const float in_shadow  = (spoteffect > 0.0f) ? shadow(vertex.position) * spoteffect : 0.0f;
+			if (in_shadow <= 0.0f)
+				return make_float3(0.0f);
+			const float3 vertex_to_prev_direction_ecs = normalize(prev_vertex_position - vertex.position);
+			const float3 brdf = Microfacet_Lambert_BSDF(vertex_to_light_direction_ecs, vertex_to_prev_direction_ecs, vertex);
+			return brdf * NdotL(vertex_to_light_direction_ecs, vertex) * in_shadow * light.color / vertex_to_light_dist2;
+		};
+
+		vector<MMRTStatistics> thread_statistics(thread_pool.size());
+		MMRTStatistics frame_statistics;
+		unsigned int skipped_faces = 0;
+		for (unsigned int frame = 0; frame < m_settings.frames; ++frame)
+		{
+			const float time = m_settings.time + static_cast<float>(frame) * FRAME_TIME;
+			thread_pool.run(view.height, [&](unsigned int y, unsigned int thread)
+			{
+				MMRTStatistics& ray_statistics = thread_statistics[thread];
+				for (unsigned int x = 0; x < view.width; ++x)
+				{
+					float3 final_color = m_settings.background;
+					if (!isEmpty(x, y))
+					{
+						const float2 frag_coord = make_float2(x + 0.5f, y + 0.5f);
+						const SamplingSeed seed = { make_float2(frag_coord.x / view.width, frag_coord.y / view.height), static_cast<float>(frame), time };
+
+						MMRTVertex current_vertex;
+						createVertex(frag_coord + seed.getPixelOffset(), getFrontFragment(x, y), MMRT_FACE_PRIMARY, current_vertex);
+						if (m_views.size() > 1)
+							current_vertex.face = MMRT_FACE_FRONT;
+
+						if (current_vertex.color.w > PT_SKY_EMISSION)
+							final_color = make_float3(current_vertex.color);
+						else
+						{
+							// direct lighting and emission from the camera
+							float3 prev_vertex_position_ecs = make_float3(0.0f);
+							final_color  = directLighting(current_vertex, prev_vertex_position_ecs);
+							final_color += make_float3(current_vertex.color) * current_vertex.color.w;
+
+							float3	point_transport_operators			  = make_float3(1.0f);
+							float	point_transport_inverse_probabilities = 1.0f;
+							bool	hitSkybox = false;
+							MMRTVertex new_vertex;
+							for (unsigned int bounce = 1; bounce <= m_settings.bounces; bounce++)
+							{
+								const float r = rand1n(seed.get(static_cast<float>(bounce)));
+								float current_vertex_to_next_inverse_probability = 1.0f;
+								const float3 sample_dir = sampleNDF(current_vertex_to_next_inverse_probability, prev_vertex_position_ecs, current_vertex, seed, static_cast<float>(bounce));
+
+								const bool has_hit = trace(current_vertex.position, sample_dir, r * 0.5f + 0.5f, current_vertex.face, 0.0f, new_vertex, ray_statistics, skipped_faces);
+								hitSkybox = has_hit && new_vertex.color.w > PT_SKY_EMISSION;
+								if (!has_hit || hitSkybox)
+									break;
+
+								// connect the current vertex to the new one
+								const float3 current_vertex_to_next_direction_ecs = normalize(new_vertex.position - current_vertex.position);
+								const float3 current_vertex_to_prev_direction_ecs = normalize(prev_vertex_position_ecs - current_vertex.position);
+								const float3 current_vertex_brdf = Microfacet_Lambert_BSDF(current_vertex_to_next_direction_ecs, current_vertex_to_prev_direction_ecs, current_vertex);
+								point_transport_operators			  *= current_vertex_brdf * getGeometricTerm(current_vertex_to_next_direction_ecs, current_vertex, new_vertex);
+								point_transport_inverse_probabilities *= current_vertex_to_next_inverse_probability;
+
+								// next event estimation and emission at the new vertex
+								float3 path_color = directLighting(new_vertex, current_vertex.position) * (M_PIf / 4.0f) * point_transport_operators * point_transport_inverse_probabilities;
+								path_color		 += point_transport_operators * point_transport_inverse_probabilities * make_float3(new_vertex.color) * new_vertex.color.w;
+								final_color		 += path_color;
+
+								prev_vertex_position_ecs = current_vertex.position;
+								current_vertex			 = new_vertex;
+							}
+
+							// the background, through the sky of a cubemap
+							if (m_views.size() > 1 && hitSkybox)
+							{
+								const float3 current_vertex_to_background_direction_ecs = normalize(new_vertex.position - current_vertex.position);
+								float geom = NdotL(current_vertex_to_background_direction_ecs, current_vertex);
+								geom = (dot(new_vertex.normal, -current_vertex_to_background_direction_ecs) < 0.0f) ? 0.0f : geom;
+								final_color += point_transport_operators * point_transport_inverse_probabilities * make_float3(current_vertex.color) * geom * m_settings.background;
+							}
+						}
+						final_color = clamp(final_color, 0.0f, 2.0f);
+					}
+					storeColor(image[make_uint2(x, y)], final_color, frame);
+				}
+			});
+			skipped_faces = getSkippedFaces(thread_statistics, frame_statistics);
+		}
+
+		for (size_t t = 0; t < thread_statistics.size(); ++t)
+			statistics += thread_statistics[t];
+	}
+}
@@ -0,0 +1,214 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// CPU reference of the MMRT tracing shaders of the demo (Shaders/Include/MMRT and
+// Shaders/Tracing/Fragment): hierarchical screen-space tracing through the bucketed,
+// double-linked A-buffers of one or seven views, and the MMRT_AO and MMRT_PT passes
+// on top of it, for validating shader changes and rendering without a GPU
+
+#pragma once
+
+#include "abuffer.h"
+#include "accel.h"
+#include "context.h"
+#include "depth_bounds.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace cpu
+{
+	// The A-buffer of an MMRT view: the head and tail images of its buckets, the
+	// NodeTypeLL_Double ID buffer and the NodeTypeData buffer, as MMRT_Store and
+	// MMRT_Reorder leave them
+	typedef LinkedListABuffer<true, FL_DECOUPLED>	MMRTABuffer;
+
+	// The sorted buckets of an MMRT view compacted after MMRT_Reorder, S-buffer style: the
+	// fragments of every bucket lie contiguously, front to back, in SoA arrays without the
+	// next and prev links, so that a search reads the depths of a bucket in sequence, in
+	// either direction. The spans follow each other in pixel order, the buckets of a pixel
+	// together, so that one offset per bucket gives both its head and its count. Index 0
+	// stays the null fragment.
+	class MMRTBucketSpans
+	{
+	public:
+		typedef FragmentStorage<FL_SOA, 0>	Storage;
+
+		MMRTBucketSpans() : m_width(0), m_buckets(1) {}
+
+		// Copies the lists of every bucket of a resolved A-buffer, in their order
+		void	build(const MMRTABuffer& abuffer, ThreadPool& thread_pool);
+
+		// bucket b of pixel (x, y) is [getBegin, getEnd)
+		unsigned int	getBegin(unsigned int x, unsigned int y, unsigned int b) const	{ return m_offsets[getSpan(x, y, b)]; }
+		unsigned int	getEnd(unsigned int x, unsigned int y, unsigned int b) const	{ return m_offsets[getSpan(x, y, b) + 1]; }
+		unsigned int	getBuckets(void) const	{ return m_buckets; }
+		const Storage&	getNodes(void) const	{ return m_nodes; }
+		size_t			memoryUsage(void) const	{ return m_offsets.capacity() * sizeof(unsigned int) + m_nodes.memoryUsage(); }
+
+	private:
+		unsigned int				m_width;
+		unsigned int				m_buckets;
+		std::vector<unsigned int>	m_offsets;	// of every span, and the end of the last
+		Storage						m_nodes;
+
+		size_t	getSpan(unsigned int x, unsigned int y, unsigned int b) const { return (static_cast<size_t>(y) * m_width + x) * m_buckets + b; }
+	};
+
+	// View indices of the shaders: the primary view, followed by the cube faces around
+	// its eye in the order of the ABC_ face constants
+	enum MMRTFace
+	{
+		MMRT_FACE_PRIMARY = 0,
+		MMRT_FACE_FRONT,
+		MMRT_FACE_BACK,
+		MMRT_FACE_LEFT,
+		MMRT_FACE_RIGHT,
+		MMRT_FACE_BOTTOM,
+		MMRT_FACE_TOP,
+		MMRT_MAX_FACES
+	};
+
+	// The <tracing> attributes of the demo .scene files and the shader defines they set
+	struct MMRTSettings
+	{
+		unsigned int	faces;				// NUM_FACES, 1 for "single" or MMRT_MAX_FACES for "cubemap"
+		unsigned int	face_resolution;	// width and height of the cube faces, 0 for the height of the primary view
+		float			near_plane;			// uniform_near_far of all views
+		float			far_plane;			// 0 for the scene length
+		float			thickness;			// THICKNESS, of every fragment behind its depth
+		float			ray_distance;		// RAY_DISTANCE of MMRT_AO, 0 for UNLIMITED_RAY_DISTANCE
+		unsigned int	samples_per_pixel;	// SAMPLES_PER_PIXEL of MMRT_AO, per frame
+		unsigned int	bounces;			// BOUNCES of MMRT_PT
+		unsigned int	frames;				// progressive frames blended into the image, uniform_progressive_sample 0, 1...
+		float			time;				// uniform_time of the first frame; later frames add 1/60 s each
+		float3			background;			// uniform_background_color of MMRT_PT
+		ABufferSettings	abuffer;			// buckets, max_layers and the node buffer of every view
+		bool			compact_buckets;	// trace MMRTBucketSpans rather than the linked lists of the shaders
+		bool			schedule_faces;		// pick the next cube face from the exit edge and direction, or test them in order
+		float			skip_faces;			// fraction of the rays of a frame below which a face is skipped in the next, 0 for none
+
+		MMRTSettings() : faces(MMRT_MAX_FACES), face_resolution(0), near_plane(0.1f), far_plane(0.0f), thickness(0.1f), ray_distance(1.0f),
+			samples_per_pixel(1), bounces(1), frames(1), time(0.5f), background(optix::make_float3(0.0f)), compact_buckets(true),
+			schedule_faces(true), skip_faces(0.0f) {}
+	};
+
+	// The spotlight uniforms of MMRT_PT, in world space
+	struct MMRTLight
+	{
+		float3	position;
+		float3	direction;
+		float3	color;					// intensity, divided by the squared distance
+		bool	conical;
+		float	cosine_umbra;
+		float	cosine_penumbra;
+		float	spotlight_exponent;
+		bool	casts_shadow;
+	};
+
+	// A point light of the CPU backend as a spotlight: conical lights have a hard edge at
+	// their cone angle, and the color is scaled by the flux
+	MMRTLight	makeMMRTLight(const BasicLight& light);
+
+	// Vertex of MMRT_vertex.glsl, in the eye space of view 0
+	struct MMRTVertex
+	{
+		float3	position;
+		float3	normal;
+		float4	color;			// albedo, and the emission in a
+		float	reflectivity;
+		float	roughness;
+		float	metal;
+		float	ior;
+		float	opacity;
+		int		face;
+	};
+
+	// Per-thread counters of MMRTTracer, summed over a render
+	struct MMRTStatistics
+	{
+		unsigned long long	rays;			// traceScreenSpaceRay_abuffer calls
+		unsigned long long	hits;
+		unsigned long long	faces;			// traceScreenSpaceRay_abuffer_cube calls
+		unsigned long long	searches;		// ray_hit_a_buffer_search calls
+		unsigned long long	buckets;		// non-empty buckets walked by the searches
+		unsigned long long	fragments;		// nodes visited by the searches
+		unsigned long long	frustum_tests;	// of the faces a ray might continue in
+		unsigned long long	skipped;		// rays that ended at a skipped face
+		unsigned long long	entries[MMRT_MAX_FACES];	// rays that entered each view, or would have had it not been skipped
+
+		MMRTStatistics() : rays(0), hits(0), faces(0), searches(0), buckets(0), fragments(0), frustum_tests(0), skipped(0) { std::fill(entries, entries + MMRT_MAX_FACES, 0ull); }
+		MMRTStatistics&	operator+=(const MMRTStatistics& other);
+	};
+
+	// One view of the multiview structure: its camera, projection and A-buffer
+	struct MMRTView
+	{
+		RasterCamera	camera;
+		float			far_plane;
+		unsigned int	width, height;
+		float3			axis_x, axis_y, axis_z;		// eye space: x along U, y along V, z against W
+		float			tan_x, tan_y;				// half extents of the image plane at unit depth
+
+		std::unique_ptr<MMRTABuffer>	abuffer;
+		// with MMRTSettings::compact_buckets, the fragments of the A-buffer, whose lists
+		// are then released; its depth bounds stay
+		MMRTBucketSpans					spans;
+
+		float3	toEye(const float3& p) const		{ const float3 d = p - camera.eye; return make_float3(dot(d, axis_x), dot(d, axis_y), dot(d, axis_z)); }
+		float3	toEyeVector(const float3& v) const	{ return make_float3(dot(v, axis_x), dot(v, axis_y), dot(v, axis_z)); }
+		float3	toWorld(const float3& p) const		{ return camera.eye + toWorldVector(p); }
+		float3	toWorldVector(const float3& v) const { return axis_x * v.x + axis_y * v.y + axis_z * v.z; }
+	};
+
+	class MMRTTracer
+	{
+	public:
+		explicit MMRTTracer(const MMRTSettings& settings) : m_settings(settings), m_scene_length(0.0f) {}
+
+		// Sets up the views around the camera, rasterizes the A-buffer of each (MMRT_Store
+		// and MMRT_Reorder), compacts their buckets with MMRTSettings::compact_buckets and
+		// builds their depth-bounds pyramids. Cube faces look along the axes of the camera,
+		// with a 90 degree field of view. Calling it again for the next frame of an
+		// animation, with views of the same size, reduces only the tiles of the pyramids
+		// whose depth bounds changed.
+		void	build(const TriangleMesh& mesh, const RasterCamera& camera, unsigned int width, unsigned int height, float scene_length, ThreadPool& thread_pool);
+
+		// traceScreenSpaceRay_abuffer: traces a ray given in the eye space of view 0 from
+		// view face, and through the unused cube faces it enters, and returns the vertex it
+		// hits. remaining_distance is 0 for UNLIMITED_RAY_DISTANCE. A ray that would enter
+		// a face of the skipped_faces mask, bit f for face f, ends there without a hit.
+		bool	trace(const float3& origin, const float3& direction, float jitter, int face, float remaining_distance, MMRTVertex& vertex, MMRTStatistics& statistics,
+					unsigned int skipped_faces = 0) const;
+
+		// MMRT_AO and MMRT_PT over frames progressive samples; pixel (x, y) of the image
+		// is gl_FragCoord (x + 0.5, y + 0.5) of the primary view. Shadows of MMRT_PT are
+		// traced through shadower, as the CPU backend has no shadow map; null lights every
+		// point inside the spotlight. With MMRTSettings::skip_faces, each frame skips the
+		// cube faces that few of the rays of the frame before entered.
+		void	renderAO(ThreadPool& thread_pool, Buffer& image, MMRTStatistics& statistics) const;
+		void	renderPT(const MMRTLight& light, const Accel* shadower, float scene_epsilon, ThreadPool& thread_pool, Buffer& image, MMRTStatistics& statistics) const;
+
+		const MMRTView&	getView(unsigned int face) const { return m_views[face]; }
+		unsigned int	getViewCount(void) const		 { return static_cast<unsigned int>(m_views.size()); }
+		const DepthBoundsPyramid&	getDepthBounds(void) const { return m_depth_bounds; }
+		size_t			memoryUsage(void) const;
+
+	private:
+		MMRTSettings			m_settings;
+		std::vector<MMRTView>	m_views;
+		float					m_scene_length;		// uniform_scene_length
+		DepthBoundsPyramid		m_depth_bounds;		// of all views
+		int						m_neighbors[MMRT_MAX_FACES][4];	// cube face across each VIEWPORT_EXIT_ edge, -1 for the primary view
+
+		void	buildDepthBounds(ThreadPool& thread_pool);
+
+		int		search(int face, int x, int y, float minZ, float maxZ, int increment, float divstep, int lod, MMRTStatistics& statistics) const;
+		int		traceFace(const float3& origin, const float3& direction, int iteration, float* remaining_distance, float jitter, int face,
+					float3& new_hitpoint, int& viewport_exit, MMRTVertex& vertex, MMRTStatistics& statistics) const;
+		int		getCubeFace(const float3& direction) const;
+		unsigned int	getSkippedFaces(const std::vector<MMRTStatistics>& thread_statistics, MMRTStatistics& before) const;
+		void	createVertex(const float2& coords, unsigned int id, int face, MMRTVertex& vertex) const;
+		bool	isEmpty(int x, int y) const;
+		unsigned int	getFrontFragment(int x, int y) const;
+	};
+}
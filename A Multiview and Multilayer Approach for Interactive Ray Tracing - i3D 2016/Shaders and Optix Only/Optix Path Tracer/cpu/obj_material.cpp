@@ -0,0 +1,36 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host port of the material programs in cuda/obj_material.cu
+
+#include "phong.h"
+
+using namespace optix;
+
+namespace cpu
+{
+	void any_hit_shadow(PerRayData_shadow& prd)
+	{
+		path_tracingShadowed(prd);
+	}
+
+	void closest_hit_radiance(const Context& context, const Ray& ray, float t_hit, const Attributes& attributes, PerRayData_radiance& prd)
+	{
+		const ObjMaterial& material		= context.mesh->materials[attributes.material];
+
+		float3 direction				= ray.direction;
+		float3 world_shading_normal		= attributes.shading_normal;
+		float3 world_geometric_normal	= attributes.geometric_normal;
+		float3 ffnormal					= faceforward(world_shading_normal, -direction, world_geometric_normal);
+		float3 uv						= attributes.texcoord;
+		float3 black					= make_float3(0.0f, 0.0f, 0.0f);
+
+		// grab values from textures
+		// support only MTL illumination modes 0-3 (Ks is for now used as reflectivity)
+		float3 Kd = make_float3(tex2D(material.diffuse_map, uv.x, uv.y));
+		float3 Ka = (material.illum < 1) ? black : make_float3(tex2D(material.ambient_map, uv.x, uv.y));
+		float3 Ks = (material.illum < 2) ? black : make_float3(tex2D(material.specular_map, uv.x, uv.y));
+		float3 Kr = (material.illum < 3) ? black : Ks;
+
+		path_tracingShade(context, ray, t_hit, prd, ffnormal, Ka, Kd, Ks, Kr, material.phong_exp);
+	}
+}
@@ -0,0 +1,111 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host port of the shading routines in cuda/phong.h
+
+#pragma once
+
+#include "context.h"
+#include "../cuda/random.h"
+
+namespace cpu
+{
+	//
+	// Terminates and fully attenuates ray after any hit
+	//
+	inline void path_tracingShadowed(PerRayData_shadow& prd_shadow)
+	{
+		prd_shadow.inShadow = true;
+	}
+
+	inline void path_tracingShade(const Context& context,
+		const Ray& ray,
+		float t_hit,
+		PerRayData_radiance& prd_radiance,
+		float3 p_normal,
+		float3 p_Ka,
+		float3 p_Kd,
+		float3 /*p_Ks*/,
+		float3 /*p_reflectivity*/,
+		float  /*p_phong_exp*/)
+	{
+		// [3D Hit Point]
+		float3 hit_point = ray.origin + t_hit * ray.direction;
+
+		// [Shading for each ray]
+		float3 result = p_Ka * context.ambient_light_color;
+		// [Light Selection] one light per hit point, chosen in proportion to its power
+		if (!context.lights.empty())
+		{
+			const unsigned int num_lights = static_cast<unsigned int>(context.lights.size());
+			const float		   u		  = rnd(prd_radiance.seed) * num_lights;
+			const unsigned int slot		  = std::min(static_cast<unsigned int>(u), num_lights - 1);
+			const unsigned int i		  = (u - slot < context.light_alias_table[slot].probability) ? slot : context.light_alias_table[slot].alias;
+			const BasicLight& light = context.lights[i];
+
+			float  Latt;
+			float  Ldist = DEFAULT_MAX;
+			float3 L, Lpos = make_float3(light.pos.x, light.pos.y, light.pos.z);
+
+			if (light.pos.w == 0.0f) // A. Directional light
+			{
+				L	 = normalize(Lpos); Latt = 1.0f;
+			}
+			else 					 // B. Point light
+			{
+				L	  = normalize(Lpos - hit_point);
+				Ldist = length(Lpos - hit_point);
+				Latt  = 1.0f / (Ldist*Ldist);
+
+				//cone restrictions (affects attenuation)
+				float lightToSurfaceAngle = degrees(acosf(dot(-L, normalize(light.coneTarget - Lpos))));
+				if (lightToSurfaceAngle > light.coneAngle)
+					Latt = 0.0f;
+			}
+
+			float diffuseCoefficient = dot(p_normal, L);
+			if (Latt > 0.0f && diffuseCoefficient > 0.0f)
+			{
+				// [Cast Shadow Ray]
+				PerRayData_shadow shadow_prd;
+				shadow_prd.inShadow = false;
+				if (light.casts_shadow)
+				{
+					Ray shadow_ray = make_Ray(hit_point, L, context.pt.shadow_ray_type, context.scene_epsilon, Ldist);
+					trace(context, shadow_ray, shadow_prd);
+					prd_radiance.num_rays++;
+				}
+
+				// If not completely shadowed, light the hit point
+				if (!shadow_prd.inShadow)
+				{
+					// [Light Color]
+					float3 Lc = Latt * light.flux * light.color / context.light_alias_table[i].pdf;
+
+					// [Diffuse Color]
+					float3 diffuse = (p_Kd / M_PIf) * diffuseCoefficient;
+
+					// [Final Color]
+					result += diffuse * Lc;
+				}
+			}
+		}
+
+		// [New direction]
+		{
+			float3 p;
+			float z1 = rnd(prd_radiance.seed);
+			float z2 = rnd(prd_radiance.seed);
+			cosine_sample_hemisphere(z1, z2, p);
+
+			float3 v1, v2;
+			createONB(p_normal, v1, v2);
+
+			prd_radiance.origin = hit_point;
+			prd_radiance.direction = v1 * p.x + v2 * p.y + p_normal * p.z;
+			prd_radiance.attenuation *= p_Kd; // use the diffuse_color as the diffuse response
+		}
+
+		// pass the color back up the tree
+		prd_radiance.radiance = result;
+	}
+}
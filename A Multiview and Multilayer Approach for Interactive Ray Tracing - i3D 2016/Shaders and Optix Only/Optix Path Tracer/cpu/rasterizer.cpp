@@ -0,0 +1,144 @@
+#include "rasterizer.h"
+
+#include <cmath>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const unsigned int	SETUP_BATCH_SIZE = 4096;
+	// Clipped vertices stay within this many pixels of the viewport, so that the 24.8
+	// fixed-point edge functions cannot overflow
+	static const float			GUARD_BAND		 = 8192.0f;
+
+	// Eye-space vertex: x and y in units of U and V, w along W, so that the viewport spans
+	// [-w, w] on both axes
+	struct ClipVertex
+	{
+		float x, y, w;
+	};
+
+	// Sutherland-Hodgman against the half-space where dot((x, y, w, 1), plane) >= 0
+	static int clipPolygon(const ClipVertex* in, int count, const float4& plane, ClipVertex* out)
+	{
+		int result = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const ClipVertex& p = in[i];
+			const ClipVertex& q = in[(i + 1) % count];
+			const float dp = p.x * plane.x + p.y * plane.y + p.w * plane.z + plane.w;
+			const float dq = q.x * plane.x + q.y * plane.y + q.w * plane.z + plane.w;
+			if (dp >= 0.0f)
+				out[result++] = p;
+			if ((dp >= 0.0f) != (dq >= 0.0f))
+			{
+				const float t = dp / (dp - dq);
+				ClipVertex v = { p.x + t * (q.x - p.x), p.y + t * (q.y - p.y), p.w + t * (q.w - p.w) };
+				out[result++] = v;
+			}
+		}
+		return result;
+	}
+
+	void Rasterizer::setup(const TriangleMesh& mesh, const RasterCamera& camera, unsigned int width, unsigned int height, ThreadPool& thread_pool)
+	{
+		m_width  = width;
+		m_height = height;
+
+		const float3 inv_U	 = camera.U / dot(camera.U, camera.U);
+		const float3 inv_V	 = camera.V / dot(camera.V, camera.V);
+		const float3 inv_W	 = camera.W / dot(camera.W, camera.W);
+		const float	 w_scale = length(camera.W);			// eye-space depth per unit of w
+		const float	 near_w	 = camera.near / w_scale;
+		const float	 guard_x = 1.0f + 2.0f * GUARD_BAND / width;
+		const float	 guard_y = 1.0f + 2.0f * GUARD_BAND / height;
+
+		const float4 planes[5] =
+		{
+			make_float4( 0.0f,  0.0f, 1.0f,	  -near_w),
+			make_float4(-1.0f,  0.0f, guard_x, 0.0f),
+			make_float4( 1.0f,  0.0f, guard_x, 0.0f),
+			make_float4( 0.0f, -1.0f, guard_y, 0.0f),
+			make_float4( 0.0f,  1.0f, guard_y, 0.0f)
+		};
+
+		const unsigned int num_prims   = mesh.size();
+		const unsigned int num_batches = (num_prims + SETUP_BATCH_SIZE - 1) / SETUP_BATCH_SIZE;
+		vector<vector<RasterTriangle> > batches(num_batches);
+		thread_pool.run(num_batches, [&](unsigned int batch, unsigned int)
+		{
+			vector<RasterTriangle>& triangles = batches[batch];
+			const unsigned int end = min(num_prims, (batch + 1) * SETUP_BATCH_SIZE);
+			for (unsigned int prim = batch * SETUP_BATCH_SIZE; prim < end; ++prim)
+			{
+				const int3 v_idx = mesh.vindex_buffer[prim];
+				ClipVertex polygon[2][8];
+				for (int i = 0; i < 3; ++i)
+				{
+					const float3 p = mesh.vertex_buffer[(&v_idx.x)[i]] - camera.eye;
+					ClipVertex v = { dot(p, inv_U), dot(p, inv_V), dot(p, inv_W) };
+					polygon[0][i] = v;
+				}
+
+				int count = 3, current = 0;
+				for (int p = 0; p < 5 && count >= 3; ++p)
+				{
+					count	= clipPolygon(polygon[current], count, planes[p], polygon[1 - current]);
+					current = 1 - current;
+				}
+				if (count < 3)
+					continue;
+
+				// snap to the viewport
+				int	  sx[8], sy[8];
+				float inv_z[8];
+				for (int i = 0; i < count; ++i)
+				{
+					const ClipVertex& v = polygon[current][i];
+					const float inv_w = 1.0f / v.w;
+					sx[i]	 = static_cast<int>(floorf((v.x * inv_w + 1.0f) * 0.5f * width  * 256.0f + 0.5f));
+					sy[i]	 = static_cast<int>(floorf((v.y * inv_w + 1.0f) * 0.5f * height * 256.0f + 0.5f));
+					inv_z[i] = inv_w / w_scale;
+				}
+
+				// fan triangulation of the clipped polygon
+				for (int i = 1; i + 1 < count; ++i)
+				{
+					int order[3] = { 0, i, i + 1 };
+					const long long area = static_cast<long long>(sx[order[1]] - sx[order[0]]) * (sy[order[2]] - sy[order[0]]) -
+										   static_cast<long long>(sy[order[1]] - sy[order[0]]) * (sx[order[2]] - sx[order[0]]);
+					if (area == 0)
+						continue;
+					if (area < 0)
+						swap(order[1], order[2]);
+
+					RasterTriangle t;
+					int min_x = sx[order[0]], max_x = min_x, min_y = sy[order[0]], max_y = min_y;
+					for (int k = 0; k < 3; ++k)
+					{
+						t.x[k]	   = sx[order[k]];
+						t.y[k]	   = sy[order[k]];
+						t.inv_z[k] = inv_z[order[k]];
+						min_x = min(min_x, t.x[k]);	max_x = max(max_x, t.x[k]);
+						min_y = min(min_y, t.y[k]);	max_y = max(max_y, t.y[k]);
+					}
+
+					// pixel centers lie at 256 * p + 128
+					t.min_x = max(0, -static_cast<int>(floorDivide(128 - min_x, 256)));
+					t.min_y = max(0, -static_cast<int>(floorDivide(128 - min_y, 256)));
+					t.max_x = min(static_cast<int>(width) - 1,  static_cast<int>(floorDivide(max_x - 128, 256)));
+					t.max_y = min(static_cast<int>(height) - 1, static_cast<int>(floorDivide(max_y - 128, 256)));
+					if (t.min_x > t.max_x || t.min_y > t.max_y)
+						continue;
+					t.prim = prim;
+					triangles.push_back(t);
+				}
+			}
+		});
+
+		m_triangles.clear();
+		for (size_t b = 0; b < batches.size(); ++b)
+			m_triangles.insert(m_triangles.end(), batches[b].begin(), batches[b].end());
+	}
+}
@@ -0,0 +1,139 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Software triangle rasterizer of the CPU backend, the counterpart of the GL geometry passes
+// that generate the fragments of the A-buffer shaders in GLSL/A-Buffer Shaders
+
+#pragma once
+
+#include "thread_pool.h"
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <vector>
+
+namespace cpu
+{
+	// Pinhole view of the rasterizer, in the convention of Context::camera: pixel (x, y) of a
+	// width x height viewport looks along d.x*U + d.y*V + W, with d in [-1, 1] over the
+	// viewport and y pointing up. U, V and W must be orthogonal.
+	struct RasterCamera
+	{
+		float3	eye, U, V, W;
+		float	near;			// eye-space distance of the near clipping plane
+	};
+
+	// A triangle after clipping, in screen space. Vertices are snapped to 1/256 of a pixel
+	// and ordered counter-clockwise; the coverage test is exact, so a pixel center on an
+	// edge shared by two triangles belongs to exactly one of them.
+	struct RasterTriangle
+	{
+		int				x[3], y[3];		// 24.8 fixed-point
+		float			inv_z[3];		// reciprocal eye-space depth, interpolated linearly in screen space
+		int				min_x, min_y;	// pixels whose centers the bounding box covers, clamped to the viewport
+		int				max_x, max_y;
+		unsigned int	prim;			// index into the mesh
+	};
+
+	class Rasterizer
+	{
+	public:
+		Rasterizer() : m_width(0), m_height(0) {}
+
+		// Transforms, clips and snaps the triangles of the mesh. Triangles are not culled by
+		// orientation, as the A-buffer passes render both sides.
+		void	setup(const TriangleMesh& mesh, const RasterCamera& camera, unsigned int width, unsigned int height, ThreadPool& thread_pool);
+
+		// Invokes shader(x, y, pecsZ, prim) for every pixel center covered by every triangle,
+		// where pecsZ is the negative eye-space depth, as in the GLSL fragment shaders.
+		// Triangles are shaded concurrently in no particular order, so shaders that write
+		// shared pixels must use atomics, as on the GPU.
+		template<typename Shader>
+		void	rasterize(ThreadPool& thread_pool, const Shader& shader) const;
+
+		unsigned int	width(void) const  { return m_width; }
+		unsigned int	height(void) const { return m_height; }
+		size_t			getTriangleCount(void) const { return m_triangles.size(); }
+
+	private:
+		enum { BATCH_SIZE = 64 };
+
+		unsigned int				m_width;
+		unsigned int				m_height;
+		std::vector<RasterTriangle>	m_triangles;
+
+		template<typename Shader>
+		static void	rasterizeTriangle(const RasterTriangle& triangle, const Shader& shader);
+	};
+
+	template<typename Shader>
+	void Rasterizer::rasterize(ThreadPool& thread_pool, const Shader& shader) const
+	{
+		const unsigned int num_triangles = static_cast<unsigned int>(m_triangles.size());
+		thread_pool.run((num_triangles + BATCH_SIZE - 1) / BATCH_SIZE, [&](unsigned int batch, unsigned int)
+		{
+			const unsigned int end = std::min(num_triangles, (batch + 1) * static_cast<unsigned int>(BATCH_SIZE));
+			for (unsigned int i = batch * BATCH_SIZE; i < end; ++i)
+				rasterizeTriangle(m_triangles[i], shader);
+		});
+	}
+
+	static inline long long floorDivide(long long a, long long b)
+	{
+		const long long q = a / b;
+		return (q * b != a && ((a < 0) != (b < 0))) ? q - 1 : q;
+	}
+
+	// Edge i runs from vertex i+1 to vertex i+2 and is 0 at vertex i+1, 2 * area at vertex i
+	// and positive inside. It is evaluated as a*x + b*y + c at the center of pixel (x, y);
+	// edges that are not left or bottom edges subtract 1, so that ties on them fail.
+	template<typename Shader>
+	void Rasterizer::rasterizeTriangle(const RasterTriangle& t, const Shader& shader)
+	{
+		long long a[3], b[3], c[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const int j = (i + 1) % 3, k = (i + 2) % 3;
+			const long long dx = static_cast<long long>(t.x[k]) - t.x[j];
+			const long long dy = static_cast<long long>(t.y[k]) - t.y[j];
+			a[i] = -dy * 256;
+			b[i] =  dx * 256;
+			c[i] = dx * (128 - t.y[j]) - dy * (128 - t.x[j]);
+			if (!(dy < 0 || (dy == 0 && dx > 0)))
+				c[i] -= 1;
+		}
+		const double area = static_cast<double>(static_cast<long long>(t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) -
+												static_cast<long long>(t.y[1] - t.y[0]) * (t.x[2] - t.x[0]));
+
+		// 1/z as a plane over pixel coordinates
+		double dzdx = 0.0, dzdy = 0.0, z0 = 0.0;
+		for (int i = 0; i < 3; ++i)
+		{
+			dzdx += a[i] * static_cast<double>(t.inv_z[i]);
+			dzdy += b[i] * static_cast<double>(t.inv_z[i]);
+			z0	 += c[i] * static_cast<double>(t.inv_z[i]);
+		}
+		dzdx /= area; dzdy /= area; z0 /= area;
+
+		for (int y = t.min_y; y <= t.max_y; ++y)
+		{
+			// the covered span of the row, solved per edge
+			long long lo = t.min_x, hi = t.max_x;
+			for (int i = 0; i < 3; ++i)
+			{
+				const long long r = b[i] * y + c[i];
+				if (a[i] > 0)
+					lo = std::max(lo, -floorDivide(r, a[i]));
+				else if (a[i] < 0)
+					hi = std::min(hi, floorDivide(r, -a[i]));
+				else if (r < 0)
+					hi = lo - 1;
+			}
+
+			const double row_z = z0 + dzdy * y;
+			for (long long x = lo; x <= hi; ++x)
+			{
+				const float pecsZ = static_cast<float>(-1.0 / (row_z + dzdx * static_cast<double>(x)));
+				shader(static_cast<unsigned int>(x), static_cast<unsigned int>(y), pecsZ, t.prim);
+			}
+		}
+	}
+}
@@ -0,0 +1,354 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// Spatial split BVH, after M. Stich, H. Friedrich and A. Dietrich, "Spatial Splits
+	// in Bounding Volume Hierarchies", HPG 2009. A primitive may be referenced by more
+	// than one leaf, each reference bounding only the part of the triangle inside it.
+
+	static const int			SBVH_BINS		= 32;
+	static const unsigned int	MAX_LEAF_SIZE	= 8;
+	static const int			MAX_DEPTH		= 48;		// keeps traversal within its stack
+	static const float			SPLIT_ALPHA		= 1.e-5f;	// overlap, relative to the root area, that enables spatial splits
+
+	struct Reference
+	{
+		Aabb			bounds;
+		unsigned int	prim;
+	};
+
+	struct SbvhTask
+	{
+		unsigned int		node;
+		int					depth;
+		vector<Reference>	refs;
+	};
+
+	struct SbvhSplit
+	{
+		float	cost;
+		int		axis;
+		float	position;		// spatial splits: plane position
+		int		bin;			// object splits: last bin on the left
+		Aabb	left_bounds;
+		Aabb	right_bounds;
+		unsigned int left_count;
+		unsigned int right_count;
+	};
+
+	static inline float cost(const Aabb& left, unsigned int left_count, const Aabb& right, unsigned int right_count)
+	{
+		return (left_count ? left.area() * left_count : 0.0f) + (right_count ? right.area() * right_count : 0.0f);
+	}
+
+	// Clips the triangle of ref against the plane and bounds each side with its part of the triangle
+	static void splitReference(const TriangleMesh& mesh, const Reference& ref, int axis, float position, Reference& left, Reference& right)
+	{
+		left.prim = right.prim = ref.prim;
+		left.bounds.invalidate();
+		right.bounds.invalidate();
+
+		const int3 v_idx = mesh.vindex_buffer[ref.prim];
+		const float3 v[3] = { mesh.vertex_buffer[v_idx.x], mesh.vertex_buffer[v_idx.y], mesh.vertex_buffer[v_idx.z] };
+		for (int i = 0; i < 3; ++i)
+		{
+			const float3& v0 = v[i];
+			const float3& v1 = v[(i + 1) % 3];
+			const float p0 = component(v0, axis);
+			const float p1 = component(v1, axis);
+			if (p0 <= position) left.bounds.include(v0);
+			if (p0 >= position) right.bounds.include(v0);
+			if ((p0 < position && p1 > position) || (p0 > position && p1 < position))
+			{
+				float3 t = lerp(v0, v1, clamp((position - p0) / (p1 - p0), 0.0f, 1.0f));
+				left.bounds.include(t);
+				right.bounds.include(t);
+			}
+		}
+		component(left.bounds.m_max, axis)  = position;
+		component(right.bounds.m_min, axis) = position;
+		left.bounds.intersection(ref.bounds);
+		right.bounds.intersection(ref.bounds);
+	}
+
+	static void findObjectSplit(const vector<Reference>& refs, const Aabb& centroid_bounds, SbvhSplit& split)
+	{
+		const unsigned int count = static_cast<unsigned int>(refs.size());
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float cmin   = component(centroid_bounds.m_min, axis);
+			const float extent = component(centroid_bounds.m_max, axis) - cmin;
+			if (extent <= 0.0f)
+				continue;
+			const float scale = SBVH_BINS / extent;
+
+			Aabb		 bin_bounds[SBVH_BINS];
+			unsigned int bin_count[SBVH_BINS] = { 0 };
+			for (size_t i = 0; i < refs.size(); ++i)
+			{
+				int b = min(SBVH_BINS - 1, static_cast<int>((component(refs[i].bounds.center(), axis) - cmin) * scale));
+				bin_bounds[b].include(refs[i].bounds);
+				bin_count[b]++;
+			}
+
+			Aabb		 right_bounds[SBVH_BINS];
+			Aabb		 right;
+			for (int b = SBVH_BINS - 1; b > 0; --b)
+			{
+				right.include(bin_bounds[b]);
+				right_bounds[b] = right;
+			}
+
+			Aabb		 left;
+			unsigned int left_count = 0;
+			for (int b = 0; b < SBVH_BINS - 1; ++b)
+			{
+				left.include(bin_bounds[b]);
+				left_count += bin_count[b];
+				if (left_count == 0 || left_count == count)
+					continue;
+				float c = cost(left, left_count, right_bounds[b + 1], count - left_count);
+				if (c < split.cost)
+				{
+					split.cost			= c;
+					split.axis			= axis;
+					split.bin			= b;
+					split.left_bounds	= left;
+					split.right_bounds	= right_bounds[b + 1];
+					split.left_count	= left_count;
+					split.right_count	= count - left_count;
+				}
+			}
+		}
+	}
+
+	static void findSpatialSplit(const TriangleMesh& mesh, const vector<Reference>& refs, const Aabb& bounds, SbvhSplit& split)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float bmin   = component(bounds.m_min, axis);
+			const float extent = component(bounds.m_max, axis) - bmin;
+			if (extent <= 0.0f)
+				continue;
+			const float scale	  = SBVH_BINS / extent;
+			const float bin_width = extent / SBVH_BINS;
+
+			// each reference is chopped into the bins it overlaps; entries and exits count
+			// the references starting and ending in each bin
+			Aabb		 bin_bounds[SBVH_BINS];
+			unsigned int bin_entry[SBVH_BINS] = { 0 };
+			unsigned int bin_exit[SBVH_BINS]  = { 0 };
+			for (size_t i = 0; i < refs.size(); ++i)
+			{
+				int first = max(0, min(SBVH_BINS - 1, static_cast<int>((component(refs[i].bounds.m_min, axis) - bmin) * scale)));
+				int last  = max(first, min(SBVH_BINS - 1, static_cast<int>((component(refs[i].bounds.m_max, axis) - bmin) * scale)));
+
+				Reference current = refs[i];
+				for (int b = first; b < last; ++b)
+				{
+					Reference left, right;
+					splitReference(mesh, current, axis, bmin + (b + 1) * bin_width, left, right);
+					bin_bounds[b].include(left.bounds);
+					current = right;
+				}
+				bin_bounds[last].include(current.bounds);
+				bin_entry[first]++;
+				bin_exit[last]++;
+			}
+
+			Aabb		 right_bounds[SBVH_BINS];
+			Aabb		 right;
+			for (int b = SBVH_BINS - 1; b > 0; --b)
+			{
+				right.include(bin_bounds[b]);
+				right_bounds[b] = right;
+			}
+
+			Aabb		 left;
+			unsigned int left_count	 = 0;
+			unsigned int right_count = static_cast<unsigned int>(refs.size());
+			for (int b = 0; b < SBVH_BINS - 1; ++b)
+			{
+				left.include(bin_bounds[b]);
+				left_count	+= bin_entry[b];
+				right_count	-= bin_exit[b];
+				if (left_count == 0 || right_count == 0)
+					continue;
+				float c = cost(left, left_count, right_bounds[b + 1], right_count);
+				if (c < split.cost)
+				{
+					split.cost			= c;
+					split.axis			= axis;
+					split.position		= bmin + (b + 1) * bin_width;
+					split.left_bounds	= left;
+					split.right_bounds	= right_bounds[b + 1];
+					split.left_count	= left_count;
+					split.right_count	= right_count;
+				}
+			}
+		}
+	}
+
+	// Distributes the references of a spatial split. Straddling references are split,
+	// unless moving them whole to one side is cheaper ("reference unsplitting").
+	static void performSpatialSplit(const TriangleMesh& mesh, vector<Reference>& refs, SbvhSplit& split,
+		vector<Reference>& left_refs, vector<Reference>& right_refs)
+	{
+		const int	axis	 = split.axis;
+		const float position = split.position;
+		Aabb		 left_bounds  = split.left_bounds,  right_bounds  = split.right_bounds;
+		unsigned int left_count	  = split.left_count,   right_count	  = split.right_count;
+
+		for (size_t i = 0; i < refs.size(); ++i)
+		{
+			const Reference& ref = refs[i];
+			if (component(ref.bounds.m_max, axis) <= position)
+				left_refs.push_back(ref);
+			else if (component(ref.bounds.m_min, axis) >= position)
+				right_refs.push_back(ref);
+			else
+			{
+				Reference left, right;
+				splitReference(mesh, ref, axis, position, left, right);
+
+				Aabb left_unsplit  = left_bounds;	left_unsplit.include(ref.bounds);
+				Aabb right_unsplit = right_bounds;	right_unsplit.include(ref.bounds);
+				const float split_cost = cost(left_bounds, left_count, right_bounds, right_count);
+				const float left_cost  = cost(left_unsplit, left_count, right_bounds, right_count - 1);
+				const float right_cost = cost(left_bounds, left_count - 1, right_unsplit, right_count);
+
+				if (!right.bounds.valid() || (left.bounds.valid() && left_cost < split_cost && left_cost <= right_cost))
+				{
+					left_refs.push_back(ref);
+					left_bounds = left_unsplit;
+					right_count--;
+					continue;
+				}
+				if (!left.bounds.valid() || right_cost < split_cost)
+				{
+					right_refs.push_back(ref);
+					right_bounds = right_unsplit;
+					left_count--;
+					continue;
+				}
+				left_refs.push_back(left);
+				right_refs.push_back(right);
+			}
+		}
+	}
+
+	void Bvh::buildSpatialSplits(const vector<Aabb>& prim_bounds)
+	{
+		const TriangleMesh& mesh = *m_mesh;
+
+		vector<unsigned int> prims;
+		prims.swap(m_prim_indices);
+
+		SbvhTask root;
+		root.node  = 0;
+		root.depth = 0;
+		root.refs.resize(prims.size());
+		Aabb root_bounds;
+		for (size_t i = 0; i < prims.size(); ++i)
+		{
+			root.refs[i].bounds = prim_bounds[i];
+			root.refs[i].prim	= prims[i];
+			root_bounds.include(prim_bounds[i]);
+		}
+		const float min_overlap = SPLIT_ALPHA * root_bounds.area();
+
+		m_nodes.reserve(2 * prims.size());
+		m_nodes.push_back(BvhNode());
+
+		vector<SbvhTask> tasks;
+		tasks.push_back(move(root));
+		while (!tasks.empty())
+		{
+			SbvhTask task = move(tasks.back());
+			tasks.pop_back();
+			vector<Reference>& refs = task.refs;
+			const unsigned int count = static_cast<unsigned int>(refs.size());
+
+			Aabb bounds, centroid_bounds;
+			for (size_t i = 0; i < refs.size(); ++i)
+			{
+				bounds.include(refs[i].bounds);
+				centroid_bounds.include(refs[i].bounds.center());
+			}
+			m_nodes[task.node].bmin = bounds.m_min;
+			m_nodes[task.node].bmax = bounds.m_max;
+
+			// leaf cost is count, a split costs one traversal step plus the weighted child costs
+			SbvhSplit object_split, spatial_split;
+			object_split.axis = spatial_split.axis = -1;
+			object_split.cost = spatial_split.cost = 1.e30f;
+			if (count > 2 && task.depth < MAX_DEPTH)
+			{
+				findObjectSplit(refs, centroid_bounds, object_split);
+
+				Aabb overlap = object_split.left_bounds;
+				overlap.intersection(object_split.right_bounds);
+				spatial_split.cost = object_split.cost;
+				if (object_split.axis < 0 || (overlap.valid() && overlap.area() > min_overlap))
+					findSpatialSplit(mesh, refs, bounds, spatial_split);
+			}
+
+			const float	inv_area  = 1.0f / max(bounds.area(), 1.e-30f);
+			const bool	use_spatial = spatial_split.axis >= 0;
+			const float best_cost = 1.0f + (use_spatial ? spatial_split.cost : object_split.cost) * inv_area;
+			const bool	has_split = use_spatial || object_split.axis >= 0;
+
+			vector<Reference> left_refs, right_refs;
+			if (has_split && (best_cost < count || count > MAX_LEAF_SIZE))
+			{
+				if (use_spatial)
+					performSpatialSplit(mesh, refs, spatial_split, left_refs, right_refs);
+				else
+				{
+					const int	axis  = object_split.axis;
+					const float cmin  = component(centroid_bounds.m_min, axis);
+					const float scale = SBVH_BINS / (component(centroid_bounds.m_max, axis) - cmin);
+					for (size_t i = 0; i < refs.size(); ++i)
+					{
+						int b = min(SBVH_BINS - 1, static_cast<int>((component(refs[i].bounds.center(), axis) - cmin) * scale));
+						(b <= object_split.bin ? left_refs : right_refs).push_back(refs[i]);
+					}
+				}
+			}
+			else if (count > MAX_LEAF_SIZE && task.depth < MAX_DEPTH)
+			{
+				// coincident centroids: halve the list
+				left_refs.assign(refs.begin(), refs.begin() + count / 2);
+				right_refs.assign(refs.begin() + count / 2, refs.end());
+			}
+
+			if (left_refs.empty() || right_refs.empty())
+			{
+				m_nodes[task.node].first = static_cast<unsigned int>(m_prim_indices.size());
+				m_nodes[task.node].count = count;
+				for (size_t i = 0; i < refs.size(); ++i)
+					m_prim_indices.push_back(refs[i].prim);
+				continue;
+			}
+
+			const unsigned int left_child = static_cast<unsigned int>(m_nodes.size());
+			m_nodes.push_back(BvhNode());
+			m_nodes.push_back(BvhNode());
+			m_nodes[task.node].first = left_child;
+			m_nodes[task.node].count = 0;
+
+			vector<Reference>().swap(refs);
+			SbvhTask right_task, left_task;
+			right_task.node = left_child + 1;	right_task.depth = task.depth + 1;	right_task.refs.swap(right_refs);
+			left_task.node	= left_child;		left_task.depth	 = task.depth + 1;	left_task.refs.swap(left_refs);
+			tasks.push_back(move(right_task));
+			tasks.push_back(move(left_task));
+		}
+	}
+}
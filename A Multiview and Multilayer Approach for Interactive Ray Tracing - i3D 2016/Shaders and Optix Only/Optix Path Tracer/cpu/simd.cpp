@@ -0,0 +1,111 @@
+#include "simd.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+namespace cpu
+{
+	static const char* SIMD_LEVEL_NAMES[] = { "scalar", "avx2", "avx512" };
+
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+		for (int i = 0; i < 4; ++i)
+			regs[i] = static_cast<unsigned int>(info[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// XCR0: register state the operating system saves on context switches
+	static unsigned long long xgetbv(void)
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+	}
+
+	SimdLevel detectSimdLevel(void)
+	{
+		unsigned int regs[4];
+		cpuid(0, 0, regs);
+		const unsigned int max_leaf = regs[0];
+		if (max_leaf < 7)
+			return SIMD_SCALAR;
+
+		// AVX and OSXSAVE, with the YMM state enabled
+		cpuid(1, 0, regs);
+		if ((regs[2] & (1u << 27)) == 0 || (regs[2] & (1u << 28)) == 0)
+			return SIMD_SCALAR;
+		const unsigned long long xcr0 = xgetbv();
+		if ((xcr0 & 0x6) != 0x6)
+			return SIMD_SCALAR;
+
+		cpuid(7, 0, regs);
+		if ((regs[1] & (1u << 5)) == 0)
+			return SIMD_SCALAR;
+
+		// AVX-512F, with the opmask and ZMM state enabled
+		if ((regs[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6)
+			return SIMD_AVX512;
+		return SIMD_AVX2;
+	}
+#else
+	SimdLevel detectSimdLevel(void)
+	{
+		return SIMD_SCALAR;
+	}
+#endif
+
+	static atomic<int> s_simd_level(-1);
+
+	SimdLevel getSimdLevel(void)
+	{
+		int level = s_simd_level.load(memory_order_relaxed);
+		if (level < 0)
+		{
+			level = detectSimdLevel();
+			s_simd_level.store(level, memory_order_relaxed);
+		}
+		return static_cast<SimdLevel>(level);
+	}
+
+	SimdLevel setSimdLevel(SimdLevel level)
+	{
+		const SimdLevel detected = detectSimdLevel();
+		if (level > detected)
+			level = detected;
+		s_simd_level.store(level, memory_order_relaxed);
+		return level;
+	}
+
+	const char* getSimdLevelName(SimdLevel level)
+	{
+		return SIMD_LEVEL_NAMES[level];
+	}
+
+	bool parseSimdLevel(const string& name, SimdLevel& level)
+	{
+		for (int i = SIMD_SCALAR; i <= SIMD_AVX512; ++i)
+			if (name == SIMD_LEVEL_NAMES[i])
+			{
+				level = static_cast<SimdLevel>(i);
+				return true;
+			}
+		return false;
+	}
+}
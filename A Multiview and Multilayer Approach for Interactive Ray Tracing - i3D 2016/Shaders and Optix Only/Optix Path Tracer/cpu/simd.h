@@ -0,0 +1,47 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Runtime selection of the vector instruction set used by the CPU traversal kernels
+
+#pragma once
+
+#include <string>
+
+// The AVX2/AVX-512 kernels are compiled per function, so that the rest of the backend
+// keeps the baseline instruction set and runs on any x86-64 processor
+#if defined(_MSC_VER)
+#define CPU_TARGET_AVX2
+#define CPU_TARGET_AVX512
+#else
+#define CPU_TARGET_AVX2		__attribute__((target("avx2")))
+#define CPU_TARGET_AVX512	__attribute__((target("avx512f,avx2")))
+#endif
+
+// Fully unrolls the loop that follows, for kernels whose registers are indexed by loop
+// counters with constant bounds and must not spill to memory
+#if defined(_MSC_VER)
+#define CPU_UNROLL
+#else
+#define CPU_UNROLL			_Pragma("GCC unroll 64")
+#endif
+
+namespace cpu
+{
+	enum SimdLevel
+	{
+		SIMD_SCALAR = 0,
+		SIMD_AVX2,
+		SIMD_AVX512
+	};
+
+	// Highest level supported by both the processor and the operating system
+	SimdLevel	detectSimdLevel(void);
+
+	// Level used by the kernels, the detected one unless lowered by setSimdLevel
+	SimdLevel	getSimdLevel(void);
+	// Clamped to the detected level; returns the level in effect
+	SimdLevel	setSimdLevel(SimdLevel level);
+
+	const char*	getSimdLevelName(SimdLevel level);
+	// "scalar", "avx2" or "avx512"; returns false for unknown names
+	bool		parseSimdLevel(const std::string& name, SimdLevel& level);
+}
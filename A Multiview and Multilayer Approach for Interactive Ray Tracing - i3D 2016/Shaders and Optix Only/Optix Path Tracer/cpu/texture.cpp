@@ -0,0 +1,183 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static string extension(const string& filename)
+	{
+		size_t dot = filename.find_last_of('.');
+		if (dot == string::npos)
+			return "";
+		string ext = filename.substr(dot + 1);
+		transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		return ext;
+	}
+
+	bool TextureSampler::load(const string& filename)
+	{
+		string ext = extension(filename);
+		if (ext == "tga")
+			return loadTGA(filename);
+		if (ext == "ppm")
+			return loadPPM(filename);
+		return false;
+	}
+
+	bool TextureSampler::loadTGA(const string& filename)
+	{
+		ifstream file(filename.c_str(), ios::binary);
+		if (!file)
+			return false;
+
+		unsigned char header[18];
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+			return false;
+
+		const unsigned char id_length	= header[0];
+		const unsigned char color_map	= header[1];
+		const unsigned char image_type	= header[2];
+		const unsigned int	width		= header[12] | (header[13] << 8);
+		const unsigned int	height		= header[14] | (header[15] << 8);
+		const unsigned int	bpp			= header[16] / 8;
+		const bool			top_down	= (header[17] & 0x20) != 0;
+
+		// 2: uncompressed true-color, 3: uncompressed grayscale, 10/11: RLE variants
+		const bool rle = image_type == 10 || image_type == 11;
+		if (color_map != 0 || (image_type != 2 && image_type != 3 && !rle))
+			return false;
+		if (width == 0 || height == 0 || (bpp != 1 && bpp != 3 && bpp != 4))
+			return false;
+		file.seekg(id_length, ios::cur);
+
+		vector<unsigned char> pixels(width * height * bpp);
+		if (!rle)
+		{
+			if (!file.read(reinterpret_cast<char*>(&pixels[0]), pixels.size()))
+				return false;
+		}
+		else
+		{
+			size_t written = 0;
+			unsigned char packet[4];
+			while (written < pixels.size())
+			{
+				int repetition = file.get();
+				if (repetition == EOF)
+					return false;
+				unsigned int count = (repetition & 0x7f) + 1;
+				if (written + count * bpp > pixels.size())
+					return false;
+				if (repetition & 0x80)
+				{
+					if (!file.read(reinterpret_cast<char*>(packet), bpp))
+						return false;
+					for (unsigned int i = 0; i < count; ++i, written += bpp)
+						copy(packet, packet + bpp, pixels.begin() + written);
+				}
+				else
+				{
+					if (!file.read(reinterpret_cast<char*>(&pixels[written]), count * bpp))
+						return false;
+					written += count * bpp;
+				}
+			}
+		}
+
+		shared_ptr<vector<uchar4> > texels(new vector<uchar4>(width * height));
+		for (unsigned int y = 0; y < height; ++y)
+		{
+			unsigned int row = top_down ? height - 1 - y : y;
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned char* p = &pixels[(y * width + x) * bpp];
+				uchar4& t = (*texels)[row * width + x];
+				if (bpp == 1)
+					t = make_uchar4(p[0], p[0], p[0], 255);
+				else	// stored as BGR(A)
+					t = make_uchar4(p[2], p[1], p[0], bpp == 4 ? p[3] : 255);
+			}
+		}
+		m_width  = width;
+		m_height = height;
+		m_texels = texels;
+		return true;
+	}
+
+	bool TextureSampler::loadPPM(const string& filename)
+	{
+		ifstream file(filename.c_str(), ios::binary);
+		if (!file)
+			return false;
+
+		string magic;
+		file >> magic;
+		if (magic != "P6")
+			return false;
+
+		unsigned int values[3], read = 0;
+		while (read < 3 && file)
+		{
+			file >> ws;
+			if (file.peek() == '#')
+			{
+				string comment;
+				getline(file, comment);
+				continue;
+			}
+			file >> values[read++];
+		}
+		if (!file || values[0] == 0 || values[1] == 0 || values[2] != 255)
+			return false;
+		file.get();
+
+		const unsigned int width = values[0], height = values[1];
+		vector<unsigned char> pixels(width * height * 3);
+		if (!file.read(reinterpret_cast<char*>(&pixels[0]), pixels.size()))
+			return false;
+
+		shared_ptr<vector<uchar4> > texels(new vector<uchar4>(width * height));
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				const unsigned char* p = &pixels[(y * width + x) * 3];
+				(*texels)[(height - 1 - y) * width + x] = make_uchar4(p[0], p[1], p[2], 255);
+			}
+		m_width  = width;
+		m_height = height;
+		m_texels = texels;
+		return true;
+	}
+
+	float4 TextureSampler::texel(int x, int y) const
+	{
+		// repeat wrapping
+		x %= int(m_width);	if (x < 0) x += m_width;
+		y %= int(m_height); if (y < 0) y += m_height;
+		const uchar4 t = (*m_texels)[y * m_width + x];
+		const float scale = 1.0f / 255.0f;
+		return make_float4(t.x * scale, t.y * scale, t.z * scale, t.w * scale);
+	}
+
+	float4 TextureSampler::sample(float u, float v) const
+	{
+		if (!m_texels)
+			return m_color;
+
+		// texel centers are at half-integer coordinates
+		float x = u * m_width  - 0.5f;
+		float y = v * m_height - 0.5f;
+		float fx = floorf(x), fy = floorf(y);
+		float ax = x - fx, ay = y - fy;
+		int ix = int(fx), iy = int(fy);
+
+		float4 bottom = lerp(texel(ix, iy),		texel(ix + 1, iy),	   ax);
+		float4 top	  = lerp(texel(ix, iy + 1), texel(ix + 1, iy + 1), ax);
+		return lerp(bottom, top, ay);
+	}
+}
@@ -0,0 +1,51 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host-side texture sampler, equivalent to rtTextureSampler<float4, 2> with
+// repeat wrapping, linear filtering and normalized coordinates
+
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	using namespace optix;
+
+	class TextureSampler
+	{
+	public:
+		TextureSampler() : m_width(0), m_height(0), m_color(make_float4(1.0f)) {}
+		explicit TextureSampler(const float3& color) : m_width(0), m_height(0), m_color(make_float4(color, 1.0f)) {}
+
+		// Supports uncompressed/RLE .tga and binary .ppm. Returns false and
+		// leaves the sampler untouched if the file cannot be read. Copies of
+		// a sampler share the same texels.
+		bool			load(const std::string& filename);
+
+		float4			sample(float u, float v) const;
+
+		unsigned int	width(void)	 const { return m_width; }
+		unsigned int	height(void) const { return m_height; }
+
+	private:
+		unsigned int		m_width;
+		unsigned int		m_height;
+		// constant color of samplers without an image
+		float4				m_color;
+		// RGBA8, rows stored bottom-up as OpenGL texture coordinates expect
+		std::shared_ptr<const std::vector<uchar4> >	m_texels;
+
+		bool loadTGA(const std::string& filename);
+		bool loadPPM(const std::string& filename);
+
+		float4 texel(int x, int y) const;
+	};
+
+	inline float4 tex2D(const TextureSampler& sampler, float u, float v)
+	{
+		return sampler.sample(u, v);
+	}
+}
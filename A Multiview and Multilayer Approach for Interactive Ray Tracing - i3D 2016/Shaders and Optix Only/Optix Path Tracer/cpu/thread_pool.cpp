@@ -0,0 +1,169 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace cpu
+{
+	ThreadPool::ThreadPool(unsigned int num_threads) :
+		m_task(0),
+		m_count(0),
+		m_next(0),
+		m_stealing(false),
+		m_generation(0),
+		m_active(0),
+		m_quit(false)
+	{
+		if (num_threads == 0)
+			num_threads = max(1u, thread::hardware_concurrency());
+		m_ranges.reset(new WorkRange[num_threads]);
+		for (unsigned int i = 0; i < num_threads; ++i)
+			m_ranges[i].range = 0;
+		for (unsigned int i = 1; i < num_threads; ++i)
+			m_workers.push_back(thread(&ThreadPool::worker, this, i));
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_all();
+		for (size_t i = 0; i < m_workers.size(); ++i)
+			m_workers[i].join();
+	}
+
+	void ThreadPool::drain(unsigned int thread_id)
+	{
+		for (unsigned int index = m_next++; index < m_count; index = m_next++)
+			(*m_task)(index, thread_id);
+	}
+
+	static inline unsigned long long packRange(unsigned int begin, unsigned int end)
+	{
+		return (static_cast<unsigned long long>(end) << 32) | begin;
+	}
+
+	void ThreadPool::drainStealing(unsigned int thread_id)
+	{
+		const unsigned int num_threads = size();
+		atomic<unsigned long long>& own = m_ranges[thread_id].range;
+		for (;;)
+		{
+			// pop from the front of the own range
+			unsigned long long range = own.load();
+			unsigned int begin = static_cast<unsigned int>(range), end = static_cast<unsigned int>(range >> 32);
+			if (begin < end)
+			{
+				if (own.compare_exchange_weak(range, packRange(begin + 1, end)))
+					(*m_task)(begin, thread_id);
+				continue;
+			}
+
+			// steal the back half of the largest range; the owner may pop concurrently,
+			// so the victim's range is re-read on a failed exchange
+			bool stolen = false;
+			for (;;)
+			{
+				unsigned int victim = thread_id, victim_size = 0;
+				for (unsigned int i = 0; i < num_threads; ++i)
+				{
+					const unsigned long long r = m_ranges[i].range.load();
+					const unsigned int b = static_cast<unsigned int>(r), e = static_cast<unsigned int>(r >> 32);
+					if (i != thread_id && e > b && e - b > victim_size)
+					{
+						victim		= i;
+						victim_size	= e - b;
+					}
+				}
+				if (victim_size == 0)
+					break;
+
+				unsigned long long victim_range = m_ranges[victim].range.load();
+				const unsigned int b = static_cast<unsigned int>(victim_range), e = static_cast<unsigned int>(victim_range >> 32);
+				if (b >= e)
+					continue;
+				const unsigned int mid = b + (e - b) / 2;
+				if (m_ranges[victim].range.compare_exchange_strong(victim_range, packRange(b, mid)))
+				{
+					own.store(packRange(mid, e));
+					stolen = true;
+					break;
+				}
+			}
+			if (!stolen)
+				return;
+		}
+	}
+
+	void ThreadPool::worker(unsigned int thread_id)
+	{
+		unsigned int generation = 0;
+		for (;;)
+		{
+			{
+				unique_lock<mutex> lock(m_mutex);
+				m_wake.wait(lock, [&] { return m_quit || m_generation != generation; });
+				if (m_quit)
+					return;
+				generation = m_generation;
+			}
+
+			if (m_stealing)
+				drainStealing(thread_id);
+			else
+				drain(thread_id);
+
+			{
+				lock_guard<mutex> lock(m_mutex);
+				if (--m_active == 0)
+					m_done.notify_one();
+			}
+		}
+	}
+
+	void ThreadPool::run(unsigned int count, const function<void(unsigned int, unsigned int)>& task)
+	{
+		launch(count, task, false);
+	}
+
+	void ThreadPool::runStealing(unsigned int count, const function<void(unsigned int, unsigned int)>& task)
+	{
+		launch(count, task, true);
+	}
+
+	void ThreadPool::launch(unsigned int count, const function<void(unsigned int, unsigned int)>& task, bool stealing)
+	{
+		if (count == 0)
+			return;
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_task	   = &task;
+			m_count	   = count;
+			m_next	   = 0;
+			m_stealing = stealing;
+			m_active   = static_cast<unsigned int>(m_workers.size());
+			if (stealing)
+			{
+				const unsigned int num_threads = size();
+				for (unsigned int i = 0; i < num_threads; ++i)
+					m_ranges[i].range = packRange(static_cast<unsigned int>(static_cast<unsigned long long>(count) * i / num_threads),
+												  static_cast<unsigned int>(static_cast<unsigned long long>(count) * (i + 1) / num_threads));
+			}
+			++m_generation;
+		}
+		m_wake.notify_all();
+
+		if (stealing)
+			drainStealing(0);
+		else
+			drain(0);
+
+		unique_lock<mutex> lock(m_mutex);
+		m_done.wait(lock, [&] { return m_active == 0; });
+		m_task = 0;
+	}
+}
@@ -0,0 +1,64 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Persistent worker threads for the CPU backend launches
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu
+{
+	class ThreadPool
+	{
+	public:
+		// 0 uses all hardware threads
+		explicit ThreadPool(unsigned int num_threads = 0);
+		~ThreadPool();
+
+		unsigned int size(void) const { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+		// Calls task(index, thread_id) for every index in [0, count) and returns when all
+		// are done. Indices are handed out dynamically, so uneven work balances itself.
+		// The calling thread participates with thread_id 0.
+		void run(unsigned int count, const std::function<void(unsigned int, unsigned int)>& task);
+
+		// Same contract as run, but [0, count) is first split into one contiguous range per
+		// thread, each walked front to back by its owner. A thread that runs out of work
+		// steals the back half of the largest remaining range, so neighbouring indices tend
+		// to stay on the same thread and no thread idles while work is left.
+		void runStealing(unsigned int count, const std::function<void(unsigned int, unsigned int)>& task);
+
+	private:
+		// [begin, end) packed as end << 32 | begin, padded to its own cache line
+		struct WorkRange
+		{
+			std::atomic<unsigned long long>	range;
+			char							padding[64 - sizeof(std::atomic<unsigned long long>)];
+		};
+
+		std::vector<std::thread>	m_workers;
+		std::mutex					m_mutex;
+		std::condition_variable		m_wake;
+		std::condition_variable		m_done;
+
+		const std::function<void(unsigned int, unsigned int)>* m_task;
+		unsigned int				m_count;
+		std::atomic<unsigned int>	m_next;
+		std::unique_ptr<WorkRange[]>	m_ranges;
+		bool						m_stealing;
+		unsigned int				m_generation;
+		unsigned int				m_active;
+		bool						m_quit;
+
+		void worker(unsigned int thread_id);
+		void drain(unsigned int thread_id);
+		void drainStealing(unsigned int thread_id);
+		void launch(unsigned int count, const std::function<void(unsigned int, unsigned int)>& task, bool stealing);
+	};
+}
@@ -0,0 +1,57 @@
+#include "tiles.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	// Inserts a zero bit after each of the 16 lowest bits of v
+	static inline unsigned int expandBits2D(unsigned int v)
+	{
+		v &= 0x0000FFFFu;
+		v = (v | (v << 8)) & 0x00FF00FFu;
+		v = (v | (v << 4)) & 0x0F0F0F0Fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+	void TileBuffer::resize(unsigned int width, unsigned int height, unsigned int tile_size)
+	{
+		m_tile_size = tile_size;
+		m_tiles_x	= (width + tile_size - 1) / tile_size;
+		const unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+
+		// neighbouring tiles stay close in the order, so that a contiguous range of tiles
+		// covers a compact part of the image
+		vector<unsigned long long> keys;
+		for (unsigned int ty = 0; ty < tiles_y; ++ty)
+			for (unsigned int tx = 0; tx < m_tiles_x; ++tx)
+			{
+				unsigned long long code = (expandBits2D(ty) << 1) | expandBits2D(tx);
+				keys.push_back((code << 32) | (ty * m_tiles_x + tx));
+			}
+		sort(keys.begin(), keys.end());
+
+		m_tiles.resize(keys.size());
+		m_tile_index.resize(keys.size());
+		for (unsigned int i = 0; i < keys.size(); ++i)
+		{
+			const unsigned int grid = static_cast<unsigned int>(keys[i] & 0xFFFFFFFFu);
+			Tile& tile	  = m_tiles[i];
+			tile.origin	  = make_uint2((grid % m_tiles_x) * tile_size, (grid / m_tiles_x) * tile_size);
+			tile.size	  = make_uint2(min(tile_size, width - tile.origin.x), min(tile_size, height - tile.origin.y));
+			tile.frames	  = 0;
+			m_tile_index[grid] = i;
+		}
+		m_data.assign(m_tiles.size() * tile_size * tile_size, make_float4(0.0f));
+	}
+
+	void TileBuffer::reset(void)
+	{
+		for (size_t i = 0; i < m_tiles.size(); ++i)
+			m_tiles[i].frames = 0;
+	}
+}
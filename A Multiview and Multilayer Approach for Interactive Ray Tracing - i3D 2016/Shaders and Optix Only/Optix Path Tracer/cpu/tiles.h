@@ -0,0 +1,57 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Image tiles of the CPU backend and their progressive accumulation
+
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <vector>
+
+namespace cpu
+{
+	using namespace optix;
+
+	struct Tile
+	{
+		uint2			origin;
+		uint2			size;		// clipped to the image
+		unsigned int	frames;		// frames accumulated since the last reset
+	};
+
+	// Square tiles in Morton order of their tile coordinates, each owning a contiguous
+	// block of accumulated radiance. A tile is written by one thread per launch, and its
+	// sum persists across launches until reset() discards it.
+	class TileBuffer
+	{
+	public:
+		TileBuffer() : m_tile_size(0), m_tiles_x(0) {}
+
+		void			resize(unsigned int width, unsigned int height, unsigned int tile_size);
+		// Restarts accumulation; the next frame of each tile overwrites its sum
+		void			reset(void);
+
+		unsigned int	size(void) const { return static_cast<unsigned int>(m_tiles.size()); }
+		unsigned int	getTileSize(void) const { return m_tile_size; }
+
+		Tile&			operator[](unsigned int index)		 { return m_tiles[index]; }
+		const Tile&		operator[](unsigned int index) const { return m_tiles[index]; }
+
+		// Tile that holds an image pixel
+		const Tile&		tile(const uint2& index) const { return m_tiles[m_tile_index[(index.y / m_tile_size) * m_tiles_x + index.x / m_tile_size]]; }
+
+		// Accumulated radiance of an image pixel, along with the tile that holds it
+		float4&			pixel(const uint2& index, const Tile*& tile)
+		{
+			const unsigned int t = m_tile_index[(index.y / m_tile_size) * m_tiles_x + index.x / m_tile_size];
+			tile = &m_tiles[t];
+			return m_data[(t * m_tile_size + index.y % m_tile_size) * m_tile_size + index.x % m_tile_size];
+		}
+
+	private:
+		unsigned int				m_tile_size;
+		unsigned int				m_tiles_x;
+		std::vector<Tile>			m_tiles;		// Morton order
+		std::vector<unsigned int>	m_tile_index;	// row-major tile grid to m_tiles
+		std::vector<float4>			m_data;			// tile_size^2 pixels per tile, in the order of m_tiles
+	};
+}
@@ -0,0 +1,301 @@
+#include "triangle_mesh.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	Aabb TriangleMesh::bounds(int primIdx) const
+	{
+		const int3 v_idx = vindex_buffer[primIdx];
+
+		const float3 v0   = vertex_buffer[v_idx.x];
+		const float3 v1   = vertex_buffer[v_idx.y];
+		const float3 v2   = vertex_buffer[v_idx.z];
+		const float  area = length(cross(v1 - v0, v2 - v0));
+
+		Aabb aabb;
+		if (area > 0.0f && !isinf(area))
+		{
+			aabb.m_min = fminf(fminf(v0, v1), v2);
+			aabb.m_max = fmaxf(fmaxf(v0, v1), v2);
+		}
+		else
+			aabb.invalidate();
+		return aabb;
+	}
+
+	Aabb TriangleMesh::sceneBBox() const
+	{
+		Aabb aabb;
+		aabb.invalidate();
+		for (size_t i = 0; i < vertex_buffer.size(); ++i)
+			aabb.include(vertex_buffer[i]);
+		return aabb;
+	}
+
+	void mesh_attributes(const TriangleMesh& mesh, int primIdx, float beta, float gamma, Attributes& attributes)
+	{
+		const int3 v_idx = mesh.vindex_buffer[primIdx];
+		const float3 p0 = mesh.vertex_buffer[v_idx.x];
+		const float3 p1 = mesh.vertex_buffer[v_idx.y];
+		const float3 p2 = mesh.vertex_buffer[v_idx.z];
+		const float3 n  = cross(p0 - p2, p1 - p0);
+
+		const int3 n_idx = mesh.nindex_buffer[primIdx];
+		if (mesh.normal_buffer.size() == 0 || n_idx.x < 0 || n_idx.y < 0 || n_idx.z < 0)
+			attributes.shading_normal = normalize(n);
+		else
+		{
+			const float3 n0 = mesh.normal_buffer[n_idx.x];
+			const float3 n1 = mesh.normal_buffer[n_idx.y];
+			const float3 n2 = mesh.normal_buffer[n_idx.z];
+			attributes.shading_normal = normalize(n1*beta + n2*gamma + n0*(1.0f - beta - gamma));
+		}
+		attributes.geometric_normal = normalize(n);
+
+		const int3 t_idx = mesh.tindex_buffer[primIdx];
+		if (mesh.texcoord_buffer.size() == 0 || t_idx.x < 0 || t_idx.y < 0 || t_idx.z < 0)
+			attributes.texcoord = make_float3(0.0f, 0.0f, 0.0f);
+		else
+		{
+			const float2 t0 = mesh.texcoord_buffer[t_idx.x];
+			const float2 t1 = mesh.texcoord_buffer[t_idx.y];
+			const float2 t2 = mesh.texcoord_buffer[t_idx.z];
+			attributes.texcoord = make_float3(t1*beta + t2*gamma + t0*(1.0f - beta - gamma));
+		}
+
+		attributes.material = mesh.material_buffer[primIdx];
+	}
+
+	//
+	// OBJ/MTL parsing
+	//
+	static string directoryOf(const string& filename)
+	{
+		size_t slash = filename.find_last_of("/\\");
+		return (slash == string::npos) ? string(".") : filename.substr(0, slash);
+	}
+
+	static string joinPath(const string& dir, string file)
+	{
+		// exporters on Windows write maps\file.tga
+		for (size_t i = 0; i < file.size(); ++i)
+			if (file[i] == '\\') file[i] = '/';
+		return file.empty() || file[0] == '/' ? file : dir + "/" + file;
+	}
+
+	static float3 readFloat3(istringstream& line)
+	{
+		float3 v = make_float3(0.0f);
+		line >> v.x >> v.y >> v.z;
+		return v;
+	}
+
+	static string readRest(istringstream& line)
+	{
+		string rest;
+		getline(line >> ws, rest);
+		while (!rest.empty() && (rest[rest.size() - 1] == '\r' || rest[rest.size() - 1] == ' '))
+			rest.erase(rest.size() - 1);
+		return rest;
+	}
+
+	// default material, as in glm
+	static ObjMaterial defaultMaterial(const string& name)
+	{
+		ObjMaterial material;
+		material.name		  = name;
+		material.ambient_map  = TextureSampler(make_float3(0.2f));
+		material.diffuse_map  = TextureSampler(make_float3(0.8f));
+		material.specular_map = TextureSampler(make_float3(0.0f));
+		material.illum		  = 2;
+		material.phong_exp	  = 65.0f;
+		return material;
+	}
+
+	typedef map<string, TextureSampler> TextureCache;
+
+	static void loadMaterialMap(TextureSampler& sampler, const string& filename, TextureCache& cache)
+	{
+		TextureCache::const_iterator it = cache.find(filename);
+		if (it != cache.end())
+		{
+			sampler = it->second;
+			return;
+		}
+		if (sampler.load(filename))
+			cache[filename] = sampler;
+		else
+			fprintf(stderr, "Could not load texture '%s', using the material color instead.\n", filename.c_str());
+	}
+
+	// textures replace the constant colors, as OptiXMesh does
+	static void applyMaterialMaps(ObjMaterial* material, const string& dir, TextureCache& cache,
+		const float3& Ka, const float3& Kd, const float3& Ks,
+		const string& map_Ka, const string& map_Kd, const string& map_Ks)
+	{
+		if (!material)
+			return;
+		material->ambient_map  = TextureSampler(Ka);
+		material->diffuse_map  = TextureSampler(Kd);
+		material->specular_map = TextureSampler(Ks);
+		if (!map_Ka.empty()) loadMaterialMap(material->ambient_map,  joinPath(dir, map_Ka), cache);
+		if (!map_Kd.empty()) loadMaterialMap(material->diffuse_map,  joinPath(dir, map_Kd), cache);
+		if (!map_Ks.empty()) loadMaterialMap(material->specular_map, joinPath(dir, map_Ks), cache);
+	}
+
+	static void loadMTL(const string& filename, TriangleMesh& mesh, map<string, unsigned int>& material_ids)
+	{
+		ifstream file(filename.c_str());
+		if (!file)
+		{
+			fprintf(stderr, "Could not open material library '%s'.\n", filename.c_str());
+			return;
+		}
+
+		const string dir = directoryOf(filename);
+		TextureCache cache;
+		ObjMaterial* current = NULL;
+		float3 Ka = make_float3(0.2f), Kd = make_float3(0.8f), Ks = make_float3(0.0f);
+		string map_Ka, map_Kd, map_Ks;
+
+		string text;
+		while (getline(file, text))
+		{
+			istringstream line(text);
+			string key;
+			if (!(line >> key) || key[0] == '#')
+				continue;
+
+			if (key == "newmtl")
+			{
+				applyMaterialMaps(current, dir, cache, Ka, Kd, Ks, map_Ka, map_Kd, map_Ks);
+
+				string name = readRest(line);
+				if (material_ids.find(name) == material_ids.end())
+				{
+					material_ids[name] = static_cast<unsigned int>(mesh.materials.size());
+					mesh.materials.push_back(defaultMaterial(name));
+				}
+				current = &mesh.materials[material_ids[name]];
+				Ka = make_float3(0.2f); Kd = make_float3(0.8f); Ks = make_float3(0.0f);
+				map_Ka.clear(); map_Kd.clear(); map_Ks.clear();
+			}
+			else if (!current)
+				continue;
+			else if (key == "Ka")		Ka = readFloat3(line);
+			else if (key == "Kd")		Kd = readFloat3(line);
+			else if (key == "Ks")		Ks = readFloat3(line);
+			else if (key == "Ns")		line >> current->phong_exp;
+			else if (key == "illum")	line >> current->illum;
+			else if (key == "map_Ka")	map_Ka = readRest(line);
+			else if (key == "map_Kd")	map_Kd = readRest(line);
+			else if (key == "map_Ks")	map_Ks = readRest(line);
+		}
+		applyMaterialMaps(current, dir, cache, Ka, Kd, Ks, map_Ka, map_Kd, map_Ks);
+	}
+
+	// resolves a 1-based (or negative, relative) OBJ index to a 0-based one, -1 if absent
+	static int resolveIndex(const string& token, size_t count)
+	{
+		if (token.empty())
+			return -1;
+		int index = atoi(token.c_str());
+		if (index < 0)
+			index += static_cast<int>(count);
+		else
+			index -= 1;
+		return (index >= 0 && index < static_cast<int>(count)) ? index : -1;
+	}
+
+	void loadOBJ(const string& filename, TriangleMesh& mesh)
+	{
+		ifstream file(filename.c_str());
+		if (!file)
+			throw runtime_error("Could not open model '" + filename + "'");
+
+		const string dir = directoryOf(filename);
+		map<string, unsigned int> material_ids;
+		unsigned int current_material = 0;
+		mesh.materials.clear();
+		mesh.materials.push_back(defaultMaterial("default"));
+		material_ids["default"] = 0;
+
+		string text;
+		vector<int3> corners;
+		while (getline(file, text))
+		{
+			istringstream line(text);
+			string key;
+			if (!(line >> key) || key[0] == '#')
+				continue;
+
+			if (key == "v")
+				mesh.vertex_buffer.push_back(readFloat3(line));
+			else if (key == "vn")
+				mesh.normal_buffer.push_back(readFloat3(line));
+			else if (key == "vt")
+			{
+				float2 t = make_float2(0.0f, 0.0f);
+				line >> t.x >> t.y;
+				mesh.texcoord_buffer.push_back(t);
+			}
+			else if (key == "f")
+			{
+				// each corner is v, v/t, v//n or v/t/n
+				corners.clear();
+				string corner;
+				while (line >> corner)
+				{
+					string v, t, n;
+					size_t s0 = corner.find('/');
+					v = corner.substr(0, s0);
+					if (s0 != string::npos)
+					{
+						size_t s1 = corner.find('/', s0 + 1);
+						t = corner.substr(s0 + 1, s1 == string::npos ? string::npos : s1 - s0 - 1);
+						if (s1 != string::npos)
+							n = corner.substr(s1 + 1);
+					}
+					corners.push_back(make_int3(
+						resolveIndex(v, mesh.vertex_buffer.size()),
+						resolveIndex(t, mesh.texcoord_buffer.size()),
+						resolveIndex(n, mesh.normal_buffer.size())));
+				}
+
+				// triangle fan
+				for (size_t i = 2; i < corners.size(); ++i)
+				{
+					const int3& c0 = corners[0];
+					const int3& c1 = corners[i - 1];
+					const int3& c2 = corners[i];
+					if (c0.x < 0 || c1.x < 0 || c2.x < 0)
+						continue;
+					mesh.vindex_buffer.push_back(make_int3(c0.x, c1.x, c2.x));
+					mesh.tindex_buffer.push_back(make_int3(c0.y, c1.y, c2.y));
+					mesh.nindex_buffer.push_back(make_int3(c0.z, c1.z, c2.z));
+					mesh.material_buffer.push_back(current_material);
+				}
+			}
+			else if (key == "usemtl")
+			{
+				string name = readRest(line);
+				map<string, unsigned int>::const_iterator it = material_ids.find(name);
+				current_material = (it == material_ids.end()) ? 0 : it->second;
+			}
+			else if (key == "mtllib")
+				loadMTL(joinPath(dir, readRest(line)), mesh, material_ids);
+		}
+
+		if (mesh.vindex_buffer.empty())
+			throw runtime_error("Model '" + filename + "' contains no triangles");
+	}
+}
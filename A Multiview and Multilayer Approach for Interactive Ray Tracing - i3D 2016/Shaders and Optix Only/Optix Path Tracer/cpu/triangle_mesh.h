@@ -0,0 +1,82 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Host-side version of the triangle soup in cuda/triangle_mesh.cu, together with
+// the OBJ material parameters consumed by cuda/obj_material.cu
+
+#pragma once
+
+#include "helpers.h"
+#include "texture.h"
+#include <optixu/optixu_aabb_namespace.h>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// Correspond to OBJ mtl params
+	struct ObjMaterial
+	{
+		std::string		name;
+
+		TextureSampler	ambient_map;
+		TextureSampler	diffuse_map;
+		TextureSampler	specular_map;
+
+		int				illum;
+		float			phong_exp;
+	};
+
+	// Correspond to OBJ geom params
+	struct Attributes
+	{
+		float3			texcoord;
+		float3			geometric_normal;
+		float3			shading_normal;
+		unsigned int	material;
+	};
+
+	struct TriangleMesh
+	{
+		std::vector<float3>			vertex_buffer;
+		std::vector<float3>			normal_buffer;
+		std::vector<float2>			texcoord_buffer;
+		std::vector<int3>			vindex_buffer;		// position indices
+		std::vector<int3>			nindex_buffer;		// normal indices
+		std::vector<int3>			tindex_buffer;		// texcoord indices
+		std::vector<unsigned int>	material_buffer;	// per-face material index
+
+		std::vector<ObjMaterial>	materials;
+
+		unsigned int	size(void) const { return static_cast<unsigned int>(vindex_buffer.size()); }
+
+		// mesh_bounds: degenerate triangles return an invalid box
+		Aabb			bounds(int primIdx) const;
+		Aabb			sceneBBox(void) const;
+	};
+
+	// Loads a Wavefront OBJ file and its material libraries. Texture maps are
+	// resolved relative to the model directory. Throws std::runtime_error on failure.
+	void loadOBJ(const std::string& filename, TriangleMesh& mesh);
+
+	// Same convention as optix::intersect_triangle: n is the unnormalized
+	// geometric normal and (beta, gamma) the barycentrics of p1 and p2
+	inline bool intersect_triangle(const Ray& ray, const float3& p0, const float3& p1, const float3& p2,
+		float3& n, float& t, float& beta, float& gamma)
+	{
+		const float3 e0 = p1 - p0;
+		const float3 e1 = p0 - p2;
+		n = cross(e1, e0);
+
+		const float3 e2 = (1.0f / dot(n, ray.direction)) * (p0 - ray.origin);
+		const float3 i  = cross(ray.direction, e2);
+
+		beta  = dot(i, e1);
+		gamma = dot(i, e0);
+		t     = dot(n, e2);
+
+		return ((t < ray.tmax) & (t > ray.tmin) & (beta >= 0.0f) & (gamma >= 0.0f) & (beta + gamma <= 1.0f));
+	}
+
+	// mesh_intersect: fills the attributes of an already accepted intersection
+	void mesh_attributes(const TriangleMesh& mesh, int primIdx, float beta, float gamma, Attributes& attributes);
+}
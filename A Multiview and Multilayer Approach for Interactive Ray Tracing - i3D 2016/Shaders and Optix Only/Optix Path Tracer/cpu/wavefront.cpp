@@ -0,0 +1,193 @@
+#include "wavefront.h"
+#include "../cuda/random.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace optix;
+
+namespace cpu
+{
+	static const unsigned int		BATCH_SIZE	= 1024;
+	static const int				KEY_BITS	= 24;
+	static const int				RADIX_BITS	= 12;
+
+	// Inserts two zero bits after each of the 10 lowest bits of v
+	static inline unsigned int expandBits(unsigned int v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// The direction octant in bits 21-23, above the 21-bit Morton code of the origin on a
+	// 128^3 grid over the scene bounds. Finer cells do not make the rays more coherent, but
+	// cost a third radix pass.
+	static inline unsigned int rayKey(const float3& origin, const float3& direction, const float3& scene_min, const float3& inv_extent)
+	{
+		const float3 p = (origin - scene_min) * inv_extent;
+		const unsigned int x = static_cast<unsigned int>(min(max(p.x * 128.0f, 0.0f), 127.0f));
+		const unsigned int y = static_cast<unsigned int>(min(max(p.y * 128.0f, 0.0f), 127.0f));
+		const unsigned int z = static_cast<unsigned int>(min(max(p.z * 128.0f, 0.0f), 127.0f));
+		const unsigned int morton = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+		const unsigned int octant = (direction.x < 0.0f ? 4u : 0u) | (direction.y < 0.0f ? 2u : 0u) | (direction.z < 0.0f ? 1u : 0u);
+		return (octant << 21) | morton;
+	}
+
+	// LSD radix sort of queue entries on the key in their upper half. Stable, so rays with
+	// equal keys stay in path order.
+	static void sortQueue(vector<unsigned long long>& queue, vector<unsigned long long>& scratch)
+	{
+		scratch.resize(queue.size());
+		for (int shift = 32; shift < 32 + KEY_BITS; shift += RADIX_BITS)
+		{
+			const unsigned long long mask = (1u << RADIX_BITS) - 1u;
+			unsigned int offsets[1 << RADIX_BITS] = { 0 };
+			for (size_t i = 0; i < queue.size(); ++i)
+				offsets[(queue[i] >> shift) & mask]++;
+			unsigned int sum = 0;
+			for (unsigned int b = 0; b < (1u << RADIX_BITS); ++b)
+			{
+				const unsigned int count = offsets[b];
+				offsets[b] = sum;
+				sum += count;
+			}
+			for (size_t i = 0; i < queue.size(); ++i)
+				scratch[offsets[(queue[i] >> shift) & mask]++] = queue[i];
+			queue.swap(scratch);
+		}
+	}
+
+	void Wavefront::trace(Context& context, ThreadPool& thread_pool, const Aabb& scene_bounds)
+	{
+		const unsigned int width			 = context.output_buffer.width;
+		const unsigned int height			 = context.output_buffer.height;
+		const unsigned int num_pixels		 = width * height;
+		const unsigned int samples_per_pixel = context.pt.sqrt_num_samples * context.pt.sqrt_num_samples;
+		const unsigned int num_paths		 = num_pixels * samples_per_pixel;
+
+		const float3 extent		= scene_bounds.extent();
+		const float3 inv_extent	= make_float3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+											  extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+											  extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		// [Camera rays] they share their origin, so they stay in pixel order
+		m_paths.resize(num_paths);
+		m_results.resize(num_paths);
+		thread_pool.run((num_paths + BATCH_SIZE - 1) / BATCH_SIZE, [&](unsigned int batch, unsigned int)
+		{
+			const unsigned int end = min(num_paths, (batch + 1) * BATCH_SIZE);
+			for (unsigned int i = batch * BATCH_SIZE; i < end; ++i)
+			{
+				const unsigned int pixel  = i / samples_per_pixel;
+				const unsigned int sample = i % samples_per_pixel;
+				const uint2 launch_index = make_uint2(pixel % width, pixel / width);
+				const float3 direction	 = camera_ray_direction(context, launch_index, sample);
+
+				Path& path		= m_paths[i];
+				path.num_rays	= 0;
+				path.index		= i;
+				m_results[i].result	  = make_float3(0.f);
+				m_results[i].num_rays = 0;
+
+				PerRayData_radiance& prd = path.prd;
+				prd.result		 = make_float3(0.f);
+				prd.attenuation  = make_float3(1.f);
+				prd.done		 = pixel_converged(context, launch_index);
+				prd.seed		 = camera_sample_seed(context, launch_index, sample);
+				prd.depth		 = 0;
+				prd.num_rays	 = 0;
+				prd.origin		 = context.camera.eye;
+				prd.direction	 = direction;
+			}
+		});
+		// the pixels converged by adaptive sampling trace no paths
+		if (context.max_depth <= 0)
+			m_paths.clear();
+		else if (context.pt.adaptive_threshold > 0.0f)
+			m_paths.erase(remove_if(m_paths.begin(), m_paths.end(), [](const Path& path) { return path.prd.done; }), m_paths.end());
+
+		// [Bounces] the path states are moved into the sorted order rather than indexed through
+		// it, since tracing through a permutation of them costs more than sorting saves
+		for (int depth = 0; !m_paths.empty(); ++depth)
+		{
+			const unsigned int num_rays = static_cast<unsigned int>(m_paths.size());
+			if (m_sort && depth > 0)
+			{
+				m_queue.resize(num_rays);
+				thread_pool.run((num_rays + BATCH_SIZE - 1) / BATCH_SIZE, [&](unsigned int batch, unsigned int)
+				{
+					const unsigned int end = min(num_rays, (batch + 1) * BATCH_SIZE);
+					for (unsigned int i = batch * BATCH_SIZE; i < end; ++i)
+						m_queue[i] = (static_cast<unsigned long long>(rayKey(m_paths[i].prd.origin, m_paths[i].prd.direction, scene_bounds.m_min, inv_extent)) << 32) | i;
+				});
+				sortQueue(m_queue, m_scratch);
+
+				m_sorted_paths.resize(num_rays);
+				thread_pool.run((num_rays + BATCH_SIZE - 1) / BATCH_SIZE, [&](unsigned int batch, unsigned int)
+				{
+					const unsigned int end = min(num_rays, (batch + 1) * BATCH_SIZE);
+					for (unsigned int i = batch * BATCH_SIZE; i < end; ++i)
+						m_sorted_paths[i] = m_paths[m_queue[i] & 0xFFFFFFFFu];
+				});
+				m_paths.swap(m_sorted_paths);
+			}
+
+			thread_pool.run((num_rays + BATCH_SIZE - 1) / BATCH_SIZE, [&](unsigned int batch, unsigned int)
+			{
+				const unsigned int end = min(num_rays, (batch + 1) * BATCH_SIZE);
+				for (unsigned int k = batch * BATCH_SIZE; k < end; ++k)
+				{
+					Path& path = m_paths[k];
+					PerRayData_radiance& prd = path.prd;
+
+					Ray ray = make_Ray(prd.origin, prd.direction, context.pt.radiance_ray_type, context.scene_epsilon, DEFAULT_MAX);
+					cpu::trace(context, ray, prd);
+					path.num_rays++;
+
+					prd.result += prd.radiance * prd.attenuation;
+
+					if (!russian_roulette(context, prd))
+						prd.done = true;
+
+					prd.depth++;
+
+					if (prd.done || prd.depth >= context.max_depth)
+					{
+						m_results[path.index].result   = prd.result;
+						m_results[path.index].num_rays = path.num_rays + prd.num_rays;
+					}
+				}
+			});
+
+			const int max_depth = context.max_depth;
+			m_paths.erase(remove_if(m_paths.begin(), m_paths.end(),
+				[max_depth](const Path& path) { return path.prd.done || path.prd.depth >= max_depth; }), m_paths.end());
+		}
+
+		// [Accumulation] in the order of pinhole_camera, so that one sample per pixel gives the same image
+		thread_pool.run(height, [&](unsigned int y, unsigned int)
+		{
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				if (pixel_converged(context, make_uint2(x, y)))
+				{
+					context.ray_count_buffer[make_uint2(x, y)] = 0;
+					continue;
+				}
+
+				const PathResult* results = &m_results[(y * width + x) * samples_per_pixel];
+				float3 result = make_float3(0.0f);
+				unsigned int num_rays = 0;
+				for (unsigned int s = 0; s < samples_per_pixel; ++s)
+				{
+					result	 += results[s].result;
+					num_rays += results[s].num_rays;
+				}
+				accumulate(context, make_uint2(x, y), result / static_cast<float>(samples_per_pixel), num_rays);
+			}
+		});
+	}
+}
@@ -0,0 +1,51 @@
+// A Multiview and Multilayer Approach for Interactive Ray Tracing
+// Authors: K. Vardis, A. A. Vasilakis, G. Papaioannou
+// Wavefront path tracing for the CPU backend: the frame advances one bounce at a time for
+// all paths, so that the rays of each bounce can be reordered before they are traced
+
+#pragma once
+
+#include "context.h"
+#include "thread_pool.h"
+#include <optixu/optixu_aabb_namespace.h>
+#include <vector>
+
+namespace cpu
+{
+	class Wavefront
+	{
+	public:
+		Wavefront() : m_sort(true) {}
+
+		// Sorts the rays of every bounce after the camera rays by direction octant and then
+		// along a Morton curve of their origin, so that consecutive rays visit the same nodes
+		void	setSorting(bool sort) { m_sort = sort; }
+
+		// Traces a frame of pinhole_camera over the whole output buffer and accumulates it.
+		// The frame counters of all tiles must already account for the frame. The samples take
+		// their rays and seeds from camera_ray_direction and camera_sample_seed, as in
+		// pinhole_camera, so the paths match it exactly at any number of samples.
+		void	trace(Context& context, ThreadPool& thread_pool, const Aabb& scene_bounds);
+
+	private:
+		struct Path
+		{
+			PerRayData_radiance	prd;			// origin and direction hold the next ray
+			unsigned int		num_rays;
+			unsigned int		index;			// pixel * samples_per_pixel + sample
+		};
+
+		struct PathResult
+		{
+			float3				result;
+			unsigned int		num_rays;
+		};
+
+		bool							m_sort;
+		std::vector<Path>				m_paths;		// the active paths, in tracing order
+		std::vector<Path>				m_sorted_paths;
+		std::vector<unsigned long long>	m_queue;		// sort key << 32 | position in m_paths
+		std::vector<unsigned long long>	m_scratch;
+		std::vector<PathResult>			m_results;		// samples_per_pixel consecutive results per pixel, pixels row-major
+	};
+}
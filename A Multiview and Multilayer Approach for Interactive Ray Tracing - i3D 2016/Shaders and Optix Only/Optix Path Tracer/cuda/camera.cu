@@ -24,6 +24,8 @@
 #include "random.h"
 
 rtBuffer<float4, 2>       output_buffer;
+rtBuffer<unsigned int, 2> ray_count_buffer;		// rays traced per launch index in the last launch
+rtBuffer<float4, 2>       variance_buffer;		// luminance sum and squared sum over the frames, frame of convergence (0 while sampled)
 rtDeclareVariable(int	, max_depth, , );
 rtDeclareVariable(float	, scene_epsilon, , );
 rtDeclareVariable(rtObject, top_object, , );
@@ -45,11 +47,47 @@ namespace color
 	rtDeclareVariable(float3, exception, , );
 }
 
+//
+// Adaptive sampling: a pixel is no longer traced once the relative MSE of its mean,
+// estimated from the luminance variance across frames, falls below adaptive_threshold
+// Squared means are offset by 0.01 as in cpu::relativeMSE, so that dark pixels converge
+//
+static __device__ __inline__ bool pixel_converged()
+{
+	if (pt::adaptive_threshold <= 0.0f || pt::frame_number <= 1 || variance_buffer[launch_index].z == 0.0f)
+		return false;
+	ray_count_buffer[launch_index] = 0;
+	return true;
+}
+
+static __device__ __inline__ void update_variance(const float3& pixel_color)
+{
+	if (pt::adaptive_threshold <= 0.0f)
+		return;
+
+	const float frames = (float)pt::frame_number;
+	const float l = luminance(pixel_color);
+	float4 stats = (pt::frame_number > 1) ? variance_buffer[launch_index] : make_float4(0.0f);
+	stats.x += l;
+	stats.y += l * l;
+	if (pt::frame_number >= pt::adaptive_min_frames)
+	{
+		const float mean	 = stats.x / frames;
+		const float variance = fmaxf(stats.y / frames - mean * mean, 0.0f) * frames / (frames - 1.0f);
+		if (variance / frames <= pt::adaptive_threshold * (mean * mean + 0.01f))
+			stats.z = frames;
+	}
+	variance_buffer[launch_index] = stats;
+}
+
 //
 // Perspective Camera
 //
 RT_PROGRAM void pinhole_camera()
 {
+	if (pixel_converged())
+		return;
+
 	unsigned int samples_per_pixel = pt::sqrt_num_samples*pt::sqrt_num_samples;
 
 	size_t2 screen		= output_buffer.size();
@@ -64,6 +102,7 @@ RT_PROGRAM void pinhole_camera()
 	unsigned int seed	= tea<16>(screen.x*launch_index.y + launch_index.x, pt::frame_number);
 	
 	float3 result = make_float3(0.0f);
+	unsigned int num_rays = 0;
 	do
 	{
 #if defined (AA)	
@@ -81,33 +120,38 @@ RT_PROGRAM void pinhole_camera()
 		prd.done		 = false;
 		prd.seed		 = seed;
 		prd.depth		 = 0;
+		prd.num_rays	 = 0;
 
 		while(!prd.done && prd.depth < max_depth)
 		{
 			Ray ray = make_Ray(ray_origin, ray_direction, pt::radiance_ray_type, scene_epsilon, RT_DEFAULT_MAX);
 			rtTrace(top_object, ray, prd);
+			num_rays++;
 			
 			prd.result += prd.radiance * prd.attenuation;
 
 			// Monte Carlo strategy (Russian Roulette) as stopping criterion
-			//if (prd.depth >= rr_begin_depth)
-			//{
-				//float pcont = fmaxf(prd.attenuation);
-			//	if (rnd(prd.seed) >= pcont)
-			//		break;
-				//prd.attenuation /= pcont;
-			//}
+			if (!prd.done && prd.depth >= (int)pt::rr_begin_depth)
+			{
+				float pcont = fminf(fmaxf(prd.attenuation), 1.0f);
+				if (rnd(prd.seed) >= pcont)
+					break;
+				prd.attenuation /= pcont;
+			}
 			
 			prd.depth++;
 			ray_origin	  = prd.origin;
 			ray_direction = prd.direction;
 		} 
 
-		result += prd.result;
-		seed	= prd.seed;
+		result	 += prd.result;
+		num_rays += prd.num_rays;
+		seed	  = prd.seed;
 	} 
 	while (--samples_per_pixel);
 
+	ray_count_buffer[launch_index] = num_rays;
+
 	float3 pixel_color = result / (pt::sqrt_num_samples*pt::sqrt_num_samples);
 	if (pt::frame_number > 1)
 	{
@@ -118,12 +162,17 @@ RT_PROGRAM void pinhole_camera()
 	}
 	else
 		output_buffer[launch_index] = make_float4(pixel_color, 0.0f);
+
+	update_variance(pixel_color);
 }
 //
 // Orthographic Camera
 //
 RT_PROGRAM void orthographic_camera()
 {
+	if (pixel_converged())
+		return;
+
 	unsigned int samples_per_pixel = pt::sqrt_num_samples*pt::sqrt_num_samples;
 
 	size_t2 screen = output_buffer.size();
@@ -138,6 +187,7 @@ RT_PROGRAM void orthographic_camera()
 	unsigned int seed = tea<16>(screen.x*launch_index.y + launch_index.x, pt::frame_number);
 
 	float3 result = make_float3(0.0f);
+	unsigned int num_rays = 0;
 	do
 	{
 #if defined (AA)	
@@ -155,22 +205,24 @@ RT_PROGRAM void orthographic_camera()
 		prd.done = false;
 		prd.seed = seed;
 		prd.depth = 0;
+		prd.num_rays = 0;
 
 		while (!prd.done && prd.depth < max_depth)
 		{
 			Ray ray = make_Ray(ray_origin, ray_direction, pt::radiance_ray_type, scene_epsilon, RT_DEFAULT_MAX);
 			rtTrace(top_object, ray, prd);
+			num_rays++;
 
 			prd.result += prd.radiance * prd.attenuation;
 
 			// Monte Carlo strategy (Russian Roulette) as stopping criterion
-			//if (prd.depth >= rr_begin_depth)
-			//{
-			//	float pcont = fmaxf(prd.attenuation);
-			//	if (rnd(prd.seed) >= pcont)
-			//		break;
-			//	prd.attenuation /= pcont;
-			//}
+			if (!prd.done && prd.depth >= (int)pt::rr_begin_depth)
+			{
+				float pcont = fminf(fmaxf(prd.attenuation), 1.0f);
+				if (rnd(prd.seed) >= pcont)
+					break;
+				prd.attenuation /= pcont;
+			}
 
 			prd.depth++;
 			ray_origin = prd.origin;
@@ -178,9 +230,12 @@ RT_PROGRAM void orthographic_camera()
 		}
 
 		result += prd.result;
+		num_rays += prd.num_rays;
 		seed = prd.seed;
 	} while (--samples_per_pixel);
 
+	ray_count_buffer[launch_index] = num_rays;
+
 	float3 pixel_color = result / (pt::sqrt_num_samples*pt::sqrt_num_samples);
 	if (pt::frame_number > 1)
 	{
@@ -191,6 +246,8 @@ RT_PROGRAM void orthographic_camera()
 	}
 	else
 		output_buffer[launch_index] = make_float4(pixel_color, 0.0f);
+
+	update_variance(pixel_color);
 }
 //
 // Returns environment map color for miss rays
@@ -352,6 +352,7 @@ struct PerRayData_radiance
 	unsigned int seed;
 	int depth;
 	int done;
+	unsigned int num_rays;	// shadow rays traced by the closest hit programs
 };
 
 struct PerRayData_shadow
@@ -363,6 +364,9 @@ namespace pt
 {
 	rtDeclareVariable(unsigned int, frame_number, , );
 	rtDeclareVariable(unsigned int, sqrt_num_samples, , );
+	rtDeclareVariable(unsigned int, rr_begin_depth, , );		// bounce from which Russian roulette ends paths
+	rtDeclareVariable(float, adaptive_threshold, , );			// relative MSE of converged pixels, 0 disables adaptive sampling
+	rtDeclareVariable(unsigned int, adaptive_min_frames, , );	// frames before a pixel may converge
 
 	rtDeclareVariable(unsigned int, radiance_ray_type, , );
 	rtDeclareVariable(unsigned int, shadow_ray_type, , );
@@ -31,6 +31,7 @@ rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );
 
 rtBuffer<BasicLight>      lights;
+rtBuffer<LightAlias>      light_alias_table;
 rtDeclareVariable(float3, ambient_light_color, , );
 rtDeclareVariable(float3, shadow_attenuation, , );
 
@@ -60,8 +61,13 @@ float  p_phong_exp)
 
 	// [Shading for each ray]
 	float3 result = p_Ka * ambient_light_color;
-	for (int i = 0; i < lights.size(); ++i)
+	// [Light Selection] one light per hit point, chosen in proportion to its power
+	if (lights.size() > 0)
 	{
+		unsigned int num_lights = lights.size();
+		float        u          = rnd(pt::prd_radiance.seed) * num_lights;
+		unsigned int slot       = min(static_cast<unsigned int>(u), num_lights - 1);
+		unsigned int i          = (u - slot < light_alias_table[slot].probability) ? slot : light_alias_table[slot].alias;
 		BasicLight	light = lights[i];
 
 		float  Latt;
@@ -94,13 +100,14 @@ float  p_phong_exp)
 				shadow_prd.inShadow = false;
 				Ray shadow_ray(hit_point, L, pt::shadow_ray_type, scene_epsilon, Ldist);
 				rtTrace(top_shadower, shadow_ray, shadow_prd);
+				pt::prd_radiance.num_rays++;
 			}
 
 			// If not completely shadowed, light the hit point
 			if (!shadow_prd.inShadow)
 			{
 				// [Light Color]
-				float3 Lc = Latt * light.flux * light.color;
+				float3 Lc = Latt * light.flux * light.color / light_alias_table[i].pdf;
 				
 				// [Diffuse Color]
 				float3 diffuse = (p_Kd / M_PIf) * diffuseCoefficient;